@@ -23,12 +23,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 #include "modutil.hpp"
 
-static int num_669;
-static int num_composer;
-static int num_unis;
+static std::atomic<int> num_669;
+static std::atomic<int> num_composer;
+static std::atomic<int> num_unis;
 
 
 static constexpr size_t MAX_SAMPLES = 64;
@@ -126,7 +127,8 @@ class _669_loader : public modutil::loader
   static constexpr size_t pattern_data_size = NUM_ROWS * NUM_CHANNELS * 3;
 
 public:
-  _669_loader(): modutil::loader("669", "669", "Composer 669") {}
+  _669_loader(): modutil::loader("669", "669", "Composer 669",
+   {{ 0, "if" }, { 0, "JN" }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
@@ -339,9 +341,9 @@ public:
 
     format::report("Total 669s", num_669);
     if(num_composer)
-      format::reportline("Composer 669s", "%d", num_composer);
+      format::reportline("Composer 669s", "%d", num_composer.load());
     if(num_unis)
-      format::reportline("UNIS 669",      "%d", num_unis);
+      format::reportline("UNIS 669",      "%d", num_unis.load());
   }
 };
 
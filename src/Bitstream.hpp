@@ -23,137 +23,191 @@
 #ifndef MZXTEST_BITSTREAM_HPP
 #define MZXTEST_BITSTREAM_HPP
 
-#include <stdio.h>
 #include <stdint.h>
-#include <type_traits>
-#include <vector>
+#include <utility>
 
 #include "common.hpp"
+#include "vio.hpp"
 
-/* Generic little endian bitstream. */
-template<typename SRC=FILE *>
-struct Bitstream
+enum class Bitorder
 {
-  using BUFFERTYPE = std::conditional<(sizeof(size_t) > sizeof(uint32_t)), size_t, uint32_t>::type;
+  LSB, /* Codes start at the least significant bit of each byte (LZW, IT). */
+  MSB  /* Codes start at the most significant bit of each byte. */
+};
 
-  SRC &fp;
-  BUFFERTYPE buf = 0;
-  size_t pos = 0;
-  size_t num_read = 0;
-  size_t max_read;
-  unsigned buf_bits = 0;
+/* Bitstream input from a buffer in memory. */
+class Bitsource_span
+{
+  const uint8_t *data;
+  size_t len;
 
-  Bitstream(SRC &_fp): fp(_fp), max_read(0) {}
-  Bitstream(SRC &_fp, size_t _max_read): fp(_fp), max_read(_max_read) {}
+public:
+  Bitsource_span(const uint8_t *_data, size_t _len) noexcept:
+   data(_data), len(_len) {}
 
-  inline int read(unsigned bits_to_read)
+  /* Get the next chunk of input. Returns its length, or 0 at the end. */
+  size_t next(const uint8_t *&out) noexcept
   {
-    int ret;
-
-    if(buf_bits < bits_to_read)
-      if(!fill(bits_to_read))
-        return -1;
-
-    ret = buf & ((1 << bits_to_read) - 1);
-    buf >>= bits_to_read;
-    buf_bits -= bits_to_read;
+    size_t ret = len;
+    out = data;
+    data += len;
+    len = 0;
     return ret;
   }
-
-private:
-  inline int read_byte();
-  inline bool fill(unsigned bits_to_read);
 };
 
-template<>
-inline int Bitstream<FILE *>::read_byte()
-{
-  return fgetc(fp);
-}
-
-/*
-template<>
-inline int Bitstream<std::vector<uint8_t>>::read_byte()
+/**
+ * Bitstream input read in place from a vio_reader, stopping after at most
+ * max_len bytes. The reader is only advanced past a chunk once the next
+ * chunk is requested, so when the bitstream is done the reader should be
+ * moved to the end of the data actually used (see Bitstream::bytes_used).
+ */
+template<class Backend = vio>
+class Bitsource_vio
 {
-  if(pos < fp.size())
-    return fp[pos++];
+  vio_reader<Backend> &vf;
+  size_t left;
+  size_t last = 0;
 
-  return EOF;
-}
+public:
+  Bitsource_vio(vio_reader<Backend> &_vf, size_t max_len) noexcept:
+   vf(_vf), left(max_len) {}
 
-template<>
-inline int Bitstream<const std::vector<uint8_t>>::read_byte()
-{
-  if(pos < fp.size())
-    return fp[pos++];
+  size_t next(const uint8_t *&out) noexcept
+  {
+    if(last)
+      vf.skip(last);
 
-  return EOF;
-}
-*/
+    size_t num = left ? vf.buffered(out) : 0;
+    last = MIN(num, left);
+    left -= last;
+    return last;
+  }
+};
 
-/* TODO: the main user of this is Digital Symphony, which fills
- * by reading four new bytes at a time. */
-template<>
-inline bool Bitstream<FILE *>::fill(unsigned bits_to_read)
+/**
+ * Bit reader. Input is loaded into a 64-bit buffer a word at a time, so
+ * after a successful fill(n), peek() and consume() can read up to n bits
+ * without checking for the end of the input. Bytes near the end of a chunk
+ * of input are loaded one at a time instead.
+ */
+template<Bitorder ORDER = Bitorder::LSB, class SOURCE = Bitsource_span>
+class Bitstream
 {
-  while(buf_bits < bits_to_read)
+  SOURCE src;
+  uint64_t buf = 0; /* LSB: next bit is bit 0. MSB: next bit is bit 63. */
+  const uint8_t *pos = nullptr;
+  const uint8_t *end = nullptr;
+  size_t total = 0; /* Sum of the lengths of all chunks loaded. */
+  unsigned buf_bits = 0;
+
+  /* Requires buf_bits < 64 and at least 8 bytes left in the chunk. Bits
+   * past buf_bits may be set afterward; they're always the next bits. */
+  inline void load_word() noexcept
   {
-    if(num_read >= max_read)
-      return false;
+    if constexpr(ORDER == Bitorder::LSB)
+      buf |= mem_u64le(pos) << buf_bits;
+    else
+      buf |= mem_u64be(pos) >> buf_bits;
 
-    int byte = read_byte();
-    if(byte < 0)
-      return false;
+    pos += (63 - buf_bits) >> 3;
+    buf_bits |= 56;
+  }
 
-    buf |= byte << buf_bits;
-    buf_bits += 8;
-    num_read++;
+  bool fill_slow(unsigned bits) noexcept
+  {
+    while(buf_bits < bits)
+    {
+      if(pos >= end)
+      {
+        const uint8_t *next;
+        size_t len = src.next(next);
+        if(!len)
+          return false;
+
+        pos = next;
+        end = next + len;
+        total += len;
+      }
+      if(end - pos >= 8)
+      {
+        load_word();
+        break;
+      }
+
+      if constexpr(ORDER == Bitorder::LSB)
+        buf |= (uint64_t)*(pos++) << buf_bits;
+      else
+        buf |= (uint64_t)*(pos++) << (56 - buf_bits);
+
+      buf_bits += 8;
+    }
+    return true;
   }
-  return true;
-}
 
-template<>
-inline bool Bitstream<std::vector<uint8_t>>::fill(unsigned bits_to_read)
-{
-  unsigned m = fp.size();
-  if(max_read && max_read < m)
-    m = max_read;
+public:
+  /* Maximum number of bits fill() can guarantee. */
+  static constexpr unsigned MAX_FILL = 56;
 
-  if(num_read >= m)
-    return false;
+  template<class... Args>
+  Bitstream(Args &&... args) noexcept: src(std::forward<Args>(args)...) {}
 
-  unsigned bytes = MIN(m - num_read, ((sizeof(BUFFERTYPE)<<3) - buf_bits)>>3);
-  const uint8_t *data = fp.data() + num_read;
+  /* Number of bits that can be read without calling fill(). */
+  inline unsigned available() const noexcept
+  {
+    return buf_bits;
+  }
 
-  if(bytes > 4)
-    bytes = 4;
+  /* Number of input bytes used so far, including partially read bytes. */
+  inline size_t bytes_used() const noexcept
+  {
+    return total - (end - pos) - (buf_bits >> 3);
+  }
 
-  num_read += bytes;
+  /* Make at least `bits` (at most MAX_FILL) bits available. Returns false
+   * if the input ends first. */
+  inline bool fill(unsigned bits) noexcept
+  {
+    if(buf_bits >= bits)
+      return true;
+
+    if(end - pos >= 8)
+    {
+      load_word();
+      return true;
+    }
+    return fill_slow(bits);
+  }
 
-  /* 4 bytes is sufficient and it's much faster to stop without filling any further. */
-  if(bytes >= 4)
+  /* Get the next `bits` (1 to 32) bits without consuming them. */
+  inline uint32_t peek(unsigned bits) const noexcept
   {
-    BUFFERTYPE t = data[0] | (data[1] << 8) | (data[2] << 16) | ((BUFFERTYPE)data[3] << 24);
-    buf |= t << buf_bits;
-    buf_bits += 32;
-    return (buf_bits >= bits_to_read);
+    if constexpr(ORDER == Bitorder::LSB)
+      return buf & ((UINT64_C(1) << bits) - 1);
+    else
+      return (buf >> 1) >> (63 - bits);
   }
 
-  /* 2 bytes isn't necessarily enough, so handle the extra byte after if needed. */
-  if(bytes & 2)
+  inline void consume(unsigned bits) noexcept
   {
-    BUFFERTYPE t = data[0] | (data[1] << 8);
-    buf |= t << buf_bits;
-    buf_bits += 16;
-    data += 2;
+    if constexpr(ORDER == Bitorder::LSB)
+      buf >>= bits;
+    else
+      buf <<= bits;
+
+    buf_bits -= bits;
   }
-  if(bytes & 1)
+
+  /* Read `bits` (1 to 31) bits, or -1 if the input ends first. */
+  inline int read(unsigned bits) noexcept
   {
-    BUFFERTYPE t = data[0];
-    buf |= t << buf_bits;
-    buf_bits += 8;
+    if(!fill(bits))
+      return -1;
+
+    int ret = peek(bits);
+    consume(bits);
+    return ret;
   }
-  return (buf_bits >= bits_to_read);
-}
+};
 
 #endif /* MZXTEST_BITSTREAM_HPP */
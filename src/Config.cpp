@@ -24,6 +24,7 @@
 #include "modutil.hpp"
 
 #include <ctype.h>
+#include <fcntl.h>
 #include <stdlib.h>
 
 ConfigInfo Config;
@@ -41,6 +42,7 @@ const char ConfigInfo::COMMON_FLAGS[] =
   "            N=2 additionally dumps extended data (envelopes, MED synth programs).\n"
   "  -p[=N]    Dump patterns. N=1 (optional) enables, N=0 disables (default).\n"
   "            N=2 additionally dumps the entire pattern as raw data.\n"
+  "  -o=file   Write text output to 'file' instead of stderr. '-' writes to stdout.\n"
   "  -H=...    Highlight data in pattern dump. Highlight string is in the format\n"
   "            'C:#[,...]' where C indicates the column type to highlight and\n"
   "            # indicates the value to highlight (decimal). Valid column types:\n"
@@ -229,7 +231,8 @@ bool ConfigInfo::init(int *_argc, char **argv, bool (*handler)(const char *, voi
 
         /* Suppress text output.
          * This does NOT completely disable text printing code,
-         * just prevents it from printing. */
+         * just prevents it from printing. Frontends that don't need
+         * the dump code to run (moddiag) also clear the dump flags. */
         case 'q':
           value = 1;
           if(arg[2] == '=' && !parse_int(arg[1], arg + 3, &value))
@@ -247,6 +250,28 @@ bool ConfigInfo::init(int *_argc, char **argv, bool (*handler)(const char *, voi
           trace = (value != 0);
           continue;
 
+        /* Redirect text output. */
+        case 'o':
+        {
+          if(arg[2] != '=' || !arg[3])
+            break;
+
+          if(!strcmp(arg + 3, "-"))
+          {
+            format::sink::set_destination(stdout);
+            continue;
+          }
+
+          int fd = open(arg + 3, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+          if(fd < 0)
+          {
+            format::error("failed to open output file '%s'", arg + 3);
+            return false;
+          }
+          format::sink::set_destination(fd);
+          continue;
+        }
+
         /* Filter by format. */
         case 'f':
         {
@@ -24,10 +24,12 @@
 #define MZXTEST_IFF_HPP
 
 #include <stdio.h>
+#include <type_traits>
 #include <vector>
 #include "common.hpp"
 #include "error.hpp"
 #include "format.hpp"
+#include "vio.hpp"
 
 enum class IFFPadding
 {
@@ -100,14 +102,14 @@ private:
    * Attempt to execute a static IFF handler. Most of the time dynamically
    * changing handlers isn't necessary, and these are cleaner to write in loaders.
    */
-  template<int I>
-  modutil::error exec_static_handler(FILE *fp, size_t len, T &m, IFFCode &id)
+  template<int I, class S>
+  modutil::error exec_static_handler(S &fp, size_t len, T &m, IFFCode &id)
   {
     return modutil::IFF_NO_HANDLER;
   }
 
-  template<int I, class H, class... REST>
-  modutil::error exec_static_handler(FILE *fp, size_t len, T &m, IFFCode &id)
+  template<int I, class H, class... REST, class S>
+  modutil::error exec_static_handler(S &fp, size_t len, T &m, IFFCode &id)
   {
     if(I < sizeof...(HANDLERS))
     {
@@ -124,29 +126,71 @@ private:
     return modutil::IFF_NO_HANDLER;
   }
 
-  modutil::error exec_static_handler(FILE *fp, size_t len, T &m, IFFCode &id)
+  template<class S>
+  modutil::error exec_static_handler(S &fp, size_t len, T &m, IFFCode &id)
   {
     return exec_static_handler<0, HANDLERS...>(fp, len, m, id);
   }
 
   /**
    * Attempt to execute a dynamic IFF handler.
+   * Dynamic handlers currently only support stdio streams.
    */
-  modutil::error exec_dynamic_handler(FILE *fp, size_t len, T &m, const char *id)
+  template<class S>
+  modutil::error exec_dynamic_handler(S &fp, size_t len, T &m, const char *id)
   {
     for(const IFFHandler<T> *h : handlers)
     {
       if(use_generic || !memcmp(h->id, id, static_cast<size_t>(codesize)))
       {
-        if(!h->is_container)
+        if(h->is_container)
+          return parse_iff(fp, len, m);
+
+        if constexpr(std::is_same<S, FILE *>::value)
           return h->parse(fp, len, m);
         else
-          return parse_iff(fp, len, m);
+          return modutil::IFF_CONFIG_ERROR;
       }
     }
     return modutil::IFF_NO_HANDLER;
   }
 
+  /**
+   * Stream operations for parse_iff, which can read either a stdio stream
+   * or a vio_reader.
+   */
+  static int64_t stream_tell(FILE *fp) { return ftell(fp); }
+  static int64_t stream_tell(vio_reader<> &vf) { return vf.tell(); }
+  static bool stream_eof(FILE *fp) { return feof(fp); }
+  static bool stream_eof(vio_reader<> &vf) { return vf.eof(); }
+
+  static int stream_seek(FILE *fp, int64_t pos)
+  {
+    return fseek(fp, pos, SEEK_SET);
+  }
+  static int stream_seek(vio_reader<> &vf, int64_t pos)
+  {
+    return vf.seek(pos, SEEK_SET);
+  }
+
+  static bool stream_read(FILE *fp, void *dest, size_t num)
+  {
+    return fread(dest, num, 1, fp) == 1;
+  }
+  static bool stream_read(vio_reader<> &vf, void *dest, size_t num)
+  {
+    return vf.read(dest, num) == num;
+  }
+
+  static uint32_t stream_u32(FILE *fp, Endian e)
+  {
+    return (e == Endian::BIG) ? fget_u32be(fp) : fget_u32le(fp);
+  }
+  static uint32_t stream_u32(vio_reader<> &vf, Endian e)
+  {
+    return (e == Endian::BIG) ? vf.u32be() : vf.u32le();
+  }
+
 public:
   size_t max_chunk_length = 0;
   bool full_chunk_lengths = false;
@@ -191,9 +235,10 @@ public:
   IFF(Endian e, IFFPadding p): endian(e), padding(p) {}
   IFF() {}
 
-  modutil::error parse_iff(FILE *fp, size_t container_len, T &m)
+  template<class S>
+  modutil::error parse_iff(S &fp, size_t container_len, T &m)
   {
-    size_t start_pos = ftell(fp);
+    size_t start_pos = stream_tell(fp);
     size_t current_pos = start_pos;
     size_t end_pos = start_pos;
     int codelen = static_cast<int>(codesize);
@@ -216,9 +261,9 @@ public:
     {
       size_t len;
 
-      current_start = ftell(fp);
+      current_start = stream_tell(fp);
 
-      if(!fread(id, codelen, 1, fp))
+      if(!stream_read(fp, id, codelen))
         break;
 
       switch(codesize)
@@ -234,13 +279,10 @@ public:
       memcpy(current_id, id, codelen);
       current_id[codelen] = '\0';
 
-      if(endian == Endian::BIG)
-        len = fget_u32be(fp);
-      else
-        len = fget_u32le(fp);
+      len = stream_u32(fp, endian);
 
       /* Length may be optional on the final code in some formats... */
-      if(feof(fp))
+      if(stream_eof(fp))
         len = 0;
 
       if(len > max_chunk_length)
@@ -255,7 +297,7 @@ public:
           len = 0;
       }
 
-      end_pos = ftell(fp) + len;
+      end_pos = stream_tell(fp) + len;
       switch(padding)
       {
         case IFFPadding::BYTE:
@@ -280,17 +322,17 @@ public:
         if(result == modutil::IFF_NO_HANDLER)
         {
           format::warning("ignoring unknown IFF tag '%*.*s' @ %#lx.",
-           codelen, codelen, id, ftell(fp) - 8);
+           codelen, codelen, id, (long)stream_tell(fp) - 8);
           result = modutil::SUCCESS;
         }
       }
       if(result)
         return result;
 
-      if(fseek(fp, end_pos, SEEK_SET))
+      if(stream_seek(fp, end_pos))
         return modutil::SEEK_ERROR;
 
-      current_pos = ftell(fp);
+      current_pos = stream_tell(fp);
     }
 
     if(container_len && current_pos > start_pos + container_len)
@@ -21,8 +21,9 @@
  */
 
 /**
- * Simple LZW decoder for Digital Symphony.
- * This does not handle the hacks required for ARC or UnShrink.
+ * Simple LZW decoder for Digital Symphony. The dictionary is shared with
+ * the ARC unpacker (see dimgutil/lzw_unpack.h); this handles code reading
+ * and the Digital Symphony quirks. This does not handle UnShrink.
  *
  * Adapted from the Digital Symphony LZW decoder in libxmp, which in turn was
  * adapted from the ZIP Shrink decoder in MegaZeux.
@@ -31,12 +32,27 @@
 #ifndef MZXTEST_LZW_HPP
 #define MZXTEST_LZW_HPP
 
-#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "vio.hpp"
 
 #define LZW_FLAG_MAXBITS(x)	((x) & 15)
 #define LZW_FLAG_SYMQUIRKS	0x100
 #define LZW_FLAGS_SYM		LZW_FLAG_MAXBITS(13) | LZW_FLAG_SYMQUIRKS
 
-int LZW_read(void *dest, size_t dest_len, size_t max_read_len, int flags, FILE *fp);
+/**
+ * Decode an LZW stream from memory. Returns the length of the stream
+ * (aligned for LZW_FLAG_SYMQUIRKS), which may exceed src_len if the
+ * stream is truncated, or -1 for invalid flags.
+ */
+ssize_t LZW_read(void *dest, size_t dest_len, const uint8_t *src, size_t src_len, int flags);
+
+/**
+ * Decode an LZW stream of at most max_read_len bytes from the current
+ * position of vf and seek past it. Returns 0 on success, otherwise -1.
+ */
+int LZW_read(void *dest, size_t dest_len, size_t max_read_len, int flags, vio_reader<> &vf);
 
 #endif /* MZXTEST_LZW_HPP */
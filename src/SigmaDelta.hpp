@@ -0,0 +1,186 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MZXTEST_SIGMADELTA_HPP
+#define MZXTEST_SIGMADELTA_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "Bitstream.hpp"
+#include "common.hpp"
+#include "error.hpp"
+#include "vio.hpp"
+
+/**
+ * Digital Symphony sigma delta sample decoder.
+ */
+class SigmaDelta
+{
+  using bitstream = Bitstream<Bitorder::LSB>;
+
+  /**
+   * Decode codes of width BITS until the width changes, the output is full,
+   * or the buffered input runs out. The caller makes sure at least one code
+   * is buffered. Returns the new code width, or 0 at the end of the stream.
+   */
+  template<unsigned BITS>
+  static inline unsigned run(bitstream &bs, uint8_t *dest, size_t &pos, size_t dest_len,
+   uint8_t &accumulator, unsigned &runlength, unsigned max_runlength) noexcept
+  {
+    size_t i = pos;
+    size_t stop = MIN(dest_len, i + bs.available() / BITS);
+    unsigned next = BITS;
+    uint8_t acc = accumulator;
+    unsigned rl = runlength;
+
+    while(i < stop)
+    {
+      unsigned value = bs.peek(BITS);
+      bs.consume(BITS);
+
+      // Expand bitwidth.
+      if(value == 0)
+      {
+        next = (BITS >= 9) ? 0 : BITS + 1; // ??
+        rl = 0;
+        break;
+      }
+
+      uint8_t delta = value >> 1;
+      acc += (value & 1) ? -delta : delta;
+      dest[i++] = acc;
+
+      // High bit set -> reset run length.
+      if(value >> (BITS - 1))
+      {
+        rl = 0;
+      }
+      else
+
+      if(++rl >= max_runlength)
+      {
+        rl = 0;
+        if(BITS > 1)
+        {
+          next = BITS - 1;
+          break;
+        }
+      }
+    }
+    pos = i;
+    accumulator = acc;
+    runlength = rl;
+    return next;
+  }
+
+public:
+  /**
+   * Based on the sigma delta sample decoder from OpenMPT by Saga Musix.
+   *
+   * Decode a sigma delta stream from memory, starting with its max runlength
+   * byte. Returns the length of the stream including padding, which may
+   * exceed src_len if the stream is truncated, or -1 if the input ends
+   * before the output is full.
+   */
+  static ssize_t read(uint8_t *dest, size_t dest_len, const uint8_t *src, size_t src_len)
+  {
+    size_t pos = 0;
+    unsigned runlength = 0;
+    unsigned bits = 8;
+
+    if(!dest_len)
+      return 0;
+    if(!src_len)
+      return -1;
+
+    unsigned max_runlength = src[0];
+    bitstream bs(src + 1, src_len - 1);
+
+    int first = bs.read(8);
+    if(first < 0)
+      return -1;
+
+    uint8_t accumulator = first;
+    dest[pos++] = accumulator;
+
+    while(pos < dest_len)
+    {
+      bs.fill(bitstream::MAX_FILL);
+      if(bs.available() < bits)
+        return -1;
+
+#define RUN(n) case n: \
+  bits = run<n>(bs, dest, pos, dest_len, accumulator, runlength, max_runlength); break
+
+      switch(bits)
+      {
+        RUN(1); RUN(2); RUN(3); RUN(4); RUN(5); RUN(6); RUN(7); RUN(8); RUN(9);
+      }
+#undef RUN
+
+      if(!bits)
+        break;
+    }
+
+    /* Digital Symphony aligns packed stream lengths to 4 bytes. The max
+     * runlength byte doesn't count towards alignment for some reason. */
+    return 1 + ((bs.bytes_used() + 3) & ~(size_t)3);
+  }
+
+  /**
+   * Decode a sigma delta stream from the current position of vf and seek
+   * past it.
+   */
+  static modutil::error read(uint8_t *dest, size_t dest_len, vio_reader<> &vf)
+  {
+    if(!dest_len)
+      return modutil::SUCCESS;
+
+    int64_t stream_start = vf.tell();
+    int64_t file_length = vf.length();
+    /* Noisy samples pack larger than they started. Worst case is a 9-bit
+     * code per sample with a width change before each, plus the runlength
+     * byte and padding. */
+    size_t max_len = dest_len * 9 / 4 + 8;
+
+    if(file_length >= 0)
+    {
+      size_t file_left = (stream_start < file_length) ? file_length - stream_start : 0;
+      max_len = MIN(max_len, file_left);
+    }
+
+    const uint8_t *src = vf.span(max_len);
+    if(!src)
+      return modutil::READ_ERROR;
+
+    ssize_t stream_len = read(dest, dest_len, src, max_len);
+    if(stream_len < 0)
+      return modutil::READ_ERROR;
+
+    vf.seek(stream_start + stream_len, SEEK_SET);
+    return modutil::SUCCESS;
+  }
+};
+
+#endif /* MZXTEST_SIGMADELTA_HPP */
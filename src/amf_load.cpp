@@ -24,10 +24,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 #include "modutil.hpp"
 
-static int total_dsmi = 0;
+static std::atomic<int> total_dsmi;
 
 
 enum AMF_features
@@ -665,14 +666,14 @@ static modutil::error AMF_read(FILE *fp)
           if(j && !(j % 24))
           {
             // Insert break.
-            fprintf(stderr, "\n");
+            format::printf("\n");
             O_("        : ");
           }
 
-          fprintf(stderr, "%02x %02x %02x  ",
+          format::printf("%02x %02x %02x  ",
            track.raw_data[j + 0], track.raw_data[j + 1], track.raw_data[j + 2]);
         }
-        fprintf(stderr, "\n");
+        format::printf("\n");
       }
     }
 
@@ -685,8 +686,8 @@ static modutil::error AMF_read(FILE *fp)
     {
       O_("FX Key  : ");
       for(int i = 0; i < arraysize(AMF_effect_strings); i++)
-        fprintf(stderr, "%s%s=%02x", (i > 0)?",":"", AMF_effect_strings[i], i + 0x81);
-      fprintf(stderr, "\n");
+        format::printf("%s%s=%02x", (i > 0)?",":"", AMF_effect_strings[i], i + 0x81);
+      format::printf("\n");
     }
 
     for(unsigned int i = 0; i < m.num_orders; i++)
@@ -711,17 +712,16 @@ static modutil::error AMF_read(FILE *fp)
         uint8_t enable;
         static constexpr int width() { return 5; }
         bool can_print() const { return enable; }
-        void print() const
+        char *render(char *dest) const
         {
           if(can_print())
           {
             if(effect - 0x81 >= arraysize(AMF_effect_strings))
-              fprintf(stderr, " %02x%02x", effect - 0x81, param);
+              return dest + sprintf(dest, " %02x%02x", effect - 0x81, param);
             else
-              fprintf(stderr, " %s%02X", AMF_effect_strings[effect - 0x81], param);
+              return dest + sprintf(dest, " %s%02X", AMF_effect_strings[effect - 0x81], param);
           }
-          else
-            fprintf(stderr, "     ");
+          return format::render::blank(dest, width());
         }
       };
 
@@ -772,7 +772,8 @@ static modutil::error AMF_read(FILE *fp)
 class AMF_loader : modutil::loader
 {
 public:
-  AMF_loader(): modutil::loader("AMF", "dsmi", "Digital Sound and Music Interface") {}
+  AMF_loader(): modutil::loader("AMF", "dsmi", "Digital Sound and Music Interface",
+   {{ 0, "AMF" }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
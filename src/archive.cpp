@@ -0,0 +1,189 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <memory>
+#include <new>
+
+#include "archive.hpp"
+#include "dimgutil/DiskImage.hpp"
+#include "dimgutil/ice_unpack.h"
+
+/* Don't unpack Pack-Ice files larger than this (same as unice). */
+static constexpr ice_int64 ICE_DEPACK_LIMIT = (1 << 28);
+
+class disk_archive final : public modutil::archive
+{
+  std::unique_ptr<DiskImage> disk;
+  FileList list;
+  size_t pos = 0;
+
+public:
+  disk_archive(std::unique_ptr<DiskImage> &&_disk, FileList &&_list, size_t _num_members):
+   archive(_disk->type, _num_members), disk(std::move(_disk)), list(std::move(_list)) {}
+
+  bool next(member &m) override
+  {
+    while(pos < list.size())
+    {
+      const FileInfo &file = list[pos++];
+      if(~file.get_type() & FileInfo::IS_REG)
+        continue;
+
+      m.name = file.name();
+      m.data = nullptr;
+      m.length = 0;
+      m.index = pos - 1;
+      return true;
+    }
+    return false;
+  }
+
+  bool unpack(member &m) override
+  {
+    if(m.index >= list.size() || !disk->Unpack(list[m.index], &m.data, &m.length))
+    {
+      m.data = nullptr;
+      m.length = 0;
+      return false;
+    }
+    return true;
+  }
+};
+
+class ice_archive final : public modutil::archive
+{
+  vio &vf;
+  int version;
+  size_t in_length;
+  size_t out_length;
+  std::unique_ptr<uint8_t[]> output;
+  bool done = false;
+
+  static size_t ice_read(void * ICE_RESTRICT dest, size_t num, void *priv)
+  {
+    return reinterpret_cast<vio *>(priv)->read(dest, num);
+  }
+
+  static int ice_seek(void *priv, ice_int64 offset, int whence)
+  {
+    return reinterpret_cast<vio *>(priv)->seek(offset, whence);
+  }
+
+public:
+  ice_archive(vio &_vf, int _version, size_t _in_length, size_t _out_length):
+   archive(_version == 1 ? "Pack-Ice v1" : "Pack-Ice v2", 1), vf(_vf),
+   version(_version), in_length(_in_length), out_length(_out_length) {}
+
+  bool next(member &m) override
+  {
+    if(done)
+      return false;
+
+    done = true;
+    m.name = "(unpacked)";
+    m.data = nullptr;
+    m.length = 0;
+    m.index = 0;
+    return true;
+  }
+
+  bool unpack(member &m) override
+  {
+    m.data = nullptr;
+    m.length = 0;
+
+    output.reset(new (std::nothrow) uint8_t[out_length]);
+    if(!output || vf.seek(0, SEEK_SET))
+      return false;
+
+    int ret = (version == 1) ?
+     ice1_unpack(output.get(), out_length, ice_read, ice_seek, &vf, in_length) :
+     ice2_unpack(output.get(), out_length, ice_read, ice_seek, &vf, in_length);
+    if(ret != 0)
+      return false;
+
+    m.data = output.get();
+    m.length = out_length;
+    return true;
+  }
+
+  /**
+   * Returns the Pack-Ice version of the stream, or 0 if it isn't Pack-Ice.
+   */
+  static int test(vio &vf, size_t length, ice_int64 &out_length)
+  {
+    uint8_t buf[12];
+    if(length < sizeof(buf) || length > UINT32_MAX)
+      return 0;
+
+    int version = 0;
+    if(!vf.seek(-8, SEEK_END) && vf.read(buf, 8) == 8)
+    {
+      out_length = ice1_unpack_test(buf, 8);
+      if(out_length >= 0)
+        version = 1;
+    }
+    if(!version && !vf.seek(0, SEEK_SET) && vf.read(buf, 12) == 12)
+    {
+      out_length = ice2_unpack_test(buf, 12);
+      if(out_length >= 0)
+        version = 2;
+    }
+    vf.seek(0, SEEK_SET);
+
+    if(!version || out_length == 0 || out_length > ICE_DEPACK_LIMIT ||
+     out_length > ice_uncompressed_bound(length))
+      return 0;
+
+    return version;
+  }
+};
+
+std::unique_ptr<modutil::archive> modutil::archive::open(vio &vf)
+{
+  int64_t length = vf.length();
+  if(length <= 0)
+    return nullptr;
+
+  ice_int64 out_length;
+  int version = ice_archive::test(vf, length, out_length);
+  if(version)
+    return std::make_unique<ice_archive>(vf, version, length, out_length);
+
+  std::unique_ptr<DiskImage> disk(DiskImageLoader::TryLoad(vf, length));
+  vf.seek(0, SEEK_SET);
+  if(!disk || disk->error_state)
+    return nullptr;
+
+  FileList list;
+  if(!disk->Search(list, nullptr, true))
+    return nullptr;
+
+  size_t num_members = 0;
+  for(const FileInfo &file : list)
+    if(file.get_type() & FileInfo::IS_REG)
+      num_members++;
+
+  return std::make_unique<disk_archive>(std::move(disk), std::move(list), num_members);
+}
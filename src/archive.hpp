@@ -0,0 +1,78 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MODUTIL_ARCHIVE_HPP
+#define MODUTIL_ARCHIVE_HPP
+
+#include <stdint.h>
+#include <memory>
+
+#include "vio.hpp"
+
+namespace modutil
+{
+  /**
+   * A container file whose members can be unpacked into memory: any archive
+   * or disk image supported by dimgutil (Spark, ArcFS, LZX, ...) or a
+   * Pack-Ice packed file. Nothing is written to disk.
+   */
+  class archive
+  {
+  public:
+    struct member
+    {
+      const char *name;    /* Path relative to the archive root. */
+      const uint8_t *data; /* nullptr if not unpacked or failed to unpack. */
+      size_t length;
+      size_t index;        /* Used by the archive to find the member. */
+    };
+
+    const char *type;
+    size_t num_members;
+
+    archive(const char *_type, size_t _num_members):
+     type(_type), num_members(_num_members) {}
+    virtual ~archive() {}
+
+    /**
+     * Get the next regular file in the archive without unpacking it.
+     * Returns false once all members have been returned.
+     */
+    virtual bool next(member &m) = 0;
+
+    /**
+     * Unpack a member returned by the most recent call to next(). On
+     * failure, returns false and the member data is nullptr. The member
+     * data belongs to the archive and is only valid until the next call to
+     * next() or unpack().
+     */
+    virtual bool unpack(member &m) = 0;
+
+    /**
+     * Open a stream as a container. Returns nullptr if the stream is not a
+     * supported container. The stream must outlive the returned archive.
+     */
+    static std::unique_ptr<archive> open(vio &vf);
+  };
+}
+
+#endif /* MODUTIL_ARCHIVE_HPP */
@@ -29,10 +29,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 #include "modutil.hpp"
 
-static int total_asylum = 0;
+static std::atomic<int> total_asylum;
 
 
 enum ASYLUM_features
@@ -117,7 +118,8 @@ struct ASYLUM_data
 class ASYLUM_loader : public modutil::loader
 {
 public:
-  ASYLUM_loader(): modutil::loader("AMF", "asylum", "ASYLUM Music Format") {}
+  ASYLUM_loader(): modutil::loader("AMF", "asylum", "ASYLUM Music Format",
+   {{ 0, MAGIC }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
@@ -0,0 +1,414 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Config.hpp"
+#include "bench.hpp"
+#include "common.hpp"
+#include "dirwalk.hpp"
+#include "format.hpp"
+#include "modutil.hpp"
+#include "record.hpp"
+#include "vio.hpp"
+
+#define USAGE \
+  "Measure loader throughput over a corpus of modules held in memory.\n\n" \
+  "Usage:\n" \
+  "  %s [options] [file or directory...]\n\n" \
+  "Directories are scanned recursively. Each loader is run over the files it\n" \
+  "identifies, then the full moddiag scan (including probing every candidate\n" \
+  "loader) is run over the entire corpus. Text output is discarded; dump\n" \
+  "flags (-a, -p, -s, ...) can be used to include dump work in the timings.\n\n" \
+  "moddiag_bench flags:\n" \
+  "  --iterations=N  Timed iterations per format (default: 10).\n" \
+  "  --warmup=N      Untimed iterations per format run first (default: 2).\n" \
+  "  --json=file     Write results to 'file' as JSON ('-' for stdout).\n" \
+  "  --baseline=file Compare MB/s against a previous --json result and exit\n" \
+  "                  with status 1 if any format regressed.\n" \
+  "  --threshold=N   Percent slowdown treated as a regression (default: 10).\n\n"
+
+namespace
+{
+  struct bench_file
+  {
+    std::string path;
+    std::vector<uint8_t> data;
+    const modutil::loader *loader = nullptr;
+  };
+
+  struct bench_result
+  {
+    const char *ext;
+    const char *tag;
+    size_t files = 0;
+    uint64_t bytes = 0;
+    std::vector<double> samples; /* Seconds per iteration. */
+
+    double mean = 0.0;
+    double stddev = 0.0;
+    double min = 0.0;
+
+    double mb_per_sec() const
+    {
+      return mean > 0.0 ? bytes / mean / 1000000.0 : 0.0;
+    }
+
+    double files_per_sec() const
+    {
+      return mean > 0.0 ? files / mean : 0.0;
+    }
+  };
+
+  struct bench_baseline
+  {
+    std::string tag;
+    double mb_per_sec;
+  };
+}
+
+static unsigned iterations = 10;
+static unsigned warmup = 2;
+static const char *json_filename = nullptr;
+static const char *baseline_filename = nullptr;
+static double threshold = 10.0;
+
+static bool parse_uint(const char *value, unsigned &out, unsigned min)
+{
+  char *end;
+  long tmp = strtol(value, &end, 10);
+  if(!*value || *end || tmp < (long)min || tmp > 1000000)
+    return false;
+
+  out = tmp;
+  return true;
+}
+
+static bool bench_option(const char *arg, void *priv)
+{
+  if(!strncmp(arg, "--iterations=", 13))
+    return parse_uint(arg + 13, iterations, 1);
+
+  if(!strncmp(arg, "--warmup=", 9))
+    return parse_uint(arg + 9, warmup, 0);
+
+  if(!strncmp(arg, "--json=", 7))
+  {
+    json_filename = arg + 7;
+    return !!*json_filename;
+  }
+
+  if(!strncmp(arg, "--baseline=", 11))
+  {
+    baseline_filename = arg + 11;
+    return !!*baseline_filename;
+  }
+
+  if(!strncmp(arg, "--threshold=", 12))
+  {
+    char *end;
+    threshold = strtod(arg + 12, &end);
+    return arg[12] && !*end && threshold >= 0.0;
+  }
+  return false;
+}
+
+static void add_file(std::vector<bench_file> &corpus, vio &vf, const char *path)
+{
+  int64_t len = vf.length();
+  if(len <= 0)
+    return;
+
+  bench_file f;
+  f.path = path;
+  f.data.resize(len);
+  if(vf.read(f.data.data(), len) < (size_t)len)
+  {
+    fprintf(stderr, "failed to read '%s'.\n", path);
+    return;
+  }
+  corpus.push_back(std::move(f));
+}
+
+static void load_corpus(std::vector<bench_file> &corpus, const char *path)
+{
+  modutil::walk_filter filter;
+  bool is_dir = modutil::walk_directory(path, filter, [&corpus](modutil::walk_file &f)
+  {
+    try
+    {
+      std::unique_ptr<vio> vf = vio_open_read(f.dir->fd, f.name);
+      add_file(corpus, *vf, f.path.c_str());
+    }
+    catch(const char *e)
+    {
+      fprintf(stderr, "failed to open '%s'.\n", f.path.c_str());
+    }
+  });
+  if(is_dir)
+    return;
+
+  try
+  {
+    std::unique_ptr<vio> vf = vio_open_read(path);
+    add_file(corpus, *vf, path);
+  }
+  catch(const char *e)
+  {
+    fprintf(stderr, "failed to open '%s'.\n", path);
+  }
+}
+
+template<class FN>
+static void run(bench_result &r, FN &&fn)
+{
+  for(unsigned i = 0; i < warmup + iterations; i++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+
+    if(i >= warmup)
+      r.samples.push_back(t.count());
+  }
+
+  double total = 0.0;
+  r.min = r.samples[0];
+  for(double t : r.samples)
+  {
+    total += t;
+    r.min = MIN(r.min, t);
+  }
+  r.mean = total / r.samples.size();
+
+  double variance = 0.0;
+  for(double t : r.samples)
+    variance += (t - r.mean) * (t - r.mean);
+  if(r.samples.size() > 1)
+    variance /= r.samples.size() - 1;
+  r.stddev = sqrt(variance);
+}
+
+static bool load_baseline(std::vector<bench_baseline> &out, const char *filename)
+{
+  FILE *fp = fopen(filename, "rb");
+  if(!fp)
+    return false;
+
+  /* Only files written by write_json are supported: one result per line. */
+  char buffer[1024];
+  while(fgets_safe(buffer, fp))
+  {
+    const char *tag = strstr(buffer, "\"tag\":\"");
+    const char *mbps = strstr(buffer, "\"mb_per_s\":");
+    if(!tag || !mbps)
+      continue;
+
+    tag += 7;
+    const char *end = strchr(tag, '"');
+    if(!end)
+      continue;
+
+    out.push_back({ std::string(tag, end - tag), strtod(mbps + 11, nullptr) });
+  }
+  fclose(fp);
+  return true;
+}
+
+static void write_json(FILE *fp, const std::vector<bench_result> &results)
+{
+  fprintf(fp, "{\"iterations\":%u,\"warmup\":%u,\"results\":[\n", iterations, warmup);
+  for(size_t i = 0; i < results.size(); i++)
+  {
+    const bench_result &r = results[i];
+    fprintf(fp, "{\"ext\":\"%s\",\"tag\":\"%s\",\"files\":%zu,\"bytes\":%" PRIu64 ","
+     "\"mean_ms\":%.4f,\"stddev_ms\":%.4f,\"min_ms\":%.4f,"
+     "\"mb_per_s\":%.3f,\"files_per_s\":%.1f}%s\n",
+     r.ext, r.tag, r.files, r.bytes,
+     r.mean * 1000.0, r.stddev * 1000.0, r.min * 1000.0,
+     r.mb_per_sec(), r.files_per_sec(), (i + 1 < results.size()) ? "," : "");
+  }
+  fprintf(fp, "]}\n");
+}
+
+int modutil::bench_main(int argc, char **argv,
+ const std::vector<const loader *> &loaders, void (*scan)(vio &))
+{
+  if(!argv || argc < 2)
+  {
+    fprintf(stdout, USAGE "%s", argv ? argv[0] : "moddiag_bench", Config.COMMON_FLAGS);
+    return 0;
+  }
+
+  if(!Config.init(&argc, argv, bench_option, nullptr))
+    return -1;
+
+  Config.quiet = true;
+
+  std::vector<bench_file> corpus;
+  for(int i = 1; i < argc; i++)
+    load_corpus(corpus, argv[i]);
+
+  if(corpus.empty())
+  {
+    fprintf(stderr, "no files to benchmark.\n");
+    return -1;
+  }
+
+  /* Output is collected here and thrown away after every file. */
+  format::output.set_buffered(true);
+
+  /* Identify each file the same way moddiag would. */
+  for(bench_file &f : corpus)
+  {
+    format::record rec;
+    format::current_record = &rec;
+
+    vio_buffer vf(f.data.data(), f.data.size());
+    scan(vf);
+
+    format::current_record = nullptr;
+    format::output.clear();
+
+    for(const loader *l : loaders)
+      if(rec.tag == l->tag)
+        f.loader = l;
+  }
+
+  std::vector<bench_result> results;
+  for(const loader *l : loaders)
+  {
+    bench_result r;
+    r.ext = l->ext;
+    r.tag = l->tag;
+
+    std::vector<const bench_file *> files;
+    for(const bench_file &f : corpus)
+    {
+      if(f.loader == l)
+      {
+        files.push_back(&f);
+        r.bytes += f.data.size();
+      }
+    }
+    if(files.empty())
+      continue;
+
+    r.files = files.size();
+    run(r, [l, &files]()
+    {
+      for(const bench_file *f : files)
+      {
+        vio_buffer vf(f->data.data(), f->data.size());
+        l->load(modutil::data(vf));
+        format::output.clear();
+      }
+    });
+    results.push_back(std::move(r));
+  }
+
+  {
+    bench_result r;
+    r.ext = "*";
+    r.tag = "all";
+    r.files = corpus.size();
+    for(const bench_file &f : corpus)
+      r.bytes += f.data.size();
+
+    run(r, [&corpus, scan]()
+    {
+      for(const bench_file &f : corpus)
+      {
+        vio_buffer vf(f.data.data(), f.data.size());
+        scan(vf);
+        format::output.clear();
+      }
+    });
+    results.push_back(std::move(r));
+  }
+
+  fprintf(stdout, "%zu files, %u iterations (%u warmup)\n\n", corpus.size(), iterations, warmup);
+  fprintf(stdout, "%-4s %-6s : %6s %10s : %10s %10s %6s : %10s %10s\n",
+   "Ext", "Tag", "Files", "Bytes", "Mean (ms)", "Std (ms)", "CV%", "MB/s", "Files/s");
+  fprintf(stdout, "---- ------ : ------ ---------- : ---------- ---------- ------ : "
+   "---------- ----------\n");
+  for(const bench_result &r : results)
+  {
+    fprintf(stdout, "%-4.4s %-6.6s : %6zu %10" PRIu64 " : %10.3f %10.3f %6.2f : %10.2f %10.1f\n",
+     r.ext, r.tag, r.files, r.bytes, r.mean * 1000.0, r.stddev * 1000.0,
+     r.mean > 0.0 ? r.stddev * 100.0 / r.mean : 0.0, r.mb_per_sec(), r.files_per_sec());
+  }
+
+  if(json_filename)
+  {
+    bool is_stdout = !strcmp(json_filename, "-");
+    FILE *fp = is_stdout ? stdout : fopen(json_filename, "wb");
+    if(!fp)
+    {
+      fprintf(stderr, "failed to open '%s' for writing.\n", json_filename);
+      return -1;
+    }
+    write_json(fp, results);
+    if(!is_stdout)
+      fclose(fp);
+  }
+
+  int ret = 0;
+  if(baseline_filename)
+  {
+    std::vector<bench_baseline> baseline;
+    if(!load_baseline(baseline, baseline_filename))
+    {
+      fprintf(stderr, "failed to open baseline '%s'.\n", baseline_filename);
+      return -1;
+    }
+
+    fprintf(stdout, "\nBaseline: %s (regression threshold %.1f%%)\n\n",
+     baseline_filename, threshold);
+    fprintf(stdout, "%-4s %-6s : %10s %10s %8s :\n", "Ext", "Tag", "Base MB/s", "MB/s", "Change");
+    fprintf(stdout, "---- ------ : ---------- ---------- -------- :\n");
+    for(const bench_result &r : results)
+    {
+      for(const bench_baseline &b : baseline)
+      {
+        if(b.tag != r.tag || b.mb_per_sec <= 0.0)
+          continue;
+
+        double change = (r.mb_per_sec() - b.mb_per_sec) * 100.0 / b.mb_per_sec;
+        bool regressed = change < -threshold;
+        fprintf(stdout, "%-4.4s %-6.6s : %10.2f %10.2f %+7.1f%% : %s\n",
+         r.ext, r.tag, b.mb_per_sec, r.mb_per_sec(), change, regressed ? "REGRESSION" : "");
+        if(regressed)
+          ret = 1;
+        break;
+      }
+    }
+  }
+  return ret;
+}
@@ -0,0 +1,44 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MODUTIL_BENCH_HPP
+#define MODUTIL_BENCH_HPP
+
+#include <vector>
+
+class vio;
+
+namespace modutil
+{
+  class loader;
+
+  /**
+   * Entry point for moddiag_bench (BENCH_FRONTEND). Loads every file named
+   * on the command line (directories are walked recursively) into memory,
+   * times each loader over the files it identifies, and times scan() over
+   * the whole corpus to include the cost of probing.
+   */
+  int bench_main(int argc, char **argv, const std::vector<const loader *> &loaders,
+   void (*scan)(vio &));
+}
+
+#endif /* MODUTIL_BENCH_HPP */
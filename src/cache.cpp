@@ -0,0 +1,328 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "cache.hpp"
+#include "common.hpp"
+
+static constexpr char CACHE_MAGIC[] = "MODDIAGC";
+static constexpr uint32_t CACHE_VERSION = 2;
+
+static void put_u16(std::string &out, uint16_t v)
+{
+  out += (char)(v & 0xff);
+  out += (char)(v >> 8);
+}
+
+static void put_u32(std::string &out, uint32_t v)
+{
+  put_u16(out, v & 0xffff);
+  put_u16(out, v >> 16);
+}
+
+static void put_u64(std::string &out, uint64_t v)
+{
+  put_u32(out, v & 0xffffffffu);
+  put_u32(out, v >> 32);
+}
+
+static void put_string16(std::string &out, const std::string &str)
+{
+  put_u16(out, str.size());
+  out += str;
+}
+
+static void put_string32(std::string &out, const std::string &str)
+{
+  put_u32(out, str.size());
+  out += str;
+}
+
+/* Bounds-checked reader for the cache file contents. */
+class cache_reader
+{
+  const uint8_t *pos;
+  const uint8_t *end;
+
+public:
+  bool error = false;
+
+  cache_reader(const uint8_t *data, size_t len): pos(data), end(data + len) {}
+
+  bool eof() const { return pos >= end; }
+
+  const uint8_t *take(size_t n)
+  {
+    if(error || (size_t)(end - pos) < n)
+    {
+      error = true;
+      return nullptr;
+    }
+    const uint8_t *ret = pos;
+    pos += n;
+    return ret;
+  }
+
+  uint16_t u16() { const uint8_t *p = take(2); return p ? mem_u16le(p) : 0; }
+  uint32_t u32() { const uint8_t *p = take(4); return p ? mem_u32le(p) : 0; }
+  uint64_t u64() { uint64_t lo = u32(); return lo | ((uint64_t)u32() << 32); }
+
+  std::string string(size_t n)
+  {
+    const uint8_t *p = take(n);
+    return p ? std::string(reinterpret_cast<const char *>(p), n) : std::string();
+  }
+};
+
+/**
+ * Fast non-cryptographic hash. This only needs to detect whether a file
+ * with a new mtime is actually different, so it reads 8 bytes at a time.
+ */
+uint64_t modutil::result_cache::hash(const uint8_t *data, size_t len)
+{
+  constexpr uint64_t M = 0x9e3779b97f4a7c15ull;
+  uint64_t h = M ^ len;
+  uint64_t v;
+
+  for(; len >= 8; data += 8, len -= 8)
+  {
+    memcpy(&v, data, 8);
+    h = (h ^ v) * M;
+    h ^= h >> 29;
+  }
+  v = 0;
+  memcpy(&v, data, len);
+  h = (h ^ v) * M;
+  h ^= h >> 32;
+  return h;
+}
+
+bool modutil::result_cache::stat_file(const char *path, entry &e)
+{
+  struct stat st;
+  if(stat(path, &st) || !S_ISREG(st.st_mode))
+    return false;
+
+  e.size = st.st_size;
+#if defined(__APPLE__)
+  e.mtime_sec = st.st_mtimespec.tv_sec;
+  e.mtime_nsec = st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+  e.mtime_sec = st.st_mtime;
+  e.mtime_nsec = 0;
+#else
+  e.mtime_sec = st.st_mtim.tv_sec;
+  e.mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+  return true;
+}
+
+bool modutil::result_cache::load(const char *filename, const char *config)
+{
+  cache_filename = filename;
+  cache_config = config;
+
+  std::unique_ptr<vio> vf;
+  try
+  {
+    vf = vio_open_read(filename);
+  }
+  catch(const char *e)
+  {
+    /* New cache. */
+    return true;
+  }
+
+  int64_t len = vf->length();
+  if(len <= 0)
+    return true;
+
+  std::unique_ptr<uint8_t[]> held;
+  const uint8_t *data = vf->contents();
+  if(!data)
+  {
+    held.reset(new uint8_t[len]);
+    if(vf->read(held.get(), len) < (size_t)len)
+      return false;
+    data = held.get();
+  }
+
+  cache_reader r(data, len);
+  const uint8_t *magic = r.take(8);
+  if(!magic || memcmp(magic, CACHE_MAGIC, 8) || r.u32() != CACHE_VERSION)
+    return false;
+
+  /* Different configurations produce different output; start over. */
+  if(r.string(r.u16()) != cache_config)
+  {
+    dirty = true;
+    return true;
+  }
+
+  while(!r.eof() && !r.error)
+  {
+    std::string path = r.string(r.u32());
+    entry e;
+    e.size       = r.u64();
+    e.mtime_sec  = r.u64();
+    e.mtime_nsec = r.u32();
+    e.hash       = r.u64();
+    e.loader     = r.string(r.u16());
+    e.stamp      = r.string(r.u16());
+    e.output     = r.string(r.u32());
+    if(r.error)
+      break;
+
+    entries[std::move(path)] = std::move(e);
+  }
+  return !r.error;
+}
+
+bool modutil::result_cache::save()
+{
+  if(!dirty || cache_filename.empty())
+    return true;
+
+  std::string out;
+  out.append(CACHE_MAGIC, 8);
+  put_u32(out, CACHE_VERSION);
+  put_string16(out, cache_config);
+
+  for(auto &it : entries)
+  {
+    const entry &e = it.second;
+    put_string32(out, it.first);
+    put_u64(out, e.size);
+    put_u64(out, e.mtime_sec);
+    put_u32(out, e.mtime_nsec);
+    put_u64(out, e.hash);
+    put_string16(out, e.loader);
+    put_string16(out, e.stamp);
+    put_string32(out, e.output);
+  }
+
+  /* Write to a temporary file first so an interrupted run can't leave
+   * a truncated cache behind. */
+  std::string tmp = cache_filename + ".tmp";
+  FILE *fp = fopen(tmp.c_str(), "wb");
+  if(!fp)
+    return false;
+
+  bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+  ok = !fclose(fp) && ok;
+#ifdef _WIN32
+  /* rename won't replace an existing file on Windows. */
+  if(ok)
+    remove(cache_filename.c_str());
+#endif
+  if(!ok || rename(tmp.c_str(), cache_filename.c_str()))
+  {
+    remove(tmp.c_str());
+    return false;
+  }
+  dirty = false;
+  return true;
+}
+
+void modutil::result_cache::set_stamp(const char *tag, const char *stamp)
+{
+  stamps[tag] = stamp;
+}
+
+bool modutil::result_cache::lookup(const char *path, std::string &output, bool &identified)
+{
+  entry now;
+  if(!stat_file(path, now))
+    return false;
+
+  std::unique_lock<std::mutex> l(lock);
+  auto it = entries.find(path);
+  if(it == entries.end())
+    return false;
+
+  entry &e = it->second;
+  auto st = stamps.find(e.loader);
+  if(st == stamps.end() || st->second != e.stamp || e.size != now.size)
+    return false;
+
+  if(e.mtime_sec != now.mtime_sec || e.mtime_nsec != now.mtime_nsec)
+  {
+    /* Touched but possibly not modified (e.g. an archive sync). */
+    uint64_t old_hash = e.hash;
+    if(!old_hash)
+      return false;
+
+    l.unlock();
+    uint64_t new_hash = 0;
+    try
+    {
+      std::unique_ptr<vio> vf = vio_open_read(path);
+      if(vf->contents())
+        new_hash = hash(vf->contents(), vf->length());
+    }
+    catch(const char *e)
+    {
+      return false;
+    }
+    if(new_hash != old_hash)
+      return false;
+
+    l.lock();
+    it = entries.find(path);
+    if(it == entries.end())
+      return false;
+
+    it->second.mtime_sec = now.mtime_sec;
+    it->second.mtime_nsec = now.mtime_nsec;
+    dirty = true;
+  }
+  output = it->second.output;
+  identified = !it->second.loader.empty();
+  return true;
+}
+
+void modutil::result_cache::store(const char *path, vio &vf, const char *loader,
+ std::string &&output)
+{
+  entry e;
+  if(!stat_file(path, e))
+    return;
+
+  e.hash = 0;
+  if(vf.contents())
+    e.hash = hash(vf.contents(), vf.length());
+
+  e.loader = loader ? loader : "";
+  e.output = std::move(output);
+
+  std::lock_guard<std::mutex> l(lock);
+  auto st = stamps.find(e.loader);
+  if(st == stamps.end())
+    return;
+
+  e.stamp = st->second;
+  entries[path] = std::move(e);
+  dirty = true;
+}
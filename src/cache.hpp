@@ -0,0 +1,94 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MODUTIL_CACHE_HPP
+#define MODUTIL_CACHE_HPP
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "vio.hpp"
+
+namespace modutil
+{
+  /**
+   * Persistent cache of moddiag results, keyed by path, size, modification
+   * time, and a content hash. An entry is only reused if the loader that
+   * produced it (or, for unidentified files, every loader) has the same
+   * version stamp as the current build.
+   */
+  class result_cache
+  {
+  public:
+    struct entry
+    {
+      uint64_t size;
+      int64_t mtime_sec;
+      uint32_t mtime_nsec;
+      uint64_t hash;
+      std::string loader; /* Tag of the matching loader or empty. */
+      std::string stamp;
+      std::string output;
+    };
+
+    /**
+     * Load a cache file. The cache is only used if it was written with the
+     * same configuration string (output mode, filters, etc.). Returns false
+     * if the file existed but couldn't be used.
+     */
+    bool load(const char *filename, const char *config);
+    bool save();
+
+    /* Register the version stamp for a loader tag. The empty tag is used
+     * for files that weren't identified by any loader. */
+    void set_stamp(const char *tag, const char *stamp);
+
+    /**
+     * Look up a file. If a valid entry exists, its output is copied into
+     * output, identified is set if a loader matched the file, and true is
+     * returned. This is safe to call from multiple threads.
+     */
+    bool lookup(const char *path, std::string &output, bool &identified);
+
+    /**
+     * Add or replace the entry for a file that was just scanned.
+     * If vf is memory mapped, its contents are used to compute the hash.
+     */
+    void store(const char *path, vio &vf, const char *loader, std::string &&output);
+
+    static uint64_t hash(const uint8_t *data, size_t len);
+
+  private:
+    std::string cache_filename;
+    std::string cache_config;
+    std::unordered_map<std::string, entry> entries;
+    std::unordered_map<std::string, std::string> stamps;
+    std::mutex lock;
+    bool dirty = false;
+
+    bool stat_file(const char *path, entry &e);
+  };
+}
+
+#endif /* MODUTIL_CACHE_HPP */
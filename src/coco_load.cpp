@@ -25,9 +25,10 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include <atomic>
 
-static size_t num_coconizer = 0;
-static size_t num_coconizersong = 0;
+static std::atomic<size_t> num_coconizer;
+static std::atomic<size_t> num_coconizersong;
 
 
 static constexpr int MAX_ORDERS = 255;
@@ -642,7 +643,7 @@ public:
     if(num_coconizersong)
     {
       format::reportline("Total Coconizer module", "%zu", num_coconizer - num_coconizersong);
-      format::reportline("Total CoconizerSong", "%zu", num_coconizersong);
+      format::reportline("Total CoconizerSong", "%zu", num_coconizersong.load());
     }
   }
 };
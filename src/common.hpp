@@ -25,8 +25,10 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <type_traits>
 
 template<class T>
 constexpr T MAX(T a, T b)
@@ -169,6 +171,18 @@ static inline constexpr uint32_t mem_u32be(const void *_mem) noexcept
   return (mem[0] << 24) | (mem[1] << 16) | (mem[2] << 8) | mem[3];
 }
 
+static inline constexpr uint64_t mem_u64le(const void *_mem) noexcept
+{
+  const uint8_t *mem = (const uint8_t *)_mem;
+  return mem_u32le(mem) | ((uint64_t)mem_u32le(mem + 4) << 32);
+}
+
+static inline constexpr uint64_t mem_u64be(const void *_mem) noexcept
+{
+  const uint8_t *mem = (const uint8_t *)_mem;
+  return ((uint64_t)mem_u32be(mem) << 32) | mem_u32be(mem + 4);
+}
+
 static inline constexpr uint32_t magic32(char a, char b, char c, char d) noexcept
 {
   return ((unsigned)a << 24u) | ((unsigned)b << 16u) |
@@ -180,6 +194,150 @@ static inline constexpr uint32_t mem_magic32(const void *mem) noexcept
   return mem_u32be(mem);
 }
 
+/* Compile-time record layouts.
+ *
+ * A layout::record describes the on-disk layout of a fixed-size structure
+ * as a list of fields, each with an offset, width, and endianness. The
+ * whole record is then read into memory once and decoded with fixed-offset
+ * loads, or encoded into a buffer for output:
+ *
+ *   using S3M_header_layout = layout::record<S3M_header, 96,
+ *     layout::bytes<&S3M_header::name,        0>,
+ *     layout::u8   <&S3M_header::eof,        28>,
+ *     layout::u16le<&S3M_header::num_orders, 32>>;
+ *
+ *   S3M_header_layout::decode(h, buffer);
+ *
+ * Integer fields are zero-extended; array fields are copied verbatim and
+ * their width is the size of the member. Fields must not overlap or extend
+ * past the end of the record. Anything not described by a field (e.g.
+ * mixed-endian values) should be handled by the caller.
+ */
+namespace layout
+{
+  template<class M>
+  struct member_traits;
+
+  template<class C, class V>
+  struct member_traits<V C::*>
+  {
+    using record = C;
+    using value = V;
+  };
+
+  template<auto MEMBER, size_t OFFSET, size_t WIDTH, Endian E>
+  struct field
+  {
+    using record = typename member_traits<decltype(MEMBER)>::record;
+    using value = typename member_traits<decltype(MEMBER)>::value;
+
+    static constexpr size_t offset = OFFSET;
+    static constexpr size_t width = WIDTH;
+
+    static_assert(WIDTH > 0, "field must not be empty");
+    static_assert(std::is_array<value>::value ?
+     WIDTH == sizeof(value) : WIDTH <= sizeof(value) && WIDTH <= 4,
+     "field width does not fit the member");
+
+    static inline void decode(record &dest, const uint8_t *src) noexcept
+    {
+      if constexpr(std::is_array<value>::value)
+      {
+        memcpy(dest.*MEMBER, src + OFFSET, WIDTH);
+      }
+      else
+      {
+        uint32_t v = 0;
+        for(size_t i = 0; i < WIDTH; i++)
+        {
+          size_t pos = (E == Endian::BIG) ? WIDTH - 1 - i : i;
+          v |= (uint32_t)src[OFFSET + pos] << (i * 8);
+        }
+        dest.*MEMBER = static_cast<value>(v);
+      }
+    }
+
+    static inline void encode(uint8_t *dest, const record &src) noexcept
+    {
+      if constexpr(std::is_array<value>::value)
+      {
+        memcpy(dest + OFFSET, src.*MEMBER, WIDTH);
+      }
+      else
+      {
+        uint32_t v = static_cast<uint32_t>(src.*MEMBER);
+        for(size_t i = 0; i < WIDTH; i++)
+        {
+          size_t pos = (E == Endian::BIG) ? WIDTH - 1 - i : i;
+          dest[OFFSET + pos] = (v >> (i * 8)) & 0xff;
+        }
+      }
+    }
+  };
+
+  template<auto M, size_t O>
+  using u8 = field<M, O, 1, Endian::LITTLE>;
+  template<auto M, size_t O>
+  using u16le = field<M, O, 2, Endian::LITTLE>;
+  template<auto M, size_t O>
+  using u16be = field<M, O, 2, Endian::BIG>;
+  template<auto M, size_t O>
+  using u24le = field<M, O, 3, Endian::LITTLE>;
+  template<auto M, size_t O>
+  using u24be = field<M, O, 3, Endian::BIG>;
+  template<auto M, size_t O>
+  using u32le = field<M, O, 4, Endian::LITTLE>;
+  template<auto M, size_t O>
+  using u32be = field<M, O, 4, Endian::BIG>;
+  template<auto M, size_t O>
+  using bytes = field<M, O, sizeof(typename member_traits<decltype(M)>::value), Endian::LITTLE>;
+
+  template<class T, size_t SIZE, class... FIELDS>
+  struct record
+  {
+    static constexpr size_t size = SIZE;
+
+    static constexpr bool fields_valid() noexcept
+    {
+      constexpr size_t offsets[] = { FIELDS::offset... };
+      constexpr size_t widths[] = { FIELDS::width... };
+      for(size_t i = 0; i < sizeof...(FIELDS); i++)
+      {
+        if(offsets[i] + widths[i] > SIZE)
+          return false;
+
+        for(size_t j = i + 1; j < sizeof...(FIELDS); j++)
+          if(offsets[i] < offsets[j] + widths[j] && offsets[j] < offsets[i] + widths[i])
+            return false;
+      }
+      return true;
+    }
+
+    static_assert(sizeof...(FIELDS) > 0, "record must have fields");
+    static_assert((std::is_same<typename FIELDS::record, T>::value && ...),
+     "field belongs to a different structure");
+    static_assert(fields_valid(), "fields overlap or exceed the record size");
+
+    /**
+     * Decode a record from a buffer of at least `size` bytes.
+     */
+    static inline void decode(T &dest, const uint8_t *src) noexcept
+    {
+      (FIELDS::decode(dest, src), ...);
+    }
+
+    /**
+     * Encode a record to a buffer of at least `size` bytes.
+     * Bytes not covered by a field are zeroed.
+     */
+    static inline void encode(uint8_t *dest, const T &src) noexcept
+    {
+      memset(dest, 0, SIZE);
+      (FIELDS::encode(dest, src), ...);
+    }
+  };
+}
+
 /* Multibyte file reading functions. */
 
 static inline uint16_t fget_u16le(FILE *fp) noexcept
@@ -316,6 +474,235 @@ static inline int64_t fput_u32be(uint32_t val, FILE *fp) noexcept
   return val;
 }
 
+/* Multibyte memory writing functions. */
+
+static inline void mem_put_u16le(void *_mem, uint16_t val) noexcept
+{
+  uint8_t *mem = (uint8_t *)_mem;
+  mem[0] = val & 0xff;
+  mem[1] = val >> 8;
+}
+
+static inline void mem_put_u16be(void *_mem, uint16_t val) noexcept
+{
+  uint8_t *mem = (uint8_t *)_mem;
+  mem[0] = val >> 8;
+  mem[1] = val & 0xff;
+}
+
+static inline void mem_put_u24le(void *_mem, uint32_t val) noexcept
+{
+  uint8_t *mem = (uint8_t *)_mem;
+  mem[0] = val & 0xff;
+  mem[1] = (val >> 8) & 0xff;
+  mem[2] = (val >> 16) & 0xff;
+}
+
+static inline void mem_put_u24be(void *_mem, uint32_t val) noexcept
+{
+  uint8_t *mem = (uint8_t *)_mem;
+  mem[0] = (val >> 16) & 0xff;
+  mem[1] = (val >> 8) & 0xff;
+  mem[2] = val & 0xff;
+}
+
+static inline void mem_put_u32le(void *_mem, uint32_t val) noexcept
+{
+  uint8_t *mem = (uint8_t *)_mem;
+  mem[0] = val & 0xff;
+  mem[1] = (val >> 8) & 0xff;
+  mem[2] = (val >> 16) & 0xff;
+  mem[3] = val >> 24;
+}
+
+static inline void mem_put_u32be(void *_mem, uint32_t val) noexcept
+{
+  uint8_t *mem = (uint8_t *)_mem;
+  mem[0] = val >> 24;
+  mem[1] = (val >> 16) & 0xff;
+  mem[2] = (val >> 8) & 0xff;
+  mem[3] = val & 0xff;
+}
+
+/**
+ * Output file assembled in memory, for the converters. Everything is
+ * appended to a growable buffer and written out at the end with a single
+ * fwrite, so a failed conversion never leaves a partial file behind.
+ * Fields whose values aren't known until later (lengths, offsets) can be
+ * reserved with placeholder() and filled in with the patch_* functions.
+ */
+class mem_writer
+{
+  uint8_t *buf = nullptr;
+  size_t pos = 0;
+  size_t alloc = 0;
+
+  uint8_t *grow(size_t num)
+  {
+    if(num > alloc - pos)
+      reserve(pos + num);
+
+    uint8_t *ret = buf + pos;
+    pos += num;
+    return ret;
+  }
+
+#define MEM_WRITER_FN(type, name, N, mem) \
+  inline void name(type val) \
+  { \
+    mem(grow(N), val); \
+  } \
+  inline void patch_ ## name(size_t offset, type val) noexcept \
+  { \
+    if(offset <= pos && pos - offset >= N) \
+      mem(buf + offset, val); \
+  }
+
+public:
+  mem_writer(size_t initial = 0)
+  {
+    if(initial)
+      reserve(initial);
+  }
+
+  ~mem_writer()
+  {
+    free(buf);
+  }
+
+  mem_writer(const mem_writer &) = delete;
+  mem_writer &operator=(const mem_writer &) = delete;
+
+  /* Grow the buffer to hold at least total bytes. */
+  void reserve(size_t total)
+  {
+    if(total <= alloc)
+      return;
+
+    size_t new_alloc = MAX(alloc * 2, MAX(total, (size_t)4096));
+    uint8_t *tmp = (uint8_t *)realloc(buf, new_alloc);
+    if(!tmp)
+    {
+      fprintf(stderr, "mem_writer: out of memory (%zu bytes)\n", new_alloc);
+      abort();
+    }
+    buf = tmp;
+    alloc = new_alloc;
+  }
+
+  inline size_t tell() const noexcept
+  {
+    return pos;
+  }
+
+  /* Discard the contents, keeping the allocation for the next file. */
+  inline void clear() noexcept
+  {
+    pos = 0;
+  }
+
+  inline uint8_t *data() noexcept
+  {
+    return buf;
+  }
+
+  inline void u8(uint8_t val)
+  {
+    *grow(1) = val;
+  }
+
+  inline void write(const void *src, size_t num)
+  {
+    if(num)
+      memcpy(grow(num), src, num);
+  }
+
+  inline void puts(const char *str)
+  {
+    write(str, strlen(str));
+  }
+
+  inline void fill(uint8_t val, size_t num)
+  {
+    if(num)
+      memset(grow(num), val, num);
+  }
+
+  /* Append num zero bytes and return their offset for patching later. */
+  inline size_t placeholder(size_t num)
+  {
+    size_t offset = pos;
+    fill(0, num);
+    return offset;
+  }
+
+  /* Append num uninitialized bytes and return a pointer to them. */
+  inline uint8_t *append(size_t num)
+  {
+    return grow(num);
+  }
+
+  inline void patch_u8(size_t offset, uint8_t val) noexcept
+  {
+    if(offset < pos)
+      buf[offset] = val;
+  }
+
+  MEM_WRITER_FN(uint16_t, u16le, 2, mem_put_u16le)
+  MEM_WRITER_FN(uint16_t, u16be, 2, mem_put_u16be)
+  MEM_WRITER_FN(uint32_t, u24le, 3, mem_put_u24le)
+  MEM_WRITER_FN(uint32_t, u24be, 3, mem_put_u24be)
+  MEM_WRITER_FN(uint32_t, u32le, 4, mem_put_u32le)
+  MEM_WRITER_FN(uint32_t, u32be, 4, mem_put_u32be)
+#undef MEM_WRITER_FN
+
+  /* Write the buffer to an open stream. */
+  bool flush(FILE *fp) const noexcept
+  {
+    if(pos && fwrite(buf, 1, pos, fp) < pos)
+      return false;
+    return fflush(fp) == 0;
+  }
+
+  /**
+   * Write the buffer to a temporary file next to filename, then rename it
+   * over filename, so the output is either complete or not there at all.
+   */
+  bool save(const char *filename) const noexcept
+  {
+    size_t len = strlen(filename) + 5;
+    char *tmpname = (char *)malloc(len);
+    if(!tmpname)
+      return false;
+
+    snprintf(tmpname, len, "%s.tmp", filename);
+
+    FILE *fp = fopen(tmpname, "wb");
+    if(!fp)
+    {
+      free(tmpname);
+      return false;
+    }
+
+    bool ok = flush(fp);
+    if(fclose(fp))
+      ok = false;
+
+#ifdef _WIN32
+    /* rename won't replace an existing file on Windows. */
+    if(ok)
+      remove(filename);
+#endif
+    if(!ok || rename(tmpname, filename))
+    {
+      remove(tmpname);
+      ok = false;
+    }
+    free(tmpname);
+    return ok;
+  }
+};
+
 /* String cleaning functions. */
 
 static inline bool strip_module_name(char *dest, size_t dest_len) noexcept
@@ -31,6 +31,9 @@
 
 #include <fcntl.h>
 
+#include "../common.hpp"
+#include "sigma_delta.hpp"
+
 #define ERROR(...) do{ fprintf(stderr, __VA_ARGS__); fflush(stderr); exit(-1); }while(0)
 
 #ifdef DEBUG
@@ -104,138 +107,7 @@ struct dsym
   int line;
 };
 
-static void fput16(int value, FILE *fp)
-{
-  fputc(value & 0xff, fp);
-  fputc(value >> 8, fp);
-}
-
-static void fput24(int value, FILE *fp)
-{
-  fputc(value & 0xff, fp);
-  fputc((value & 0x00ff00) >> 8, fp);
-  fputc((value & 0xff0000) >> 16, fp);
-}
-
-static void fput32(uint32_t value, FILE *fp)
-{
-  fputc(value & 0xff, fp);
-  fputc((value & 0x0000ff00UL) >> 8, fp);
-  fputc((value & 0x00ff0000UL) >> 16, fp);
-  fputc((value & 0xff000000UL) >> 24, fp);
-}
-
 /* Sigma-delta 8-bit sample compression. */
-struct bitstream
-{
-  std::vector<uint8_t> &out;
-  uint64_t buf = 0;
-  unsigned pos = 0;
-
-  bitstream(std::vector<uint8_t> &o): out(o) {}
-
-  void flush()
-  {
-    out.push_back((buf & 0x000000ffUL) >> 0);
-    out.push_back((buf & 0x0000ff00UL) >> 8);
-    out.push_back((buf & 0x00ff0000UL) >> 16);
-    out.push_back((buf & 0xff000000UL) >> 24);
-    buf >>= 32;
-    pos -= 32;
-  }
-
-  void write(uint64_t value, unsigned width)
-  {
-    buf |= value << pos;
-    pos += width;
-
-    if(pos >= 32)
-      flush();
-  }
-};
-
-static void sigma_delta_compress(std::vector<uint8_t> &out,
- const std::vector<uint8_t> &in, unsigned max_runlength)
-{
-  if(in.size() < 1)
-    return;
-
-  bitstream stream(out);
-  unsigned width = 8;
-  int8_t delta_min = -127;
-  int8_t delta_max = 127;
-  unsigned runlength = 0;
-  uint8_t prev = in[0];
-
-  out.push_back(max_runlength);
-  stream.write(in[0], 8);
-
-  for(size_t i = 1; i < in.size(); i++)
-  {
-    int8_t delta = static_cast<int8_t>(in[i] - prev);
-    prev = in[i];
-
-    if(delta == -128)
-    {
-      /* Pretend this edge case didn't happen... */
-      prev++;
-      delta = -127;
-    }
-
-    while(delta < delta_min || delta > delta_max)
-    {
-      /* Expand width. */
-      assert(width < 8);
-      stream.write(0, width);
-
-      width++;
-      delta_max = (1 << (width - 1)) - 1;
-      delta_min = -delta_max;
-      runlength = 0;
-      //DEBUG("  %u: expand width to %d\n", i, width);
-    }
-
-    /* Output delta. */
-    uint8_t code;
-    if(delta <= 0)
-    {
-      code = 0x01 | (static_cast<uint8_t>(-delta) << 1);
-      stream.write(code, width);
-    }
-    else
-    {
-      code = static_cast<uint8_t>(delta) << 1;
-      stream.write(code, width);
-    }
-    //DEBUG("  %u: write %02x\n", i, code);
-
-    /* Reset the run length for large values. */
-    if(code >> (width - 1))
-    {
-      runlength = 0;
-      continue;
-    }
-
-    /* Otherwise, increment the run length. */
-    if(++runlength >= max_runlength)
-    {
-      runlength = 0;
-
-      /* Shrink width. */
-      if(width > 1)
-      {
-        width--;
-        delta_max = (1 << (width - 1)) - 1;
-        delta_min = -delta_max;
-        //DEBUG("  %u: shrink width to %d\n", i, width);
-      }
-    }
-  }
-
-  /* Output any remaining bytes + padding. */
-  stream.flush();
-}
-
 static void sigma_delta_compress(std::vector<uint8_t> &out,
  const std::vector<uint8_t> &in)
 {
@@ -529,12 +401,14 @@ int main()
   DEBUG("writing module\n");
 
   /* Write */
-  fputs("\x02\x01\x13\x13\x14\x12\x01\x0b", stdout);
-  fputc(m.version, stdout);
-  fputc(m.num_channels, stdout);
-  fput16(m.num_orders, stdout);
-  fput16(m.num_patterns, stdout);
-  fput24(m.comment_length, stdout);
+  mem_writer out(1 << 16);
+
+  out.puts("\x02\x01\x13\x13\x14\x12\x01\x0b");
+  out.u8(m.version);
+  out.u8(m.num_channels);
+  out.u16le(m.num_orders);
+  out.u16le(m.num_patterns);
+  out.u24le(m.comment_length);
 
   for(i = 0; i < NUM_SAMPLES; i++)
   {
@@ -543,22 +417,22 @@ int main()
     int flags = s.present ? 0 : 0x80;
     int len = strlen(s.name);
 
-    fputc(flags | len, stdout);
+    out.u8(flags | len);
     if(s.present)
-      fput24(s.length >> 1, stdout);
+      out.u24le(s.length >> 1);
   }
 
-  fputc(strlen(m.name), stdout);
-  fputs(m.name, stdout);
-  fputs("\xff\xff\xff\xff\xff\xff\xff\xff", stdout); /* Effects allowed table. */
+  out.u8(strlen(m.name));
+  out.puts(m.name);
+  out.fill(0xff, 8); /* Effects allowed table. */
 
   if(m.num_orders > 0)
   {
     DEBUG("writing %u orders\n", m.num_orders);
-    fputc(0, stdout); // Packing method.
+    out.u8(0); // Packing method.
     for(i = 0; i < m.num_orders; i++)
       for(size_t j = 0; j < m.num_channels; j++)
-        fput16(m.orders[i][j], stdout);
+        out.u16le(m.orders[i][j]);
   }
 
   if(m.num_patterns > 0)
@@ -567,12 +441,12 @@ int main()
     for(i = 0; i < m.num_patterns;)
     {
       DEBUG("  block of %u\n", (m.num_patterns - i) < 2000 ? (m.num_patterns - i) : 2000);
-      fputc(0, stdout); // Packing method.
+      out.u8(0); // Packing method.
       for(size_t j = 0; i < m.num_patterns && j < 2000; i++, j++)
       {
         pattern &p = m.patterns[i];
         for(size_t r = 0; r < 64; r++)
-          fput32(p.events[r], stdout);
+          out.u32le(p.events[r]);
       }
     }
   }
@@ -580,21 +454,21 @@ int main()
   for(i = 0; i < NUM_SAMPLES; i++)
   {
     sample &s = m.samples[i];
-    fputs(s.name, stdout);
+    out.puts(s.name);
     if(!s.present)
       continue;
 
     DEBUG("writing sample %u\n", i);
 
-    fput24(s.loop_start >> 1, stdout);
-    fput24(s.loop_length >> 1, stdout);
-    fputc(s.volume, stdout);
-    fputc((signed char)s.finetune, stdout);
+    out.u24le(s.loop_start >> 1);
+    out.u24le(s.loop_length >> 1);
+    out.u8(s.volume);
+    out.u8((signed char)s.finetune);
 
     if(!s.length)
       continue;
 
-    fputc(s.type, stdout); // Sample packing type.
+    out.u8(s.type); // Sample packing type.
 
     size_t buf_size = s.length;
     if(s.input_is_16bit)
@@ -618,7 +492,7 @@ int main()
       case 0: // signed uncompressed 8-bit log
       case 2: // signed uncompressed 8-bit
       case 3: // signed uncompressed 16-bit
-        fwrite(buf.data(), buf_size, 1, stdout);
+        out.write(buf.data(), buf_size);
         break;
 
       case 4: // unsigned sigma-delta 8-bit
@@ -639,7 +513,7 @@ int main()
         std::vector<uint8_t> compressed;
         sigma_delta_compress(compressed, buf);
 
-        fwrite(compressed.data(), compressed.size(), 1, stdout);
+        out.write(compressed.data(), compressed.size());
         break;
       }
 
@@ -687,7 +561,7 @@ int main()
         std::vector<uint8_t> compressed;
         sigma_delta_compress(compressed, buf);
 
-        fwrite(compressed.data(), compressed.size(), 1, stdout);
+        out.write(compressed.data(), compressed.size());
         break;
       }
 
@@ -701,14 +575,20 @@ int main()
   {
     DEBUG("writing comment, length %zu\n", m.comment_length);
 
-    fputc(0, stdout); // Packing method.
+    out.u8(0); // Packing method.
 
     for(i = 0; i < m.num_comment_lines; i++)
-      fprintf(stdout, "%s\n", m.comments[i].text);
+    {
+      out.puts(m.comments[i].text);
+      out.u8('\n');
+    }
 
     for(i = m.comment_length & 3; i & 3; i++)
-      fputc(0, stdout);
+      out.u8(0);
   }
 
+  if(!out.flush(stdout))
+    ERROR("write error on output\n");
+
   return 0;
 }
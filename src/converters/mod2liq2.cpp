@@ -25,6 +25,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "../common.hpp"
+
 #define ERROR(...) do { \
   fprintf(stderr, "ERROR: " __VA_ARGS__); \
   fprintf(stderr, "\n"); \
@@ -172,16 +174,41 @@ struct no_header
   struct no_instrument ins[63];
 };
 
-static uint16_t read_u16be(const uint8_t *data)
-{
-  return (data[0] << 8) | data[1];
-}
-
-static void write_u16le(uint8_t *data, uint16_t value)
-{
-  data[0] = value & 0xff;
-  data[1] = value >> 8;
-}
+using mod_instrument_layout = layout::record<mod_instrument, 30,
+  layout::bytes<&mod_instrument::name,             0>,
+  layout::u16be<&mod_instrument::length_half,     22>,
+  layout::u8   <&mod_instrument::finetune,        24>,
+  layout::u8   <&mod_instrument::volume,          25>,
+  layout::u16be<&mod_instrument::loopstart_half,  26>,
+  layout::u16be<&mod_instrument::looplength_half, 28>>;
+
+/* The 31 instruments at offset 20 are decoded separately. */
+using mod_header_layout = layout::record<mod_header, 1084,
+  layout::bytes<&mod_header::name,      0>,
+  layout::u8   <&mod_header::length,  950>,
+  layout::u8   <&mod_header::restart, 951>,
+  layout::bytes<&mod_header::order,   952>,
+  layout::bytes<&mod_header::magic,  1080>>;
+
+using no_instrument_layout = layout::record<no_instrument, 46,
+  layout::u8   <&no_instrument::nlen,       0>,
+  layout::bytes<&no_instrument::name,       1>,
+  layout::u8   <&no_instrument::volume,    31>,
+  layout::u16le<&no_instrument::c2_freq,   32>,
+  layout::u32le<&no_instrument::length,    34>,
+  layout::u32le<&no_instrument::loopstart, 38>,
+  layout::u32le<&no_instrument::loopend,   42>>;
+
+/* Followed by 63 instruments. */
+using no_header_layout = layout::record<no_header, 0x12B,
+  layout::bytes<&no_header::magic,         0>,
+  layout::u8   <&no_header::nlen,          4>,
+  layout::bytes<&no_header::name,          5>,
+  layout::u8   <&no_header::num_patterns, 34>,
+  layout::u8   <&no_header::unknown_ff,   35>,
+  layout::u8   <&no_header::num_channels, 36>,
+  layout::bytes<&no_header::unknown,      37>,
+  layout::bytes<&no_header::order,        43>>;
 
 static void write_u32le(uint8_t *data, uint32_t value)
 {
@@ -206,7 +233,7 @@ static size_t mod_strlen(const uint8_t (&buf)[N])
 
 static bool load_mod_header(struct mod_header &mod, FILE *in)
 {
-  uint8_t buf[1084];
+  uint8_t buf[mod_header_layout::size];
   int tmp;
   int i;
 
@@ -215,11 +242,11 @@ static bool load_mod_header(struct mod_header &mod, FILE *in)
     ERROR("read error on input");
     return false;
   }
+  mod_header_layout::decode(mod, buf);
   mod.num_patterns = 0;
   mod.num_channels = 0;
   mod.sample_bytes_total = 0;
 
-  memcpy(mod.magic, buf + 1080, 4);
   tmp = (mod.magic[0] - '0') * 10 + (mod.magic[1] - '0');
 
   if(!memcmp(mod.magic, "M.K.", 4) || !memcmp(mod.magic, "M!K!", 4) ||
@@ -252,23 +279,13 @@ static bool load_mod_header(struct mod_header &mod, FILE *in)
     return false;
   }
 
-  memcpy(mod.name, buf, 20);
-  mod.length = buf[950];
-  mod.restart = buf[951];
-  memcpy(mod.order, buf + 952, 128);
-
   /* Parse samples */
   const uint8_t *pos = buf + 20;
   for(i = 0; i < 31; i++)
   {
     struct mod_instrument &ins = mod.ins[i];
-    memcpy(ins.name, pos, 22);
-    ins.length_half = read_u16be(pos + 22);
-    ins.finetune = pos[24];
-    ins.volume = pos[25];
-    ins.loopstart_half = read_u16be(pos + 26);
-    ins.looplength_half = read_u16be(pos + 28);
-    pos += 30;
+    mod_instrument_layout::decode(ins, pos);
+    pos += mod_instrument_layout::size;
 
     mod.sample_bytes_total += ins.length_half * 2;
   }
@@ -344,42 +361,22 @@ static bool convert_mod_header(struct no_header &no, const struct mod_header &mo
   return true;
 }
 
-static bool write_no_header(const struct no_header &no, FILE *out)
+static bool write_no_header(const struct no_header &no, mem_writer &out)
 {
-  uint8_t buf[0xC7D];
-  memcpy(buf, no.magic, 4);
-  buf[4] = no.nlen;
-  memcpy(buf + 5, no.name, 29);
-  buf[34] = no.num_patterns;
-  buf[35] = no.unknown_ff;
-  buf[36] = no.num_channels;
-  memcpy(buf + 37, no.unknown, 6);
-  memcpy(buf + 43, no.order, 256);
-
-  uint8_t *pos = buf + 0x12B;
+  uint8_t *buf = out.append(0xC7D);
+  no_header_layout::encode(buf, no);
+
+  uint8_t *pos = buf + no_header_layout::size;
   for(int i = 0; i < 63; i++)
   {
-    const struct no_instrument &ins = no.ins[i];
-    pos[0] = ins.nlen;
-    memcpy(pos + 1, ins.name, 30);
-    pos[31] = ins.volume;
-    write_u16le(pos + 32, ins.c2_freq);
-    write_u32le(pos + 34, ins.length);
-    write_u32le(pos + 38, ins.loopstart);
-    write_u32le(pos + 42, ins.loopend);
-    pos += 46;
+    no_instrument_layout::encode(pos, no.ins[i]);
+    pos += no_instrument_layout::size;
   }
   if(pos - buf != 0xC7D)
   {
     ERROR("internal error");
     return false;
   }
-
-  if(fwrite(buf, 1, sizeof(buf), out) < sizeof(buf))
-  {
-    ERROR("write error in header");
-    return false;
-  }
   return true;
 }
 
@@ -583,7 +580,6 @@ int main(int argc, char *argv[])
   for(int i = 1; i < argc; i++)
   {
     FILE *in;
-    FILE *out;
     char *extpos;
     char *path;
     size_t len;
@@ -616,59 +612,48 @@ int main(int argc, char *argv[])
     else
       snprintf(path, sizeof(patbuf), "%s.liq", argv[i]);
 
-    out = fopen(path, "wb");
-    if(!out)
-    {
-      ERROR("failed to fopen '%s' output file '%s'", argv[i], path);
-      goto err_close;
-    }
-    if(!write_no_header(no, out))
     {
-      ERROR("failed to convert '%s'", argv[i]);
-      goto err_close2;
-    }
+      pattern_bytes = (size_t)mod.num_channels * 64 * 4;
+      mem_writer out(0xC7D + pattern_bytes * mod.num_patterns + mod.sample_bytes_total);
 
-    // Convert and copy patterns
-    pattern_bytes = (size_t)mod.num_channels * 64 * 4;
-
-    for(size_t j = 0; j < mod.num_patterns; j++)
-    {
-      if(fread(patbuf, 1, pattern_bytes, in) < pattern_bytes ||
-         !convert_mod_pattern(patbuf, pattern_bytes, mod) ||
-         fwrite(patbuf, 1, pattern_bytes, out) < pattern_bytes)
+      if(!write_no_header(no, out))
       {
-        ERROR("failed to convert '%s' pattern %zu", argv[i], j);
-        goto err_close2;
+        ERROR("failed to convert '%s'", argv[i]);
+        goto err_close;
       }
-    }
 
-    // Copy samples
-    for(size_t k = 0; k < mod.sample_bytes_total;)
-    {
-      size_t sz = sizeof(patbuf) < mod.sample_bytes_total - k ?
-                  sizeof(patbuf) : mod.sample_bytes_total - k;
+      // Convert patterns in place in the output buffer
+      for(size_t j = 0; j < mod.num_patterns; j++)
+      {
+        uint8_t *dest = out.append(pattern_bytes);
+        if(fread(dest, 1, pattern_bytes, in) < pattern_bytes ||
+           !convert_mod_pattern(dest, pattern_bytes, mod))
+        {
+          ERROR("failed to convert '%s' pattern %zu", argv[i], j);
+          goto err_close;
+        }
+      }
 
-      k += sz;
-      if(fread(patbuf, 1, sz, in) < sz)
+      // Copy samples
+      uint8_t *dest = out.append(mod.sample_bytes_total);
+      if(fread(dest, 1, mod.sample_bytes_total, in) < mod.sample_bytes_total)
       {
         ERROR("read error in '%s' sample data", argv[i]);
-        goto err_close2;
+        goto err_close;
       }
       /* Convert signed -> unsigned */
-      for(size_t n = 0; n < sz; n++)
-        patbuf[n] ^= 0x80;
+      for(size_t n = 0; n < mod.sample_bytes_total; n++)
+        dest[n] ^= 0x80;
 
-      if(fwrite(patbuf, 1, sz, out) < sz)
+      if(!out.save(path))
       {
-        ERROR("write error in '%s' sample data", argv[i]);
-        goto err_close2;
+        ERROR("failed to write '%s' output file '%s'", argv[i], path);
+        goto err_close;
       }
     }
     fprintf(stderr, "OK\n");
     fflush(stderr);
 
-err_close2:
-    fclose(out);
 err_close:
     fclose(in);
   }
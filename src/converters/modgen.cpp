@@ -0,0 +1,1264 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Synthetic worst-case module generator for loader scaling tests.
+ *
+ * Every format is generated at the limits accepted by its moddiag loader:
+ * every pattern is full (every channel of every row has a note, instrument,
+ * volume and effect), every sample slot is present, and the order list is
+ * as long as the loader will accept. With --adversarial, the generator
+ * instead tries to maximize the amount of work per input byte: counts are
+ * pushed past what the original trackers would ever save, and parapointers
+ * and offsets all alias a single pattern/sample so a small file expands to
+ * a very large amount of loader work.
+ */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <fcntl.h>
+
+#define ERROR(...) do{ fprintf(stderr, __VA_ARGS__); fflush(stderr); exit(-1); }while(0)
+
+#ifdef DEBUG
+#undef DEBUG
+#define DEBUG(...) do{ fprintf(stderr, __VA_ARGS__); fflush(stderr); }while(0)
+#else
+#define DEBUG(...)
+#endif
+
+static const char USAGE[] =
+  "Synthetic worst-case module generator.\n\n"
+  "Usage:\n"
+  "  modgen format [options...] > output\n\n"
+  "Formats:\n"
+  "  mod       ProTracker/FastTracker xxCH MOD.\n"
+  "  s3m       Scream Tracker 3.\n"
+  "  xm        FastTracker 2.\n"
+  "  it        Impulse Tracker.\n"
+  "  med       OctaMED MMD1.\n"
+  "  dtt       Desktop Tracker.\n"
+  "  musx      Archimedes Tracker (IFF, nested SAMP chunks).\n\n"
+  "Options:\n"
+  "  -a  --adversarial   Maximize loader work per input byte (see below).\n"
+  "  --channels=N        Channels/tracks per pattern.\n"
+  "  --patterns=N        Number of patterns/blocks.\n"
+  "  --rows=N            Rows per pattern.\n"
+  "  --orders=N          Length of the order list.\n"
+  "  --samples=N         Number of samples (or instruments for XM/IT).\n"
+  "  --length=N          Length of each sample in frames.\n"
+  "  --seed=N            Seed for the pattern event generator.\n\n"
+  "Values not provided default to the largest values the original tracker\n"
+  "would save (or, with --adversarial, the variant described below). Values\n"
+  "above what the moddiag loader for the format accepts are rejected.\n\n"
+  "Adversarial variants:\n"
+  "  mod       Samples at 64k with loops running past the sample end.\n"
+  "  s3m       65535 orders/instruments/patterns; all parapointers alias.\n"
+  "  xm        256 channels; every sample is flagged as ADPCM.\n"
+  "  it        Thousands of instruments/samples aliasing a single sample\n"
+  "            compressed with width 1 blocks (maximum expansion ratio).\n"
+  "  med       Blocks with more than 256 rows; all block pointers alias.\n"
+  "  dtt       65536 orders, every event has multiple effects, and all\n"
+  "            pattern offsets alias.\n"
+  "  musx      Every SAMP chunk is padded with thousands of empty unknown\n"
+  "            subchunks (the deepest IFF nesting any loader parses).\n";
+
+enum format
+{
+  FMT_MOD,
+  FMT_S3M,
+  FMT_XM,
+  FMT_IT,
+  FMT_MED,
+  FMT_DTT,
+  FMT_MUSX,
+  NUM_FORMATS
+};
+
+struct limits
+{
+  const char *name;
+  unsigned channels;
+  unsigned patterns;
+  unsigned rows;
+  unsigned orders;
+  unsigned samples;
+  unsigned length;
+};
+
+/* Maximums accepted by the moddiag loaders. */
+static constexpr limits MAXIMUM[NUM_FORMATS] =
+{
+  { "mod",  32,   128,   64,   128,   31, 65536 },
+  { "s3m",  32, 65535,   64, 65535, 65535, 0xffffff },
+  { "xm",  256,   256,  256,   256, 65535, 0xffffff },
+  { "it",   64, 65535,  200, 65535, 65535, 0xffffff },
+  { "med", 256,   256, 9999,   256,   63, 0xffffff },
+  { "dtt",  16,   256,  255, 65536,   63, 0xffffff },
+  { "musx",  8,    64,   64,   128,   36, 0xffffff },
+};
+
+/* Maximums saved by the original trackers. */
+static constexpr limits DEFAULTS[NUM_FORMATS] =
+{
+  { "mod",  32,  128,  64,   128, 31, 65536 },
+  { "s3m",  32,  256,  64,   256, 99, 64000 },
+  { "xm",   32,  256, 256,   256, 128, 4096 },
+  { "it",   64,  200, 200,   256, 99, 65536 },
+  { "med",  64,  256, 256,   256, 63, 65536 },
+  { "dtt",  16,  256, 255, 65536, 63, 65536 },
+  { "musx",  8,   64,  64,   128, 36, 65536 },
+};
+
+static constexpr limits ADVERSARIAL[NUM_FORMATS] =
+{
+  { "mod",  32,   128,   64,   128,    31, 65536 },
+  { "s3m",  32, 65535,   64, 65535, 65535, 64000 },
+  { "xm",  256,   256,  256,   256,   128, 4096 },
+  { "it",   64, 65535,  200, 65535,  4000, 262144 },
+  { "med",  64,   256, 1024,   256,    63, 65536 },
+  { "dtt",  16,   256,  255, 65536,    63, 65536 },
+  { "musx",  8,    64,   64,   128,    36, 4096 },
+};
+
+struct options
+{
+  enum format format;
+  bool adversarial;
+  unsigned channels;
+  unsigned patterns;
+  unsigned rows;
+  unsigned orders;
+  unsigned samples;
+  unsigned length;
+};
+
+/**
+ * In-memory output buffer. Offsets are back-patched after the data they
+ * point to has been placed, so everything is written in one pass.
+ */
+class output
+{
+  std::vector<uint8_t> buf;
+
+public:
+  size_t pos() const
+  {
+    return buf.size();
+  }
+
+  void u8(unsigned v)
+  {
+    buf.push_back(v);
+  }
+
+  void u16le(unsigned v)
+  {
+    u8(v & 0xff);
+    u8((v >> 8) & 0xff);
+  }
+
+  void u16be(unsigned v)
+  {
+    u8((v >> 8) & 0xff);
+    u8(v & 0xff);
+  }
+
+  void u32le(uint32_t v)
+  {
+    u16le(v & 0xffff);
+    u16le(v >> 16);
+  }
+
+  void u32be(uint32_t v)
+  {
+    u16be(v >> 16);
+    u16be(v & 0xffff);
+  }
+
+  void zero(size_t count)
+  {
+    buf.resize(buf.size() + count, 0);
+  }
+
+  void string(const char *str, size_t count)
+  {
+    size_t len = strlen(str);
+    for(size_t i = 0; i < count; i++)
+      u8(i < len ? str[i] : 0);
+  }
+
+  void align(size_t boundary)
+  {
+    while(buf.size() % boundary)
+      u8(0);
+  }
+
+  void patch_u8(size_t at, unsigned v)
+  {
+    buf[at] = v & 0xff;
+  }
+
+  void patch_u16le(size_t at, unsigned v)
+  {
+    buf[at + 0] = v & 0xff;
+    buf[at + 1] = (v >> 8) & 0xff;
+  }
+
+  void patch_u32le(size_t at, uint32_t v)
+  {
+    patch_u16le(at + 0, v & 0xffff);
+    patch_u16le(at + 2, v >> 16);
+  }
+
+  void tag(const char *id)
+  {
+    for(size_t i = 0; i < 4; i++)
+      u8(id[i]);
+  }
+
+  void patch_u32be(size_t at, uint32_t v)
+  {
+    buf[at + 0] = (v >> 24) & 0xff;
+    buf[at + 1] = (v >> 16) & 0xff;
+    buf[at + 2] = (v >> 8) & 0xff;
+    buf[at + 3] = v & 0xff;
+  }
+
+  void write(FILE *fp) const
+  {
+    if(fwrite(buf.data(), 1, buf.size(), fp) < buf.size())
+      ERROR("write error\n");
+  }
+};
+
+/* xorshift32; deterministic for a given seed on every platform. */
+static uint32_t rng_state;
+
+static unsigned rnd(unsigned range)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return range ? rng_state % range : rng_state;
+}
+
+/**
+ * Sample data: a sawtooth with a bit of noise, so that the data is neither
+ * silent nor trivially compressible.
+ */
+static void sample_data(output &out, unsigned length)
+{
+  for(unsigned i = 0; i < length; i++)
+    out.u8(((i * 4) + rnd(8)) & 0xff);
+}
+
+static void sample_data_delta(output &out, unsigned length)
+{
+  uint8_t prev = 0;
+  for(unsigned i = 0; i < length; i++)
+  {
+    uint8_t cur = ((i * 4) + rnd(8)) & 0xff;
+    out.u8((cur - prev) & 0xff);
+    prev = cur;
+  }
+}
+
+static void sample_name(char (&name)[32], const char *prefix, unsigned num)
+{
+  snprintf(name, sizeof(name), "%s %u", prefix, num);
+}
+
+
+/**
+ * ProTracker MOD. 31 samples, 128 orders, xxCH magic for >9 channels.
+ */
+static void generate_mod(output &out, const options &opt)
+{
+  static const uint16_t periods[36] =
+  {
+    856, 808, 762, 720, 678, 640, 604, 570, 538, 508, 480, 453,
+    428, 404, 381, 360, 339, 320, 302, 285, 269, 254, 240, 226,
+    214, 202, 190, 180, 170, 160, 151, 143, 135, 127, 120, 113,
+  };
+  unsigned half_length = (opt.length + 1) >> 1;
+  char name[32];
+  unsigned i;
+
+  out.string("modgen maximal mod", 20);
+
+  for(i = 0; i < 31; i++)
+  {
+    sample_name(name, "sample", i + 1);
+    out.string(name, 22);
+    out.u16be(half_length);
+    out.u8(i & 0x0f);
+    out.u8(64);
+    if(opt.adversarial)
+    {
+      /* Loops that start inside the sample and run well past its end. */
+      out.u16be(half_length >> 1);
+      out.u16be(half_length);
+    }
+    else
+    {
+      out.u16be(0);
+      out.u16be(half_length);
+    }
+  }
+
+  out.u8(opt.orders);
+  out.u8(0x7f);
+  for(i = 0; i < 128; i++)
+    out.u8(i % opt.patterns);
+
+  if(opt.channels == 4)
+  {
+    out.string("M.K.", 4);
+  }
+  else
+
+  if(opt.channels < 10)
+  {
+    out.u8('0' + opt.channels);
+    out.string("CHN", 3);
+  }
+  else
+  {
+    out.u8('0' + opt.channels / 10);
+    out.u8('0' + opt.channels % 10);
+    out.string("CH", 2);
+  }
+
+  /* Every order slot counts towards the pattern count, not just the
+   * used ones, so emit enough patterns for all 128 entries. */
+  unsigned num_patterns = (opt.patterns < 128) ? opt.patterns : 128;
+  for(i = 0; i < num_patterns; i++)
+  {
+    for(unsigned j = 0; j < 64 * opt.channels; j++)
+    {
+      unsigned period = periods[rnd(36)];
+      unsigned sample = rnd(31) + 1;
+      unsigned effect = rnd(16);
+      unsigned param = rnd(256);
+
+      out.u8((sample & 0xf0) | (period >> 8));
+      out.u8(period & 0xff);
+      out.u8(((sample & 0x0f) << 4) | effect);
+      out.u8(param);
+    }
+  }
+
+  for(i = 0; i < 31; i++)
+    sample_data(out, half_length << 1);
+}
+
+
+/**
+ * Scream Tracker 3. Pattern and instrument parapointers are 16-bit
+ * paragraph indices, so everything other than the sample data must fit in
+ * the first 1MB. Patterns that don't fit alias earlier patterns.
+ */
+static void generate_s3m(output &out, const options &opt)
+{
+  unsigned num_instruments = opt.samples;
+  unsigned num_patterns = opt.patterns;
+  unsigned num_orders = opt.orders;
+  char name[32];
+  unsigned i;
+
+  out.string("modgen maximal s3m", 28);
+  out.u8(0x1a);
+  out.u8(16);
+  out.u16le(0);
+  out.u16le(num_orders);
+  out.u16le(num_instruments);
+  out.u16le(num_patterns);
+  out.u16le(0);       /* flags */
+  out.u16le(0x1320);  /* Scream Tracker 3.20 */
+  out.u16le(2);       /* unsigned samples */
+  out.string("SCRM", 4);
+  out.u8(64);         /* global volume */
+  out.u8(6);          /* speed */
+  out.u8(125);        /* tempo */
+  out.u8(0x80 | 48);  /* stereo, master volume */
+  out.u8(0);
+  out.u8(0xfc);       /* panning table present */
+  out.zero(8);
+  out.u16le(0);
+  for(i = 0; i < 32; i++)
+    out.u8(i < opt.channels ? (i & 15) : 0xff);
+
+  /* 254 and 255 are markers, so only the first 254 patterns are used. */
+  for(i = 0; i < num_orders; i++)
+    out.u8(i % (num_patterns < 254 ? num_patterns : 254));
+
+  size_t instrument_ptrs = out.pos();
+  out.zero(num_instruments * 2);
+  size_t pattern_ptrs = out.pos();
+  out.zero(num_patterns * 2);
+
+  for(i = 0; i < 32; i++)
+    out.u8(0x20 | ((i & 1) ? 0x0c : 0x03));
+
+  /* Instruments. */
+  std::vector<size_t> sample_ptrs;
+  for(i = 0; i < num_instruments; i++)
+  {
+    if(opt.adversarial && i > 0)
+    {
+      out.patch_u16le(instrument_ptrs + i * 2, sample_ptrs[0] >> 4);
+      continue;
+    }
+
+    out.align(16);
+    if(out.pos() + 80 > (0xffffu << 4))
+      ERROR("instruments don't fit in 1MB; use fewer instruments.\n");
+
+    out.patch_u16le(instrument_ptrs + i * 2, out.pos() >> 4);
+    sample_ptrs.push_back(out.pos());
+
+    sample_name(name, "sample", i + 1);
+    out.u8(1);
+    out.string(name, 12);
+    out.zero(3);                  /* data segment; patched below */
+    out.u32le(opt.length);
+    out.u32le(0);
+    out.u32le(opt.length);
+    out.u8(64);
+    out.u8(0);
+    out.u8(0);
+    out.u8(1);                    /* loop */
+    out.u32le(8363);
+    out.zero(4);
+    out.u16le(1);                 /* Int:Gp; SoundBlaster */
+    out.zero(6);
+    out.string(name, 28);
+    out.string("SCRS", 4);
+  }
+
+  /* Patterns. */
+  std::vector<size_t> pattern_pos;
+  for(i = 0; i < num_patterns; i++)
+  {
+    size_t packed_size = 64 + 64 * opt.channels * 6;
+
+    out.align(16);
+    if((opt.adversarial && i > 0) ||
+       out.pos() + packed_size + 2 > (0xffffu << 4))
+    {
+      if(pattern_pos.empty())
+        ERROR("patterns don't fit in 1MB; use fewer instruments.\n");
+
+      size_t alias = pattern_pos[i % pattern_pos.size()];
+      out.patch_u16le(pattern_ptrs + i * 2, alias >> 4);
+      continue;
+    }
+
+    out.patch_u16le(pattern_ptrs + i * 2, out.pos() >> 4);
+    pattern_pos.push_back(out.pos());
+
+    out.u16le(packed_size + 2);
+    for(unsigned row = 0; row < 64; row++)
+    {
+      for(unsigned ch = 0; ch < opt.channels; ch++)
+      {
+        out.u8(0x20 | 0x40 | 0x80 | ch);
+        out.u8((rnd(8) << 4) | rnd(12));
+        out.u8(rnd(num_instruments < 99 ? num_instruments : 99) + 1);
+        out.u8(rnd(65));
+        out.u8(rnd(26) + 1);
+        out.u8(rnd(256));
+      }
+      out.u8(0);
+    }
+  }
+
+  /* Sample data. The segment is 24 bits, so this can go past 1MB. */
+  for(size_t ptr : sample_ptrs)
+  {
+    out.align(16);
+    uint32_t segment = out.pos() >> 4;
+    out.patch_u8(ptr + 13, segment >> 16);
+    out.patch_u16le(ptr + 14, segment & 0xffff);
+    sample_data(out, opt.length);
+  }
+}
+
+
+/**
+ * FastTracker 2 XM (version 0x0104). Each instrument has 16 samples.
+ * Packed pattern data is limited to 65535 bytes, which limits the number
+ * of rows in very wide patterns.
+ */
+static void generate_xm(output &out, const options &opt)
+{
+  static constexpr unsigned SAMPLES_PER_INSTRUMENT = 16;
+  unsigned num_instruments = opt.samples;
+  char name[32];
+  unsigned i;
+
+  out.string("Extended Module: ", 17);
+  out.string("modgen maximal xm", 20);
+  out.u8(0x1a);
+  out.string("modgen", 20);
+  out.u16le(0x0104);
+  out.u32le(20 + 256);
+  out.u16le(opt.orders);
+  out.u16le(0);
+  out.u16le(opt.channels);
+  out.u16le(opt.patterns);
+  out.u16le(num_instruments);
+  out.u16le(1);       /* linear slides */
+  out.u16le(6);
+  out.u16le(125);
+  for(i = 0; i < 256; i++)
+    out.u8(i < opt.orders ? i % opt.patterns : 0);
+
+  /* Patterns. */
+  for(i = 0; i < opt.patterns; i++)
+  {
+    out.u32le(9);
+    out.u8(0);
+    out.u16le(opt.rows);
+    out.u16le(opt.rows * opt.channels * 6);
+
+    for(unsigned j = 0; j < opt.rows * opt.channels; j++)
+    {
+      out.u8(0x80 | 0x1f);
+      out.u8(rnd(96) + 1);
+      out.u8(rnd(num_instruments < 128 ? num_instruments : 128) + 1);
+      out.u8(0x10 + rnd(0x41));
+      out.u8(rnd(36));
+      out.u8(rnd(256));
+    }
+  }
+
+  /* Instruments. */
+  for(i = 0; i < num_instruments; i++)
+  {
+    sample_name(name, "instrument", i + 1);
+    out.u32le(243);
+    out.string(name, 22);
+    out.u8(0);
+    out.u16le(SAMPLES_PER_INSTRUMENT);
+    out.u32le(40);
+
+    for(unsigned j = 0; j < 96; j++)
+      out.u8(j % SAMPLES_PER_INSTRUMENT);
+
+    /* Volume and panning envelopes: 12 points each. */
+    for(unsigned env = 0; env < 2; env++)
+    {
+      for(unsigned j = 0; j < 12; j++)
+      {
+        out.u16le(j * 16);
+        out.u16le(64 - j * 4);
+      }
+    }
+    out.u8(12);
+    out.u8(12);
+    out.u8(4);
+    out.u8(2);
+    out.u8(8);
+    out.u8(4);
+    out.u8(2);
+    out.u8(8);
+    out.u8(7);
+    out.u8(7);
+    out.u8(0);
+    out.u8(0x10);
+    out.u8(0x08);
+    out.u8(0x04);
+    out.u16le(0x400);
+    out.u16le(0);
+
+    unsigned stored_length = opt.length;
+    if(opt.adversarial)
+      stored_length = ((opt.length + 1) >> 1) + 16;
+
+    for(unsigned j = 0; j < SAMPLES_PER_INSTRUMENT; j++)
+    {
+      sample_name(name, "sample", j + 1);
+      out.u32le(opt.length);
+      out.u32le(0);
+      out.u32le(opt.length);
+      out.u8(64);
+      out.u8(0);
+      out.u8(1);                /* forward loop */
+      out.u8(128);
+      out.u8(0);
+      out.u8(opt.adversarial ? 0xad : 0);
+      out.string(name, 22);
+    }
+    for(unsigned j = 0; j < SAMPLES_PER_INSTRUMENT; j++)
+      sample_data_delta(out, stored_length);
+  }
+}
+
+
+/**
+ * Build a single IT compressed 8-bit sample where every block switches to
+ * a bit width of 1 and then stores every sample as a single zero bit.
+ * This is the highest compression ratio the format can express.
+ */
+static void it_compressed_sample(output &out, unsigned length)
+{
+  for(unsigned pos = 0; pos < length; pos += 0x8000)
+  {
+    unsigned count = length - pos;
+    if(count > 0x8000)
+      count = 0x8000;
+
+    unsigned num_bits = 9 + count;
+    unsigned num_bytes = (num_bits + 7) >> 3;
+
+    out.u16le(num_bytes);
+    /* Width 9 code 0x100: change width to (0x00 + 1). LSB first. */
+    out.u8(0x00);
+    out.u8(0x01);
+    out.zero(num_bytes - 2);
+  }
+}
+
+/**
+ * Impulse Tracker 2.14. Instrument mode; instruments, samples and patterns
+ * are all 32-bit offsets. Packed patterns are limited to 64k.
+ */
+static void generate_it(output &out, const options &opt)
+{
+  unsigned num_instruments = opt.samples;
+  unsigned num_samples = opt.samples;
+  char name[32];
+  unsigned i;
+
+  out.string("IMPM", 4);
+  out.string("modgen maximal it", 26);
+  out.u16le(0x1004);
+  out.u16le(opt.orders);
+  out.u16le(num_instruments);
+  out.u16le(num_samples);
+  out.u16le(opt.patterns);
+  out.u16le(0x0214);
+  out.u16le(0x0214);
+  out.u16le(0x0001 | 0x0004 | 0x0008); /* stereo, instruments, linear */
+  out.u16le(0);
+  out.u8(128);
+  out.u8(48);
+  out.u8(6);
+  out.u8(125);
+  out.u8(128);
+  out.u8(0);
+  out.u16le(0);
+  out.u32le(0);
+  out.u32le(0);
+  for(i = 0; i < 64; i++)
+    out.u8(i < opt.channels ? 32 : 0xa0);
+  for(i = 0; i < 64; i++)
+    out.u8(64);
+
+  /* 254 and 255 are markers, so only the first 200 patterns are used. */
+  for(i = 0; i < opt.orders; i++)
+    out.u8(i % (opt.patterns < 200 ? opt.patterns : 200));
+
+  size_t instrument_ptrs = out.pos();
+  out.zero(num_instruments * 4);
+  size_t sample_ptrs = out.pos();
+  out.zero(num_samples * 4);
+  size_t pattern_ptrs = out.pos();
+  out.zero(opt.patterns * 4);
+  out.u16le(0);
+
+  /* Instruments. */
+  size_t first_instrument = 0;
+  for(i = 0; i < num_instruments; i++)
+  {
+    if(opt.adversarial && i > 0)
+    {
+      out.patch_u32le(instrument_ptrs + i * 4, first_instrument);
+      continue;
+    }
+    first_instrument = out.pos();
+    out.patch_u32le(instrument_ptrs + i * 4, out.pos());
+
+    sample_name(name, "instrument", i + 1);
+    out.string("IMPI", 4);
+    out.zero(13);
+    out.u8(1);          /* NNA: continue */
+    out.u8(1);          /* DCT: note */
+    out.u8(0);          /* DCA: cut */
+    out.u16le(256);
+    out.u8(0);
+    out.u8(60);
+    out.u8(128);
+    out.u8(0x80 | 32);
+    out.u8(0);
+    out.u8(0);
+    out.u16le(0x0214);
+    out.u8(1);
+    out.u8(0);
+    out.string(name, 26);
+    out.u8(0);
+    out.u8(0);
+    out.u8(0);
+    out.u8(0);
+    out.u16le(0xffff);
+
+    for(unsigned j = 0; j < 120; j++)
+    {
+      out.u8(j);
+      out.u8((i % (num_samples < 99 ? num_samples : 99)) + 1);
+    }
+
+    /* Volume, panning, and pitch envelopes: all 25 nodes. */
+    for(unsigned env = 0; env < 3; env++)
+    {
+      out.u8(0x01 | 0x02 | 0x04);
+      out.u8(25);
+      out.u8(4);
+      out.u8(20);
+      out.u8(8);
+      out.u8(12);
+      for(unsigned j = 0; j < 25; j++)
+      {
+        out.u8(env == 0 ? 64 - j * 2 : j);
+        out.u16le(j * 8);
+      }
+      out.u8(0);
+    }
+    out.zero(4);
+  }
+
+  /* Sample headers. */
+  std::vector<size_t> sample_pos;
+  for(i = 0; i < num_samples; i++)
+  {
+    out.patch_u32le(sample_ptrs + i * 4, out.pos());
+    sample_pos.push_back(out.pos());
+
+    sample_name(name, "sample", i + 1);
+    out.string("IMPS", 4);
+    out.zero(13);
+    out.u8(64);
+    out.u8(0x01 | 0x10 | (opt.adversarial ? 0x08 : 0));
+    out.u8(64);
+    out.string(name, 26);
+    out.u8(0x01);       /* signed */
+    out.u8(32);
+    out.u32le(opt.length);
+    out.u32le(0);
+    out.u32le(opt.length);
+    out.u32le(8363);
+    out.u32le(0);
+    out.u32le(0);
+    out.u32le(0);       /* sample data; patched below */
+    out.u8(0);
+    out.u8(0);
+    out.u8(0);
+    out.u8(0);
+  }
+
+  /* Patterns. Store the mask byte for every event. */
+  size_t first_pattern = 0;
+  for(i = 0; i < opt.patterns; i++)
+  {
+    if(opt.adversarial && i > 0)
+    {
+      out.patch_u32le(pattern_ptrs + i * 4, first_pattern);
+      continue;
+    }
+    first_pattern = out.pos();
+    out.patch_u32le(pattern_ptrs + i * 4, out.pos());
+
+    out.u16le(opt.rows * (opt.channels * 7 + 1));
+    out.u16le(opt.rows);
+    out.u32le(0);
+
+    for(unsigned row = 0; row < opt.rows; row++)
+    {
+      for(unsigned ch = 0; ch < opt.channels; ch++)
+      {
+        out.u8(0x80 | (ch + 1));
+        out.u8(0x01 | 0x02 | 0x04 | 0x08);
+        out.u8(rnd(120));
+        out.u8(rnd(num_instruments < 99 ? num_instruments : 99) + 1);
+        out.u8(rnd(65));
+        out.u8(rnd(26) + 1);
+        out.u8(rnd(256));
+      }
+      out.u8(0);
+    }
+  }
+
+  /* Sample data. */
+  size_t first_data = 0;
+  for(i = 0; i < num_samples; i++)
+  {
+    if(opt.adversarial && i > 0)
+    {
+      out.patch_u32le(sample_pos[i] + 72, first_data);
+      continue;
+    }
+    first_data = out.pos();
+    out.patch_u32le(sample_pos[i] + 72, out.pos());
+
+    if(opt.adversarial)
+      it_compressed_sample(out, opt.length);
+    else
+      sample_data(out, opt.length);
+  }
+}
+
+
+/**
+ * OctaMED MMD1. Big endian; every structure is located by a 32-bit offset.
+ */
+static void generate_med(output &out, const options &opt)
+{
+  unsigned i;
+
+  out.string("MMD1", 4);
+  size_t file_length = out.pos();
+  out.u32be(0);
+  out.u32be(52);        /* song */
+  out.u32be(0);
+  size_t block_array_ptr = out.pos();
+  out.u32be(0);
+  out.u32be(0);
+  size_t sample_array_ptr = out.pos();
+  out.u32be(0);
+  out.u32be(0);
+  out.u32be(0);         /* expansion */
+  out.u32be(0);
+  out.zero(12);
+
+  /* Song. */
+  for(i = 0; i < 63; i++)
+  {
+    out.u16be(0);
+    out.u16be((opt.length + 1) >> 1);
+    out.u8(0);
+    out.u8(0);
+    out.u8(64);
+    out.u8(0);
+  }
+  out.u16be(opt.patterns);
+  out.u16be(opt.orders);
+  for(i = 0; i < 256; i++)
+    out.u8(i < opt.orders ? i % opt.patterns : 0);
+  out.u16be(125);
+  out.u8(0);
+  out.u8(0x20);         /* 8 channel mode off, volume hex */
+  out.u8(0);
+  out.u8(6);
+  for(i = 0; i < 16; i++)
+    out.u8(64);
+  out.u8(64);
+  out.u8(opt.samples);
+
+  /* Block array. */
+  out.align(4);
+  out.patch_u32be(block_array_ptr, out.pos());
+  size_t blocks = out.pos();
+  out.zero(opt.patterns * 4);
+
+  size_t first_block = 0;
+  for(i = 0; i < opt.patterns; i++)
+  {
+    if(opt.adversarial && i > 0)
+    {
+      out.patch_u32be(blocks + i * 4, first_block);
+      continue;
+    }
+    first_block = out.pos();
+    out.patch_u32be(blocks + i * 4, out.pos());
+
+    out.u16be(opt.channels);
+    out.u16be(opt.rows - 1);
+    out.u32be(0);
+    for(unsigned j = 0; j < opt.rows * opt.channels; j++)
+    {
+      out.u8(rnd(72) + 1);
+      out.u8(rnd(opt.samples) + 1);
+      out.u8(rnd(0x20));
+      out.u8(rnd(256));
+    }
+  }
+
+  /* Instruments. */
+  out.align(4);
+  out.patch_u32be(sample_array_ptr, out.pos());
+  size_t instruments = out.pos();
+  out.zero(opt.samples * 4);
+
+  for(i = 0; i < opt.samples; i++)
+  {
+    out.align(4);
+    out.patch_u32be(instruments + i * 4, out.pos());
+    out.u32be(opt.length);
+    out.u16be(0);       /* sample */
+    sample_data(out, opt.length);
+  }
+  out.patch_u32be(file_length, out.pos());
+}
+
+
+/**
+ * Desktop Tracker. Little endian, uncompressed patterns and samples.
+ */
+static void generate_dtt(output &out, const options &opt)
+{
+  char name[32];
+  unsigned i;
+
+  out.string("DskT", 4);
+  out.string("modgen maximal dtt", 64);
+  out.string("modgen", 64);
+  out.u32le(0);
+  out.u32le(opt.channels);
+  out.u32le(opt.orders);
+  for(i = 0; i < 8; i++)
+    out.u8((i & 1) ? 0x60 : 0x20);
+  out.u32le(6);
+  out.u32le(0);
+  out.u32le(opt.patterns);
+  out.u32le(opt.samples);
+
+  for(i = 0; i < opt.orders; i++)
+    out.u8(i % opt.patterns);
+  out.align(4);
+
+  size_t pattern_ptrs = out.pos();
+  out.zero(opt.patterns * 4);
+  for(i = 0; i < opt.patterns; i++)
+    out.u8(opt.rows);
+  out.align(4);
+
+  std::vector<size_t> sample_pos;
+  for(i = 0; i < opt.samples; i++)
+  {
+    sample_pos.push_back(out.pos());
+    sample_name(name, "sample", i + 1);
+    out.u8(24);
+    out.u8(255);
+    out.u16le(0);
+    out.u32le(428);
+    out.u32le(0);
+    out.u32le(0);
+    out.u32le(0);
+    out.u32le(opt.length);
+    out.u32le(opt.length);
+    out.string(name, 32);
+    out.u32le(0);       /* sample data; patched below */
+  }
+
+  size_t first_pattern = 0;
+  for(i = 0; i < opt.patterns; i++)
+  {
+    if(opt.adversarial && i > 0)
+    {
+      out.patch_u32le(pattern_ptrs + i * 4, first_pattern);
+      continue;
+    }
+    first_pattern = out.pos();
+    out.patch_u32le(pattern_ptrs + i * 4, out.pos());
+
+    for(unsigned j = 0; j < opt.rows * opt.channels; j++)
+    {
+      uint32_t a = (rnd(opt.samples) + 1) | ((rnd(63) + 1) << 6) | (rnd(32) << 12);
+      if(opt.adversarial)
+      {
+        /* Force a second effect so every event takes the multi-effect path. */
+        a |= ((rnd(31) + 1) << 17) | (rnd(32) << 22);
+        out.u32le(a);
+        out.u32le(rnd(0));
+      }
+      else
+        out.u32le(a);
+    }
+  }
+
+  for(i = 0; i < opt.samples; i++)
+  {
+    out.patch_u32le(sample_pos[i] + 60, out.pos());
+    sample_data(out, opt.length);
+    out.align(4);
+  }
+}
+
+
+/**
+ * Archimedes Tracker MUSX. Little endian IFF with byte padding; each SAMP
+ * chunk is a container of sample subchunks.
+ */
+static constexpr unsigned MUSX_FILLER_CHUNKS = 4096;
+
+static size_t musx_chunk(output &out, const char *id)
+{
+  out.tag(id);
+  size_t len_pos = out.pos();
+  out.u32le(0);
+  return len_pos;
+}
+
+static void musx_end_chunk(output &out, size_t len_pos)
+{
+  out.patch_u32le(len_pos, out.pos() - len_pos - 4);
+}
+
+static void musx_u32_chunk(output &out, const char *id, uint32_t value)
+{
+  size_t len_pos = musx_chunk(out, id);
+  out.u32le(value);
+  musx_end_chunk(out, len_pos);
+}
+
+static void generate_musx(output &out, const options &opt)
+{
+  char name[32];
+  unsigned i;
+  size_t chunk;
+
+  out.tag("MUSX");
+  size_t file_length = out.pos();
+  out.u32le(0);
+
+  musx_u32_chunk(out, "TINF", 0);
+  musx_u32_chunk(out, "MVOX", opt.channels);
+
+  chunk = musx_chunk(out, "STER");
+  for(i = 0; i < 8; i++)
+    out.u8((i & 1) ? 6 : 2);
+  musx_end_chunk(out, chunk);
+
+  chunk = musx_chunk(out, "MNAM");
+  out.string("modgen maximal musx", 32);
+  musx_end_chunk(out, chunk);
+
+  chunk = musx_chunk(out, "ANAM");
+  out.string("modgen", 32);
+  musx_end_chunk(out, chunk);
+
+  musx_u32_chunk(out, "MLEN", opt.orders);
+  musx_u32_chunk(out, "PNUM", opt.patterns);
+
+  chunk = musx_chunk(out, "PLEN");
+  for(i = 0; i < 64; i++)
+    out.u8(i < opt.patterns ? opt.rows : 0);
+  musx_end_chunk(out, chunk);
+
+  chunk = musx_chunk(out, "SEQU");
+  for(i = 0; i < 128; i++)
+    out.u8(i < opt.orders ? i % opt.patterns : 0);
+  musx_end_chunk(out, chunk);
+
+  for(i = 0; i < opt.patterns; i++)
+  {
+    chunk = musx_chunk(out, "PATT");
+    for(unsigned j = 0; j < opt.rows * opt.channels; j++)
+    {
+      out.u8(rnd(256));
+      out.u8(rnd(32));
+      out.u8(rnd(opt.samples) + 1);
+      out.u8(rnd(36) + 1);
+    }
+    musx_end_chunk(out, chunk);
+  }
+
+  for(i = 0; i < opt.samples; i++)
+  {
+    size_t samp = musx_chunk(out, "SAMP");
+
+    chunk = musx_chunk(out, "SNAM");
+    sample_name(name, "sample", i + 1);
+    out.string(name, 20);
+    musx_end_chunk(out, chunk);
+
+    musx_u32_chunk(out, "SVOL", 0xff);
+    musx_u32_chunk(out, "SLEN", opt.length);
+    musx_u32_chunk(out, "ROFS", 0);
+    musx_u32_chunk(out, "RLEN", opt.length);
+
+    if(opt.adversarial)
+    {
+      /* Empty chunks no handler knows: a header read, a seek and a
+       * warning per 8 bytes of input. */
+      for(unsigned j = 0; j < MUSX_FILLER_CHUNKS; j++)
+        musx_end_chunk(out, musx_chunk(out, "FILL"));
+    }
+
+    chunk = musx_chunk(out, "SDAT");
+    sample_data(out, opt.length);
+    musx_end_chunk(out, chunk);
+
+    musx_end_chunk(out, samp);
+  }
+  out.patch_u32le(file_length, out.pos() - 8);
+}
+
+
+static bool parse_value(const char *arg, const char *name, unsigned &value)
+{
+  size_t len = strlen(name);
+  if(strncmp(arg, name, len) || arg[len] != '=')
+    return false;
+
+  char *end;
+  unsigned long tmp = strtoul(arg + len + 1, &end, 0);
+  if(!isdigit((unsigned char)arg[len + 1]) || *end)
+    ERROR("invalid value for %s: %s\n", name, arg + len + 1);
+
+  value = tmp;
+  return true;
+}
+
+static void check_value(const char *format, const char *name,
+ unsigned value, unsigned min, unsigned max)
+{
+  if(value < min || value > max)
+    ERROR("%s: %s must be %u through %u (got %u)\n", format, name, min, max, value);
+}
+
+int main(int argc, char *argv[])
+{
+  static constexpr unsigned UNSET = ~0u;
+  options opt{};
+  unsigned seed = 1;
+  int i;
+
+  if(argc < 2)
+  {
+    fprintf(stderr, "%s", USAGE);
+    return 0;
+  }
+
+  for(i = 0; i < NUM_FORMATS; i++)
+    if(!strcmp(argv[1], MAXIMUM[i].name))
+      break;
+
+  if(i >= NUM_FORMATS)
+    ERROR("unknown format '%s'\n", argv[1]);
+
+  opt.format = static_cast<format>(i);
+  opt.channels = UNSET;
+  opt.patterns = UNSET;
+  opt.rows = UNSET;
+  opt.orders = UNSET;
+  opt.samples = UNSET;
+  opt.length = UNSET;
+
+  for(i = 2; i < argc; i++)
+  {
+    const char *arg = argv[i];
+
+    if(!strcmp(arg, "-a") || !strcmp(arg, "--adversarial"))
+    {
+      opt.adversarial = true;
+      continue;
+    }
+
+    if(parse_value(arg, "--channels", opt.channels) ||
+       parse_value(arg, "--patterns", opt.patterns) ||
+       parse_value(arg, "--rows", opt.rows) ||
+       parse_value(arg, "--orders", opt.orders) ||
+       parse_value(arg, "--samples", opt.samples) ||
+       parse_value(arg, "--length", opt.length) ||
+       parse_value(arg, "--seed", seed))
+      continue;
+
+    ERROR("unknown option '%s'\n", arg);
+  }
+
+  const limits &max = MAXIMUM[opt.format];
+  const limits &def = opt.adversarial ? ADVERSARIAL[opt.format] : DEFAULTS[opt.format];
+
+  if(opt.channels == UNSET)
+    opt.channels = def.channels;
+  if(opt.patterns == UNSET)
+    opt.patterns = def.patterns;
+  if(opt.orders == UNSET)
+    opt.orders = def.orders;
+  if(opt.samples == UNSET)
+    opt.samples = def.samples;
+  if(opt.length == UNSET)
+    opt.length = def.length;
+
+  check_value(max.name, "channels", opt.channels, 1, max.channels);
+  check_value(max.name, "patterns", opt.patterns, 1, max.patterns);
+  check_value(max.name, "orders", opt.orders, 1, max.orders);
+  check_value(max.name, "samples", opt.samples, 1, max.samples);
+  check_value(max.name, "length", opt.length, 16, max.length);
+
+  /* Packed XM and IT patterns are limited to 64k, so the default row
+   * count is however many full rows fit. */
+  unsigned max_rows = max.rows;
+  if(opt.format == FMT_XM)
+    max_rows = 65535 / (opt.channels * 6);
+  else
+
+  if(opt.format == FMT_IT)
+    max_rows = 65535 / (opt.channels * 7 + 1);
+
+  if(max_rows > max.rows)
+    max_rows = max.rows;
+
+  if(opt.rows == UNSET)
+    opt.rows = (def.rows < max_rows) ? def.rows : max_rows;
+
+  check_value(max.name, "rows", opt.rows, 1, max_rows);
+
+  if(opt.format == FMT_MOD && opt.rows != 64)
+    ERROR("mod: rows must be 64\n");
+  if(opt.format == FMT_S3M && opt.rows != 64)
+    ERROR("s3m: rows must be 64\n");
+
+  rng_state = seed ? seed : 1;
+
+  DEBUG("%s%s: %u channels, %u patterns, %u rows, %u orders, %u samples of %u\n",
+    max.name, opt.adversarial ? " (adversarial)" : "", opt.channels,
+    opt.patterns, opt.rows, opt.orders, opt.samples, opt.length);
+
+  output out;
+  switch(opt.format)
+  {
+    case FMT_MOD: generate_mod(out, opt); break;
+    case FMT_S3M: generate_s3m(out, opt); break;
+    case FMT_XM:  generate_xm(out, opt);  break;
+    case FMT_IT:  generate_it(out, opt);  break;
+    case FMT_MED: generate_med(out, opt); break;
+    case FMT_DTT: generate_dtt(out, opt); break;
+    case FMT_MUSX: generate_musx(out, opt); break;
+    case NUM_FORMATS: break;
+  }
+
+#ifdef _WIN32
+  _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+  out.write(stdout);
+  return 0;
+}
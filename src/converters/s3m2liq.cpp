@@ -26,6 +26,8 @@
 #include <string.h>
 #include <vector>
 
+#include "../common.hpp"
+
 #define NAME_STRING           "s3m2liq"
 #define NAME_VERSION_STRING   NAME_STRING " 1.0.0"
 #define AUTHOR_STRING         "IGNORED THE MESSAGE"
@@ -312,29 +314,96 @@ struct liq_header
   uint8_t   order[256];
 };
 
-static uint16_t read_u16le(const uint8_t *data)
-{
-  return data[0] | (data[1] << 8);
-}
-
-static uint32_t read_u32le(const uint8_t *data)
-{
-  return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24u);
-}
-
-static void write_u16le(uint8_t *data, uint16_t value)
-{
-  data[0] = value & 0xff;
-  data[1] = value >> 8;
-}
-
-static void write_u32le(uint8_t *data, uint32_t value)
-{
-  data[0] = value & 0xff;
-  data[1] = value >> 8;
-  data[2] = value >> 16;
-  data[3] = value >> 24;
-}
+using s3m_header_layout = layout::record<s3m_header, 96,
+  layout::bytes<&s3m_header::name,               0>,
+  layout::u8   <&s3m_header::eof,               28>,
+  layout::u8   <&s3m_header::type,              29>,
+  layout::u16le<&s3m_header::reserved,          30>,
+  layout::u16le<&s3m_header::num_orders,        32>,
+  layout::u16le<&s3m_header::num_instruments,   34>,
+  layout::u16le<&s3m_header::num_patterns,      36>,
+  layout::u16le<&s3m_header::flags,             38>,
+  layout::u16le<&s3m_header::cwtv,              40>,
+  layout::u16le<&s3m_header::ffi,               42>,
+  layout::bytes<&s3m_header::magic,             44>,
+  layout::u8   <&s3m_header::global_volume,     48>,
+  layout::u8   <&s3m_header::initial_speed,     49>,
+  layout::u8   <&s3m_header::initial_bpm,       50>,
+  layout::u8   <&s3m_header::mix_volume,        51>,
+  layout::u8   <&s3m_header::click_removal,     52>,
+  layout::u8   <&s3m_header::has_panning_table, 53>,
+  layout::bytes<&s3m_header::reserved2,         54>,
+  layout::u16le<&s3m_header::special_seg,       62>,
+  layout::bytes<&s3m_header::channel_settings,  64>>;
+
+/* data_seg is mixed-endian and is decoded separately. */
+using s3m_instrument_layout = layout::record<s3m_instrument, 80,
+  layout::u8   <&s3m_instrument::type,            0>,
+  layout::bytes<&s3m_instrument::filename,        1>,
+  layout::u32le<&s3m_instrument::length,         16>,
+  layout::u32le<&s3m_instrument::loopstart,      20>,
+  layout::u32le<&s3m_instrument::loopend,        24>,
+  layout::u8   <&s3m_instrument::default_volume, 28>,
+  layout::u8   <&s3m_instrument::dsk,            29>,
+  layout::u8   <&s3m_instrument::packing,        30>,
+  layout::u8   <&s3m_instrument::flags,          31>,
+  layout::u32le<&s3m_instrument::rate,           32>,
+  layout::u32le<&s3m_instrument::reserved,       36>,
+  layout::u16le<&s3m_instrument::int_gp,         40>,
+  layout::u16le<&s3m_instrument::int_512,        42>,
+  layout::u32le<&s3m_instrument::int_lastpos,    44>,
+  layout::bytes<&s3m_instrument::name,           48>,
+  layout::bytes<&s3m_instrument::magic,          76>>;
+
+using ldss_layout = layout::record<ldss, 0x90,
+  layout::bytes<&ldss::magic,            0>,
+  layout::u16le<&ldss::version,          4>,
+  layout::bytes<&ldss::name,             6>,
+  layout::bytes<&ldss::software,        36>,
+  layout::bytes<&ldss::author,          56>,
+  layout::u8   <&ldss::sound_board,     76>,
+  layout::u32le<&ldss::length,          77>,
+  layout::u32le<&ldss::loopstart,       81>,
+  layout::u32le<&ldss::loopend,         85>,
+  layout::u32le<&ldss::rate,            89>,
+  layout::u8   <&ldss::default_volume,  93>,
+  layout::u8   <&ldss::flags,           94>,
+  layout::u8   <&ldss::default_pan,     95>,
+  layout::u8   <&ldss::midi_patch,      96>,
+  layout::u8   <&ldss::global_volume,   97>,
+  layout::u8   <&ldss::chord_type,      98>,
+  layout::u16le<&ldss::header_bytes,    99>,
+  layout::u16le<&ldss::compression,    101>,
+  layout::u32le<&ldss::crc32,          103>,
+  layout::u8   <&ldss::midi_channel,   107>,
+  layout::u8   <&ldss::loop_type,      108>,
+  layout::bytes<&ldss::reserved,       109>,
+  layout::bytes<&ldss::filename,       119>>;
+
+using liq_pattern_layout = layout::record<liq_pattern, 44,
+  layout::bytes<&liq_pattern::magic,        0>,
+  layout::bytes<&liq_pattern::name,         4>,
+  layout::u16le<&liq_pattern::num_rows,    34>,
+  layout::u32le<&liq_pattern::packed_size, 36>,
+  layout::u32le<&liq_pattern::reserved,    40>>;
+
+using liq_header_layout = layout::record<liq_header, 0x6d,
+  layout::bytes<&liq_header::magic,             0>,
+  layout::bytes<&liq_header::name,             14>,
+  layout::bytes<&liq_header::author,           44>,
+  layout::u8   <&liq_header::eof,              64>,
+  layout::bytes<&liq_header::tracker,          65>,
+  layout::u16le<&liq_header::format_version,   85>,
+  layout::u16le<&liq_header::initial_speed,    87>,
+  layout::u16le<&liq_header::initial_bpm,      89>,
+  layout::u16le<&liq_header::lowest_note,      91>,
+  layout::u16le<&liq_header::highest_note,     93>,
+  layout::u16le<&liq_header::num_channels,     95>,
+  layout::u32le<&liq_header::flags,            97>,
+  layout::u16le<&liq_header::num_patterns,    101>,
+  layout::u16le<&liq_header::num_instruments, 103>,
+  layout::u16le<&liq_header::num_orders,      105>,
+  layout::u16le<&liq_header::header_size,     107>>;
 
 template<int N>
 static size_t s3m_strlen(const uint8_t (&buf)[N])
@@ -357,7 +426,7 @@ static bool load_s3m_header(s3m_header &s3m, FILE *in)
   uint8_t buf[512];
   size_t i;
 
-  if(fread(buf, 1, 96, in) < 96)
+  if(fread(buf, 1, s3m_header_layout::size, in) < s3m_header_layout::size)
   {
     ERROR("read error on input");
     return false;
@@ -368,25 +437,7 @@ static bool load_s3m_header(s3m_header &s3m, FILE *in)
     return false;
   }
 
-  memcpy(s3m.name, buf, 28);
-  s3m.eof = buf[28];
-  s3m.type = buf[29];
-  s3m.reserved = read_u16le(buf + 30);
-  s3m.num_orders = read_u16le(buf + 32);
-  s3m.num_instruments = read_u16le(buf + 34);
-  s3m.num_patterns = read_u16le(buf + 36);
-  s3m.flags = read_u16le(buf + 38);
-  s3m.cwtv = read_u16le(buf + 40);
-  s3m.ffi = read_u16le(buf + 42);
-  s3m.global_volume = buf[48];
-  s3m.initial_speed = buf[49];
-  s3m.initial_bpm = buf[50];
-  s3m.mix_volume = buf[51];
-  s3m.click_removal = buf[52];
-  s3m.has_panning_table = buf[53];
-  memcpy(s3m.reserved2, buf + 54, 8);
-  s3m.special_seg = read_u16le(buf + 62);
-  memcpy(s3m.channel_settings, buf + 64, 32);
+  s3m_header_layout::decode(s3m, buf);
 
   if(s3m.num_orders > 256)
   {
@@ -418,7 +469,7 @@ static bool load_s3m_header(s3m_header &s3m, FILE *in)
     return false;
   }
   for(i = 0; i < s3m.num_instruments; i++)
-    s3m.instrument_seg[i] = read_u16le(buf + i * 2);
+    s3m.instrument_seg[i] = mem_u16le(buf + i * 2);
 
   /* Pattern parapointers */
   if(fread(buf, 2, s3m.num_patterns, in) < s3m.num_patterns)
@@ -427,7 +478,7 @@ static bool load_s3m_header(s3m_header &s3m, FILE *in)
     return false;
   }
   for(i = 0; i < s3m.num_patterns; i++)
-    s3m.pattern_seg[i] = read_u16le(buf + i * 2);
+    s3m.pattern_seg[i] = mem_u16le(buf + i * 2);
 
   /* Panning table */
   if(s3m.has_panning_table == 252)
@@ -538,7 +589,7 @@ static bool load_s3m_pattern(std::vector<event> &events,
 static bool load_s3m_instrument(s3m_instrument &ins, std::vector<uint8_t> &data,
  unsigned seg, FILE *in)
 {
-  uint8_t buf[80];
+  uint8_t buf[s3m_instrument_layout::size];
 
   if(!seg)
     return true;
@@ -549,34 +600,20 @@ static bool load_s3m_instrument(s3m_instrument &ins, std::vector<uint8_t> &data,
     return false;
   }
 
-  if(fread(buf, 1, 80, in) < 80)
+  if(fread(buf, 1, sizeof(buf), in) < sizeof(buf))
   {
     ERROR("read error on input");
     return false;
   }
 
-  ins.type = buf[0];
+  s3m_instrument_layout::decode(ins, buf);
   if(ins.type >= 2)
   {
     ERROR("unsupported adlib instrument");
     return false;
   }
 
-  memcpy(ins.filename, buf + 1, 12);
-  ins.data_seg = read_u16le(buf + 14) | (buf[13] << 16);
-  ins.length = read_u32le(buf + 16);
-  ins.loopstart = read_u32le(buf + 20);
-  ins.loopend = read_u32le(buf + 24);
-  ins.default_volume = buf[28];
-  ins.dsk = buf[29];
-  ins.packing = buf[30];
-  ins.flags = buf[31];
-  ins.rate = read_u32le(buf + 32);
-  ins.reserved = read_u32le(buf + 36);
-  ins.int_gp = read_u16le(buf + 40);
-  ins.int_512 = read_u16le(buf + 42);
-  ins.int_lastpos = read_u32le(buf + 44);
-  memcpy(ins.name, buf + 48, 28);
+  ins.data_seg = mem_u16le(buf + 14) | (buf[13] << 16);
 
   if(ins.type != 1 || !ins.data_seg)
   {
@@ -1030,129 +1067,46 @@ static bool convert_s3m_instrument(ldss &ls, const s3m_header &s3m,
 
 /** Output LIQ */
 
-static bool write_liq_header(const liq_header &liq, FILE *out)
+static bool write_liq_header(const liq_header &liq, mem_writer &out)
 {
-  uint8_t buf[0x6d];
-  memcpy(buf + 0, liq.magic, 14);
-  memcpy(buf + 14, liq.name, 30);
-  memcpy(buf + 44, liq.author, 20);
-  buf[64] = liq.eof;
-  memcpy(buf + 65, liq.tracker, 20);
-  write_u16le(buf + 85, liq.format_version);
-  write_u16le(buf + 87, liq.initial_speed);
-  write_u16le(buf + 89, liq.initial_bpm);
-  write_u16le(buf + 91, liq.lowest_note);
-  write_u16le(buf + 93, liq.highest_note);
-  write_u16le(buf + 95, liq.num_channels);
-  write_u32le(buf + 97, liq.flags);
-  write_u16le(buf + 101, liq.num_patterns);
-  write_u16le(buf + 103, liq.num_instruments);
-  write_u16le(buf + 105, liq.num_orders);
-  write_u16le(buf + 107, liq.header_size);
-
-  if(fwrite(buf, 1, sizeof(buf), out) < sizeof(buf))
-  {
-    ERROR("write error on output");
-    return false;
-  }
-  if(fwrite(liq.initial_pan, 1, liq.num_channels, out) < liq.num_channels)
-  {
-    ERROR("write error on output (initial pan)");
-    return false;
-  }
-  if(fwrite(liq.initial_volume, 1, liq.num_channels, out) < liq.num_channels)
-  {
-    ERROR("write error on output (initial volume)");
-    return false;
-  }
-  if(fwrite(liq.order, 1, liq.num_orders, out) < liq.num_orders)
-  {
-    ERROR("write error on output (sequence)");
-    return false;
-  }
-  if(ftell(out) != (long)liq.header_size)
+  liq_header_layout::encode(out.append(liq_header_layout::size), liq);
+
+  out.write(liq.initial_pan, liq.num_channels);
+  out.write(liq.initial_volume, liq.num_channels);
+  out.write(liq.order, liq.num_orders);
+
+  if(out.tell() != (size_t)liq.header_size)
   {
-    ERROR("internal error: pos is %ld but should be %u", ftell(out), liq.header_size);
+    ERROR("internal error: pos is %zu but should be %u", out.tell(), liq.header_size);
     return false;
   }
   return true;
 }
 
-static bool write_liq_pattern(const liq_pattern &lp,
- const std::vector<uint8_t> &data, FILE *out)
+static void write_liq_pattern(const liq_pattern &lp,
+ const std::vector<uint8_t> &data, mem_writer &out)
 {
   if(!memcmp(lp.magic, "!!!!", 4))
   {
-    fputs("!!!!", out);
-    return true;
+    out.puts("!!!!");
+    return;
   }
 
-  uint8_t buf[44];
-  memcpy(buf + 0, lp.magic, 4);
-
-  memcpy(buf + 4, lp.name, 30);
-  write_u16le(buf + 34, lp.num_rows);
-  write_u32le(buf + 36, lp.packed_size);
-  write_u32le(buf + 40, lp.reserved);
-
-  if(fwrite(buf, 1, sizeof(buf), out) < sizeof(buf))
-  {
-    ERROR("write error on output");
-    return false;
-  }
-  if(fwrite(data.data(), 1, data.size(), out) < data.size())
-  {
-    ERROR("write error on output (pattern data)");
-    return false;
-  }
-  return true;
+  liq_pattern_layout::encode(out.append(liq_pattern_layout::size), lp);
+  out.write(data.data(), data.size());
 }
 
-static bool write_liq_instrument(const ldss &ls,
- const std::vector<uint8_t> &data, FILE *out)
+static void write_liq_instrument(const ldss &ls,
+ const std::vector<uint8_t> &data, mem_writer &out)
 {
   if(!memcmp(ls.magic, "????", 4))
   {
-    fputs("????", out);
-    return true;
+    out.puts("????");
+    return;
   }
 
-  uint8_t buf[0x90];
-  memcpy(buf + 0, ls.magic, 4);
-  write_u16le(buf + 4, ls.version);
-  memcpy(buf + 6, ls.name, 30);
-  memcpy(buf + 36, ls.software, 20);
-  memcpy(buf + 56, ls.author, 20);
-  buf[76] = ls.sound_board;
-  write_u32le(buf + 77, ls.length);
-  write_u32le(buf + 81, ls.loopstart);
-  write_u32le(buf + 85, ls.loopend);
-  write_u32le(buf + 89, ls.rate);
-  buf[93] = ls.default_volume;
-  buf[94] = ls.flags;
-  buf[95] = ls.default_pan;
-  buf[96] = ls.midi_patch;
-  buf[97] = ls.global_volume;
-  buf[98] = ls.chord_type;
-  write_u16le(buf + 99, ls.header_bytes);
-  write_u16le(buf + 101, ls.compression);
-  write_u32le(buf + 103, ls.crc32);
-  buf[107] = ls.midi_channel;
-  buf[108] = ls.loop_type;
-  memcpy(buf + 109, ls.reserved, 10);
-  memcpy(buf + 119, ls.filename, 25);
-
-  if(fwrite(buf, 1, sizeof(buf), out) < sizeof(buf))
-  {
-    ERROR("write error on output");
-    return false;
-  }
-  if(fwrite(data.data(), 1, data.size(), out) < data.size())
-  {
-    ERROR("write error on output (sample data)");
-    return false;
-  }
-  return true;
+  ldss_layout::encode(out.append(ldss_layout::size), ls);
+  out.write(data.data(), data.size());
 }
 
 
@@ -1178,6 +1132,7 @@ int main(int argc, char *argv[])
 {
   std::vector<event> events;
   std::vector<uint8_t> data;
+  mem_writer out(1 << 20);
   char path[1024];
 
   fprintf(stderr,
@@ -1212,7 +1167,6 @@ int main(int argc, char *argv[])
   for(int i = 1; i < argc; i++)
   {
     FILE *in;
-    FILE *out;
     char *extpos;
     size_t len;
 
@@ -1249,16 +1203,11 @@ int main(int argc, char *argv[])
     else
       snprintf(path, sizeof(path), "%s.liq", argv[i]);
 
-    out = fopen(path, "wb");
-    if(!out)
-    {
-      ERROR("failed to fopen '%s' output file '%s'", argv[i], path);
-      goto err_close;
-    }
+    out.clear();
     if(!write_liq_header(liq, out))
     {
       ERROR("failed to convert '%s'", argv[i]);
-      goto err_close2;
+      goto err_close;
     }
 
     // Convert and copy patterns
@@ -1267,12 +1216,12 @@ int main(int argc, char *argv[])
       liq_pattern lp{};
 
       if(!load_s3m_pattern(events, data, s3m.pattern_seg[j], in) ||
-         !convert_s3m_pattern(liq, lp, events, data) ||
-         !write_liq_pattern(lp, data, out))
+         !convert_s3m_pattern(liq, lp, events, data))
       {
         ERROR("failed to convert '%s' pattern %zu", argv[i], j);
-        goto err_close2;
+        goto err_close;
       }
+      write_liq_pattern(lp, data, out);
     }
 
     // Convert and copy instruments
@@ -1282,18 +1231,22 @@ int main(int argc, char *argv[])
       ldss ls{};
 
       if(!load_s3m_instrument(ins, data, s3m.instrument_seg[k], in) ||
-         !convert_s3m_instrument(ls, s3m, ins, data) ||
-         !write_liq_instrument(ls, data, out))
+         !convert_s3m_instrument(ls, s3m, ins, data))
       {
         ERROR("failed to convert '%s' instrument %zu", argv[i], k);
-        goto err_close2;
+        goto err_close;
       }
+      write_liq_instrument(ls, data, out);
+    }
+
+    if(!out.save(path))
+    {
+      ERROR("failed to write '%s' output file '%s'", argv[i], path);
+      goto err_close;
     }
     fprintf(stderr, "OK\n");
     fflush(stderr);
 
-err_close2:
-    fclose(out);
 err_close:
     fclose(in);
   }
@@ -0,0 +1,145 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Digital Symphony sigma delta sample encoder for a fixed max runlength.
+ * Shared by dsymgen and the SigmaDelta decoder test.
+ */
+
+#ifndef MZXTEST_CONVERTERS_SIGMA_DELTA_HPP
+#define MZXTEST_CONVERTERS_SIGMA_DELTA_HPP
+
+#include <assert.h>
+#include <stdint.h>
+#include <vector>
+
+struct bitstream
+{
+  std::vector<uint8_t> &out;
+  uint64_t buf = 0;
+  unsigned pos = 0;
+
+  bitstream(std::vector<uint8_t> &o): out(o) {}
+
+  void flush()
+  {
+    out.push_back((buf & 0x000000ffUL) >> 0);
+    out.push_back((buf & 0x0000ff00UL) >> 8);
+    out.push_back((buf & 0x00ff0000UL) >> 16);
+    out.push_back((buf & 0xff000000UL) >> 24);
+    buf >>= 32;
+    pos -= 32;
+  }
+
+  void write(uint64_t value, unsigned width)
+  {
+    buf |= value << pos;
+    pos += width;
+
+    if(pos >= 32)
+      flush();
+  }
+};
+
+static inline void sigma_delta_compress(std::vector<uint8_t> &out,
+ const std::vector<uint8_t> &in, unsigned max_runlength)
+{
+  if(in.size() < 1)
+    return;
+
+  bitstream stream(out);
+  unsigned width = 8;
+  int8_t delta_min = -127;
+  int8_t delta_max = 127;
+  unsigned runlength = 0;
+  uint8_t prev = in[0];
+
+  out.push_back(max_runlength);
+  stream.write(in[0], 8);
+
+  for(size_t i = 1; i < in.size(); i++)
+  {
+    int8_t delta = static_cast<int8_t>(in[i] - prev);
+    prev = in[i];
+
+    if(delta == -128)
+    {
+      /* Pretend this edge case didn't happen... */
+      prev++;
+      delta = -127;
+    }
+
+    while(delta < delta_min || delta > delta_max)
+    {
+      /* Expand width. */
+      assert(width < 8);
+      stream.write(0, width);
+
+      width++;
+      delta_max = (1 << (width - 1)) - 1;
+      delta_min = -delta_max;
+      runlength = 0;
+      //DEBUG("  %u: expand width to %d\n", i, width);
+    }
+
+    /* Output delta. */
+    uint8_t code;
+    if(delta <= 0)
+    {
+      code = 0x01 | (static_cast<uint8_t>(-delta) << 1);
+      stream.write(code, width);
+    }
+    else
+    {
+      code = static_cast<uint8_t>(delta) << 1;
+      stream.write(code, width);
+    }
+    //DEBUG("  %u: write %02x\n", i, code);
+
+    /* Reset the run length for large values. */
+    if(code >> (width - 1))
+    {
+      runlength = 0;
+      continue;
+    }
+
+    /* Otherwise, increment the run length. */
+    if(++runlength >= max_runlength)
+    {
+      runlength = 0;
+
+      /* Shrink width. */
+      if(width > 1)
+      {
+        width--;
+        delta_max = (1 << (width - 1)) - 1;
+        delta_min = -delta_max;
+        //DEBUG("  %u: shrink width to %d\n", i, width);
+      }
+    }
+  }
+
+  /* Output any remaining bytes + padding. */
+  stream.flush();
+}
+
+#endif /* MZXTEST_CONVERTERS_SIGMA_DELTA_HPP */
@@ -232,13 +232,6 @@ int main(int argc, char *argv[])
   if(!wav.format_signed && wav.format_bits < 9)
     wav.convert_signed();
 
-  FILE *out = fopen(argv[2], "wb");
-  if(!out)
-  {
-    fprintf(stderr, "output file could not be written: %s\n", argv[2]);
-    return 1;
-  }
-
   // Convert filename, if possible.
   char *input_filename = argv[1];
   char *sep = strrchr(input_filename, DIR_SEPARATOR);
@@ -252,26 +245,31 @@ int main(int argc, char *argv[])
   if(name_len > 8)
     strncpy(filename_ext, input_filename + 8, 20);
 
-  uint8_t zeros[64]{};
-
-  /*   0 */ fputs("2BIT", out);
-  /*   4 */ fwrite(filename, 1, 8, out); // Filename
-  /*  12 */ fput_u16be(wav.format_channels == 2 ? AVR_TRUE : AVR_FALSE, out); // stereo?
-  /*  14 */ fput_u16be(wav.format_bits, out);
-  /*  16 */ fput_u16be(wav.format_signed ? AVR_TRUE : AVR_FALSE, out); // signed?
-  /*  18 */ fput_u16be(wav.smpl_loop_count ? AVR_TRUE : AVR_FALSE, out); // looping?
-  /*  20 */ fput_u16be(AVR_NO_MIDI_NOTE, out); // MIDI note/split
-  /*  22 */ fputc(0x03, out); // 24-bit sample rate
-            fput_u24be(wav.sample_rate, out);
-  /*  26 */ fput_u32be(wav.length_in_bytes, out);
-  /*  30 */ fput_u32be(wav.smpl_loop_start, out); // loop start
-  /*  34 */ fput_u32be(wav.smpl_loop_end, out); // loop end
-  /*  38 */ fput_u16be(0, out); // reserved for MIDI keyboard split
-  /*  40 */ fput_u16be(0, out); // reserved for sample compression
-  /*  42 */ fput_u16be(0, out); // reserved
-  /*  44 */ fwrite(filename_ext, 1, 20, out); // Filename extension
-  /*  64 */ fwrite(zeros, 1, 64, out); // User-defined area
-  /* 128 */ fwrite(wav.raw.data(), 1, wav.raw.size(), out); // Raw sample data
-  fclose(out);
+  mem_writer out(128 + wav.raw.size());
+
+  /*   0 */ out.puts("2BIT");
+  /*   4 */ out.write(filename, 8); // Filename
+  /*  12 */ out.u16be(wav.format_channels == 2 ? AVR_TRUE : AVR_FALSE); // stereo?
+  /*  14 */ out.u16be(wav.format_bits);
+  /*  16 */ out.u16be(wav.format_signed ? AVR_TRUE : AVR_FALSE); // signed?
+  /*  18 */ out.u16be(wav.smpl_loop_count ? AVR_TRUE : AVR_FALSE); // looping?
+  /*  20 */ out.u16be(AVR_NO_MIDI_NOTE); // MIDI note/split
+  /*  22 */ out.u8(0x03); // 24-bit sample rate
+            out.u24be(wav.sample_rate);
+  /*  26 */ out.u32be(wav.length_in_bytes);
+  /*  30 */ out.u32be(wav.smpl_loop_start); // loop start
+  /*  34 */ out.u32be(wav.smpl_loop_end); // loop end
+  /*  38 */ out.u16be(0); // reserved for MIDI keyboard split
+  /*  40 */ out.u16be(0); // reserved for sample compression
+  /*  42 */ out.u16be(0); // reserved
+  /*  44 */ out.write(filename_ext, 20); // Filename extension
+  /*  64 */ out.fill(0, 64); // User-defined area
+  /* 128 */ out.write(wav.raw.data(), wav.raw.size()); // Raw sample data
+
+  if(!out.save(argv[2]))
+  {
+    fprintf(stderr, "output file could not be written: %s\n", argv[2]);
+    return 1;
+  }
   return 0;
 }
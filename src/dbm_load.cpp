@@ -23,11 +23,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 #include "IFF.hpp"
 #include "modutil.hpp"
 
-static int total_dbm = 0;
+static std::atomic<int> total_dbm;
 
 
 enum DBM_features
@@ -464,7 +465,7 @@ class NAME_handler
 public:
   static constexpr IFFCode id = IFFCode("NAME");
 
-  static modutil::error parse(FILE *fp, size_t len, DBM_data &m)
+  static modutil::error parse(vio_reader<> &vf, size_t len, DBM_data &m)
   {
     if(len < 44)
     {
@@ -477,7 +478,7 @@ public:
       return modutil::INVALID;
     }
 
-    if(!fread(m.name, 44, 1, fp))
+    if(vf.read(m.name, 44) < 44)
       return modutil::READ_ERROR;
 
     m.name[44] = '\0';
@@ -495,7 +496,7 @@ class INFO_handler
 public:
   static constexpr IFFCode id = IFFCode("INFO");
 
-  static modutil::error parse(FILE *fp, size_t len, DBM_data &m)
+  static modutil::error parse(vio_reader<> &vf, size_t len, DBM_data &m)
   {
     if(len < 10)
     {
@@ -509,13 +510,13 @@ public:
     }
     m.read_info = true;
 
-    m.num_instruments = fget_u16be(fp);
-    m.num_samples     = fget_u16be(fp);
-    m.num_songs       = fget_u16be(fp);
-    m.num_patterns    = fget_u16be(fp);
-    m.num_channels    = fget_u16be(fp);
+    m.num_instruments = vf.u16be();
+    m.num_samples     = vf.u16be();
+    m.num_songs       = vf.u16be();
+    m.num_patterns    = vf.u16be();
+    m.num_channels    = vf.u16be();
 
-    if(feof(fp))
+    if(vf.eof())
       return modutil::READ_ERROR;
 
     return modutil::SUCCESS;
@@ -527,7 +528,7 @@ class SONG_handler
 public:
   static constexpr IFFCode id = IFFCode("SONG");
 
-  static modutil::error parse(FILE *fp, size_t len, DBM_data &m)
+  static modutil::error parse(vio_reader<> &vf, size_t len, DBM_data &m)
   {
     if(len < 46 * m.num_songs)
     {
@@ -545,20 +546,20 @@ public:
 
       DBM_song &sng = m.songs[i];
 
-      if(!fread(sng.name, 44, 1, fp))
+      if(vf.read(sng.name, 44) < 44)
         return modutil::READ_ERROR;
       sng.name[44] = '\0';
 
-      sng.num_orders = fget_u16be(fp);
-      if(feof(fp))
+      sng.num_orders = vf.u16be();
+      if(vf.eof())
         return modutil::READ_ERROR;
 
       sng.orders = new uint16_t[sng.num_orders];
 
       for(size_t i = 0; i < sng.num_orders; i++)
-        sng.orders[i] = fget_u16be(fp);
+        sng.orders[i] = vf.u16be();
 
-      if(feof(fp))
+      if(vf.eof())
         return modutil::READ_ERROR;
     }
     return modutil::SUCCESS;
@@ -570,7 +571,7 @@ class PATT_handler
 public:
   static constexpr IFFCode id = IFFCode("PATT");
 
-  static modutil::error parse(FILE *fp, size_t len, DBM_data &m)
+  static modutil::error parse(vio_reader<> &vf, size_t len, DBM_data &m)
   {
     if(!m.read_info)
       m.uses[FT_CHUNK_ORDER] = true;
@@ -590,8 +591,8 @@ public:
 
       DBM_pattern &p = m.patterns[i];
 
-      p.num_rows         = fget_u16be(fp);
-      p.packed_data_size = fget_u32be(fp);
+      p.num_rows         = vf.u16be();
+      p.packed_data_size = vf.u32be();
       len -= 6;
 
       if(p.num_rows > 64)
@@ -599,7 +600,7 @@ public:
       if(p.num_rows > 256)
         m.uses[FT_ROWS_OVER_256] = true;
 
-      if(feof(fp))
+      if(vf.eof())
         return modutil::READ_ERROR;
 
       if(len < p.packed_data_size)
@@ -612,7 +613,7 @@ public:
       if(!p.num_rows)
       {
         if(p.packed_data_size)
-          if(fseek(fp, p.packed_data_size, SEEK_CUR))
+          if(vf.seek(p.packed_data_size, SEEK_CUR))
             return modutil::SEEK_ERROR;
         continue;
       }
@@ -626,7 +627,7 @@ public:
 
       while(left > 0 && row < end)
       {
-        uint8_t channel = fgetc(fp);
+        uint8_t channel = vf.u8();
         left--;
 
         if(!channel)
@@ -635,7 +636,7 @@ public:
           continue;
         }
 
-        uint8_t flags = fgetc(fp);
+        uint8_t flags = vf.u8();
         left--;
 
         channel--;
@@ -648,7 +649,7 @@ public:
 
         if(flags & DBM_pattern::NOTE)
         {
-          e.note = fgetc(fp);
+          e.note = vf.u8();
           left--;
 
           if((e.note & 0xf0) == 0)
@@ -662,31 +663,31 @@ public:
         }
         if(flags & DBM_pattern::INSTRUMENT)
         {
-          e.instrument = fgetc(fp);
+          e.instrument = vf.u8();
           left--;
         }
         if(flags & DBM_pattern::EFFECT_1)
         {
-          e.effect_1 = fgetc(fp);
+          e.effect_1 = vf.u8();
           left--;
         }
         if(flags & DBM_pattern::PARAM_1)
         {
-          e.param_1 = fgetc(fp);
+          e.param_1 = vf.u8();
           left--;
         }
         if(flags & DBM_pattern::EFFECT_2)
         {
-          e.effect_2 = fgetc(fp);
+          e.effect_2 = vf.u8();
           left--;
         }
         if(flags & DBM_pattern::PARAM_2)
         {
-          e.param_2 = fgetc(fp);
+          e.param_2 = vf.u8();
           left--;
         }
 
-        if(feof(fp))
+        if(vf.eof())
           return modutil::READ_ERROR;
 
         check_event(m, e);
@@ -698,7 +699,7 @@ public:
         /* Don't print for 1 byte, this seems to be common... */
         if(left > 1)
           format::warning("%zd of packed data remaining for pattern %zu.", left, i);
-        if(fseek(fp, left, SEEK_CUR))
+        if(vf.seek(left, SEEK_CUR))
           return modutil::SEEK_ERROR;
       }
 
@@ -713,13 +714,13 @@ class PNAM_handler
 public:
   static constexpr IFFCode id = IFFCode("PNAM");
 
-  static modutil::error parse(FILE *fp, size_t len, DBM_data &m)
+  static modutil::error parse(vio_reader<> &vf, size_t len, DBM_data &m)
   {
     if(!m.read_info)
       m.uses[FT_CHUNK_ORDER] = true;
 
     m.pattern_names = true;
-    m.pattern_name_encoding = fget_u16be(fp);
+    m.pattern_name_encoding = vf.u16be();
 
     ssize_t left = len;
     for(size_t i = 0; i < m.num_patterns; i++)
@@ -727,7 +728,7 @@ public:
       if(!left)
         break;
 
-      uint8_t length = fgetc(fp);
+      uint8_t length = vf.u8();
       left--;
 
       if(left < length)
@@ -736,7 +737,7 @@ public:
       DBM_pattern &p = m.patterns[i];
 
       p.name = new char[length + 1];
-      if(!fread(p.name, length, 1, fp))
+      if(vf.read(p.name, length) < length)
         return modutil::READ_ERROR;
       p.name[length] = '\0';
       left -= length;
@@ -750,7 +751,7 @@ class INST_handler
 public:
   static constexpr IFFCode id = IFFCode("INST");
 
-  static modutil::error parse(FILE *fp, size_t len, DBM_data &m)
+  static modutil::error parse(vio_reader<> &vf, size_t len, DBM_data &m)
   {
     if(!m.read_info)
       m.uses[FT_CHUNK_ORDER] = true;
@@ -771,20 +772,20 @@ public:
 
       DBM_instrument &is = m.instruments[i];
 
-      if(!fread(is.name, 30, 1, fp))
+      if(vf.read(is.name, 30) < 30)
         return modutil::READ_ERROR;
       is.name[30] = '\0';
 
-      is.sample_id     = fget_u16be(fp);
-      is.volume        = fget_u16be(fp);
-      is.finetune_hz   = fget_u32be(fp);
-      is.repeat_start  = fget_u32be(fp);
-      is.repeat_length = fget_u32be(fp);
-      is.panning       = fget_s16be(fp);
-      is.flags         = fget_u16be(fp);
+      is.sample_id     = vf.u16be();
+      is.volume        = vf.u16be();
+      is.finetune_hz   = vf.u32be();
+      is.repeat_start  = vf.u32be();
+      is.repeat_length = vf.u32be();
+      is.panning       = vf.s16be();
+      is.flags         = vf.u16be();
     }
 
-    if(feof(fp))
+    if(vf.eof())
       return modutil::READ_ERROR;
 
     return modutil::SUCCESS;
@@ -796,7 +797,7 @@ class SMPL_handler
 public:
   static constexpr IFFCode id = IFFCode("SMPL");
 
-  static modutil::error parse(FILE *fp, size_t len, DBM_data &m)
+  static modutil::error parse(vio_reader<> &vf, size_t len, DBM_data &m)
   {
     if(!m.read_info)
       m.uses[FT_CHUNK_ORDER] = true;
@@ -817,8 +818,8 @@ public:
 
       DBM_sample &s = m.samples[i];
 
-      s.flags  = fget_u32be(fp);
-      s.length = fget_u32be(fp);
+      s.flags  = vf.u32be();
+      s.length = vf.u32be();
 
       size_t byte_length = s.length;
       if(s.flags & DBM_sample::S_8_BIT)
@@ -843,35 +844,35 @@ public:
         m.uses[FT_S_UNKNOWN_FORMAT] = true;
 
       /* Ignore the sample data... */
-      if(fseek(fp, byte_length, SEEK_CUR))
+      if(vf.seek(byte_length, SEEK_CUR))
         return modutil::SEEK_ERROR;
     }
     return modutil::SUCCESS;
   }
 };
 
-static modutil::error read_envelope(DBM_data &m, DBM_envelope &env, size_t env_num, FILE *fp)
+static modutil::error read_envelope(DBM_data &m, DBM_envelope &env, size_t env_num, vio_reader<> &vf)
 {
-  env.instrument_id    = fget_u16be(fp);
-  env.flags            = fgetc(fp);
-  env.num_points       = fgetc(fp) + 1;
-  env.sustain_1_point  = fgetc(fp);
-  env.loop_start_point = fgetc(fp);
-  env.loop_end_point   = fgetc(fp);
-  env.sustain_2_point  = fgetc(fp);
+  env.instrument_id    = vf.u16be();
+  env.flags            = vf.u8();
+  env.num_points       = vf.u8() + 1;
+  env.sustain_1_point  = vf.u8();
+  env.loop_start_point = vf.u8();
+  env.loop_end_point   = vf.u8();
+  env.sustain_2_point  = vf.u8();
 
   for(size_t i = 0; i < DBM_envelope::MAX_POINTS; i++)
   {
     DBM_envelope::point &p = env.points[i];
-    p.time  = fget_u16be(fp);
-    p.value = fget_s16be(fp);
+    p.time  = vf.u16be();
+    p.value = vf.s16be();
     if(p.value < 0)
       m.uses[FT_NEGATIVE_ENVELOPE_VALUE] = true;
     if(p.value > 64)
       m.uses[FT_HIGH_ENVELOPE_VALUE] = true;
   }
 
-  if(feof(fp))
+  if(vf.eof())
     return modutil::READ_ERROR;
 
   if(env.instrument_id > m.num_instruments)
@@ -924,7 +925,7 @@ class VENV_handler
 public:
   static constexpr IFFCode id = IFFCode("VENV");
 
-  static modutil::error parse(FILE *fp, size_t len, DBM_data &m)
+  static modutil::error parse(vio_reader<> &vf, size_t len, DBM_data &m)
   {
     if(!m.read_info)
       m.uses[FT_CHUNK_ORDER] = true;
@@ -937,8 +938,8 @@ public:
       return modutil::INVALID;
     }
 
-    uint16_t num_envelopes = fget_u16be(fp);
-    if(feof(fp))
+    uint16_t num_envelopes = vf.u16be();
+    if(vf.eof())
       return modutil::READ_ERROR;
 
     if(!num_envelopes)
@@ -957,7 +958,7 @@ public:
     for(size_t i = 0; i < num_envelopes; i++)
     {
       DBM_envelope &env = m.volume_envelopes[i];
-      modutil::error result = read_envelope(m, env, i, fp);
+      modutil::error result = read_envelope(m, env, i, vf);
       if(result == modutil::INVALID)
       {
         m.uses[FT_BAD_VOLUME_ENVELOPE] = true;
@@ -976,7 +977,7 @@ class PENV_handler
 public:
   static constexpr IFFCode id = IFFCode("PENV");
 
-  static modutil::error parse(FILE *fp, size_t len, DBM_data &m)
+  static modutil::error parse(vio_reader<> &vf, size_t len, DBM_data &m)
   {
     if(!m.read_info)
       m.uses[FT_CHUNK_ORDER] = true;
@@ -989,8 +990,8 @@ public:
       return modutil::INVALID;
     }
 
-    uint16_t num_envelopes = fget_u16be(fp);
-    if(feof(fp))
+    uint16_t num_envelopes = vf.u16be();
+    if(vf.eof())
       return modutil::READ_ERROR;
 
     if(!num_envelopes)
@@ -1009,7 +1010,7 @@ public:
     for(size_t i = 0; i < num_envelopes; i++)
     {
       DBM_envelope &env = m.pan_envelopes[i];
-      modutil::error result = read_envelope(m, env, i, fp);
+      modutil::error result = read_envelope(m, env, i, vf);
       if(result == modutil::INVALID)
       {
         m.uses[FT_BAD_PAN_ENVELOPE] = true;
@@ -1028,7 +1029,7 @@ class DSPE_handler
 public:
   static constexpr IFFCode id = IFFCode("DSPE");
 
-  static modutil::error parse(FILE *fp, size_t len, DBM_data &m)
+  static modutil::error parse(vio_reader<> &vf, size_t len, DBM_data &m)
   {
     m.uses[FT_DSPE_CHUNK] = true;
 
@@ -1038,19 +1039,19 @@ public:
       return modutil::INVALID;
     }
 
-    m.dspe_mask_length = fget_u16be(fp);
-    if(feof(fp))
+    m.dspe_mask_length = vf.u16be();
+    if(vf.eof())
       return modutil::READ_ERROR;
 
     m.dspe_mask = new uint8_t[m.dspe_mask_length];
-    if(!fread(m.dspe_mask, m.dspe_mask_length, 1, fp))
+    if(vf.read(m.dspe_mask, m.dspe_mask_length) < m.dspe_mask_length)
       return modutil::READ_ERROR;
 
-    m.dspe_global_echo_delay    = fget_u16be(fp);
-    m.dspe_global_echo_feedback = fget_u16be(fp);
-    m.dspe_global_echo_mix      = fget_u16be(fp);
-    m.dspe_cross_channel_echo   = fget_u16be(fp);
-    if(feof(fp))
+    m.dspe_global_echo_delay    = vf.u16be();
+    m.dspe_global_echo_feedback = vf.u16be();
+    m.dspe_global_echo_mix      = vf.u16be();
+    m.dspe_cross_channel_echo   = vf.u16be();
+    if(vf.eof())
       return modutil::READ_ERROR;
 
     return modutil::SUCCESS;
@@ -1091,25 +1092,25 @@ static void print_envelopes(const char *name, size_t num, DBM_envelope *envs)
     );
     for(size_t j = 0; j < env.num_points; j++)
     {
-      fprintf(stderr, "%1s%-5u%1s ",
+      format::printf("%1s%-5u%1s ",
         (j == loop_start) ? "(" : "",
         env.points[j].time,
         (j == loop_end) ? ")" : ""
       );
     }
-    fprintf(stderr, "\n");
+    format::printf("\n");
 
     O_("        : %8s  %7s : ", "", "");
     for(size_t j = 0; j < env.num_points; j++)
     {
-      fprintf(stderr, "%1s%-4d%1s%1s ",
+      format::printf("%1s%-4d%1s%1s ",
         (j == loop_start) ? "(" : "",
         env.points[j].value,
         (j == sustain_1 || j == sustain_2) ? "S" : "",
         (j == loop_end) ? ")" : ""
       );
     }
-    fprintf(stderr, "\n");
+    format::printf("\n");
   }
 }
 
@@ -1117,17 +1118,18 @@ static void print_envelopes(const char *name, size_t num, DBM_envelope *envs)
 class DBM_loader : public modutil::loader
 {
 public:
-  DBM_loader(): modutil::loader("DBM", "dbm", "DigiBooster Pro") {}
+  DBM_loader(): modutil::loader("DBM", "dbm", "DigiBooster Pro",
+   {{ 0, "DBM0" }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
-    FILE *fp = state.reader.unwrap(); /* FIXME: */
+    vio_reader<> vf(state.reader);
 
     DBM_data m{};
     auto parser = DBM_parser;
     parser.max_chunk_length = 0;
 
-    if(!fread(m.magic, 4, 1, fp))
+    if(vf.read(m.magic, 4) < 4)
       return modutil::FORMAT_ERROR;
 
     if(strncmp(m.magic, "DBM0", 4))
@@ -1135,10 +1137,10 @@ public:
 
     total_dbm++;
 
-    m.tracker_version = fget_u16be(fp);
-    fget_u16be(fp);
+    m.tracker_version = vf.u16be();
+    vf.u16be();
 
-    modutil::error err = parser.parse_iff(fp, 0, m);
+    modutil::error err = parser.parse_iff(vf, 0, m);
     if(err)
       return err;
 
@@ -132,6 +132,7 @@ public:
    const char *base, bool recursive = false) const override;
   virtual bool Test(const FileInfo &file) override;
   virtual bool Extract(const FileInfo &file, const char *destdir = nullptr) override;
+  virtual bool Unpack(const FileInfo &file, const uint8_t **dest, size_t *dest_len) override;
 };
 
 bool ADFSImage::PrintSummary() const
@@ -163,17 +164,23 @@ bool ADFSImage::Extract(const FileInfo &file, const char *destdir)
   return false;
 }
 
+bool ADFSImage::Unpack(const FileInfo &file, const uint8_t **dest, size_t *dest_len)
+{
+  // FIXME
+  return false;
+}
+
 
 class ADFSLoader: public DiskImageLoader
 {
-  ADFS_type init_old_map(FILE *fp, int num_sides, ADFS_map &map) const
+  ADFS_type init_old_map(vio &vf, int num_sides, ADFS_map &map) const
   {
     // FIXME read more here
     // Get real number of sectors.
-    if(fseek(fp, 0xfc, SEEK_SET))
+    if(vf.seek(0xfc, SEEK_SET))
       return NOT_ADFS;
 
-    map.num_sectors = fget_u24be(fp);
+    map.num_sectors = vf.u24be();
 
     if(num_sides > 1)
       return ADFS_L_640K;
@@ -184,37 +191,37 @@ class ADFSLoader: public DiskImageLoader
     return ADFS_S_160K;
   }
 
-  ADFS_type init_new_map(FILE *fp, ADFS_map &map) const
+  ADFS_type init_new_map(vio &vf, ADFS_map &map) const
   {
     // FIXME read literally anything here
     return ADFS_E_800K;
   }
 
-  ADFS_type identify(FILE *fp, ADFS_map &map) const
+  ADFS_type identify(vio &vf, ADFS_map &map) const
   {
     char magic[4];
     char magic2[4];
 
     // One sided ADFS-S and ADFS-M should have a "Hugo" directory magic at byte 1 of the 2nd sector.
-    if(fseek(fp, SMALL_SECTOR * 2 + 1, SEEK_SET))
+    if(vf.seek(SMALL_SECTOR * 2 + 1, SEEK_SET))
       return NOT_ADFS;
 
-    if(!fread(magic, 4, 1, fp))
+    if(vf.read(magic, 4) < 4)
       return NOT_ADFS;
 
     if(!memcmp(magic, HUGO, 4))
-      return init_old_map(fp, 1, map);
+      return init_old_map(vf, 1, map);
 
     // Two sided ADFS-L should have a "Hugo" directory magic at byte 1 of the 2nd sector on either side.
     // Sides are interleaved. For large sector disks, this corresponds to the start of the second side.
-    if(fseek(fp, SMALL_SECTOR * 2 * 2 + 1, SEEK_SET))
+    if(vf.seek(SMALL_SECTOR * 2 * 2 + 1, SEEK_SET))
       return NOT_ADFS;
 
-    if(!fread(magic2, 4, 1, fp))
+    if(vf.read(magic2, 4) < 4)
       return NOT_ADFS;
 
     if(!memcmp(magic2, HUGO, 4))
-      return init_old_map(fp, 2, map);
+      return init_old_map(vf, 2, map);
 
     // Two sided volumes with large sectors should have four NUL bytes at the 2nd (256 byte)
     // sector of either side, corresponding to the position read from the first "magic".
@@ -222,26 +229,26 @@ class ADFSLoader: public DiskImageLoader
     if(memcmp(magic, "\0\0\0\0", 4))
       return NOT_ADFS;
 
-    if(fseek(fp, SMALL_SECTOR * 2 * 4 + 1, SEEK_SET))
+    if(vf.seek(SMALL_SECTOR * 2 * 4 + 1, SEEK_SET))
       return NOT_ADFS;
 
-    if(!fread(magic, 4, 1, fp))
+    if(vf.read(magic, 4) < 4)
       return NOT_ADFS;
 
     if(!memcmp(magic, HUGO, 4))
       return ADFS_D_800K;
 
     if(!memcmp(magic, NICK, 4))
-      return init_new_map(fp, map);
+      return init_new_map(vf, map);
 
     return NOT_ADFS;
   }
 
 public:
-  virtual DiskImage *Load(FILE *fp, long file_length) const override
+  virtual DiskImage *Load(vio &vf, long file_length) const override
   {
     ADFS_map map;
-    ADFS_type type = identify(fp, map);
+    ADFS_type type = identify(vf, map);
     if(type == NOT_ADFS)
       return nullptr;
 
@@ -24,6 +24,7 @@
  * Unpacker for ArcFS archives.
  */
 
+#include <new>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -36,6 +37,9 @@
 
 #include "../format.hpp"
 
+/* Don't unpack members larger than this; a corrupt header can claim 4 GiB. */
+static constexpr size_t UNPACK_LIMIT = (1 << 28);
+
 
 enum ArcFS_type
 {
@@ -344,11 +348,11 @@ class ArcFSImage: public DiskImage
   size_t data_length;
 
 public:
-  ArcFSImage(ArcFS_header &_h, FILE *fp, long file_length):
+  ArcFSImage(ArcFS_header &_h, vio &vf, long file_length):
    DiskImage::DiskImage("ArcFS", "Archive"), header(_h), data_length(file_length)
   {
-    data = new uint8_t[file_length];
-    if(!fread(data, file_length, 1, fp))
+    data = load_image(vf, file_length);
+    if(!data)
     {
       error_state = true;
       return;
@@ -356,10 +360,6 @@ public:
     entry_start = reinterpret_cast<ArcFS_entry *>(data + ARCFS_HEADER_SIZE);
     entry_end = reinterpret_cast<ArcFS_entry *>(data + ARCFS_HEADER_SIZE + header.entries_length());
   }
-  virtual ~ArcFSImage()
-  {
-    delete[] data;
-  }
 
   /* "Driver" implemented functions. */
   virtual bool PrintSummary() const override;
@@ -367,6 +367,7 @@ public:
    const char *base, bool recursive = false) const override;
   virtual bool Test(const FileInfo &file) override;
   virtual bool Extract(const FileInfo &file, const char *destdir = nullptr) override;
+  virtual bool Unpack(const FileInfo &file, const uint8_t **dest, size_t *dest_len) override;
 
   void search_r(FileList &list, const FileInfo &filter, uint32_t filter_flags,
    const char *base, bool recursive, ArcFS_entry *h) const;
@@ -487,7 +488,17 @@ bool ArcFSImage::unpack_file(const FileInfo &file, uint8_t **dest, size_t *dest_
   if(type != UNPACKED)
   {
     output_size = h->uncompressed_size();
-    output = new uint8_t[output_size];
+    if(output_size > UNPACK_LIMIT)
+    {
+      format::error("uncompressed size %zu exceeds limit", output_size);
+      return false;
+    }
+    output = new (std::nothrow) uint8_t[output_size];
+    if(!output)
+    {
+      format::error("failed to allocate %zu bytes", output_size);
+      return false;
+    }
     held_buffer.reset(output);
 
     const char *err = arc_unpack(output, output_size, input, input_size, type, h->compression_bits());
@@ -572,6 +583,23 @@ bool ArcFSImage::Extract(const FileInfo &file, const char *destdir)
   return false;
 }
 
+bool ArcFSImage::Unpack(const FileInfo &file, const uint8_t **dest, size_t *dest_len)
+{
+  uint8_t *output;
+  size_t output_size;
+  uint16_t output_crc;
+
+  if(~file.get_type() & FileInfo::IS_REG)
+    return false;
+
+  if(!unpack_file(file, &output, &output_size, &output_crc))
+    return false;
+
+  *dest = output;
+  *dest_len = output_size;
+  return true;
+}
+
 ArcFS_entry *ArcFSImage::get_entry(const char *path) const
 {
   char buffer[1024];
@@ -617,18 +645,17 @@ ArcFS_entry *ArcFSImage::get_entry(const char *path) const
 class ArcFSLoader: public DiskImageLoader
 {
 public:
-  virtual DiskImage *Load(FILE *fp, long file_length) const override
+  virtual DiskImage *Load(vio &vf, long file_length) const override
   {
     ArcFS_header h{};
 
-    if(!fread(h.data, sizeof(h.data), 1, fp))
+    if(vf.read_buffer(h.data) < sizeof(h.data))
       return nullptr;
 
     if(!h.is_valid())
       return nullptr;
 
-    rewind(fp);
-    return new ArcFSImage(h, fp, file_length);
+    return new ArcFSImage(h, vf, file_length);
   }
 };
 
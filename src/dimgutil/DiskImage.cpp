@@ -39,12 +39,27 @@ DiskImageLoader::DiskImageLoader()
   get_list().push_back(this);
 }
 
-DiskImage *DiskImageLoader::TryLoad(FILE *fp, long file_length)
+uint8_t *DiskImage::load_image(vio &vf, size_t length)
+{
+  uint8_t *data = vf.contents();
+  if(data && vf.length() >= (int64_t)length)
+    return data;
+
+  held_image.reset(new uint8_t[length]);
+  if(vf.seek(0, SEEK_SET) || vf.read(held_image.get(), length) < length)
+  {
+    held_image.reset();
+    return nullptr;
+  }
+  return held_image.get();
+}
+
+DiskImage *DiskImageLoader::TryLoad(vio &vf, long file_length)
 {
   for(DiskImageLoader *l : get_list())
   {
-    rewind(fp);
-    DiskImage *img = l->Load(fp, file_length);
+    vf.seek(0, SEEK_SET);
+    DiskImage *img = l->Load(vf, file_length);
     if(img)
       return img;
   }
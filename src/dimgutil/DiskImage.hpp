@@ -29,6 +29,7 @@
 #include <vector>
 
 #include "FileInfo.hpp"
+#include "../vio.hpp"
 
 typedef std::vector<FileInfo> FileList;
 
@@ -49,6 +50,26 @@ public:
   virtual bool Test(const FileInfo &file) = 0;
   virtual bool Extract(const FileInfo &file, const char *destdir = nullptr) = 0;
 
+  /**
+   * Unpack a regular file into memory instead of extracting it. On success,
+   * `dest` points to the unpacked data, which belongs to the image and is
+   * only valid until the next Test, Extract, or Unpack call.
+   */
+  virtual bool Unpack(const FileInfo &file, const uint8_t **dest, size_t *dest_len) = 0;
+
+protected:
+  std::unique_ptr<uint8_t[]> held_image;
+
+  /**
+   * Get the entire contents of an image. If the image is already in memory
+   * (e.g. memory mapped copy-on-write), no copy is made and the returned
+   * pointer is only valid as long as the vio is; otherwise, the image is
+   * read into held_image. Returns nullptr on failure.
+   */
+  uint8_t *load_image(vio &vf, size_t length);
+
+public:
+
   /* Shorthand functions. */
   bool Search(FileList &dest, const char *base, bool recursive = false) const
   {
@@ -64,9 +85,9 @@ public:
   DiskImageLoader();
   virtual ~DiskImageLoader() {}
 
-  virtual DiskImage *Load(FILE *fp, long file_length) const = 0;
+  virtual DiskImage *Load(vio &vf, long file_length) const = 0;
 
-  static DiskImage *TryLoad(FILE *fp, long file_length);
+  static DiskImage *TryLoad(vio &vf, long file_length);
 };
 
 #endif /* MZXTEST_DIMGUTIL_DISKIMAGE_HPP */
@@ -321,6 +321,7 @@ public:
    const char *base, bool recursive) const override;
   virtual bool Test(const FileInfo &file) override;
   virtual bool Extract(const FileInfo &file, const char *destdir = nullptr) override;
+  virtual bool Unpack(const FileInfo &file, const uint8_t **dest, size_t *dest_len) override;
 
 
   void search_r(FileList &dest, const FileInfo &filter, uint32_t filter_flags,
@@ -676,11 +677,17 @@ bool FAT_image::Extract(const FileInfo &file, const char *destdir)
   return false;
 }
 
+bool FAT_image::Unpack(const FileInfo &file, const uint8_t **dest, size_t *dest_len)
+{
+  // FIXME
+  return false;
+}
+
 
 class FAT12_image: public FAT_image
 {
 public:
-  FAT12_image(const char *_type, const char *_media, const FAT_bios &_bios, FILE *fp):
+  FAT12_image(const char *_type, const char *_media, const FAT_bios &_bios, vio &vf):
    FAT_image::FAT_image(_type, _media, _bios)
   {
     size_t fat_size = bios.bytes_per_sector * bios.num_sectors_per_fat;
@@ -697,7 +704,7 @@ public:
 
     // Skip reserved sectors.
     size_t reserved_size = (size_t)bios.reserved_sectors * bios.bytes_per_sector;
-    fseek(fp, reserved_size, SEEK_SET);
+    vf.seek(reserved_size, SEEK_SET);
 
     /* Load FAT(s). */
     std::unique_ptr<uint8_t[]> buffer(new uint8_t[fat_size]);
@@ -707,7 +714,7 @@ public:
       uint32_t *entries = fat[i];
       uint8_t *pos = buffer.get();
 
-      if(!fread(pos, fat_size, 1, fp))
+      if(vf.read(pos, fat_size) < fat_size)
       {
         error_state = true;
         return;
@@ -737,7 +744,7 @@ public:
 
     data_area_size = size - reserved_size - (bios.num_fats * fat_size);
     data_area = new uint8_t[data_area_size];
-    if(!fread(data_area, data_area_size, 1, fp))
+    if(vf.read(data_area, data_area_size) < data_area_size)
       error_state = true;
   }
 };
@@ -747,7 +754,7 @@ public:
 class AtariST_image: public FAT12_image
 {
 public:
-  AtariST_image(const FAT_bios &_bios, FILE *fp): FAT12_image::FAT12_image("Atari ST", "3.5\"", _bios, fp) {}
+  AtariST_image(const FAT_bios &_bios, vio &vf): FAT12_image::FAT12_image("Atari ST", "3.5\"", _bios, vf) {}
 };
 
 
@@ -757,12 +764,12 @@ public:
 class AtariSTLoader: public DiskImageLoader
 {
 public:
-  virtual DiskImage *Load(FILE *fp, long file_length) const override
+  virtual DiskImage *Load(vio &vf, long file_length) const override
   {
     AtariST_FAT12_boot d{};
     uint8_t boot_sector[512];
 
-    if(!fread(boot_sector, sizeof(boot_sector), 1, fp))
+    if(vf.read_buffer(boot_sector) < sizeof(boot_sector))
       return nullptr;
     uint16_t checksum = 0;
 
@@ -782,7 +789,7 @@ public:
     d.checksum = mem_u16le(boot_sector + 510);
 
 
-    AtariST_image *disk = new AtariST_image(d.bios, fp);
+    AtariST_image *disk = new AtariST_image(d.bios, vf);
 
     /**
      * Several cases seem common:
@@ -27,6 +27,7 @@
 #include "FileInfo.hpp"
 
 #include "../common.hpp"
+#include "../format.hpp"
 
 static constexpr int CHECKSUM_WIDTHS[] =
 {
@@ -234,7 +235,7 @@ void FileInfo::print() const
   if(crc_type != NO_CHECKSUM)
     snprintf(crc_str, sizeof(crc_str), "%0*x", CHECKSUM_WIDTHS[crc_type], crc);
 
-  fprintf(stderr, "%6u-%02u-%02u %02u:%02u:%02u  :  %-15.15s  :  %10zu  : %8s : %4Xh  : %s\n",
+  format::printf("%6u-%02u-%02u %02u:%02u:%02u  :  %-15.15s  :  %10zu  : %8s : %4Xh  : %s\n",
     date_year(modify_d), date_month(modify_d), date_day(modify_d),
     time_hours(modify_d), time_minutes(modify_d), time_seconds(modify_d),
     size_str, packed, crc_str, method, name()
@@ -244,8 +245,8 @@ void FileInfo::print() const
 void FileInfo::print_header()
 {
   static constexpr const char LINES[] = "--------------------";
-  fprintf(stderr, "  %-19.19s     %-15.15s    %-11.11s    %-8.8s   %-6.6s   %-8.8s\n",
+  format::printf("  %-19.19s     %-15.15s    %-11.11s    %-8.8s   %-6.6s   %-8.8s\n",
    "Modified", "Type/size", "Stored size", "CRC", "Method", "Filename");
-  fprintf(stderr, "  %-19.19s  :  %-15.15s  : %-11.11s  : %-8.8s : %-6.6s : %-8.8s\n",
+  format::printf("  %-19.19s  :  %-15.15s  : %-11.11s  : %-8.8s : %-6.6s : %-8.8s\n",
    LINES, LINES, LINES, LINES, LINES, LINES);
 }
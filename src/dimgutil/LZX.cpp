@@ -26,6 +26,7 @@
  * This format is the direct predecessor to Microsoft CAB LZX.
  */
 
+#include <new>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -38,6 +39,9 @@
 
 #include "../format.hpp"
 
+/* Don't unpack members larger than this; a corrupt header can claim 4 GiB. */
+static constexpr size_t UNPACK_LIMIT = (1 << 28);
+
 enum LZX_method
 {
   LZX_UNPACKED = LZX_M_UNPACKED,
@@ -465,11 +469,11 @@ class LZXImage: public DiskImage
   size_t data_length;
 
 public:
-  LZXImage(LZX_header &_h, FILE *fp, long file_length):
+  LZXImage(LZX_header &_h, vio &vf, long file_length):
    DiskImage::DiskImage("LZX", "Archive"), header(_h), data_length(file_length)
   {
-    data = new uint8_t[file_length];
-    if(!fread(data, file_length, 1, fp))
+    data = load_image(vf, file_length);
+    if(!data)
     {
       error_state = true;
       return;
@@ -497,10 +501,6 @@ public:
         current = nullptr;
     }
   }
-  virtual ~LZXImage()
-  {
-    delete[] data;
-  }
 
   /* "Driver" implemented functions. */
   virtual bool PrintSummary() const override;
@@ -508,6 +508,7 @@ public:
    const char *base, bool recursive = false) const override;
   virtual bool Test(const FileInfo &file) override;
   virtual bool Extract(const FileInfo &file, const char *destdir = nullptr) override;
+  virtual bool Unpack(const FileInfo &file, const uint8_t **dest, size_t *dest_len) override;
 
   bool unpack_file(const FileInfo &file, uint8_t **dest, size_t *dest_len, uint32_t *dest_crc);
   LZX_entry *get_entry(const char *path) const;
@@ -659,7 +660,17 @@ bool LZXImage::unpack_file(const FileInfo &file, uint8_t **dest, size_t *dest_le
   if(method != LZX_UNPACKED)
   {
     output_size = h->uncompressed_size();
-    output = new uint8_t[output_size];
+    if(output_size > UNPACK_LIMIT)
+    {
+      format::error("uncompressed size %zu exceeds limit", output_size);
+      return false;
+    }
+    output = new (std::nothrow) uint8_t[output_size];
+    if(!output)
+    {
+      format::error("failed to allocate %zu bytes", output_size);
+      return false;
+    }
     held_buffer.reset(output);
 
     int err = lzx_unpack(output, output_size, input, input_size, method);
@@ -733,6 +744,23 @@ bool LZXImage::Extract(const FileInfo &file, const char *destdir)
   return output_file.commit(file, destdir);
 }
 
+bool LZXImage::Unpack(const FileInfo &file, const uint8_t **dest, size_t *dest_len)
+{
+  uint8_t *output;
+  size_t output_size;
+  uint32_t output_crc;
+
+  if(~file.get_type() & FileInfo::IS_REG)
+    return false;
+
+  if(!unpack_file(file, &output, &output_size, &output_crc))
+    return false;
+
+  *dest = output;
+  *dest_len = output_size;
+  return true;
+}
+
 LZX_entry *LZXImage::get_entry(const char *path) const
 {
   char buffer[1024];
@@ -757,18 +785,17 @@ LZX_entry *LZXImage::get_entry(const char *path) const
 class LZXLoader: public DiskImageLoader
 {
 public:
-  virtual DiskImage *Load(FILE *fp, long file_length) const override
+  virtual DiskImage *Load(vio &vf, long file_length) const override
   {
     LZX_header h{};
 
-    if(!fread(h.data, sizeof(h.data), 1, fp))
+    if(vf.read_buffer(h.data) < sizeof(h.data))
       return nullptr;
 
     if(!h.is_valid())
       return nullptr;
 
-    rewind(fp);
-    return new LZXImage(h, fp, file_length);
+    return new LZXImage(h, vf, file_length);
   }
 };
 
@@ -24,6 +24,7 @@
  * Unpacker for ARC/ArcFS/Spark archives.
  */
 
+#include <new>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -35,6 +36,9 @@
 
 #include "../format.hpp"
 
+/* Don't unpack members larger than this; a corrupt header can claim 4 GiB. */
+static constexpr size_t UNPACK_LIMIT = (1 << 28);
+
 
 enum ARC_variant
 {
@@ -194,14 +198,14 @@ struct ARC_entry
 
   /* TODO: attributes. */
 
-  bool read_header(FILE *fp)
+  bool read_header(vio &vf)
   {
-    if(!fread(data, 2, 1, fp))
+    if(vf.read(data, 2) < 2)
       return false;
 
     size_t header_size = get_header_size();
     if(header_size > 2)
-      if(!fread(data + 2, header_size - 2, 1, fp))
+      if(vf.read(data + 2, header_size - 2) < header_size - 2)
         return false;
 
     // Make sure filename is terminated...
@@ -227,16 +231,16 @@ struct ARC_entry
    * The returned ARC_entry * will be a pointer to this entry, and the
    * data in this entry will be overwritten with the next entry.
    */
-  ARC_entry *next_header(FILE *fp)
+  ARC_entry *next_header(vio &vf)
   {
     ARC_type t = type();
     if(t == ARC_INVALID || t == END_OF_ARCHIVE || t == SPARK_END_OF_ARCHIVE || t == ARC_6_END_OF_DIR)
       return nullptr;
 
-    if(fseek(fp, compressed_size(), SEEK_CUR))
+    if(vf.seek(compressed_size(), SEEK_CUR))
       return nullptr;
 
-    if(!read_header(fp))
+    if(!read_header(vf))
       return nullptr;
 
     return this;
@@ -370,17 +374,13 @@ class SparkImage: public DiskImage
   size_t num_files;
 
 public:
-  SparkImage(ARC_variant variant, size_t _num_files, FILE *fp, long file_length):
+  SparkImage(ARC_variant variant, size_t _num_files, vio &vf, long file_length):
    DiskImage::DiskImage(ARC_entry::variant_str(variant), "Archive"), data_length(file_length), num_files(_num_files)
   {
-    data = new uint8_t[file_length];
-    if(!fread(data, file_length, 1, fp))
+    data = load_image(vf, file_length);
+    if(!data)
       error_state = true;
   }
-  virtual ~SparkImage()
-  {
-    delete[] data;
-  }
 
   /* "Driver" implemented functions. */
   virtual bool PrintSummary() const override;
@@ -388,6 +388,7 @@ public:
    const char *base, bool recursive = false) const override;
   virtual bool Test(const FileInfo &file) override;
   virtual bool Extract(const FileInfo &file, const char *destdir = nullptr) override;
+  virtual bool Unpack(const FileInfo &file, const uint8_t **dest, size_t *dest_len) override;
 
   void search_r(FileList &list, const FileInfo &filter, uint32_t filter_flags,
    const char *base, bool recursive, ARC_entry *h, uint8_t *start, size_t length) const;
@@ -510,6 +511,13 @@ bool SparkImage::unpack_file(const FileInfo &file, uint8_t **dest, size_t *dest_
   if(!h->get_buffer(&input, &input_size))
     return false;
 
+  if(input < data || input > data + data_length ||
+   input_size > (size_t)(data + data_length - input))
+  {
+    format::error("file data extends past end of archive");
+    return false;
+  }
+
   uint8_t *output;
   size_t output_size;
 
@@ -518,7 +526,17 @@ bool SparkImage::unpack_file(const FileInfo &file, uint8_t **dest, size_t *dest_
   if(type != UNPACKED_OLD && type != UNPACKED)
   {
     output_size = h->uncompressed_size();
-    output = new uint8_t[output_size];
+    if(output_size > UNPACK_LIMIT)
+    {
+      format::error("uncompressed size %zu exceeds limit", output_size);
+      return false;
+    }
+    output = new (std::nothrow) uint8_t[output_size];
+    if(!output)
+    {
+      format::error("failed to allocate %zu bytes", output_size);
+      return false;
+    }
     held_buffer.reset(output);
 
     const char *err = arc_unpack(output, output_size, input, input_size, type, 0);
@@ -602,6 +620,23 @@ bool SparkImage::Extract(const FileInfo &file, const char *destdir)
   return true;
 }
 
+bool SparkImage::Unpack(const FileInfo &file, const uint8_t **dest, size_t *dest_len)
+{
+  uint8_t *output;
+  size_t output_size;
+  uint16_t output_crc;
+
+  if(~file.get_type() & FileInfo::IS_REG)
+    return false;
+
+  if(!unpack_file(file, &output, &output_size, &output_crc))
+    return false;
+
+  *dest = output;
+  *dest_len = output_size;
+  return true;
+}
+
 ARC_entry *SparkImage::get_entry(const char *path, uint8_t **start, size_t *length) const
 {
   char buffer[1024];
@@ -645,10 +680,10 @@ ARC_entry *SparkImage::get_entry(const char *path, uint8_t **start, size_t *leng
 class SparkLoader: public DiskImageLoader
 {
 public:
-  virtual DiskImage *Load(FILE *fp, long file_length) const override
+  virtual DiskImage *Load(vio &vf, long file_length) const override
   {
     ARC_entry h{};
-    if(file_length <= 0 || !h.read_header(fp))
+    if(file_length <= 0 || !h.read_header(vf))
       return nullptr;
 
     ARC_variant variant = IS_ARC;
@@ -664,10 +699,8 @@ public:
       if(variant == IS_PAK && first_type == ARCHIVE_INFO && h.type() == TRIMMED)
         variant = IS_ARC7;
     }
-    while(h.next_header(fp));
-    rewind(fp);
-
-    return new SparkImage(variant, count, fp, file_length);
+    while(h.next_header(vf));
+    return new SparkImage(variant, count, vf, file_length);
   }
 };
 
@@ -22,6 +22,7 @@
  */
 
 #include "arc_unpack.h"
+#include "lzw_unpack.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -38,13 +39,6 @@
 #define ARC_RESET_CODE 256
 #define ARC_BUFFER_SIZE 8192 /* Buffer size for multi-stage compression. */
 
-struct arc_code
-{
-  arc_uint16 prev;
-  arc_uint16 length;
-  arc_uint8 value;
-};
-
 struct arc_lookup
 {
   arc_uint16 value;
@@ -72,20 +66,12 @@ struct arc_data
   size_t lzw_in;
   size_t lzw_out;
   unsigned lzw_eof;
-  unsigned max_code;
-  unsigned first_code;
-  unsigned next_code;
-  unsigned current_width;
-  unsigned init_width;
-  unsigned max_width;
-  unsigned continue_left;
-  unsigned continue_code;
-  arc_uint32 last_code;
-  unsigned kwkwk;
-  unsigned last_first_value;
+  struct lzw_unpack lzw;
 
   unsigned char *window;
-  struct arc_code *tree;
+  size_t window_size;
+  size_t window_pos;
+  struct lzw_code *lzw_codes;
   struct arc_lookup *huffman_lookup;
   struct arc_huffman_index *huffman_tree;
   unsigned num_huffman;
@@ -104,40 +90,28 @@ static int arc_unpack_init(struct arc_data *arc, int init_width, int max_width,
   arc->lzw_in = 0;
   arc->lzw_out = 0;
   arc->lzw_eof = 0;
-  arc->max_code = (1 << max_width);
-  arc->first_code = is_dynamic ? 257 : 256;
-  arc->current_width = init_width;
-  arc->init_width = init_width;
-  arc->max_width = max_width;
-  arc->continue_left = 0;
-  arc->continue_code = 0;
-  arc->last_code = ARC_NO_CODE;
-  arc->last_first_value = 0;
-  arc->kwkwk = 0;
   arc->window = NULL;
-  arc->tree = NULL;
+  arc->window_size = 0;
+  arc->window_pos = 0;
+  arc->lzw_codes = NULL;
   arc->huffman_lookup = NULL;
   arc->huffman_tree = NULL;
   arc->num_huffman = 0;
 
   if(max_width)
   {
-    size_t i;
     if(max_width < 9 || max_width > 16)
       return -1;
 
-    arc->tree = (struct arc_code *)calloc(1 << max_width, sizeof(struct arc_code));
-    if(!arc->tree)
+    /* Only codes that have been added are read, so this doesn't need to
+     * be initialized. */
+    arc->lzw_codes = (struct lzw_code *)malloc((1 << max_width) * sizeof(struct lzw_code));
+    if(!arc->lzw_codes)
       return -1;
 
-    for(i = 0; i < 256; i++)
-    {
-      struct arc_code *c = &(arc->tree[i]);
-      c->prev = (arc_uint16)ARC_NO_CODE;
-      c->length = 1;
-      c->value = i;
-    }
-    arc->next_code = arc->first_code;
+    if(lzw_unpack_init(&arc->lzw, arc->lzw_codes, is_dynamic ? 257 : 256,
+     init_width, max_width) != 0)
+      return -1;
   }
   return 0;
 }
@@ -147,13 +121,15 @@ static int arc_unpack_window(struct arc_data *arc, size_t window_size)
   arc->window = (unsigned char *)malloc(window_size);
   if(!arc->window)
     return -1;
+
+  arc->window_size = window_size;
   return 0;
 }
 
 static void arc_unpack_free(struct arc_data *arc)
 {
   free(arc->window);
-  free(arc->tree);
+  free(arc->lzw_codes);
   free(arc->huffman_lookup);
   free(arc->huffman_tree);
 }
@@ -206,12 +182,12 @@ static arc_uint32 arc_next_code(struct arc_data * ARC_RESTRICT arc,
    * When the code width changes, the extra buffered codes are discarded.
    * Despite this, the final number of codes won't always be a multiple of 8.
    */
-  if(arc->buffered_pos >= 8 || arc->buffered_width != arc->current_width)
+  if(arc->buffered_pos >= 8 || arc->buffered_width != arc->lzw.width)
   {
     size_t i;
     for(i = 0; i < 8; i++)
     {
-      arc_int32 value = arc_read_bits(arc, src, src_len, arc->current_width);
+      arc_int32 value = arc_read_bits(arc, src, src_len, arc->lzw.width);
       if(value < 0)
         break;
 
@@ -221,66 +197,16 @@ static arc_uint32 arc_next_code(struct arc_data * ARC_RESTRICT arc,
       arc->codes_buffered[i] = ARC_NO_CODE;
 
     arc->buffered_pos = 0;
-    arc->buffered_width = arc->current_width;
+    arc->buffered_width = arc->lzw.width;
   }
   return arc->codes_buffered[arc->buffered_pos++];
 }
 
-static void arc_unlzw_add(struct arc_data *arc)
-{
-  if(arc->last_code != ARC_NO_CODE && arc->next_code < arc->max_code)
-  {
-    arc_uint32 len = arc->tree[arc->last_code].length;
-    struct arc_code *e;
-
-    e = &(arc->tree[arc->next_code++]);
-    e->prev = arc->last_code;
-    e->length = len ? len + 1 : 0;
-    e->value = arc->last_first_value;
-
-    /* Automatically expand width. */
-    if(arc->next_code >= (1U << arc->current_width) && arc->current_width < arc->max_width)
-    {
-      arc->current_width++;
-      #ifdef ARC_DEBUG
-      fprintf(stderr, "width expanded to %u\n", arc->current_width);
-      #endif
-    }
-  }
-}
-
-static int arc_unlzw_get_length(const struct arc_data *arc,
- const struct arc_code *e)
-{
-  unsigned length = 1;
-  int code;
-
-  if(e->length)
-    return e->length;
-
-  do
-  {
-    if(length >= arc->max_code)
-      return 0;
-
-    length++;
-    code = e->prev;
-    e = &(arc->tree[code]);
-  }
-  while(code >= 256);
-  return length;
-}
-
 static int arc_unlzw_block(struct arc_data * ARC_RESTRICT arc,
  unsigned char * ARC_RESTRICT dest, size_t dest_len,
  const unsigned char *src, size_t src_len)
 {
-  unsigned char *pos;
-  struct arc_code *e;
-  arc_uint16 start_code;
   arc_uint32 code;
-  int len;
-  int set_last_first;
 
   #ifdef ARC_DEBUG
   int num_debug = 0;
@@ -288,16 +214,8 @@ static int arc_unlzw_block(struct arc_data * ARC_RESTRICT arc,
 
   while(arc->lzw_out < dest_len)
   {
-    /* Interrupted while writing out code? Resume output... */
-    if(arc->continue_code)
-    {
-      code = arc->continue_code;
-      set_last_first = 0;
-      goto continue_code;
-    }
-
     code = arc_next_code(arc, src, src_len);
-    if(code >= arc->max_code)
+    if(code >= arc->lzw.max_code)
     {
       arc->lzw_eof = 1;
       break;
@@ -310,88 +228,94 @@ static int arc_unlzw_block(struct arc_data * ARC_RESTRICT arc,
       fprintf(stderr, "\n");
     #endif
 
-    if(code == ARC_RESET_CODE && arc->first_code == 257)
+    if(code == ARC_RESET_CODE && arc->lzw.first_code == 257)
     {
-      size_t i;
       /* Reset width for dynamic modes 8, 9, and 255. */
       #ifdef ARC_DEBUG
-      fprintf(stderr, "reset at size = %u codes\n", arc->next_code);
+      fprintf(stderr, "reset at size = %u codes\n", arc->lzw.next_code);
       #endif
-      arc->next_code = arc->first_code;
-      arc->current_width = arc->init_width;
-      arc->last_code = ARC_NO_CODE;
-
-      for(i = 256; i < arc->max_code; i++)
-        arc->tree[i].length = 0;
-
+      lzw_unpack_reset(&arc->lzw);
       continue;
     }
 
-    /* Add next code first to avoid KwKwK problem. */
-    if((unsigned)code == arc->next_code)
+    /* If the final string doesn't fit, output as much as possible. */
+    if(lzw_unpack_code(&arc->lzw, code, dest, &arc->lzw_out, dest_len, LZW_PARTIAL_OUTPUT))
+    {
+      #ifdef ARC_DEBUG
+      fprintf(stderr, "invalid code %04xh (code count is %04xh)\n",
+       code, arc->lzw.next_code);
+      #endif
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Multi-stage LZW: dictionary strings are copied from earlier output, so
+ * the window holds all LZW output since the last reset, starting at
+ * window_pos. Decode until at least ARC_BUFFER_SIZE bytes past window_pos
+ * are available for the next stage, or until the end of the stream.
+ */
+static int arc_unlzw_window(struct arc_data *arc, size_t max_window,
+ const unsigned char *src, size_t src_len)
+{
+  arc_uint32 code;
+
+  while(arc->lzw_out - arc->window_pos < ARC_BUFFER_SIZE)
+  {
+    code = arc_next_code(arc, src, src_len);
+    if(code >= arc->lzw.max_code)
     {
-      arc_unlzw_add(arc);
-      arc->kwkwk = 1;
+      arc->lzw_eof = 1;
+      break;
     }
 
-    /* Emit code. */
-    set_last_first = 1;
+    if(code == ARC_RESET_CODE && arc->lzw.first_code == 257)
+    {
+      /* Nothing prior to this can be referenced anymore. */
+      size_t keep = arc->lzw_out - arc->window_pos;
+      memmove(arc->window, arc->window + arc->window_pos, keep);
+      arc->window_pos = 0;
+      arc->lzw_out = keep;
 
-continue_code:
-    start_code = code;
-    e = &(arc->tree[code]);
+      lzw_unpack_reset(&arc->lzw);
+      continue;
+    }
 
-    if(!arc->continue_code)
+    if(arc->window_size - arc->lzw_out < arc->lzw.max_code)
     {
-      len = arc_unlzw_get_length(arc, e);
-      if(!len)
+      /* Make room for the longest possible string. */
+      size_t new_size = arc->window_size * 2;
+      unsigned char *tmp;
+
+      if(arc->lzw_out > max_window)
       {
         #ifdef ARC_DEBUG
-        fprintf(stderr, "failed to get length for %04xh (code count is %04xh)\n",
-         code, arc->next_code);
+        fprintf(stderr, "LZW output exceeds %zu bytes since reset\n", max_window);
         #endif
         return -1;
       }
-    }
-    else
-      len = arc->continue_left;
 
-    if((unsigned)len > dest_len - arc->lzw_out)
-    {
-      /* Calculate arc->continue_left, skip arc->continue_left,
-       * emit remaining len from end of dest. */
-      arc_int32 num_emit = dest_len - arc->lzw_out;
+      if(new_size < arc->lzw_out + arc->lzw.max_code)
+        new_size = arc->lzw_out + arc->lzw.max_code;
 
-      arc->continue_left = len - num_emit;
-      arc->continue_code = code;
+      tmp = (unsigned char *)realloc(arc->window, new_size);
+      if(!tmp)
+        return -1;
 
-      for(; len > num_emit; len--)
-        e = &(arc->tree[e->prev]);
+      arc->window = tmp;
+      arc->window_size = new_size;
     }
-    else
-      arc->continue_code = 0;
 
-    pos = dest + arc->lzw_out + len - 1;
-    arc->lzw_out += len;
-    for(; len > 0; len--)
+    if(lzw_unpack_code(&arc->lzw, code, arc->window, &arc->lzw_out, arc->window_size, 0))
     {
-      code = e->value;
-      *(pos--) = code;
-      e = &(arc->tree[e->prev]);
+      #ifdef ARC_DEBUG
+      fprintf(stderr, "invalid code %04xh (code count is %04xh)\n",
+       code, arc->lzw.next_code);
+      #endif
+      return -1;
     }
-    /* Only set this if this is the tail end of the chain,
-     * i.e., the first section written. */
-    if(set_last_first)
-      arc->last_first_value = code;
-
-    if(arc->continue_code)
-      return 0;
-
-    if(!arc->kwkwk)
-      arc_unlzw_add(arc);
-
-    arc->last_code = start_code;
-    arc->kwkwk = 0;
   }
   return 0;
 }
@@ -575,6 +499,7 @@ static int arc_unpack_lzw_rle90(unsigned char * ARC_RESTRICT dest, size_t dest_l
  const unsigned char *src, size_t src_len, int init_width, int max_width)
 {
   struct arc_data arc;
+  size_t max_window;
   int is_dynamic = (init_width != max_width);
 
   /* This is only used for Spark method 0xff, which doesn't use RLE. */
@@ -594,30 +519,46 @@ static int arc_unpack_lzw_rle90(unsigned char * ARC_RESTRICT dest, size_t dest_l
 
   if(arc_unpack_init(&arc, init_width, max_width, is_dynamic) != 0)
     return -1;
-  if(arc_unpack_window(&arc, ARC_BUFFER_SIZE) != 0)
+  if(arc_unpack_window(&arc, ARC_BUFFER_SIZE * 2) != 0)
     goto err;
 
-  while(arc.lzw_eof == 0)
+  /* RLE90 at most doubles its input, so valid streams can't exceed this.
+   * ArcFS sometimes adds a little extra data past the end; allow for it. */
+  max_window = dest_len * 2 + ARC_BUFFER_SIZE;
+
+  while(1)
   {
-    arc.lzw_out = 0;
-    if(arc_unlzw_block(&arc, arc.window, ARC_BUFFER_SIZE, src, src_len))
+    if(arc_unlzw_window(&arc, max_window, src, src_len))
     {
       #ifdef ARC_DEBUG
-      fprintf(stderr, "arc_unlzw_block failed "
+      fprintf(stderr, "arc_unlzw_window failed "
        "(%zu in, %zu out in buffer, %zu out in stream)\n",
        arc.lzw_in, arc.lzw_out, arc.rle_out);
       #endif
       goto err;
     }
 
-    if(arc_unrle90_block(&arc, dest, dest_len, arc.window, arc.lzw_out))
+    /* Use the same RLE90 block sizes as when the window was fixed size. */
+    while(arc.lzw_out - arc.window_pos >= ARC_BUFFER_SIZE ||
+     (arc.lzw_eof && arc.lzw_out > arc.window_pos))
     {
-      #ifdef ARC_DEBUG
-      fprintf(stderr, "arc_unrle90_block failed (%zu in, %zu out)\n",
-       arc.lzw_in, arc.rle_out);
-      #endif
-      goto err;
+      size_t len = arc.lzw_out - arc.window_pos;
+      if(len > ARC_BUFFER_SIZE)
+        len = ARC_BUFFER_SIZE;
+
+      if(arc_unrle90_block(&arc, dest, dest_len, arc.window + arc.window_pos, len))
+      {
+        #ifdef ARC_DEBUG
+        fprintf(stderr, "arc_unrle90_block failed (%zu in, %zu out)\n",
+         arc.lzw_in, arc.rle_out);
+        #endif
+        goto err;
+      }
+      arc.window_pos += len;
     }
+
+    if(arc.lzw_eof)
+      break;
   }
 
   if(arc.rle_out != dest_len)
@@ -77,15 +77,20 @@ int main(int argc, char *argv[])
 
   format::line("File", "%s", filename);
 
-  FILE *fp = fopen(filename, "rb");
-  if(!fp)
+  /* Archives patch their headers in place, so map copy-on-write.
+   * This needs to outlive the disk image. */
+  std::unique_ptr<vio> vf;
+  try
+  {
+    vf = vio_open_read(filename, true);
+  }
+  catch(const char *e)
   {
     format::error("error opening file");
     return -1;
   }
-  long file_length = get_file_length(fp);
-  std::unique_ptr<DiskImage> disk(DiskImageLoader::TryLoad(fp, file_length));
-  fclose(fp);
+  long file_length = vf->length();
+  std::unique_ptr<DiskImage> disk(DiskImageLoader::TryLoad(*vf, file_length));
 
   if(!disk || disk->error_state)
   {
@@ -108,12 +113,12 @@ int main(int argc, char *argv[])
       disk->PrintSummary();
       disk->Search(list, base, true);
 
-      fprintf(stderr, "\nListing '%s':\n\n", base ? base : "");
+      format::printf("\nListing '%s':\n\n", base ? base : "");
       FileInfo::print_header();
       for(FileInfo &f : list)
         f.print();
 
-      fprintf(stderr, "\n  Total: %zu\n", list.size());
+      format::printf("\n  Total: %zu\n", list.size());
       break;
     }
 
@@ -128,7 +133,7 @@ int main(int argc, char *argv[])
       disk->PrintSummary();
       disk->Search(list, base, true);
 
-      fprintf(stderr, "\nTesting '%s':\n\n", base ? base : "");
+      format::printf("\nTesting '%s':\n\n", base ? base : "");
       FileInfo::print_header();
       for(FileInfo &f : list)
         f.print();
@@ -137,14 +142,14 @@ int main(int argc, char *argv[])
       {
         if(!disk->Test(f))
         {
-          fprintf(stderr, "  Error: test failed for '%s'.\n", f.name());
+          format::printf("  Error: test failed for '%s'.\n", f.name());
           failed++;
         }
         else
           ok++;
       }
 
-      fprintf(stderr, "\n  OK: %zu  Failed: %zu  Total: %zu\n", ok, failed, list.size());
+      format::printf("\n  OK: %zu  Failed: %zu  Total: %zu\n", ok, failed, list.size());
       break;
     }
 
@@ -161,16 +166,16 @@ int main(int argc, char *argv[])
       disk->PrintSummary();
       disk->Search(list, base, true);
 
-      fprintf(stderr, "\nExtracting '%s':\n\n", base ? base : "");
+      format::printf("\nExtracting '%s':\n\n", base ? base : "");
       FileInfo::print_header();
       for(FileInfo &f : list)
         f.print();
 
       for(FileInfo &f : list)
         if(!disk->Extract(f, destdir))
-          fprintf(stderr, "  Error: failed to extract '%s'.\n", f.name());
+          format::printf("  Error: failed to extract '%s'.\n", f.name());
 
-      fprintf(stderr, "\n  Total: %zu\n", list.size());
+      format::printf("\n  Total: %zu\n", list.size());
     }
   }
   format::endline();
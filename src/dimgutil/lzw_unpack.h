@@ -0,0 +1,202 @@
+/**
+ * dimgutil: disk image and archive utility
+ * Copyright (C) 2021 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Dynamic LZW dictionary and string output shared by the Digital Symphony
+ * and ARC/ArcFS/Spark unpackers. Code reading, clear/EOF codes, and other
+ * format quirks are handled by the callers.
+ *
+ * Every string added to the dictionary is the previous string followed by
+ * the first char of the string output after it, so it's already present in
+ * the output starting at the previous string. Codes store its position and
+ * length, so output is a copy from earlier in the output instead of a walk
+ * back through a tree. This requires all output since the last reset to be
+ * kept in one buffer.
+ *
+ * This is header-only so it can be used from both C and C++ without
+ * changing how either links; flags are expected to be constant so unused
+ * paths are removed when these functions are inlined.
+ */
+
+#ifndef DIMGUTIL_LZW_UNPACK_H
+#define DIMGUTIL_LZW_UNPACK_H
+
+#include <stddef.h> /* size_t */
+#include <stdint.h>
+#include <string.h>
+
+#define LZW_MIN_WIDTH 9
+#define LZW_MAX_WIDTH 16
+
+/* If a string doesn't fit in the output, output as much of it as possible
+ * instead of failing (ARC). */
+#define LZW_PARTIAL_OUTPUT 1
+
+struct lzw_code
+{
+  uint32_t offset;
+  uint32_t length;
+};
+
+struct lzw_unpack
+{
+  struct lzw_code *codes; /* (1 << max_width) codes, provided by the caller. */
+  size_t prev_offset;
+  uint32_t prev_length;   /* 0 if there is no previous string. */
+  unsigned next_code;
+  unsigned first_code;    /* First code added to the dictionary. */
+  unsigned max_code;
+  unsigned width;
+  unsigned init_width;
+  unsigned max_width;
+  unsigned width_increased; /* Set when an add increases the width. */
+};
+
+static inline int lzw_unpack_init(struct lzw_unpack *lzw, struct lzw_code *codes,
+ unsigned first_code, unsigned init_width, unsigned max_width)
+{
+  if(init_width < LZW_MIN_WIDTH || init_width > max_width || max_width > LZW_MAX_WIDTH)
+    return -1;
+
+  lzw->codes = codes;
+  lzw->prev_offset = 0;
+  lzw->prev_length = 0;
+  lzw->next_code = first_code;
+  lzw->first_code = first_code;
+  lzw->max_code = 1U << max_width;
+  lzw->width = init_width;
+  lzw->init_width = init_width;
+  lzw->max_width = max_width;
+  lzw->width_increased = 0;
+  return 0;
+}
+
+/**
+ * Clear the dictionary and reset the code width.
+ */
+static inline void lzw_unpack_reset(struct lzw_unpack *lzw)
+{
+  lzw->next_code = lzw->first_code;
+  lzw->width = lzw->init_width;
+  lzw->prev_length = 0;
+}
+
+static inline void lzw_unpack_add(struct lzw_unpack *lzw)
+{
+  if(lzw->next_code < lzw->max_code)
+  {
+    struct lzw_code *e = &(lzw->codes[lzw->next_code++]);
+    e->offset = lzw->prev_offset;
+    e->length = lzw->prev_length + 1;
+
+    /* Increase the width if the NEXT code wouldn't fit. */
+    if(lzw->next_code >= (1U << lzw->width) && lzw->width < lzw->max_width)
+    {
+      lzw->width++;
+      lzw->width_increased = 1;
+    }
+  }
+}
+
+/**
+ * Output the string for a code to dest + *pos and add a new code, which
+ * is the previous string with the first char of this string appended.
+ * The offsets of all previous output are relative to dest. A code equal
+ * to the next code to be added (KwKwK) is added first, then output.
+ *
+ * @return 0 on success, or -1 if the code is invalid or the string
+ *         doesn't fit (without LZW_PARTIAL_OUTPUT).
+ */
+static inline int lzw_unpack_code(struct lzw_unpack *lzw, unsigned code,
+ unsigned char *dest, size_t *pos, size_t dest_len, int flags)
+{
+  size_t start = *pos;
+  size_t left = dest_len - start;
+  const unsigned char *src;
+  size_t length;
+
+  if(!left)
+    return -1;
+
+  if(code < 256)
+  {
+    dest[start] = code;
+    if(lzw->prev_length)
+      lzw_unpack_add(lzw);
+
+    lzw->prev_offset = start;
+    lzw->prev_length = 1;
+    *pos = start + 1;
+    return 0;
+  }
+
+  if(code < lzw->first_code || code > lzw->next_code)
+    return -1;
+
+  if(code == lzw->next_code)
+  {
+    /* KwKwK: the previous string plus its own first char. The final char
+     * is the first char of this output, so it's copied after the rest. */
+    if(!lzw->prev_length)
+      return -1;
+
+    lzw_unpack_add(lzw);
+    src = dest + lzw->prev_offset;
+    length = lzw->prev_length + 1;
+    if(length > left)
+      goto partial;
+
+    memcpy(dest + start, src, length - 1);
+    dest[start + length - 1] = src[0];
+  }
+  else
+  {
+    const struct lzw_code *e = &(lzw->codes[code]);
+    src = dest + e->offset;
+    length = e->length;
+    if(length > left)
+      goto partial;
+
+    memcpy(dest + start, src, length);
+    if(lzw->prev_length)
+      lzw_unpack_add(lzw);
+  }
+
+  lzw->prev_offset = start;
+  lzw->prev_length = length;
+  *pos = start + length;
+  return 0;
+
+partial:
+  if(!(flags & LZW_PARTIAL_OUTPUT))
+    return -1;
+
+  /* The source ends at or before start, even for KwKwK. */
+  memcpy(dest + start, src, left);
+  lzw->prev_offset = start;
+  lzw->prev_length = length;
+  *pos = dest_len;
+  return 0;
+}
+
+#endif /* DIMGUTIL_LZW_UNPACK_H */
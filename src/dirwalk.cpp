@@ -0,0 +1,196 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+
+#include "dirwalk.hpp"
+#include "format.hpp"
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+modutil::scan_dir::~scan_dir()
+{
+  close(fd);
+}
+
+bool modutil::walk_filter::match_extension(const char *name) const
+{
+  if(extensions.empty())
+    return true;
+
+  const char *ext = strrchr(name, '.');
+  if(!ext)
+    return false;
+
+  for(const std::string &e : extensions)
+    if(!strcasecmp(ext + 1, e.c_str()))
+      return true;
+
+  return false;
+}
+
+bool modutil::walk_filter::match_size(int64_t size) const
+{
+  if(min_size >= 0 && size < min_size)
+    return false;
+  if(max_size >= 0 && size > max_size)
+    return false;
+  return true;
+}
+
+struct walk_entry
+{
+  std::string name;
+  unsigned char type;
+
+  bool operator<(const walk_entry &e) const
+  {
+    return strcmp(name.c_str(), e.name.c_str()) < 0;
+  }
+};
+
+static void walk_r(const std::shared_ptr<modutil::scan_dir> &dir,
+ const modutil::walk_filter &filter, const std::function<void(modutil::walk_file &)> &fn)
+{
+  std::vector<walk_entry> entries;
+
+  /* fdopendir takes ownership of its fd, so give it a duplicate. */
+  int list_fd = dup(dir->fd);
+  DIR *d = list_fd >= 0 ? fdopendir(list_fd) : nullptr;
+  if(!d)
+  {
+    if(list_fd >= 0)
+      close(list_fd);
+    format::error("failed to read directory '%s'.", dir->path.c_str());
+    return;
+  }
+
+  struct dirent *de;
+  while((de = readdir(d)))
+  {
+    if(de->d_name[0] == '.' &&
+     (!de->d_name[1] || (de->d_name[1] == '.' && !de->d_name[2])))
+      continue;
+
+    entries.push_back({ de->d_name, de->d_type });
+  }
+  closedir(d);
+
+  std::sort(entries.begin(), entries.end());
+
+  for(walk_entry &e : entries)
+  {
+    struct stat st;
+    bool have_stat = false;
+
+    /* Filesystems that don't provide d_type; symlinks need to be checked
+     * to see if they point to a file. */
+    if(e.type == DT_UNKNOWN || e.type == DT_LNK)
+    {
+      int flags = (e.type == DT_LNK) ? 0 : AT_SYMLINK_NOFOLLOW;
+      if(fstatat(dir->fd, e.name.c_str(), &st, flags))
+        continue;
+
+      have_stat = true;
+      if(S_ISREG(st.st_mode))
+        e.type = DT_REG;
+      else
+
+      if(S_ISDIR(st.st_mode) && e.type == DT_UNKNOWN)
+        e.type = DT_DIR;
+      else
+        continue;
+    }
+
+    std::string path = dir->path;
+    if(path.size() && path.back() != '/')
+      path += '/';
+    path += e.name;
+
+    if(e.type == DT_DIR)
+    {
+      int fd = openat(dir->fd, e.name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+      if(fd < 0)
+      {
+        format::error("failed to open directory '%s'.", path.c_str());
+        continue;
+      }
+      walk_r(std::make_shared<modutil::scan_dir>(fd, std::move(path)), filter, fn);
+      continue;
+    }
+
+    if(e.type != DT_REG || !filter.match_extension(e.name.c_str()))
+      continue;
+
+    if(filter.has_size_filter())
+    {
+      if(!have_stat && fstatat(dir->fd, e.name.c_str(), &st, 0))
+        continue;
+      if(!filter.match_size(st.st_size))
+        continue;
+    }
+
+    modutil::walk_file f{ dir, e.name.c_str(), std::move(path) };
+    fn(f);
+  }
+}
+
+bool modutil::walk_directory(const char *path, const walk_filter &filter,
+ const std::function<void(walk_file &)> &fn)
+{
+  int fd = open(path, O_RDONLY | O_DIRECTORY);
+  if(fd < 0)
+    return false;
+
+  walk_r(std::make_shared<scan_dir>(fd, path), filter, fn);
+  return true;
+}
+
+#else /* _WIN32 */
+
+modutil::scan_dir::~scan_dir() {}
+
+bool modutil::walk_filter::match_extension(const char *name) const
+{
+  return true;
+}
+
+bool modutil::walk_filter::match_size(int64_t size) const
+{
+  return true;
+}
+
+bool modutil::walk_directory(const char *path, const walk_filter &filter,
+ const std::function<void(walk_file &)> &fn)
+{
+  format::error("-r is not supported on this platform.");
+  return false;
+}
+
+#endif
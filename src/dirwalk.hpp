@@ -0,0 +1,77 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MODUTIL_DIRWALK_HPP
+#define MODUTIL_DIRWALK_HPP
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace modutil
+{
+  /**
+   * Open directory handle. Files found by the walker are opened relative
+   * to this, so it is reference counted and stays open until every file
+   * in it has been scanned.
+   */
+  class scan_dir
+  {
+  public:
+    int fd;
+    std::string path;
+
+    scan_dir(int f, std::string &&p): fd(f), path(std::move(p)) {}
+    ~scan_dir();
+  };
+
+  struct walk_filter
+  {
+    std::vector<std::string> extensions;
+    int64_t min_size = -1;
+    int64_t max_size = -1;
+
+    bool has_size_filter() const { return min_size >= 0 || max_size >= 0; }
+    bool match_extension(const char *name) const;
+    bool match_size(int64_t size) const;
+  };
+
+  struct walk_file
+  {
+    std::shared_ptr<scan_dir> dir;
+    const char *name; /* Relative to dir. */
+    std::string path;
+  };
+
+  /**
+   * Recursively find every regular file under path that matches the filter
+   * and pass it to fn. Entries in each directory are visited in sorted order.
+   * Symbolic links to files are followed; links to directories are not.
+   * Returns false if path couldn't be opened as a directory.
+   */
+  bool walk_directory(const char *path, const walk_filter &filter,
+   const std::function<void(walk_file &)> &fn);
+}
+
+#endif /* MODUTIL_DIRWALK_HPP */
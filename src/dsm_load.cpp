@@ -26,6 +26,7 @@
  * http://www.shikadi.net/moddingwiki/DSIK_Module_Format
  */
 
+#include <atomic>
 #include <memory>
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,7 +35,7 @@
 #include "IFF.hpp"
 #include "modutil.hpp"
 
-static int total_dsik = 0;
+static std::atomic<int> total_dsik;
 
 
 enum DSIK_features
@@ -528,7 +529,9 @@ modutil::error DSIK_read(FILE *fp)
 class DSIK_loader : modutil::loader
 {
 public:
-  DSIK_loader(): modutil::loader("DSM", "dsik", "Digital Sound Interface Kit") {}
+  DSIK_loader(): modutil::loader("DSM", "dsik", "Digital Sound Interface Kit",
+   {{ 0, "RIFF\0\0\0\0DSMF", "\xff\xff\xff\xff\0\0\0\0\xff\xff\xff\xff" },
+    { 0, "DSMF" }, { 0, "DSM\x10" }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
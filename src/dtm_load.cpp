@@ -23,13 +23,14 @@
 #include "modutil.hpp"
 #include "IFF.hpp"
 
+#include <atomic>
 #include <vector>
 
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 
-static size_t num_dtm = 0;
+static std::atomic<size_t> num_dtm;
 
 
 enum DTM_feature
@@ -1098,7 +1099,8 @@ static const IFF<
 class DTM_loader: modutil::loader
 {
 public:
-  DTM_loader(): modutil::loader("DTM", "dtm", "Digital Tracker") {}
+  DTM_loader(): modutil::loader("DTM", "dtm", "Digital Tracker",
+   {{ 0, "D.T." }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
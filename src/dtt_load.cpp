@@ -25,9 +25,10 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include <atomic>
 #include <memory>
 
-static size_t num_dtts = 0;
+static std::atomic<size_t> num_dtts;
 
 
 static constexpr char MAGIC_DSKT[] = "DskT";
@@ -180,7 +181,8 @@ static bool DTT_uncompress(uint8_t *dest, size_t dest_len, const uint8_t *src, s
 class DTT_loader: public modutil::loader
 {
 public:
-  DTT_loader(): modutil::loader("-", "dtt", "Desktop Tracker") {}
+  DTT_loader(): modutil::loader("-", "dtt", "Desktop Tracker",
+   {{ 0, MAGIC_DSKT }, { 0, MAGIC_ESKT }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
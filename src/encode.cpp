@@ -22,6 +22,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "encode.hpp"
 
@@ -155,34 +156,66 @@ static constexpr uint16_t cp437_to_utf32[256] =
   0x2261, 0xb1,   0x2265, 0x2264, 0x2320, 0x2321, 0xf7,   0x2248, 0xb0,   0x2219, 0xb7,   0x221a, 0x207f, 0xb2,   0x25a0, 0xa0,
 };
 
+/* UTF-8 encodings of cp437_to_utf32, computed at compile time so names
+ * can be encoded with a table lookup and a copy per char. */
+struct cp437_utf8_table
+{
+  struct entry
+  {
+    uint8_t length;
+    char bytes[3];
+  };
+  entry chars[256];
+
+  constexpr cp437_utf8_table(): chars{}
+  {
+    for(size_t i = 0; i < 256; i++)
+    {
+      char tmp[4]{};
+      char *pos = tmp;
+      chars[i].length = utf32_to_utf8(pos, tmp + 4, cp437_to_utf32[i]);
+      for(size_t j = 0; j < 3; j++)
+        chars[i].bytes[j] = tmp[j];
+    }
+  }
+};
+static constexpr cp437_utf8_table cp437_utf8{};
+
+static_assert(encode::cp437::MAX_UTF8_PER_CHAR == 3, "cp437_utf8 entry size");
+
 size_t encode::cp437::utf8_count(const char *in, size_t in_len)
 {
   size_t count = 0;
 
   for(size_t i = 0; i < in_len; i++)
-  {
-    uint32_t codepoint = cp437_to_utf32[(uint8_t)*in++];
-    count += utf8_codepoint_length(codepoint);
-  }
+    count += cp437_utf8.chars[(uint8_t)*in++].length;
+
   return count;
 }
 
 ssize_t encode::cp437::utf8_encode(char *out, size_t out_len, const char *in, size_t in_len)
 {
+  char *out_start = out;
   char *out_end = out + out_len;
   if(out_end < out)
     return -1;
 
-  size_t count = 0;
+  /* Copy whole entries while there's room; the extra bytes are overwritten. */
+  for(; in_len && out_end - out >= 3; in_len--)
+  {
+    const cp437_utf8_table::entry &e = cp437_utf8.chars[(uint8_t)*in++];
+    memcpy(out, e.bytes, 3);
+    out += e.length;
+  }
 
-  for(size_t i = 0; i < in_len; i++)
+  for(; in_len; in_len--)
   {
-    uint32_t codepoint = cp437_to_utf32[(uint8_t)*in++];
-    size_t len = utf32_to_utf8(out, out_end, codepoint);
-    if(len < 1)
+    const cp437_utf8_table::entry &e = cp437_utf8.chars[(uint8_t)*in++];
+    if(out_end - out < e.length)
       return -1;
 
-    count += len;
+    memcpy(out, e.bytes, e.length);
+    out += e.length;
   }
-  return count;
+  return out - out_start;
 }
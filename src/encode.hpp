@@ -31,6 +31,9 @@ namespace encode
 class strip
 {
 public:
+  /* Maximum number of UTF-8 bytes a single input char encodes to. */
+  static constexpr size_t MAX_UTF8_PER_CHAR = 1;
+
   static  size_t utf8_count(const char *in, size_t in_len);
   static ssize_t utf8_encode(char *out, size_t out_len, const char *in, size_t in_len);
 };
@@ -38,6 +41,9 @@ public:
 class cp437
 {
 public:
+  /* Maximum number of UTF-8 bytes a single input char encodes to. */
+  static constexpr size_t MAX_UTF8_PER_CHAR = 3;
+
   static  size_t utf8_count(const char *in, size_t in_len);
   static ssize_t utf8_encode(char *out, size_t out_len, const char *in, size_t in_len);
 };
@@ -24,10 +24,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 #include "modutil.hpp"
 
-static int total_far = 0;
+static std::atomic<int> total_far;
 
 
 enum FAR_feature
@@ -300,7 +301,8 @@ static void check_event_features(FAR_data &m, FAR_event &ev)
 class FAR_loader : modutil::loader
 {
 public:
-  FAR_loader(): modutil::loader("FAR", "far", "Farandole Composer") {}
+  FAR_loader(): modutil::loader("FAR", "far", "Farandole Composer",
+   {{ 0, MAGIC }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
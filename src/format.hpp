@@ -24,9 +24,13 @@
 #define MODUTIL_FORMAT_HPP
 
 #include <ctype.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <vector>
 #include <tuple>
 #include <type_traits>
@@ -35,13 +39,219 @@
 #include "attribute.hpp"
 #include "common.hpp"
 #include "encode.hpp"
+#include "record.hpp"
 
 namespace format
 {
-#define O_(...) do { \
-  fprintf(stderr, ": " __VA_ARGS__); \
-  fflush(stderr); \
-} while(0)
+  /**
+   * Output sink for all text printed by format::. Each thread collects its
+   * output in a growable buffer. If the sink is buffered, the buffer is only
+   * written to the destination when flush() is called (e.g. once per module);
+   * otherwise it is written immediately. The destination is shared by all
+   * threads and is stderr by default; it can be changed to any FILE * or to
+   * a file descriptor (written to directly with write(2)) without changes to
+   * anything that prints. A file descriptor destination is owned by the sink
+   * and is closed when it is replaced or at exit.
+   */
+  class sink
+  {
+    char *buffer = nullptr;
+    size_t length = 0;
+    size_t allocated = 0;
+    bool buffered = false;
+
+    struct destination
+    {
+      FILE *fp;
+      int fd;
+
+      constexpr destination(): fp(nullptr), fd(-1) {}
+      ~destination()
+      {
+        close();
+      }
+
+      void close()
+      {
+        if(fd >= 0)
+          ::close(fd);
+        fd = -1;
+      }
+    };
+    static inline destination dest;
+
+    void reserve(size_t add)
+    {
+      if(allocated - length >= add)
+        return;
+
+      size_t new_alloc = allocated ? allocated : 4096;
+      while(new_alloc - length < add)
+        new_alloc <<= 1;
+
+      char *tmp = reinterpret_cast<char *>(realloc(buffer, new_alloc));
+      if(!tmp)
+        throw "failed to allocate output buffer";
+
+      buffer = tmp;
+      allocated = new_alloc;
+    }
+
+  public:
+    sink() {}
+    sink(const sink &) = delete;
+    sink &operator=(const sink &) = delete;
+    ~sink()
+    {
+      flush();
+      free(buffer);
+    }
+
+    static void set_destination(FILE *fp)
+    {
+      dest.close();
+      dest.fp = fp;
+    }
+
+    /* Takes ownership of fd. */
+    static void set_destination(int fd)
+    {
+      dest.close();
+      dest.fp = nullptr;
+      dest.fd = fd;
+    }
+
+    static bool has_destination()
+    {
+      return dest.fp || dest.fd >= 0;
+    }
+
+    /* Write data directly to the destination, bypassing all buffers. */
+    static void write_direct(const char *data, size_t len)
+    {
+      if(!len)
+        return;
+
+      if(dest.fd >= 0)
+      {
+        while(len)
+        {
+          ssize_t n = ::write(dest.fd, data, len);
+          if(n < 0 && errno == EINTR)
+            continue;
+          if(n <= 0)
+            break;
+
+          data += n;
+          len -= n;
+        }
+      }
+      else
+      {
+        FILE *fp = dest.fp ? dest.fp : stderr;
+        fwrite(data, 1, len, fp);
+        fflush(fp);
+      }
+    }
+
+    void set_buffered(bool value)
+    {
+      if(!value)
+        flush();
+      buffered = value;
+    }
+
+    void write(const char *data, size_t len)
+    {
+      reserve(len);
+      memcpy(buffer + length, data, len);
+      length += len;
+      if(!buffered)
+        flush();
+    }
+
+    void vprintf(const char *fmt, va_list args)
+    {
+      va_list args_copy;
+      reserve(256);
+
+      va_copy(args_copy, args);
+      int n = vsnprintf(buffer + length, allocated - length, fmt, args_copy);
+      va_end(args_copy);
+      if(n < 0)
+        return;
+
+      if((size_t)n >= allocated - length)
+      {
+        reserve((size_t)n + 1);
+        vsnprintf(buffer + length, allocated - length, fmt, args);
+      }
+      length += n;
+      if(!buffered)
+        flush();
+    }
+
+    void flush()
+    {
+      write_direct(buffer, length);
+      length = 0;
+    }
+
+    /* Access to the buffered output, for callers that write it themselves. */
+    const char *data() const { return buffer; }
+    size_t size() const { return length; }
+    void clear() { length = 0; }
+  };
+
+  inline thread_local sink output;
+
+  /**
+   * If set, header lines, warnings, errors, and feature lists are collected
+   * into this record for the calling thread instead of being printed, and
+   * all other text output is discarded.
+   */
+  inline thread_local record *current_record = nullptr;
+
+  ATTRIBUTE_PRINTF(1, 2)
+  static inline void printf(const char *fmt, ...)
+  {
+    if(current_record)
+      return;
+    va_list args;
+    va_start(args, fmt);
+    output.vprintf(fmt, args);
+    va_end(args);
+  }
+
+  static inline void vprintf(const char *fmt, va_list args)
+  {
+    if(current_record)
+      return;
+    output.vprintf(fmt, args);
+  }
+
+  static inline void write(const char *data, size_t len)
+  {
+    if(current_record)
+      return;
+    output.write(data, len);
+  }
+
+  static inline std::string vstring(const char *fmt, va_list args)
+  {
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int len = vsnprintf(nullptr, 0, fmt, args_copy);
+    va_end(args_copy);
+    if(len <= 0)
+      return {};
+
+    std::string str(len, '\0');
+    vsnprintf(&str[0], len + 1, fmt, args);
+    return str;
+  }
+
+#define O_(...) format::printf(": " __VA_ARGS__)
 
 #define DASHES "----------------------------------------------------------------"
 #define HIGHLIGHT_START "\x1b[1m\x1b[37m\x1b[41m"
@@ -55,7 +265,7 @@ namespace format
   {
     if(Config.quiet)
       return;
-    fprintf(stderr, "%*s", count, "");
+    format::printf("%*s", count, "");
   }
 
   static inline void dashes(int count)
@@ -66,7 +276,7 @@ namespace format
     {
       constexpr int L = sizeof(DASHES) - 1;
       int n = count > L ? L : count;
-      fprintf(stderr, "%*.*s", n, n, DASHES);
+      format::printf("%*.*s", n, n, DASHES);
       count -= n;
     }
   }
@@ -75,7 +285,7 @@ namespace format
   {
     if(Config.quiet)
       return;
-    fprintf(stderr, "\n");
+    format::printf("\n");
   }
 
   static inline void line(const char *label = "")
@@ -89,12 +299,19 @@ namespace format
   ATTRIBUTE_PRINTF(2, 3)
   static inline void line(const char *label, const char *fmt, ...)
   {
+    va_list args;
+    if(current_record)
+    {
+      va_start(args, fmt);
+      current_record->field(label, vstring(fmt, args));
+      va_end(args);
+      return;
+    }
     if(Config.quiet)
       return;
     O_("%-8.8s: ", label);
-    va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    format::vprintf(fmt, args);
     va_end(args);
     endline();
   }
@@ -102,12 +319,19 @@ namespace format
   ATTRIBUTE_PRINTF(1, 2)
   static inline void warning(const char *fmt, ...)
   {
+    va_list args;
+    if(current_record)
+    {
+      va_start(args, fmt);
+      current_record->warnings.push_back(vstring(fmt, args));
+      va_end(args);
+      return;
+    }
     if(Config.quiet)
       return;
     O_("%-8.8s: ", "Warning");
-    va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    format::vprintf(fmt, args);
     va_end(args);
     endline();
   }
@@ -115,12 +339,19 @@ namespace format
   ATTRIBUTE_PRINTF(1, 2)
   static inline void error(const char *fmt, ...)
   {
+    va_list args;
+    if(current_record)
+    {
+      va_start(args, fmt);
+      current_record->errors.push_back(vstring(fmt, args));
+      va_end(args);
+      return;
+    }
     if(Config.quiet)
       return;
     O_("%-8.8s: ", "Error");
-    va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    format::vprintf(fmt, args);
     va_end(args);
     endline();
   }
@@ -135,6 +366,13 @@ namespace format
   template<typename T, int N>
   static inline void uses(const T (&uses)[N], const char * const (&desc)[N])
   {
+    if(current_record)
+    {
+      for(int i = 0; i < N; i++)
+        if(uses[i])
+          current_record->uses.push_back(desc[i]);
+      return;
+    }
     if(Config.quiet)
       return;
     int printed = 0;
@@ -154,7 +392,7 @@ namespace format
           O_("%-8.8s:", "");
         }
 
-        fprintf(stderr, " %s", desc[i]);
+        format::printf(" %s", desc[i]);
         printed++;
       }
     }
@@ -169,7 +407,7 @@ namespace format
       return;
     O_("%-8.8s:", label);
     for(size_t i = 0; i < count; i++)
-      fprintf(stderr, " %02x", orders[i]);
+      format::printf(" %02x", orders[i]);
     endline();
   }
 
@@ -186,7 +424,7 @@ namespace format
 
     O_("%-8.8s:", "");
     for(size_t i = 0; i < count; i++)
-      fprintf(stderr, " %02x", orders[i]);
+      format::printf(" %02x", orders[i]);
     endline();
   }
 
@@ -231,13 +469,13 @@ namespace format
           while(segment && isspace(line_start[segment - 1]))
             segment--;
 
-          fprintf(stderr, "%*.*s\n", segment, segment, line_start);
+          format::printf("%*.*s\n", segment, segment, line_start);
           line_start += skip;
           left -= skip;
 
           O_("%-8.8s: ", "");
         }
-        fprintf(stderr, "%*.*s\n", left, left, line_start);
+        format::printf("%*.*s\n", left, left, line_start);
       }
       else
         O_("        :\n");
@@ -261,7 +499,6 @@ namespace format
     endline();
     O_("%-22.22s: %zu\n", label, count);
     O_("%-22.22s:\n", "----------------------");
-    fflush(stderr); // MinGW buffers stderr...
   }
 
   static inline void reportline(const char *label = "")
@@ -270,7 +507,6 @@ namespace format
       return;
     O_("%-22.22s:", label);
     endline();
-    fflush(stderr); // MinGW buffers stderr...
   }
 
   ATTRIBUTE_PRINTF(2, 3)
@@ -281,10 +517,9 @@ namespace format
     O_("%-22.22s: ", label);
     va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    format::vprintf(fmt, args);
     va_end(args);
     endline();
-    fflush(stderr); // MinGW buffers stderr...
   }
 
   /**
@@ -304,12 +539,12 @@ namespace format
   {
     static void label(const char *)
     {
-      fprintf(stderr, ": ");
+      format::printf(": ");
     }
 
     static void print()
     {
-      fprintf(stderr, ": ");
+      format::printf(": ");
     }
   };
 
@@ -318,7 +553,7 @@ namespace format
   {
     static void label(const char *label)
     {
-      fprintf(stderr, "%-*.*s ", N, N, label);
+      format::printf("%-*.*s ", N, N, label);
     }
   };
 
@@ -331,29 +566,45 @@ namespace format
 
     void print() const
     {
-      size_t len = strlen(value);
-      if(len > N)
-        len = N;
+      if(current_record)
+        return;
 
-      std::vector<char> buf(ENCODE::utf8_count(value, len) + 1);
+      /* Encoded name, padding to N characters, and a trailing space. */
+      char buf[N * ENCODE::MAX_UTF8_PER_CHAR + N + 1];
 
-      int print_bytes = ENCODE::utf8_encode(buf.data(), buf.size(), value, len);
-      if(print_bytes < 0)
+      size_t len = strnlen(value, N);
+      size_t pad;
+      char *pos = buf;
+      if(F & RIGHT)
       {
-        print_bytes = 0;
-        len = 0;
+        /* The encoded length isn't known until the name is encoded. */
+        ssize_t print_bytes = ENCODE::utf8_encode(buf + N, sizeof(buf) - N - 1, value, len);
+        if(print_bytes < 0)
+        {
+          print_bytes = 0;
+          len = 0;
+        }
+        pad = N - len;
+        memset(buf, ' ', N);
+        pos = buf + pad;
+        memmove(pos, buf + N, print_bytes);
+        pos += print_bytes;
       }
-      buf[print_bytes] = '\0';
-
-      /* Force fprintf to print extra spaces.
-       * Just using N won't work because fprintf limits to bytes, not characters. */
-      if(len < N)
-        print_bytes += N - len;
-
-      if(F & RIGHT)
-        fprintf(stderr, "%*.*s ", print_bytes, print_bytes, buf.data());
       else
-        fprintf(stderr, "%-*.*s ", print_bytes, print_bytes, buf.data());
+      {
+        ssize_t print_bytes = ENCODE::utf8_encode(buf, sizeof(buf) - 1, value, len);
+        if(print_bytes < 0)
+        {
+          print_bytes = 0;
+          len = 0;
+        }
+        pad = N - len;
+        pos = buf + print_bytes;
+        memset(pos, ' ', pad);
+        pos += pad;
+      }
+      *(pos++) = ' ';
+      format::write(buf, pos - buf);
     }
   };
 
@@ -370,16 +621,16 @@ namespace format
         if(F & ZEROS)
         {
           if(F & RIGHT)
-            fprintf(stderr, "%0*" PRIx64 " ", N, (int64_t)value);
+            format::printf("%0*" PRIx64 " ", N, (int64_t)value);
           else
-            fprintf(stderr, "%-*" PRIx64 " ", N, (int64_t)value);
+            format::printf("%-*" PRIx64 " ", N, (int64_t)value);
         }
         else
         {
           if(F & RIGHT)
-            fprintf(stderr, "%*" PRIx64 " ", N, (int64_t)value);
+            format::printf("%*" PRIx64 " ", N, (int64_t)value);
           else
-            fprintf(stderr, "%-*" PRIx64 " ", N, (int64_t)value);
+            format::printf("%-*" PRIx64 " ", N, (int64_t)value);
         }
       }
       else
@@ -387,16 +638,16 @@ namespace format
         if(F & ZEROS)
         {
           if(F & RIGHT)
-            fprintf(stderr, "%0*" PRId64 " ", N, (int64_t)value);
+            format::printf("%0*" PRId64 " ", N, (int64_t)value);
           else
-            fprintf(stderr, "%-*" PRId64 " ", N, (int64_t)value);
+            format::printf("%-*" PRId64 " ", N, (int64_t)value);
         }
         else
         {
           if(F & RIGHT)
-            fprintf(stderr, "%*" PRId64 " ", N, (int64_t)value);
+            format::printf("%*" PRId64 " ", N, (int64_t)value);
           else
-            fprintf(stderr, "%-*" PRId64 " ", N, (int64_t)value);
+            format::printf("%-*" PRId64 " ", N, (int64_t)value);
         }
       }
     }
@@ -413,11 +664,11 @@ namespace format
       int len = strlen(title);
       O_("%-8.8s: ", title);
       _header<0, ELEMENTS...>(labels);
-      fprintf(stderr, ":");
+      format::printf(":");
       endline();
       O_("%-*.*s%*s: ", len, len, DASHES, 8 - len, "");
       _dashes<0, ELEMENTS...>();
-      fprintf(stderr, ":");
+      format::printf(":");
       endline();
     }
 
@@ -429,7 +680,7 @@ namespace format
       sprintf(head, "%02x", index);
       O_("%6.6s  : ", head);
       _row<0, ELEMENTS...>(args...);
-      fprintf(stderr, ":");
+      format::printf(":");
       endline();
     }
 
@@ -474,13 +725,110 @@ namespace format
    * Pattern printing classes.
    */
 
-#define HIGHLIGHT(str,n,t) (Config.highlight[n] & t) ? " " HIGHLIGHT_START str HIGHLIGHT_END : " " str
+  namespace render
+  {
+    /* Upper bound on the bytes a single pattern element renders to,
+     * including the leading space and highlight escape sequences. */
+    static constexpr size_t MAX_ELEMENT = 32;
+
+    struct hex_table
+    {
+      char pairs[256][2];
+
+      constexpr hex_table(): pairs{}
+      {
+        constexpr char digits[] = "0123456789abcdef";
+        for(int i = 0; i < 256; i++)
+        {
+          pairs[i][0] = digits[i >> 4];
+          pairs[i][1] = digits[i & 15];
+        }
+      }
+    };
+    static constexpr hex_table hex{};
+
+    /* %02x */
+    static inline char *hex2(char *dest, uint8_t value)
+    {
+      memcpy(dest, hex.pairs[value], 2);
+      return dest + 2;
+    }
+
+    /* %0Nx where N is 1, 2, or 3. */
+    static inline char *hexn(char *dest, unsigned value, int min_digits)
+    {
+      char tmp[8];
+      int len = 0;
+      do
+      {
+        tmp[len++] = hex.pairs[value & 15][1];
+        value >>= 4;
+      } while(value);
+
+      while(len < min_digits)
+        tmp[len++] = '0';
+      while(len)
+        *(dest++) = tmp[--len];
+      return dest;
+    }
+
+    static inline char *blank(char *dest, int count)
+    {
+      memset(dest, ' ', count);
+      return dest + count;
+    }
+
+    static inline char *text(char *dest, const char *str, size_t len)
+    {
+      memcpy(dest, str, len);
+      return dest + len;
+    }
+
+    /* Write " " followed by a rendered field, highlighted if requested. */
+    static inline char *field(char *dest, const char *str, size_t len, bool highlight)
+    {
+      *(dest++) = ' ';
+      if(highlight)
+      {
+        dest = text(dest, HIGHLIGHT_START, sizeof(HIGHLIGHT_START) - 1);
+        dest = text(dest, str, len);
+        return text(dest, HIGHLIGHT_END, sizeof(HIGHLIGHT_END) - 1);
+      }
+      return text(dest, str, len);
+    }
+
+    static inline bool highlight(uint8_t value, int type)
+    {
+      return Config.highlight_mask && (Config.highlight[value] & type);
+    }
+
+    static inline bool highlight_fx(uint8_t effect, uint8_t param)
+    {
+      constexpr int both = Highlight::EFFECT | Highlight::PARAMETER;
+      if(!(Config.highlight_mask & both))
+        return false;
 
-#define HIGHLIGHT_FX(str,effect,param) \
-  (( (Config.highlight_mask & (Highlight::EFFECT | Highlight::PARAMETER)) == (Highlight::EFFECT | Highlight::PARAMETER) ? \
-    (Config.highlight[effect] & Highlight::EFFECT) && (Config.highlight[param] & Highlight::PARAMETER) : \
-    (Config.highlight[effect] & Highlight::EFFECT) || (Config.highlight[param] & Highlight::PARAMETER)) ? \
-      " " HIGHLIGHT_START str HIGHLIGHT_END : " " str)
+      if((Config.highlight_mask & both) == both)
+        return (Config.highlight[effect] & Highlight::EFFECT) && (Config.highlight[param] & Highlight::PARAMETER);
+
+      return (Config.highlight[effect] & Highlight::EFFECT) || (Config.highlight[param] & Highlight::PARAMETER);
+    }
+
+    /* Render a %02x element; used by note, sample, and volume. */
+    static inline char *byte(char *dest, uint8_t value, int type)
+    {
+      char tmp[2];
+      hex2(tmp, value);
+      return field(dest, tmp, 2, highlight(value, type));
+    }
+  }
+
+  /**
+   * Pattern elements. Each has a fixed width() in characters (including the
+   * leading space) and a render() function which writes the element to a
+   * line buffer and returns the end of what it wrote. render() may write at
+   * most render::MAX_ELEMENT bytes.
+   */
 
   template<int EMPTY_NOTE=0>
   struct note
@@ -489,7 +837,7 @@ namespace format
     uint8_t enable = true;
     static constexpr int width() { return 3; }
     bool can_print() const { return enable && value != EMPTY_NOTE; }
-    void print() const { if(can_print()) fprintf(stderr, HIGHLIGHT("%02x", value, Highlight::NOTE), value); else spaces(width()); }
+    char *render(char *dest) const { return can_print() ? render::byte(dest, value, Highlight::NOTE) : render::blank(dest, width()); }
   };
 
   template<int EMPTY_INSTRUMENT=0>
@@ -499,7 +847,7 @@ namespace format
     uint8_t enable = true;
     static constexpr int width() { return 3; }
     bool can_print() const { return enable && value != EMPTY_INSTRUMENT; }
-    void print() const { if(can_print()) fprintf(stderr, HIGHLIGHT("%02x", value, Highlight::INSTRUMENT), value); else spaces(width()); }
+    char *render(char *dest) const { return can_print() ? render::byte(dest, value, Highlight::INSTRUMENT) : render::blank(dest, width()); }
   };
 
   template<int EMPTY_VOLUME=0>
@@ -509,7 +857,7 @@ namespace format
     uint8_t enable = true;
     static constexpr int width() { return 3; }
     bool can_print() const { return enable && value != EMPTY_VOLUME; }
-    void print() const { if(can_print()) fprintf(stderr, HIGHLIGHT("%02x", value, Highlight::VOLUME), value); else spaces(width()); }
+    char *render(char *dest) const { return can_print() ? render::byte(dest, value, Highlight::VOLUME) : render::blank(dest, width()); }
   };
 
   struct periodMOD
@@ -518,7 +866,13 @@ namespace format
     uint8_t enable = true;
     static constexpr int width() { return 4; }
     bool can_print() const { return enable && value != 0; }
-    void print() const { if(can_print()) fprintf(stderr, " %03x", value); else spaces(width()); } // TODO highlight.
+    char *render(char *dest) const // TODO highlight.
+    {
+      if(!can_print())
+        return render::blank(dest, width());
+      *(dest++) = ' ';
+      return render::hexn(dest, value, 3);
+    }
   };
 
   struct effect
@@ -527,7 +881,14 @@ namespace format
     uint8_t param;
     static constexpr int width() { return 4; }
     bool can_print() const { return effect > 0 || param > 0; }
-    void print() const { if(can_print()) fprintf(stderr, HIGHLIGHT_FX("%1x%02x", effect, param), effect, param); else spaces(width()); }
+    char *render(char *dest) const
+    {
+      if(!can_print())
+        return render::blank(dest, width());
+      char tmp[4];
+      char *end = render::hex2(render::hexn(tmp, effect, 1), param);
+      return render::field(dest, tmp, end - tmp, render::highlight_fx(effect, param));
+    }
   };
 
   struct effectXM
@@ -537,7 +898,14 @@ namespace format
     static constexpr int width() { return 4; }
     bool can_print() const { return effect > 0 || param > 0; }
     char effect_char() const { return (effect < 10) ? effect + '0' : (effect < 36) ? effect - 10 + 'A' : (effect == 36) ? '\\' : '?'; }
-    void print() const { if(can_print()) fprintf(stderr, HIGHLIGHT_FX("%c%02x", effect, param), effect_char(), param); else spaces(width()); }
+    char *render(char *dest) const
+    {
+      if(!can_print())
+        return render::blank(dest, width());
+      char tmp[3] = { effect_char() };
+      render::hex2(tmp + 1, param);
+      return render::field(dest, tmp, 3, render::highlight_fx(effect, param));
+    }
   };
 
   struct effectIT
@@ -547,7 +915,14 @@ namespace format
     static constexpr int width() { return 4; }
     bool can_print() const { return effect > 0; }
     char effect_char() const { return ((int)effect + '@' < 127) ? effect + '@' : '?'; }
-    void print() const { if(can_print()) fprintf(stderr, HIGHLIGHT_FX("%c%02x", effect, param), effect_char(), param); else spaces(width()); }
+    char *render(char *dest) const
+    {
+      if(!can_print())
+        return render::blank(dest, width());
+      char tmp[3] = { effect_char() };
+      render::hex2(tmp + 1, param);
+      return render::field(dest, tmp, 3, render::highlight_fx(effect, param));
+    }
   };
 
   /* 669 and FAR use a nibble effect + nibble param byte. */
@@ -557,7 +932,14 @@ namespace format
     uint8_t enable = true;
     static constexpr int width() { return 3; }
     bool can_print() const { return enable; }
-    void print() const { if(can_print()) fprintf(stderr, HIGHLIGHT_FX("%02x", effect >> 4, effect & 0xf), effect); else spaces(width()); }
+    char *render(char *dest) const
+    {
+      if(!can_print())
+        return render::blank(dest, width());
+      char tmp[2];
+      render::hex2(tmp, effect);
+      return render::field(dest, tmp, 2, render::highlight_fx(effect >> 4, effect & 0xf));
+    }
   };
 
   /* GDM, MED, Oktalyzer, etc. support >16 effects. */
@@ -567,7 +949,18 @@ namespace format
     uint8_t param;
     static constexpr int width() { return 5; }
     bool can_print() const { return effect > 0 || param > 0; }
-    void print() const { if(can_print()) fprintf(stderr, HIGHLIGHT_FX("%2x%02x", effect, param), effect, param); else spaces(width()); }
+    char *render(char *dest) const
+    {
+      if(!can_print())
+        return render::blank(dest, width());
+      char tmp[4] = { ' ' };
+      if(effect >= 16)
+        render::hex2(tmp, effect);
+      else
+        tmp[1] = render::hex.pairs[effect][1];
+      render::hex2(tmp + 2, param);
+      return render::field(dest, tmp, 4, render::highlight_fx(effect, param));
+    }
   };
 
   template<class... ELEMENTS>
@@ -625,28 +1018,29 @@ namespace format
       get_print_elements<0, ELEMENTS...>(print_element);
     }
 
+    static inline constexpr size_t max_render_size()
+    {
+      return sizeof...(ELEMENTS) * render::MAX_ELEMENT;
+    }
+
     template<unsigned int I>
-    bool print(const bool (&print_element)[sizeof...(ELEMENTS)]) const
+    char *render(char *dest, const bool (&print_element)[sizeof...(ELEMENTS)]) const
     {
-      return false;
+      return dest;
     }
 
     template<unsigned int I, class T, class... REST>
-    bool print(const bool (&print_element)[sizeof...(ELEMENTS)]) const
+    char *render(char *dest, const bool (&print_element)[sizeof...(ELEMENTS)]) const
     {
-      bool ret = false;
       if(print_element[I])
-      {
-        std::get<I>(data).print();
-        ret = true;
-      }
-      print<I + 1, REST...>(print_element);
-      return ret;
+        dest = std::get<I>(data).render(dest);
+      return render<I + 1, REST...>(dest, print_element);
     }
 
-    bool print(const bool (&print_element)[sizeof...(ELEMENTS)]) const
+    /* Render the printed elements of this event to a line buffer. */
+    char *render(char *dest, const bool (&print_element)[sizeof...(ELEMENTS)]) const
     {
-      return print<0, ELEMENTS...>(print_element);
+      return render<0, ELEMENTS...>(dest, print_element);
     }
   };
 
@@ -729,17 +1123,17 @@ namespace format
         return;
       O_("%4.4s %02x :", short_label, pattern_number);
       if(name)
-        fprintf(stderr, " '%s'", name);
+        format::printf(" '%s'", name);
 
-      fprintf(stderr, " %zu columns, %zu rows", columns, rows);
+      format::printf(" %zu columns, %zu rows", columns, rows);
 
       if(size_in_bytes)
-        fprintf(stderr, " (%zu bytes)", size_in_bytes);
+        format::printf(" (%zu bytes)", size_in_bytes);
 
       if(blank)
-        fprintf(stderr, "; %s is blank.\n", long_label);
+        format::printf("; %s is blank.\n", long_label);
       else
-        fprintf(stderr, "\n");
+        format::printf("\n");
 
       if(extra_message)
         O_("%-8.8s: %s\n", "", extra_message);
@@ -751,13 +1145,13 @@ namespace format
         return;
       O_("%-8.8s:", "");
       for(size_t i = 0; i < columns; i++)
-        fprintf(stderr, " %02x ", column_tracks[i]);
+        format::printf(" %02x ", column_tracks[i]);
       format::endline();
     }
 
     void print(const char **column_labels = nullptr, const int *column_tracks = nullptr)
     {
-      if(Config.quiet)
+      if(Config.quiet || current_record)
         return;
       // Determine which columns to print...
       bool print_any = false;
@@ -790,7 +1184,7 @@ namespace format
 
         if(column_labels && column_labels[track])
         {
-          fprintf(stderr, " %*.*s :", widths[track] - 1, widths[track] - 1, column_labels[track]);
+          format::printf(" %*.*s :", widths[track] - 1, widths[track] - 1, column_labels[track]);
         }
         else
 
@@ -798,10 +1192,10 @@ namespace format
         {
           char tmp[8];
           snprintf(tmp, sizeof(tmp), "T%02x", column_tracks[track]);
-          fprintf(stderr, " %-*s:", widths[track], tmp);
+          format::printf(" %-*s:", widths[track], tmp);
         }
         else
-          fprintf(stderr, " %02x%*s:", track, widths[track] - 2, "");
+          format::printf(" %02x%*s:", track, widths[track] - 2, "");
       }
       format::endline();
 
@@ -812,25 +1206,44 @@ namespace format
           continue;
 
         format::dashes(widths[track] + 1);
-        fprintf(stderr, ":");
+        format::printf(":");
       }
       format::endline();
 
+      /* Render each row into a line buffer and write it all at once. */
+      size_t line_size = 16 + 1;
+      for(size_t track = 0; track < columns; track++)
+        if(widths[track])
+          line_size += EVENT::max_render_size() + 2;
+
+      std::vector<char> line(line_size);
       const EVENT *ev = events.data();
       for(unsigned int row = 0; row < rows; row++)
       {
-        char rowstr[10];
-        sprintf(rowstr, "%02x", row);
-        O_("%6.6s  :", rowstr);
+        char *pos = line.data();
+        if(row < 256)
+        {
+          pos = render::text(pos, ":     ", 6);
+          pos = render::hex2(pos, row);
+          pos = render::text(pos, "  :", 3);
+        }
+        else
+        {
+          char rowstr[10];
+          snprintf(rowstr, sizeof(rowstr), "%02x", row);
+          pos += snprintf(pos, 16, ": %6.6s  :", rowstr);
+        }
+
         for(unsigned int track = 0; track < columns; track++, ev++)
         {
           if(!widths[track])
             continue;
 
-          ev->print(print_elements[track]);
-          fprintf(stderr, " :");
+          pos = ev->render(pos, print_elements[track]);
+          pos = render::text(pos, " :", 2);
         }
-        format::endline();
+        *(pos++) = '\n';
+        format::write(line.data(), pos - line.data());
       }
     }
   };
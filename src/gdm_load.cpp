@@ -24,10 +24,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 #include "modutil.hpp"
 
-static int total_gdms = 0;
+static std::atomic<int> total_gdms;
 
 
 enum GDM_features
@@ -752,9 +753,9 @@ static modutil::error GDM_read(FILE *fp)
       {
         if(h.panning[k] == 255)
           continue;
-        fprintf(stderr, " %02x", h.panning[k]);
+        format::printf(" %02x", h.panning[k]);
       }
-      fprintf(stderr, "\n");
+      format::printf("\n");
     }
 
     format::orders("Orders", m.orders, h.num_orders);
@@ -812,7 +813,8 @@ static modutil::error GDM_read(FILE *fp)
 class GDM_loader : modutil::loader
 {
 public:
-  GDM_loader(): modutil::loader("GDM", "bwsb", "General Digital Music") {}
+  GDM_loader(): modutil::loader("GDM", "bwsb", "General Digital Music",
+   {{ 0, MAGIC }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
@@ -24,11 +24,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 #include "Bitstream.hpp"
 #include "modutil.hpp"
+#include "query.hpp"
+#include "dimgutil/crc32.h"
 
-static int num_its;
+static std::atomic<int> num_its;
 //static int num_it_instrument_mode;
 //static int num_it_sample_gvol;
 //static int num_it_sample_vibrato;
@@ -113,6 +116,12 @@ enum IT_sample_flags
   SAMPLE_BIDI_SUSTAIN_LOOP = (1 << 7),
 };
 
+enum IT_sample_convert
+{
+  CVT_SIGNED               = (1 << 0),
+  CVT_DELTA                = (1 << 2), /* IT 2.15 compression for compressed samples. */
+};
+
 enum IT_vibrato_waveforms
 {
   WF_SINE_WAVE,
@@ -248,8 +257,30 @@ struct IT_sample
   uint32_t smallest_block;
   uint32_t smallest_block_samples;
   uint32_t largest_block;
+  uint32_t crc32;
 };
 
+using IT_sample_layout = layout::record<IT_sample, 80,
+  layout::bytes<&IT_sample::magic,               0>,
+  layout::bytes<&IT_sample::filename,            4>,
+  layout::u8   <&IT_sample::global_volume,      17>,
+  layout::u8   <&IT_sample::flags,              18>,
+  layout::u8   <&IT_sample::default_volume,     19>,
+  layout::bytes<&IT_sample::name,               20>,
+  layout::u8   <&IT_sample::convert,            46>,
+  layout::u8   <&IT_sample::default_pan,        47>,
+  layout::u32le<&IT_sample::length,             48>,
+  layout::u32le<&IT_sample::loop_start,         52>,
+  layout::u32le<&IT_sample::loop_end,           56>,
+  layout::u32le<&IT_sample::c5_speed,           60>,
+  layout::u32le<&IT_sample::sustain_loop_start, 64>,
+  layout::u32le<&IT_sample::sustain_loop_end,   68>,
+  layout::u32le<&IT_sample::sample_data_offset, 72>,
+  layout::u8   <&IT_sample::vibrato_speed,      76>,
+  layout::u8   <&IT_sample::vibrato_depth,      77>,
+  layout::u8   <&IT_sample::vibrato_waveform,   78>,
+  layout::u8   <&IT_sample::vibrato_rate,       79>>;
+
 struct IT_event
 {
   enum
@@ -429,6 +460,30 @@ struct IT_header
   /* 192 */
 };
 
+using IT_header_layout = layout::record<IT_header, 192,
+  layout::bytes<&IT_header::magic,              0>,
+  layout::bytes<&IT_header::name,               4>,
+  layout::u16le<&IT_header::highlight,         30>,
+  layout::u16le<&IT_header::num_orders,        32>,
+  layout::u16le<&IT_header::num_instruments,   34>,
+  layout::u16le<&IT_header::num_samples,       36>,
+  layout::u16le<&IT_header::num_patterns,      38>,
+  layout::u16le<&IT_header::tracker_version,   40>,
+  layout::u16le<&IT_header::format_version,    42>,
+  layout::u16le<&IT_header::flags,             44>,
+  layout::u16le<&IT_header::special,           46>,
+  layout::u8   <&IT_header::global_volume,     48>,
+  layout::u8   <&IT_header::mix_volume,        49>,
+  layout::u8   <&IT_header::initial_speed,     50>,
+  layout::u8   <&IT_header::initial_tempo,     51>,
+  layout::u8   <&IT_header::pan_separation,    52>,
+  layout::u8   <&IT_header::midi_pitch_wheel,  53>,
+  layout::u16le<&IT_header::message_length,    54>,
+  layout::u32le<&IT_header::message_offset,    56>,
+  layout::u32le<&IT_header::reserved,          60>,
+  layout::bytes<&IT_header::channel_pan,       64>,
+  layout::bytes<&IT_header::channel_volume,   128>>;
+
 struct IT_data
 {
   IT_header     header;
@@ -463,126 +518,205 @@ static void IT_string_fix(char (&name)[LEN])
   name[LEN - 1] = '\0';
 }
 
-static bool IT_scan_compressed_sample(FILE *fp, IT_data &m, IT_sample &s)
+enum IT_unpack_result
 {
-  bool is_16_bit = !!(s.flags & SAMPLE_16_BIT);
-  int block_num = 0;
+  IT_UNPACK_OK,
+  IT_UNPACK_TRUNCATED,
+  IT_UNPACK_INVALID_WIDTH
+};
 
-  if(fseek(fp, s.sample_data_offset, SEEK_SET))
-    return false;
+/**
+ * Decode one IT 2.14/2.15 compressed block to signed little endian PCM.
+ * The decoder state restarts with every block, so blocks don't depend on
+ * each other. If the input ends early or the block switches to an invalid
+ * bit width, the rest of the block is filled with zeroes.
+ */
+template<unsigned SAMPLE_BITS>
+static IT_unpack_result IT_unpack_block(uint8_t *dest, size_t num_samples,
+ const uint8_t *src, size_t src_len, bool is_it215)
+{
+  using bitstream = Bitstream<Bitorder::LSB>;
+  static constexpr unsigned MAX_WIDTH = SAMPLE_BITS + 1;
+  static constexpr unsigned WIDTH_BITS = (SAMPLE_BITS == 16) ? 4 : 3;
+  static constexpr unsigned BYTES = SAMPLE_BITS / 8;
+  static constexpr uint32_t MASK = (1u << SAMPLE_BITS) - 1;
+
+  bitstream bs(src, src_len);
+  IT_unpack_result result = IT_UNPACK_OK;
+  unsigned width = MAX_WIDTH;
+  uint32_t delta = 0;
+  uint32_t delta2 = 0;
+  size_t i = 0;
+
+  while(i < num_samples)
+  {
+    /* Codes from lo to lo + range change the bit width; anything else
+     * is a sample. */
+    uint32_t lo;
+    uint32_t range;
+    if(width < 7)
+    {
+      lo = 1u << (width - 1);
+      range = 0;
+    }
+    else
 
-  s.scanned = false;
-  s.compressed_bytes = 0;
-  s.uncompressed_bytes = s.length * (is_16_bit ? 2 : 1) * (s.flags & SAMPLE_STEREO ? 2 : 1);
-  s.smallest_block = 0xffffffffu;
-  s.smallest_block_samples = 0;
-  s.largest_block = 0u;
+    if(width < MAX_WIDTH)
+    {
+      // trust in olivier lapicque's incomprehensible mess
+      lo = (MASK >> (MAX_WIDTH - width)) - SAMPLE_BITS / 2 + 1;
+      range = SAMPLE_BITS - 1;
+    }
+    else
+    {
+      lo = 1u << SAMPLE_BITS;
+      range = MASK;
+    }
 
-  for(uint32_t pos = 0; pos < s.length; block_num++)
-  {
-    uint16_t block_uncompressed_samples = is_16_bit ? 0x4000 : 0x8000;
-    uint16_t block_compressed_bytes = fget_u16le(fp);
-    uint16_t bit_width = is_16_bit ? 17 : 9;
+    unsigned shift = 32 - width;
+    uint32_t value = 0;
+    bool change = false;
 
-    if(feof(fp))
-      return false;
+    /* Unpack samples until the width changes. Codes are read without
+     * checking the input in batches of as many as are buffered. */
+    while(!change && i < num_samples)
+    {
+      if(!bs.fill(bitstream::MAX_FILL) && bs.available() < width)
+        break;
 
-    s.compressed_bytes += block_compressed_bytes + 2;
+      size_t stop = MIN(num_samples, i + bs.available() / width);
+      for(; i < stop; i++)
+      {
+        value = bs.peek(width);
+        bs.consume(width);
+        if(value - lo <= range)
+        {
+          change = true;
+          break;
+        }
 
-    if(s.length - pos < block_uncompressed_samples)
-      block_uncompressed_samples = s.length - pos;
+        // Sign extend and unpack sample.
+        delta += (uint32_t)((int32_t)(value << shift) >> shift);
+        delta2 += delta;
 
-    if(block_compressed_bytes > s.largest_block)
-      s.largest_block = block_compressed_bytes;
+        uint32_t out = is_it215 ? delta2 : delta;
+        dest[i * BYTES] = out;
+        if(BYTES > 1)
+          dest[i * BYTES + 1] = out >> 8;
+      }
+    }
 
-    if(block_compressed_bytes < s.smallest_block)
+    if(!change)
     {
-      s.smallest_block = block_compressed_bytes;
-      s.smallest_block_samples = block_uncompressed_samples;
+      if(i < num_samples)
+        result = IT_UNPACK_TRUNCATED;
+      break;
     }
 
-    if(!fread(m.workbuf.data(), block_compressed_bytes, 1, fp))
-      return false;
-
-    Bitstream bs(m.workbuf, block_compressed_bytes);
-    //O_("block of size %u -> %u samples\n", block_compressed_bytes, block_uncompressed_samples);
-    for(uint32_t i = 0; i < block_uncompressed_samples;)
+    // Change bitwidth.
+    if(width < 7)
     {
-      ssize_t code = bs.read(bit_width);
-      if(code < 0)
+      int new_width = bs.read(WIDTH_BITS);
+      if(new_width < 0)
+      {
+        result = IT_UNPACK_TRUNCATED;
         break;
+      }
+      value = new_width + 1;
+    }
+    else
 
-      if(bit_width >= 1 && bit_width <= 6)
+    if(width < MAX_WIDTH)
+    {
+      value -= lo - 1;
+    }
+    else
+    {
+      width = (value & 0xff) + 1;
+      if(width > MAX_WIDTH)
       {
-        if(code == (1 << (bit_width - 1)))
-        {
-          // Change bitwidth.
-          ssize_t new_bit_width = bs.read(is_16_bit ? 4 : 3) + 1;
-          if(new_bit_width <= 0)
-            return false;
-
-          bit_width = (new_bit_width < bit_width) ? new_bit_width : new_bit_width + 1;
-          //O_("bit width now %u\n", bit_width);
-          continue;
-        }
-        // Unpack sample.
-        pos++;
-        i++;
+        result = IT_UNPACK_INVALID_WIDTH;
+        break;
       }
-      else
+      continue;
+    }
+    width = (value < width) ? value : value + 1;
+  }
 
-      if(bit_width <= (is_16_bit ? 16 : 8))
-      {
-        // trust in olivier lapicque's incomprehensible mess
-        uint16_t a, b;
-        if(is_16_bit)
-        {
-          a = (0xffff >> (17 - bit_width)) + 8;
-          b = a - 16;
-        }
-        else
-        {
-          a = (0xff >> (9 - bit_width)) + 4;
-          b = a - 8;
-        }
+  if(i < num_samples)
+    memset(dest + i * BYTES, 0, (num_samples - i) * BYTES);
 
-        if(code > b && code <= a)
-        {
-          // Change bitwidth.
-          code -= b;
-          bit_width = (code < bit_width) ? code : code + 1;
-          //O_("bit width now %u\n", bit_width);
-          continue;
-        }
+  return result;
+}
 
-        // Unpack sample.
-        pos++;
-        i++;
-      }
-      else
+/**
+ * Decode an IT 2.14/2.15 compressed sample block by block into m.workbuf,
+ * collecting block statistics and (if requested) the CRC-32 of the PCM.
+ * Stereo samples store every block of the left channel, then the right.
+ */
+static bool IT_unpack_compressed_sample(vio_reader<> &vf, IT_data &m, IT_sample &s, bool get_crc)
+{
+  bool is_16_bit = !!(s.flags & SAMPLE_16_BIT);
+  bool is_it215 = !!(s.convert & CVT_DELTA);
+  unsigned channels = (s.flags & SAMPLE_STEREO) ? 2 : 1;
+  unsigned bytes_per_sample = is_16_bit ? 2 : 1;
+  int block_num = 0;
 
-      if(bit_width == (is_16_bit ? 17 : 9))
-      {
-        if(code & (is_16_bit ? 0x10000 : 0x100))
-        {
-          // Change bitwidth.
-          bit_width = (code & 0xff) + 1;
-          //O_("bit_width now %u\n", bit_width);
-          continue;
-        }
+  if(vf.seek(s.sample_data_offset, SEEK_SET))
+    return false;
+
+  s.scanned = false;
+  s.compressed_bytes = 0;
+  s.uncompressed_bytes = s.length * bytes_per_sample * channels;
+  s.smallest_block = 0xffffffffu;
+  s.smallest_block_samples = 0;
+  s.largest_block = 0u;
+  s.crc32 = 0;
+
+  for(unsigned ch = 0; ch < channels; ch++)
+  {
+    for(uint32_t pos = 0; pos < s.length; block_num++)
+    {
+      uint16_t block_uncompressed_samples = is_16_bit ? 0x4000 : 0x8000;
+      uint16_t block_compressed_bytes = vf.u16le();
 
-        // Unpack sample.
-        pos++;
-        i++;
+      if(vf.eof())
+        return false;
+
+      s.compressed_bytes += block_compressed_bytes + 2;
+
+      if(s.length - pos < block_uncompressed_samples)
+        block_uncompressed_samples = s.length - pos;
+
+      if(block_compressed_bytes > s.largest_block)
+        s.largest_block = block_compressed_bytes;
+
+      if(block_compressed_bytes < s.smallest_block)
+      {
+        s.smallest_block = block_compressed_bytes;
+        s.smallest_block_samples = block_uncompressed_samples;
       }
-      else
+
+      const uint8_t *block = vf.span(block_compressed_bytes);
+      if(!block)
+        return false;
+
+      uint8_t *pcm = m.workbuf.data();
+      IT_unpack_result res = is_16_bit ?
+        IT_unpack_block<16>(pcm, block_uncompressed_samples, block, block_compressed_bytes, is_it215) :
+        IT_unpack_block<8>(pcm, block_uncompressed_samples, block, block_compressed_bytes, is_it215);
+
+      if(res == IT_UNPACK_INVALID_WIDTH)
       {
         // Invalid width--prematurely end block.
-        format::warning("invalid bit width %u in block %d", bit_width, block_num);
+        format::warning("invalid bit width in block %d", block_num);
         m.uses[FT_SAMPLE_COMPRESSION_INVALID_WIDTH] = true;
-        pos += block_uncompressed_samples - i;
-        break;
       }
+
+      if(get_crc)
+        s.crc32 = dimgutil_crc32(s.crc32, pcm, block_uncompressed_samples * bytes_per_sample);
+
+      pos += block_uncompressed_samples;
     }
   }
   s.scanned = true;
@@ -590,67 +724,87 @@ static bool IT_scan_compressed_sample(FILE *fp, IT_data &m, IT_sample &s)
 }
 
 /**
- * Read an IT sample.
+ * Read a truncated IT sample field by field so the fields that are present
+ * still get printed.
  */
-static modutil::error IT_read_sample(FILE *fp, IT_sample &s)
+static modutil::error IT_read_sample_partial(vio_reader<> &vf, IT_sample &s)
 {
-  if(!fread(s.magic, 4, 1, fp))
+  if(vf.read(s.magic, 4) < 4)
     return modutil::READ_ERROR;
   if(strncmp(s.magic, "IMPS", 4))
     return modutil::IT_INVALID_SAMPLE;
 
-  if(!fread(s.filename, 13, 1, fp))
+  if(vf.read(s.filename, 13) < 13)
     return modutil::READ_ERROR;
   s.filename[12] = '\0';
 
-  s.global_volume      = fgetc(fp);
-  s.flags              = fgetc(fp);
-  s.default_volume     = fgetc(fp);
+  s.global_volume      = vf.u8();
+  s.flags              = vf.u8();
+  s.default_volume     = vf.u8();
 
-  if(!fread(s.name, 26, 1, fp))
+  if(vf.read(s.name, 26) < 26)
     return modutil::READ_ERROR;
   IT_string_fix(s.name);
 
-  s.convert            = fgetc(fp);
-  s.default_pan        = fgetc(fp);
-  s.length             = fget_u32le(fp);
-  s.loop_start         = fget_u32le(fp);
-  s.loop_end           = fget_u32le(fp);
-  s.c5_speed           = fget_u32le(fp);
-  s.sustain_loop_start = fget_u32le(fp);
-  s.sustain_loop_end   = fget_u32le(fp);
-  s.sample_data_offset = fget_u32le(fp);
-  s.vibrato_speed      = fgetc(fp);
-  s.vibrato_depth      = fgetc(fp);
-  s.vibrato_waveform   = fgetc(fp);
-  s.vibrato_rate       = fgetc(fp);
-
-  if(feof(fp))
-    return modutil::READ_ERROR;
+  s.convert            = vf.u8();
+  s.default_pan        = vf.u8();
+  s.length             = vf.u32le();
+  s.loop_start         = vf.u32le();
+  s.loop_end           = vf.u32le();
+  s.c5_speed           = vf.u32le();
+  s.sustain_loop_start = vf.u32le();
+  s.sustain_loop_end   = vf.u32le();
+  s.sample_data_offset = vf.u32le();
+  s.vibrato_speed      = vf.u8();
+  s.vibrato_depth      = vf.u8();
+  s.vibrato_waveform   = vf.u8();
+  s.vibrato_rate       = vf.u8();
+  return modutil::READ_ERROR;
+}
 
+/**
+ * Read an IT sample.
+ */
+static modutil::error IT_read_sample(vio_reader<> &vf, IT_sample &s)
+{
+  int64_t pos = vf.tell();
+  const uint8_t *buffer = vf.span(IT_sample_layout::size);
+  if(!buffer)
+  {
+    if(vf.seek(pos, SEEK_SET))
+      return modutil::READ_ERROR;
+    return IT_read_sample_partial(vf, s);
+  }
+
+  IT_sample_layout::decode(s, buffer);
+  if(strncmp(s.magic, "IMPS", 4))
+    return modutil::IT_INVALID_SAMPLE;
+
+  s.filename[12] = '\0';
+  IT_string_fix(s.name);
   return modutil::SUCCESS;
 }
 
 /**
  * Read an IT envelope.
  */
-static modutil::error IT_read_envelope(FILE *fp, IT_envelope &env)
+static modutil::error IT_read_envelope(vio_reader<> &vf, IT_envelope &env)
 {
-  env.flags         = fgetc(fp);
-  env.num_nodes     = fgetc(fp);
-  env.loop_start    = fgetc(fp);
-  env.loop_end      = fgetc(fp);
-  env.sustain_start = fgetc(fp);
-  env.sustain_end   = fgetc(fp);
+  env.flags         = vf.u8();
+  env.num_nodes     = vf.u8();
+  env.loop_start    = vf.u8();
+  env.loop_end      = vf.u8();
+  env.sustain_start = vf.u8();
+  env.sustain_end   = vf.u8();
 
   static_assert(MAX_ENVELOPE >= 25, "wtf?");
   for(size_t i = 0; i < 25; i++)
   {
-    env.nodes[i].value = fgetc(fp);
-    env.nodes[i].tick  = fget_u16le(fp);
+    env.nodes[i].value = vf.u8();
+    env.nodes[i].tick  = vf.u16le();
   }
-  fgetc(fp); /* Padding byte. */
-  if(feof(fp))
+  vf.u8(); /* Padding byte. */
+  if(vf.eof())
     return modutil::READ_ERROR;
 
   return modutil::SUCCESS;
@@ -659,57 +813,57 @@ static modutil::error IT_read_envelope(FILE *fp, IT_envelope &env)
 /**
  * Read an IT instrument.
  */
-static modutil::error IT_read_instrument(FILE *fp, IT_instrument &ins)
+static modutil::error IT_read_instrument(vio_reader<> &vf, IT_instrument &ins)
 {
-  if(!fread(ins.magic, 4, 1, fp))
+  if(vf.read(ins.magic, 4) < 4)
     return modutil::READ_ERROR;
   if(strncmp(ins.magic, "IMPI", 4))
     return modutil::IT_INVALID_INSTRUMENT;
 
-  if(!fread(ins.filename, 13, 1, fp))
+  if(vf.read(ins.filename, 13) < 13)
     return modutil::READ_ERROR;
   ins.filename[12] = '\0';
 
-  ins.new_note_act          = fgetc(fp);
-  ins.duplicate_check_type  = fgetc(fp);
-  ins.duplicate_check_act   = fgetc(fp);
-  ins.fadeout               = fget_u16le(fp);
-  ins.pitch_pan_sep         = fgetc(fp);
-  ins.pitch_pan_center      = fgetc(fp);
-  ins.global_volume         = fgetc(fp);
-  ins.default_pan           = fgetc(fp);
-  ins.random_volume         = fgetc(fp);
-  ins.random_pan            = fgetc(fp);
-  ins.tracker_version       = fget_u16le(fp);
-  ins.num_samples           = fgetc(fp);
-  ins.pad                   = fgetc(fp);
-
-  if(!fread(ins.name, 26, 1, fp))
+  ins.new_note_act          = vf.u8();
+  ins.duplicate_check_type  = vf.u8();
+  ins.duplicate_check_act   = vf.u8();
+  ins.fadeout               = vf.u16le();
+  ins.pitch_pan_sep         = vf.u8();
+  ins.pitch_pan_center      = vf.u8();
+  ins.global_volume         = vf.u8();
+  ins.default_pan           = vf.u8();
+  ins.random_volume         = vf.u8();
+  ins.random_pan            = vf.u8();
+  ins.tracker_version       = vf.u16le();
+  ins.num_samples           = vf.u8();
+  ins.pad                   = vf.u8();
+
+  if(vf.read(ins.name, 26) < 26)
     return modutil::READ_ERROR;
   IT_string_fix(ins.name);
 
-  ins.init_filter_cutoff    = fgetc(fp);
-  ins.init_filter_resonance = fgetc(fp);
-  ins.midi_channel          = fgetc(fp);
-  ins.midi_program          = fgetc(fp);
-  ins.midi_bank             = fget_u16le(fp);
+  ins.init_filter_cutoff    = vf.u8();
+  ins.init_filter_resonance = vf.u8();
+  ins.midi_channel          = vf.u8();
+  ins.midi_program          = vf.u8();
+  ins.midi_bank             = vf.u16le();
 
   for(size_t i = 0; i < 120; i++)
   {
-    ins.keymap[i].note   = fgetc(fp);
-    ins.keymap[i].sample = fgetc(fp);
+    ins.keymap[i].note   = vf.u8();
+    ins.keymap[i].sample = vf.u8();
   }
-  if(feof(fp))
+  if(vf.eof())
     return modutil::READ_ERROR;
 
   modutil::error ret;
-  ret = IT_read_envelope(fp, ins.env_volume);
+  ret = IT_read_envelope(vf, ins.env_volume);
   if(ret != modutil::SUCCESS)
     return ret;
-  ret = IT_read_envelope(fp, ins.env_pan);
+  ret = IT_read_envelope(vf, ins.env_pan);
   if(ret != modutil::SUCCESS)
     return ret;
-  ret = IT_read_envelope(fp, ins.env_pitch);
+  ret = IT_read_envelope(vf, ins.env_pitch);
   if(ret != modutil::SUCCESS)
     return ret;
 
@@ -724,66 +878,66 @@ static modutil::error IT_read_instrument(FILE *fp, IT_instrument &ins)
 /**
  * Read an IT instrument (1.x).
  */
-static modutil::error IT_read_old_instrument(FILE *fp, IT_instrument &ins)
+static modutil::error IT_read_old_instrument(vio_reader<> &vf, IT_instrument &ins)
 {
-  if(!fread(ins.magic, 4, 1, fp))
+  if(vf.read(ins.magic, 4) < 4)
     return modutil::READ_ERROR;
   if(strncmp(ins.magic, "IMPI", 4))
     return modutil::IT_INVALID_INSTRUMENT;
 
-  if(!fread(ins.filename, 13, 1, fp))
+  if(vf.read(ins.filename, 13) < 13)
     return modutil::READ_ERROR;
   ins.filename[12] = '\0';
 
   IT_envelope &env = ins.env_volume;
 
-  env.flags         = fgetc(fp);
-  env.loop_start    = fgetc(fp);
-  env.loop_end      = fgetc(fp);
-  env.sustain_start = fgetc(fp);
-  env.sustain_end   = fgetc(fp);
-  fgetc(fp);
-  fgetc(fp);
-
-  ins.fadeout              = fget_u16le(fp) << 1;
-  ins.new_note_act         = fgetc(fp);
-  ins.duplicate_check_type = fgetc(fp) & 1;
+  env.flags         = vf.u8();
+  env.loop_start    = vf.u8();
+  env.loop_end      = vf.u8();
+  env.sustain_start = vf.u8();
+  env.sustain_end   = vf.u8();
+  vf.u8();
+  vf.u8();
+
+  ins.fadeout              = vf.u16le() << 1;
+  ins.new_note_act         = vf.u8();
+  ins.duplicate_check_type = vf.u8() & 1;
   ins.duplicate_check_act  = 1;
-  ins.tracker_version      = fget_u16le(fp);
-  ins.num_samples          = fgetc(fp);
-  ins.pad                  = fgetc(fp);
+  ins.tracker_version      = vf.u16le();
+  ins.num_samples          = vf.u8();
+  ins.pad                  = vf.u8();
 
-  if(!fread(ins.name, 26, 1, fp))
+  if(vf.read(ins.name, 26) < 26)
     return modutil::READ_ERROR;
   IT_string_fix(ins.name);
-  fgetc(fp);
-  fgetc(fp);
-  fgetc(fp);
-  fgetc(fp);
-  fgetc(fp);
-  fgetc(fp);
+  vf.u8();
+  vf.u8();
+  vf.u8();
+  vf.u8();
+  vf.u8();
+  vf.u8();
 
   for(size_t i = 0; i < 120; i++)
   {
-    ins.keymap[i].note   = fgetc(fp);
-    ins.keymap[i].sample = fgetc(fp);
+    ins.keymap[i].note   = vf.u8();
+    ins.keymap[i].sample = vf.u8();
   }
-  if(feof(fp))
+  if(vf.eof())
     return modutil::READ_ERROR;
 
   /* Envelope points (??) */
-  if(fseek(fp, 200, SEEK_CUR))
+  if(vf.seek(200, SEEK_CUR))
     return modutil::SEEK_ERROR;
 
   static_assert(MAX_ENVELOPE >= 25, "wtf?");
   size_t num_nodes;
   for(num_nodes = 0; num_nodes < 25; num_nodes++)
   {
-    env.nodes[num_nodes].tick  = fgetc(fp);
-    env.nodes[num_nodes].value = fgetc(fp);
+    env.nodes[num_nodes].tick  = vf.u8();
+    env.nodes[num_nodes].value = vf.u8();
   }
   env.num_nodes = num_nodes;
-  if(feof(fp))
+  if(vf.eof())
     return modutil::READ_ERROR;
 
   /* These don't exist for old instruments. */
@@ -854,15 +1008,19 @@ struct last_event
   uint8_t param;
 };
 
-static modutil::error IT_read_pattern(IT_data &m, IT_pattern &p, const std::vector<uint8_t> &stream)
+static modutil::error IT_read_pattern(IT_data &m, IT_pattern &p, size_t pattern_num,
+ const std::vector<uint8_t> &stream)
 {
   if(p.num_rows < 1 || p.num_channels < 1)
     return modutil::SUCCESS;
 
-  p.allocate();
+  /* Events are only kept if they will be printed. */
+  if(Config.dump_pattern_rows)
+    p.allocate();
 
   uint8_t mask[64]{};
   last_event last_events[64]{};
+  bool check_query = modutil::query::enabled;
 
   for(size_t row = 0, i = 0; row < p.num_rows && i < p.raw_size;)
   {
@@ -887,7 +1045,8 @@ static modutil::error IT_read_pattern(IT_data &m, IT_pattern &p, const std::vect
       mask[channel] = stream[i++];
     }
 
-    IT_event &ev = p.events[row * p.num_channels + channel];
+    IT_event tmp{};
+    IT_event &ev = p.events ? p.events[row * p.num_channels + channel] : tmp;
     if(mask[channel] & IT_event::NOTE)
     {
       if(p.raw_size - i < 1)
@@ -934,6 +1093,14 @@ static modutil::error IT_read_pattern(IT_data &m, IT_pattern &p, const std::vect
       ev.param  = last.param;
     }
 
+    if(check_query)
+      modutil::query::event(pattern_num, row, channel,
+       (mask[channel] & (IT_event::NOTE | IT_event::LAST_NOTE) ? Highlight::NOTE : 0) |
+       (mask[channel] & (IT_event::INSTRUMENT | IT_event::LAST_INSTRUMENT) ? Highlight::INSTRUMENT : 0) |
+       (mask[channel] & (IT_event::VOLUME | IT_event::LAST_VOLUME) ? Highlight::VOLUME : 0) |
+       ((mask[channel] & (IT_event::EFFECT | IT_event::LAST_EFFECT)) && ev.effect ? Highlight::EFFECT : 0),
+       ev.note, ev.instrument, last.volume, ev.effect, ev.param);
+
     if(ev.effect == ('S'-'@') && (ev.param >> 4) == 0xf)
       m.uses[FT_E_MACROSET] = true;
     if(ev.effect == ('Z'-'@'))
@@ -948,47 +1115,23 @@ static modutil::error IT_read_pattern(IT_data &m, IT_pattern &p, const std::vect
 /**
  * Read an IT file.
  */
-static modutil::error IT_read(FILE *fp)
+static modutil::error IT_read(vio_reader<> &vf)
 {
   IT_data m{};
   IT_header &h = m.header;
 
-  if(!fread(h.magic, 4, 1, fp))
-    return modutil::FORMAT_ERROR;
+  const uint8_t *buffer = vf.span(IT_header_layout::size);
+  if(!buffer)
+    return modutil::READ_ERROR;
 
+  IT_header_layout::decode(h, buffer);
   if(strncmp(h.magic, "IMPM", 4))
     return modutil::FORMAT_ERROR;
 
   num_its++;
 
-  if(!fread(h.name, 26, 1, fp))
-    return modutil::READ_ERROR;
   IT_string_fix(h.name);
 
-  h.highlight        = fget_u16le(fp);
-  h.num_orders       = fget_u16le(fp);
-  h.num_instruments  = fget_u16le(fp);
-  h.num_samples      = fget_u16le(fp);
-  h.num_patterns     = fget_u16le(fp);
-  h.tracker_version  = fget_u16le(fp);
-  h.format_version   = fget_u16le(fp);
-  h.flags            = fget_u16le(fp);
-  h.special          = fget_u16le(fp);
-  h.global_volume    = fgetc(fp);
-  h.mix_volume       = fgetc(fp);
-  h.initial_speed    = fgetc(fp);
-  h.initial_tempo    = fgetc(fp);
-  h.pan_separation   = fgetc(fp);
-  h.midi_pitch_wheel = fgetc(fp);
-  h.message_length   = fget_u16le(fp);
-  h.message_offset   = fget_u32le(fp);
-  h.reserved         = fget_u32le(fp);
-
-  if(!fread(h.channel_pan, 64, 1, fp))
-    return modutil::READ_ERROR;
-  if(!fread(h.channel_volume, 64, 1, fp))
-    return modutil::READ_ERROR;
-
   if(h.format_version < 0x200)
     m.uses[FT_OLD_FORMAT] = true;
 
@@ -1003,7 +1146,7 @@ static modutil::error IT_read(FILE *fp)
   if(h.num_orders)
   {
     m.orders.resize(h.num_orders);
-    if(!fread(m.orders.data(), h.num_orders, 1, fp))
+    if(vf.read(m.orders.data(), h.num_orders) < h.num_orders)
       return modutil::READ_ERROR;
   }
 
@@ -1011,8 +1154,8 @@ static modutil::error IT_read(FILE *fp)
   {
     m.instrument_offsets.resize(h.num_instruments);
     for(size_t i = 0; i < h.num_instruments; i++)
-      m.instrument_offsets[i] = fget_u32le(fp);
-    if(feof(fp))
+      m.instrument_offsets[i] = vf.u32le();
+    if(vf.eof())
       return modutil::READ_ERROR;
   }
 
@@ -1020,8 +1163,8 @@ static modutil::error IT_read(FILE *fp)
   {
     m.sample_offsets.resize(h.num_samples);
     for(size_t i = 0; i < h.num_samples; i++)
-      m.sample_offsets[i] = fget_u32le(fp);
-    if(feof(fp))
+      m.sample_offsets[i] = vf.u32le();
+    if(vf.eof())
       return modutil::READ_ERROR;
   }
 
@@ -1029,15 +1172,15 @@ static modutil::error IT_read(FILE *fp)
   {
     m.pattern_offsets.resize(h.num_patterns);
     for(size_t i = 0; i < h.num_patterns; i++)
-      m.pattern_offsets[i] = fget_u32le(fp);
-    if(feof(fp))
+      m.pattern_offsets[i] = vf.u32le();
+    if(vf.eof())
       return modutil::READ_ERROR;
   }
 
   /* "Read extra info"? */
   {
-    uint16_t skip = fget_u16le(fp);
-    if(feof(fp) || (skip && fseek(fp, skip * 8, SEEK_CUR) < 0))
+    uint16_t skip = vf.u16le();
+    if(vf.eof() || (skip && vf.seek(skip * 8, SEEK_CUR) < 0))
       return modutil::READ_ERROR;
   }
 
@@ -1047,19 +1190,19 @@ static modutil::error IT_read(FILE *fp)
     IT_midiconfig &midi = m.midi;
     for(int i = 0; i < arraysize(midi.global); i++)
     {
-      if(fread(midi.global[i], 1, 32, fp) < 32)
+      if(vf.read(midi.global[i], 32) < 32)
         return modutil::READ_ERROR;
       midi.global[i][31] = '\0';
     }
     for(int i = 0; i < arraysize(midi.sfx); i++)
     {
-      if(fread(midi.sfx[i], 1, 32, fp) < 32)
+      if(vf.read(midi.sfx[i], 32) < 32)
         return modutil::READ_ERROR;
       midi.sfx[i][31] = '\0';
     }
     for(int i = 0; i < arraysize(midi.zxx); i++)
     {
-      if(fread(midi.zxx[i], 1, 32, fp) < 32)
+      if(vf.read(midi.zxx[i], 32) < 32)
         return modutil::READ_ERROR;
       midi.zxx[i][31] = '\0';
     }
@@ -1068,7 +1211,7 @@ static modutil::error IT_read(FILE *fp)
   /* MPT extension: pattern names */
   /* MPT extension: channel names */
 
-  /* Buffer used for pattern data and checks on sample compression. */
+  /* Buffer used for pattern data and decoded compressed sample blocks. */
   m.workbuf.resize(65536);
 
   /* Load instruments. */
@@ -1080,16 +1223,16 @@ static modutil::error IT_read(FILE *fp)
       if(m.instrument_offsets[i] == 0)
         continue;
 
-      if(fseek(fp, m.instrument_offsets[i], SEEK_SET))
+      if(vf.seek(m.instrument_offsets[i], SEEK_SET))
         return modutil::SEEK_ERROR;
 
       IT_instrument &ins = m.instruments[i];
 
       modutil::error ret;
       if(h.format_version >= 0x200)
-        ret = IT_read_instrument(fp, ins);
+        ret = IT_read_instrument(vf, ins);
       else
-        ret = IT_read_old_instrument(fp, ins);
+        ret = IT_read_old_instrument(vf, ins);
 
       if(ret != modutil::SUCCESS)
       {
@@ -1122,12 +1265,12 @@ static modutil::error IT_read(FILE *fp)
       if(m.sample_offsets[i] == 0)
         continue;
 
-      if(fseek(fp, m.sample_offsets[i], SEEK_SET))
+      if(vf.seek(m.sample_offsets[i], SEEK_SET))
         return modutil::SEEK_ERROR;
 
       IT_sample &s = m.samples[i];
 
-      modutil::error ret = IT_read_sample(fp, s);
+      modutil::error ret = IT_read_sample(vf, s);
       if(ret != modutil::SUCCESS)
       {
         format::warning("failed to load sample %zu: %s", i, modutil::strerror(ret));
@@ -1163,19 +1306,21 @@ static modutil::error IT_read(FILE *fp)
       if(!(s.flags & SAMPLE_COMPRESSED))
         continue;
 
-      bool res = IT_scan_compressed_sample(fp, m, s);
+      bool res = IT_unpack_compressed_sample(vf, m, s, Config.dump_samples_extra);
       if(res)
       {
+        uint32_t num_samples = (s.flags & SAMPLE_STEREO) ? s.length * 2 : s.length;
+
         /* Theoretical minimum size is 1 bit per sample.
          * Potentially samples can go lower if certain alleged quirks re: large bit widths are true.
          */
-        if(s.compressed_bytes * 8 < s.length)
+        if(s.compressed_bytes * 8 < num_samples)
         {
           m.uses[FT_SAMPLE_COMPRESSION_1_8TH] = true;
         }
         else
 
-        if(s.compressed_bytes * 4 < s.length)
+        if(s.compressed_bytes * 4 < num_samples)
           m.uses[FT_SAMPLE_COMPRESSION_1_4TH] = true;
       }
       else
@@ -1193,15 +1338,15 @@ static modutil::error IT_read(FILE *fp)
       if(m.pattern_offsets[i] == 0)
         continue;
 
-      if(fseek(fp, m.pattern_offsets[i], SEEK_SET))
+      if(vf.seek(m.pattern_offsets[i], SEEK_SET))
         return modutil::SEEK_ERROR;
 
       IT_pattern &p = m.patterns[i];
 
       /* Header. */
-      p.raw_size = fget_u16le(fp);
-      p.num_rows = fget_u16le(fp);
-      fget_u32le(fp);
+      p.raw_size = vf.u16le();
+      p.num_rows = vf.u16le();
+      vf.u32le();
 
       p.raw_size_stored = p.raw_size;
 
@@ -1210,13 +1355,13 @@ static modutil::error IT_read(FILE *fp)
 
       /* Load even if the read is short or if the scan fails
        * since some software (libxmp) will also do this. */
-      p.raw_size = fread(m.workbuf.data(), 1, p.raw_size, fp);
+      p.raw_size = vf.read(m.workbuf.data(), p.raw_size);
 
       if(p.raw_size < p.raw_size_stored)
         format::warning("read error at pattern %zu", i);
 
       modutil::error ret = IT_scan_pattern(p, m.workbuf);
-      modutil::error ret2 = IT_read_pattern(m, p, m.workbuf);
+      modutil::error ret2 = IT_read_pattern(m, p, i, m.workbuf);
       if(ret || ret2)
         format::warning("error loading pattern %zu", i);
     }
@@ -1374,17 +1519,45 @@ static modutil::error IT_read(FILE *fp)
 
       cmp_table.header("Smp.Cmp.", cmp_labels);
 
+      unsigned int num_scanned = 0;
       for(unsigned int i = 0; i < h.num_samples; i++)
       {
         IT_sample &s = m.samples[i];
         if(!(s.flags & SAMPLE_COMPRESSED))
           continue;
 
+        if(s.scanned)
+          num_scanned++;
+
         cmp_table.row(i + 1, s.scanned ? "pass" : "fail",
           s.compressed_bytes, s.uncompressed_bytes, {},
           s.smallest_block, s.smallest_block_samples, s.largest_block
         );
       }
+
+      /* Failed samples are already marked in Smp.Cmp. */
+      if(Config.dump_samples_extra && num_scanned)
+      {
+        static const char *pcm_labels[] =
+        {
+          "Type", "CRC-32"
+        };
+        format::line();
+        table::table<
+          table::string<5>,
+          table::number<8, table::HEX | table::ZEROS | table::RIGHT>> pcm_table;
+
+        pcm_table.header("Smp.PCM", pcm_labels);
+
+        for(unsigned int i = 0; i < h.num_samples; i++)
+        {
+          IT_sample &s = m.samples[i];
+          if(!(s.flags & SAMPLE_COMPRESSED) || !s.scanned)
+            continue;
+
+          pcm_table.row(i + 1, (s.convert & CVT_DELTA) ? "IT215" : "IT214", s.crc32);
+        }
+      }
     }
   }
 
@@ -1440,7 +1613,14 @@ static modutil::error IT_read(FILE *fp)
         uint8_t volume_param;
         static constexpr int width() { return 4; }
         bool can_print() const { return volume_effect != IT_event::NO_VOLUME; }
-        void print() const { if(can_print()) fprintf(stderr, " %c%02x", chrs[volume_effect], volume_param); else format::spaces(width()); }
+        char *render(char *dest) const
+        {
+          if(!can_print())
+            return format::render::blank(dest, width());
+          *(dest++) = ' ';
+          *(dest++) = chrs[volume_effect];
+          return format::render::hex2(dest, volume_param);
+        }
       };
 
       using EVENT = format::event<format::note<>, format::sample<>,
@@ -1485,11 +1665,13 @@ static modutil::error IT_read(FILE *fp)
 class IT_loader : public modutil::loader
 {
 public:
-  IT_loader(): modutil::loader("IT", "it", "Impulse Tracker") {}
+  IT_loader(): modutil::loader("IT", "it", "Impulse Tracker",
+   {{ 0, "IMPM" }}, 2) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
-    return IT_read(state.reader.unwrap()); /* FIXME: */
+    vio_reader<> vf(state.reader);
+    return IT_read(vf);
   }
 
   virtual void report() const override
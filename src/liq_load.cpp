@@ -20,9 +20,11 @@
  * SOFTWARE.
  */
 
+#include <atomic>
+
 #include "modutil.hpp"
 
-static int total_liq = 0;
+static std::atomic<int> total_liq;
 
 enum LIQ_features
 {
@@ -525,7 +527,8 @@ struct LIQ_data
 class LIQ_loader : public modutil::loader
 {
 public:
-  LIQ_loader(): modutil::loader("LIQ", "liqnew", "Liquid Tracker") {}
+  LIQ_loader(): modutil::loader("LIQ", "liqnew", "Liquid Tracker",
+   {{ 0, LIQ_MAGIC }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
@@ -882,12 +885,12 @@ done:
         // hack
         O_("Panning :");
         for(i = 0; i < num_channels_to_load; i++)
-          fprintf(stderr, " %02x", h.initial_pan[i]);
-        fprintf(stderr, "\n");
+          format::printf(" %02x", h.initial_pan[i]);
+        format::printf("\n");
         O_("Volume  :");
         for(i = 0; i < num_channels_to_load; i++)
-          fprintf(stderr, " %02x", h.initial_volume[i]);
-        fprintf(stderr, "\n");
+          format::printf(" %02x", h.initial_volume[i]);
+        format::printf("\n");
       }
       format::line();
       format::orders("Orders", h.orders.data(), h.orders.size());
@@ -20,9 +20,11 @@
  * SOFTWARE.
  */
 
+#include <atomic>
+
 #include "modutil.hpp"
 
-static int total_liqno = 0;
+static std::atomic<int> total_liqno;
 
 enum NO_features
 {
@@ -132,7 +134,8 @@ struct NO_data
 class NO_loader : public modutil::loader
 {
 public:
-  NO_loader(): modutil::loader("LIQ", "liqno", "Liquid Tracker NO") {}
+  NO_loader(): modutil::loader("LIQ", "liqno", "Liquid Tracker NO",
+   {{ 0, NO_MAGIC }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
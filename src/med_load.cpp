@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -37,15 +38,15 @@ static const char MAGIC_MMD2[] = "MMD2";
 static const char MAGIC_MMD3[] = "MMD3";
 static const char MAGIC_MMDC[] = "MMDC";
 
-static int num_med;
-static int num_med2;
-static int num_med3;
-static int num_med4;
-static int num_mmd0;
-static int num_mmd1;
-static int num_mmd2;
-static int num_mmd3;
-static int num_mmdc;
+static std::atomic<int> num_med;
+static std::atomic<int> num_med2;
+static std::atomic<int> num_med3;
+static std::atomic<int> num_med4;
+static std::atomic<int> num_mmd0;
+static std::atomic<int> num_mmd1;
+static std::atomic<int> num_mmd2;
+static std::atomic<int> num_mmd3;
+static std::atomic<int> num_mmdc;
 
 static const int MAX_BLOCKS      = 256;
 static const int MAX_INSTRUMENTS = 63;
@@ -642,7 +643,7 @@ struct MMD0
   std::unique_ptr<MMD0synth> synth_data[MAX_INSTRUMENTS];
 };
 
-static modutil::error read_mmd(FILE *fp, int mmd_version)
+static modutil::error read_mmd(vio_reader<> &vf, int mmd_version)
 {
   MMD0 m{};
   MMD0head &h = m.header;
@@ -658,44 +659,44 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
   /**
    * Header.
    */
-  if(!fread(h.magic, 4, 1, fp))
+  if(vf.read(h.magic, 4) < 4)
     return modutil::READ_ERROR;
 
-  h.file_length         = fget_u32be(fp);
-  h.song_offset         = fget_u32be(fp);
-  h.reserved0           = fget_u32be(fp);
-  h.block_array_offset  = fget_u32be(fp);
-  h.reserved1           = fget_u32be(fp);
-  h.sample_array_offset = fget_u32be(fp);
-  h.reserved2           = fget_u32be(fp);
-  h.expansion_offset    = fget_u32be(fp);
-  h.reserved3           = fget_u32be(fp);
-  h.player_state        = fget_u16be(fp);
-  h.player_line         = fget_u16be(fp);
-  h.player_sequence     = fget_u16be(fp);
-  h.actplayline         = fget_s16be(fp);
-  h.counter             = fgetc(fp);
-  h.num_extra_songs     = fgetc(fp);
-
-  if(feof(fp))
+  h.file_length         = vf.u32be();
+  h.song_offset         = vf.u32be();
+  h.reserved0           = vf.u32be();
+  h.block_array_offset  = vf.u32be();
+  h.reserved1           = vf.u32be();
+  h.sample_array_offset = vf.u32be();
+  h.reserved2           = vf.u32be();
+  h.expansion_offset    = vf.u32be();
+  h.reserved3           = vf.u32be();
+  h.player_state        = vf.u16be();
+  h.player_line         = vf.u16be();
+  h.player_sequence     = vf.u16be();
+  h.actplayline         = vf.s16be();
+  h.counter             = vf.u8();
+  h.num_extra_songs     = vf.u8();
+
+  if(vf.eof())
     return modutil::READ_ERROR;
 
   /**
    * Song.
    */
-  if(fseek(fp, h.song_offset, SEEK_SET))
+  if(vf.seek(h.song_offset, SEEK_SET))
     return modutil::SEEK_ERROR;
 
   for(int i = 0; i < 63; i++)
   {
     MMD0sample &sm = s.samples[i];
 
-    sm.repeat_start   = fget_u16be(fp);
-    sm.repeat_length  = fget_u16be(fp);
-    sm.midi_channel   = fgetc(fp);
-    sm.midi_preset    = fgetc(fp);
-    sm.default_volume = fgetc(fp);
-    sm.transpose      = fgetc(fp);
+    sm.repeat_start   = vf.u16be();
+    sm.repeat_length  = vf.u16be();
+    sm.midi_channel   = vf.u8();
+    sm.midi_preset    = vf.u8();
+    sm.default_volume = vf.u8();
+    sm.transpose      = vf.u8();
 
     if(sm.midi_channel > 0)
       m.uses[FT_INST_MIDI] = true;
@@ -703,31 +704,31 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
     if(sm.transpose != 0)
       m.uses[FT_TRANSPOSE_INSTRUMENT] = true;
   }
-  s.num_blocks      = fget_u16be(fp);
+  s.num_blocks      = vf.u16be();
   /* FIXME this is completely wrong for MMD2/3 */
-  s.num_orders      = fget_u16be(fp);
+  s.num_orders      = vf.u16be();
 
-  if(!fread(s.orders, 256, 1, fp))
+  if(vf.read(s.orders, 256) < 256)
     return modutil::READ_ERROR;
   /* end FIXME */
 
-  s.default_tempo   = fget_u16be(fp);
-  s.transpose       = fgetc(fp);
-  s.flags           = fgetc(fp);
-  s.flags2          = fgetc(fp);
-  s.tempo2          = fgetc(fp);
+  s.default_tempo   = vf.u16be();
+  s.transpose       = vf.u8();
+  s.flags           = vf.u8();
+  s.flags2          = vf.u8();
+  s.tempo2          = vf.u8();
 
   if(s.transpose != 0)
     m.uses[FT_TRANSPOSE_SONG] = true;
 
   /* FIXME MMD2/3 handles track volume separately. */
-  if(!fread(s.track_volume, 16, 1, fp))
+  if(vf.read(s.track_volume, 16) < 16)
     return modutil::READ_ERROR;
 
-  s.song_volume     = fgetc(fp);
-  s.num_instruments = fgetc(fp);
+  s.song_volume     = vf.u8();
+  s.num_instruments = vf.u8();
 
-  if(feof(fp))
+  if(vf.eof())
     return modutil::READ_ERROR;
 
   /**
@@ -736,11 +737,11 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
   if(s.num_blocks > MAX_BLOCKS)
     return modutil::MED_TOO_MANY_BLOCKS;
 
-  if(fseek(fp, h.block_array_offset, SEEK_SET))
+  if(vf.seek(h.block_array_offset, SEEK_SET))
     return modutil::SEEK_ERROR;
 
   for(size_t i = 0; i < s.num_blocks; i++)
-    m.pattern_offsets[i] = fget_u32be(fp);
+    m.pattern_offsets[i] = vf.u32be();
 
   /**
    * "Blocks" (aka patterns).
@@ -751,7 +752,7 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
     if(!m.pattern_offsets[i])
       continue;
 
-    if(fseek(fp, m.pattern_offsets[i], SEEK_SET))
+    if(vf.seek(m.pattern_offsets[i], SEEK_SET))
       return modutil::SEEK_ERROR;
 
     MMD1block &b = m.patterns[i];
@@ -759,16 +760,16 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
     if(mmd_version >= 1)
     {
       /* MMD1 through MMD3 */
-      b.num_tracks       = fget_u16be(fp);
-      b.num_rows         = fget_u16be(fp) + 1;
-      b.blockinfo_offset = fget_u32be(fp);
+      b.num_tracks       = vf.u16be();
+      b.num_rows         = vf.u16be() + 1;
+      b.blockinfo_offset = vf.u32be();
       /* FIXME load blockinfo */
     }
     else
     {
       /* MMD0 */
-      b.num_tracks = fgetc(fp);
-      b.num_rows   = fgetc(fp) + 1;
+      b.num_tracks = vf.byte();
+      b.num_rows   = vf.byte() + 1;
     }
 
     if(m.num_tracks < b.num_tracks)
@@ -793,14 +794,14 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
       {
         for(size_t k = 0; k < b.num_tracks; k++, current++)
         {
-          int a = fgetc(fp);
-          int b = fgetc(fp);
-          int c = fgetc(fp);
+          int a = vf.byte();
+          int b = vf.byte();
+          int c = vf.byte();
 
           if(mmd_version >= 1)
           {
             /* MMD1 through MMD3 */
-            int d = fgetc(fp);
+            int d = vf.byte();
             current->mmd1(a, b, c, d);
           }
           else
@@ -820,7 +821,7 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
 
       while(pos < end)
       {
-        int pack = fgetc(fp);
+        int pack = vf.byte();
         if(pack < 0)
           break;
 
@@ -836,7 +837,7 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
         if(pack > end - pos)
           pack = end - pos;
 
-        if(fread(pos, 1, pack, fp) < (size_t)pack)
+        if(vf.read(pos, pack) < (size_t)pack)
           break;
 
         pos += pack;
@@ -853,27 +854,27 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
     }
 
     /* BlockInfo (MMD1+) */
-    if(b.blockinfo_offset && fseek(fp, b.blockinfo_offset, SEEK_SET) == 0)
+    if(b.blockinfo_offset && vf.seek(b.blockinfo_offset, SEEK_SET) == 0)
     {
-      b.highlight_offset  = fget_u32be(fp);
-      b.block_name_offset = fget_u32be(fp);
-      b.block_name_length = fget_u32be(fp);
-      b.pagetable_offset  = fget_u32be(fp);
+      b.highlight_offset  = vf.u32be();
+      b.block_name_offset = vf.u32be();
+      b.block_name_length = vf.u32be();
+      b.pagetable_offset  = vf.u32be();
       /* Several reserved words here... */
 
-      if(Config.dump_pattern_rows && b.highlight_offset && fseek(fp, b.highlight_offset, SEEK_SET) == 0)
+      if(Config.dump_pattern_rows && b.highlight_offset && vf.seek(b.highlight_offset, SEEK_SET) == 0)
       {
         uint32_t highlight_len = (b.num_rows + 31)/32;
         b.highlight.resize(highlight_len);
 
         for(size_t j = 0; j < highlight_len; j++)
-          b.highlight[j] = fget_u32be(fp);
+          b.highlight[j] = vf.u32be();
       }
 
-      if(b.pagetable_offset && fseek(fp, b.pagetable_offset, SEEK_SET) == 0)
+      if(b.pagetable_offset && vf.seek(b.pagetable_offset, SEEK_SET) == 0)
       {
-        b.num_pages  = fget_u16be(fp);
-        /*reserved =*/ fget_u16be(fp);
+        b.num_pages  = vf.u16be();
+        /*reserved =*/ vf.u16be();
 
         if(b.num_pages > 0)
           m.uses[FT_COMMAND_PAGES] = true;
@@ -889,17 +890,17 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
         }
 
         for(unsigned j = 0; j < b.num_pages; j++)
-          b.page[j].offset = fget_u32be(fp);
+          b.page[j].offset = vf.u32be();
 
         for(unsigned j = 0; j < b.num_pages; j++)
         {
-          if(fseek(fp, b.page[j].offset, SEEK_SET))
+          if(vf.seek(b.page[j].offset, SEEK_SET))
             continue;
 
           size_t len = b.num_tracks * b.num_rows * 2;
 
           b.page[j].data.resize(len);
-          if(fread(b.page[j].data.data(), len, 1, fp))
+          if(vf.read(b.page[j].data.data(), len) == len)
             b.page[j].loaded = true;
         }
       }
@@ -1139,13 +1140,13 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
   if(s.num_instruments > MAX_INSTRUMENTS)
     return modutil::MED_TOO_MANY_INSTR;
 
-  if(fseek(fp, h.sample_array_offset, SEEK_SET))
+  if(vf.seek(h.sample_array_offset, SEEK_SET))
     return modutil::SEEK_ERROR;
 
   for(size_t i = 0; i < s.num_instruments; i++)
-    m.instrument_offsets[i] = fget_u32be(fp);
+    m.instrument_offsets[i] = vf.u32be();
 
-  if(feof(fp))
+  if(vf.eof())
     return modutil::READ_ERROR;
 
   /**
@@ -1158,17 +1159,17 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
     if(!m.instrument_offsets[i])
       continue;
 
-    if(fseek(fp, m.instrument_offsets[i], SEEK_SET))
+    if(vf.seek(m.instrument_offsets[i], SEEK_SET))
     {
       format::warning("skipping instrument %zu with invalid offset %zu", i+1, (size_t)m.instrument_offsets[i]);
       continue;
     }
 
     MMD0instr &inst = m.instruments[i];
-    inst.length = fget_u32be(fp);
-    inst.type   = fget_s16be(fp);
+    inst.length = vf.u32be();
+    inst.type   = vf.s16be();
     trace("inst %zu length %zu type %d", i+1, (size_t)inst.length, inst.type);
-    if(feof(fp))
+    if(vf.eof())
     {
       format::warning("skipping instrument %zu past file end", i+1);
       continue;
@@ -1184,33 +1185,33 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
 
       trace("synth %zu", i+1);
 
-      syn->default_decay         = fgetc(fp);
-      syn->reserved[0]           = fgetc(fp);
-      syn->reserved[1]           = fgetc(fp);
-      syn->reserved[2]           = fgetc(fp);
-      syn->hy_repeat_start       = fget_u16be(fp);
-      syn->hy_repeat_length      = fget_u16be(fp);
-      syn->volume_table_length   = fget_u16be(fp);
-      syn->waveform_table_length = fget_u16be(fp);
-      syn->volume_table_speed    = fgetc(fp);
-      syn->waveform_table_speed  = fgetc(fp);
-      syn->num_waveforms         = fget_u16be(fp);
+      syn->default_decay         = vf.u8();
+      syn->reserved[0]           = vf.u8();
+      syn->reserved[1]           = vf.u8();
+      syn->reserved[2]           = vf.u8();
+      syn->hy_repeat_start       = vf.u16be();
+      syn->hy_repeat_length      = vf.u16be();
+      syn->volume_table_length   = vf.u16be();
+      syn->waveform_table_length = vf.u16be();
+      syn->volume_table_speed    = vf.u8();
+      syn->waveform_table_speed  = vf.u8();
+      syn->num_waveforms         = vf.u16be();
 
       trace("synth %zu tables (vol: %d wf: %d)", i+1, syn->volume_table_length, syn->waveform_table_length);
 
-      if(!fread(syn->volume_table, 128, 1, fp) ||
-       !fread(syn->waveform_table, 128, 1, fp))
+      if(vf.read(syn->volume_table, 128) < 128 ||
+       vf.read(syn->waveform_table, 128) < 128)
         return modutil::READ_ERROR;
 
       trace("synth %zu offsets (%d waveforms)", i+1, syn->num_waveforms);
 
       for(unsigned j = 0; j < syn->num_waveforms && j < MAX_WAVEFORMS; j++)
-        syn->waveform_offsets[j] = fget_u32be(fp);
+        syn->waveform_offsets[j] = vf.u32be();
 
       for(unsigned j = 0; j < syn->num_waveforms && j < MAX_WAVEFORMS; j++)
       {
         trace("synth %zu waveform %u", i+1, j);
-        if(fseek(fp, m.instrument_offsets[i] + syn->waveform_offsets[j], SEEK_SET))
+        if(vf.seek(m.instrument_offsets[i] + syn->waveform_offsets[j], SEEK_SET))
         {
           format::warning("seek error, skipping synth %zu waveform %u", i+1, j);
           continue;
@@ -1219,13 +1220,13 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
         if(inst.type == I_HYBRID && j == 0)
         {
           /* Get the size and type of the sample. */
-          h_inst.length = fget_u32be(fp);
-          h_inst.type   = fget_s16be(fp);
+          h_inst.length = vf.u32be();
+          h_inst.type   = vf.s16be();
           trace("hybrid %zu waveform 0 length %zu type %d", i+1, (size_t)h_inst.length, h_inst.type);
         }
         else
         {
-          syn->waveforms[j].length = fget_u16be(fp);
+          syn->waveforms[j].length = vf.u16be();
           trace("synth %zu waveform %u length %u", i+1, j, syn->waveforms[j].length << 1);
         }
       }
@@ -1289,41 +1290,41 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
    * Expansion data.
    */
   trace("expdata");
-  if(h.expansion_offset && !fseek(fp, h.expansion_offset, SEEK_SET))
+  if(h.expansion_offset && !vf.seek(h.expansion_offset, SEEK_SET))
   {
-    x.nextmod_offset       = fget_u32be(fp);
-    x.sample_ext_offset    = fget_u32be(fp);
-    x.sample_ext_entries   = fget_u16be(fp);
-    x.sample_ext_size      = fget_u16be(fp);
-    x.annotation_offset    = fget_u32be(fp);
-    x.annotation_length    = fget_u32be(fp);
-    x.instr_info_offset    = fget_u32be(fp);
-    x.instr_info_entries   = fget_u16be(fp);
-    x.instr_info_size      = fget_u16be(fp);
-    x.jumpmask             = fget_u32be(fp);
-    x.rgbtable_offset      = fget_u32be(fp);
-    x.channel_split        = fget_u32be(fp);
-    x.notation_info_offset = fget_u32be(fp);
-    x.songname_offset      = fget_u32be(fp);
-    x.songname_length      = fget_u32be(fp);
-    x.dumps_offset         = fget_u32be(fp);
-    x.mmdinfo_offset       = fget_u32be(fp);
-    x.mmdrexx_offset       = fget_u32be(fp);
-    x.reserved[0]          = fget_u32be(fp);
-    x.reserved[1]          = fget_u32be(fp);
-    x.reserved[2]          = fget_u32be(fp);
-    x.tag_end              = fget_u32be(fp);
-
-    if(feof(fp))
+    x.nextmod_offset       = vf.u32be();
+    x.sample_ext_offset    = vf.u32be();
+    x.sample_ext_entries   = vf.u16be();
+    x.sample_ext_size      = vf.u16be();
+    x.annotation_offset    = vf.u32be();
+    x.annotation_length    = vf.u32be();
+    x.instr_info_offset    = vf.u32be();
+    x.instr_info_entries   = vf.u16be();
+    x.instr_info_size      = vf.u16be();
+    x.jumpmask             = vf.u32be();
+    x.rgbtable_offset      = vf.u32be();
+    x.channel_split        = vf.u32be();
+    x.notation_info_offset = vf.u32be();
+    x.songname_offset      = vf.u32be();
+    x.songname_length      = vf.u32be();
+    x.dumps_offset         = vf.u32be();
+    x.mmdinfo_offset       = vf.u32be();
+    x.mmdrexx_offset       = vf.u32be();
+    x.reserved[0]          = vf.u32be();
+    x.reserved[1]          = vf.u32be();
+    x.reserved[2]          = vf.u32be();
+    x.tag_end              = vf.u32be();
+
+    if(vf.eof())
       return modutil::READ_ERROR;
 
     if(x.songname_offset && x.songname_length && x.songname_length < 256)
     {
       trace("songname %08zx length %zu", (size_t)x.songname_offset, (size_t)x.songname_length);
-      if(!fseek(fp, x.songname_offset, SEEK_SET))
+      if(!vf.seek(x.songname_offset, SEEK_SET))
       {
         m.songname.resize(x.songname_length + 1, '\0');
-        if(fread(m.songname.data(), x.songname_length, 1, fp))
+        if(vf.read(m.songname.data(), x.songname_length) == x.songname_length)
         {
           strip_module_name(m.songname.data(), x.songname_length);
         }
@@ -1340,7 +1341,7 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
     if(x.sample_ext_entries > MAX_INSTRUMENTS)
       return modutil::MED_TOO_MANY_INSTR;
 
-    if(x.sample_ext_entries && fseek(fp, x.sample_ext_offset, SEEK_SET))
+    if(x.sample_ext_entries && vf.seek(x.sample_ext_offset, SEEK_SET))
       return modutil::SEEK_ERROR;
 
     for(size_t i = 0; i < x.sample_ext_entries; i++)
@@ -1350,40 +1351,40 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
 
       if(x.sample_ext_size >= 2)
       {
-        sx.hold               = fgetc(fp);
-        sx.decay              = fgetc(fp);
+        sx.hold               = vf.u8();
+        sx.decay              = vf.u8();
         skip -= 2;
       }
       if(x.sample_ext_size >= 4)
       {
-        sx.suppress_midi_off  = fgetc(fp);
-        sx.finetune           = fgetc(fp);
+        sx.suppress_midi_off  = vf.u8();
+        sx.finetune           = vf.u8();
         skip -= 2;
       }
       if(x.sample_ext_size >= 8)
       {
-        sx.default_pitch      = fgetc(fp);
-        sx.instrument_flags   = fgetc(fp);
-        sx.long_midi_preset   = fget_u16be(fp);
+        sx.default_pitch      = vf.u8();
+        sx.instrument_flags   = vf.u8();
+        sx.long_midi_preset   = vf.u16be();
         skip -= 4;
       }
       if(x.sample_ext_size >= 10)
       {
-        sx.output_device      = fgetc(fp);
-        sx.reserved           = fgetc(fp);
+        sx.output_device      = vf.u8();
+        sx.reserved           = vf.u8();
         skip -= 2;
       }
       if(x.sample_ext_size >= 18)
       {
-        sx.long_repeat_start  = fget_u32be(fp);
-        sx.long_repeat_length = fget_u32be(fp);
+        sx.long_repeat_start  = vf.u32be();
+        sx.long_repeat_length = vf.u32be();
         m.use_long_repeat = true;
         skip -= 8;
       }
       if(x.sample_ext_size > 18)
         m.uses[FT_S_EXT_ENTRSZ_GT_18] = true;
 
-      if(skip && fseek(fp, skip, SEEK_CUR))
+      if(skip && vf.seek(skip, SEEK_CUR))
         return modutil::SEEK_ERROR;
 
       if(sx.hold)
@@ -1409,7 +1410,7 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
     if(x.instr_info_entries > MAX_INSTRUMENTS)
       return modutil::MED_TOO_MANY_INSTR;
 
-    if(x.instr_info_entries && fseek(fp, x.instr_info_offset, SEEK_SET))
+    if(x.instr_info_entries && vf.seek(x.instr_info_offset, SEEK_SET))
       return modutil::SEEK_ERROR;
 
     for(size_t i = 0; i < x.instr_info_entries; i++)
@@ -1419,13 +1420,13 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
 
       if(x.instr_info_size >= 40)
       {
-        if(!fread(sxi.name, 40, 1, fp))
+        if(vf.read(sxi.name, 40) < 40)
           return modutil::READ_ERROR;
 
         sxi.name[40] = '\0';
         skip -= 40;
       }
-      if(skip && fseek(fp, skip, SEEK_CUR))
+      if(skip && vf.seek(skip, SEEK_CUR))
         return modutil::SEEK_ERROR;
     }
   }
@@ -1777,61 +1778,61 @@ static modutil::error read_mmd(FILE *fp, int mmd_version)
 }
 
 
-static modutil::error read_med2(FILE *fp)
+static modutil::error read_med2(vio_reader<> &vf)
 {
   format::line("Type", "MED2");
   num_med2++;
   return modutil::NOT_IMPLEMENTED;
 }
 
-static modutil::error read_med3(FILE *fp)
+static modutil::error read_med3(vio_reader<> &vf)
 {
   format::line("Type", "MED3");
   num_med3++;
   return modutil::NOT_IMPLEMENTED;
 }
 
-static modutil::error read_med4(FILE *fp)
+static modutil::error read_med4(vio_reader<> &vf)
 {
   format::line("Type", "MED4");
   num_med4++;
   return modutil::NOT_IMPLEMENTED;
 }
 
-static modutil::error read_mmd0(FILE *fp)
+static modutil::error read_mmd0(vio_reader<> &vf)
 {
   num_mmd0++;
-  return read_mmd(fp, 0);
+  return read_mmd(vf, 0);
 }
 
-static modutil::error read_mmd1(FILE *fp)
+static modutil::error read_mmd1(vio_reader<> &vf)
 {
   num_mmd1++;
-  return read_mmd(fp, 1);
+  return read_mmd(vf, 1);
 }
 
-static modutil::error read_mmd2(FILE *fp)
+static modutil::error read_mmd2(vio_reader<> &vf)
 {
   num_mmd2++;
-  return read_mmd(fp, 2);
+  return read_mmd(vf, 2);
 }
 
-static modutil::error read_mmd3(FILE *fp)
+static modutil::error read_mmd3(vio_reader<> &vf)
 {
   num_mmd3++;
-  return read_mmd(fp, 3);
+  return read_mmd(vf, 3);
 }
 
-static modutil::error read_mmdc(FILE *fp)
+static modutil::error read_mmdc(vio_reader<> &vf)
 {
   num_mmdc++;
-  return read_mmd(fp, MMDC_VERSION);
+  return read_mmd(vf, MMDC_VERSION);
 }
 
 struct MED_handler
 {
   const char *magic;
-  modutil::error (*read_fn)(FILE *fp);
+  modutil::error (*read_fn)(vio_reader<> &vf);
 };
 
 static const MED_handler HANDLERS[] =
@@ -1849,24 +1850,26 @@ static const MED_handler HANDLERS[] =
 class MED_loader : modutil::loader
 {
 public:
-  MED_loader(): modutil::loader("MED", "med", "MED/OctaMED") {}
+  MED_loader(): modutil::loader("MED", "med", "MED/OctaMED",
+   {{ 0, MAGIC_MED2 }, { 0, MAGIC_MED3 }, { 0, MAGIC_MED4 }, { 0, MAGIC_MMD0 },
+    { 0, MAGIC_MMD1 }, { 0, MAGIC_MMD2 }, { 0, MAGIC_MMD3 }, { 0, MAGIC_MMDC }}, 2) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
-    FILE *fp = state.reader.unwrap(); /* FIXME: */
+    vio_reader<> vf(state.reader);
 
     char magic[4];
-    if(!fread(magic, 4, 1, fp))
+    if(vf.read(magic, 4) < 4)
       return modutil::FORMAT_ERROR;
 
-    rewind(fp);
+    vf.seek(0, SEEK_SET);
 
     for(const MED_handler &handler : HANDLERS)
     {
       if(!memcmp(handler.magic, magic, 4))
       {
         num_med++;
-        return handler.read_fn(fp);
+        return handler.read_fn(vf);
       }
     }
     return modutil::FORMAT_ERROR;
@@ -1880,21 +1883,21 @@ public:
     format::report("Total MEDs", num_med);
 
     if(num_med2)
-      format::reportline("Total MED2s", "%d", num_med2);
+      format::reportline("Total MED2s", "%d", num_med2.load());
     if(num_med3)
-      format::reportline("Total MED3s", "%d", num_med3);
+      format::reportline("Total MED3s", "%d", num_med3.load());
     if(num_med4)
-      format::reportline("Total MED4s", "%d", num_med4);
+      format::reportline("Total MED4s", "%d", num_med4.load());
     if(num_mmd0)
-      format::reportline("Total MMD0s", "%d", num_mmd0);
+      format::reportline("Total MMD0s", "%d", num_mmd0.load());
     if(num_mmd1)
-      format::reportline("Total MMD1s", "%d", num_mmd1);
+      format::reportline("Total MMD1s", "%d", num_mmd1.load());
     if(num_mmd2)
-      format::reportline("Total MMD2s", "%d", num_mmd2);
+      format::reportline("Total MMD2s", "%d", num_mmd2.load());
     if(num_mmd3)
-      format::reportline("Total MMD3s", "%d", num_mmd3);
+      format::reportline("Total MMD3s", "%d", num_mmd3.load());
     if(num_mmdc)
-      format::reportline("Total MMDCs", "%d", num_mmdc);
+      format::reportline("Total MMDCs", "%d", num_mmdc.load());
   }
 };
 
@@ -26,8 +26,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 #include "modutil.hpp"
+#include "query.hpp"
 
 enum MOD_type
 {
@@ -96,10 +98,10 @@ static const struct MOD_type_info TYPES[NUM_MOD_TYPES] =
   { "",     "unknown",         -1, false },
 };
 
-static int total_files;
-static int total_files_nonzero_diff;
-static int total_files_wow_fp_diff;
-static int type_count[NUM_MOD_TYPES];
+static std::atomic<int> total_files;
+static std::atomic<int> total_files_nonzero_diff;
+static std::atomic<int> total_files_wow_fp_diff;
+static std::atomic<int> type_count[NUM_MOD_TYPES];
 
 static constexpr uint32_t pattern_size(uint32_t num_channels)
 {
@@ -445,7 +447,7 @@ static modutil::error MOD_check_format(MOD_data &m, FILE *fp)
   if(!fread(magic, 4, 1, fp))
     return modutil::FORMAT_ERROR;
 
-  // FIXME global :(
+  // FIXME global (per-thread) :(
   memcpy(modutil::loaded_mod_magic, magic, 4);
 
   // Determine initial guess for what the mod type is.
@@ -634,14 +636,19 @@ static modutil::error MOD_read_pattern(MOD_data &m, size_t pattern_num, FILE *fp
   if(pattern_num == 0 && m.type == MOD_APOCALYPSE_ABYSS)
     MOD_AA_decode(m.pattern_buffer, m.type_channels * 64 * 4);
 
-  m.patterns[pattern_num] = new MOD_note[m.type_channels * 64]{};
+  /* Events are only kept if they will be printed. */
+  MOD_note *next = nullptr;
+  if(Config.dump_pattern_rows)
+    next = m.patterns[pattern_num] = new MOD_note[m.type_channels * 64]{};
 
-  MOD_note *note = m.patterns[pattern_num];
+  bool check_query = modutil::query::enabled;
   uint8_t *current = m.pattern_buffer;
   for(int row = 0; row < 64; row++)
   {
     for(int ch = 0; ch < m.type_channels; ch++)
     {
+      MOD_note tmp;
+      MOD_note *note = next ? next++ : &tmp;
       note->note   = ((current[0] & 0x0F) << 8) | current[1];
       note->sample = (current[0] & 0xF0) | ((current[2] & 0xF0) >> 4);
       note->effect = (current[2] & 0x0F);
@@ -649,8 +656,14 @@ static modutil::error MOD_read_pattern(MOD_data &m, size_t pattern_num, FILE *fp
 
       MOD_event_features(m, note);
 
+      if(check_query)
+        modutil::query::event(pattern_num, row, ch,
+         (note->note ? Highlight::NOTE : 0) |
+         (note->sample ? Highlight::INSTRUMENT : 0) |
+         ((note->effect || note->param) ? Highlight::EFFECT : 0),
+         note->note, note->sample, 0, note->effect, note->param);
+
       current += 4;
-      note++;
     }
   }
   return modutil::SUCCESS;
@@ -942,7 +955,14 @@ static modutil::error MOD_read(FILE *fp, long file_length)
         continue;
       }
 
+      /* Patterns that failed to load have no events. */
       MOD_note *current = m.patterns[i];
+      if(!current)
+      {
+        pattern.summary();
+        continue;
+      }
+
       for(int row = 0; row < 64; row++)
       {
         for(int track = 0; track < m.type_channels; track++, current++)
@@ -984,9 +1004,9 @@ public:
 
     format::report("Total MODs", total_files);
     if(total_files_nonzero_diff)
-      format::reportline("Nonzero difference", "%d", total_files_nonzero_diff);
+      format::reportline("Nonzero difference", "%d", total_files_nonzero_diff.load());
     if(total_files_wow_fp_diff)
-      format::reportline("WOW false positive?", "%d", total_files_wow_fp_diff);
+      format::reportline("WOW false positive?", "%d", total_files_wow_fp_diff.load());
     if(total_files_nonzero_diff || total_files_wow_fp_diff)
       format::reportline();
 
@@ -996,7 +1016,7 @@ public:
       if(type_count[i])
       {
         snprintf(label, sizeof(label), "%-16s %4.4s", TYPES[i].source, TYPES[i].magic);
-        format::reportline(label, "%d", type_count[i]);
+        format::reportline(label, "%d", type_count[i].load());
       }
     }
   }
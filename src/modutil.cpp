@@ -23,22 +23,102 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include "archive.hpp"
+#include "bench.hpp"
+#include "cache.hpp"
+#include "dirwalk.hpp"
+#include "prefetch.hpp"
+#include "profile.hpp"
+#include "query.hpp"
 #include "modutil.hpp"
 
 #define USAGE \
   "Dump information about module(s) in various module formats.\n\n" \
   "Usage:\n" \
   "  %s [options] [filename.ext...]\n\n" \
+  "moddiag flags:\n" \
+  "  -j[=N]    Scan files using N worker threads. If N is not provided or is 0,\n" \
+  "            one thread per CPU is used. Output is still printed in order.\n" \
+  "  --output=text|jsonl|binary\n" \
+  "            Output format. 'jsonl' prints one JSON object per file containing\n" \
+  "            the loader, error, header fields, and features used. 'binary' is\n" \
+  "            a compact record stream with the same contents (see record.hpp).\n" \
+  "            Pattern, sample, and description dumps are disabled for both,\n" \
+  "            and records are written to stdout unless -o is given.\n" \
+  "  --cache=file\n" \
+  "            Cache results in 'file' (requires jsonl or binary output). Files\n" \
+  "            with the same path, size, and modification time (or contents)\n" \
+  "            are not parsed again unless their loader's version has changed.\n" \
+  "  -r        Scan directories given as arguments recursively.\n" \
+  "  --ext=ext[,ext...]\n" \
+  "            With -r, only scan files with these extensions (case-insensitive).\n" \
+  "  --min-size=N, --max-size=N\n" \
+  "            With -r, only scan files of at least/at most N bytes.\n" \
+  "  -0        Filenames read from stdin ('-') are separated by NUL instead\n" \
+  "            of newlines (for use with 'find -print0').\n" \
+  "  --profile Print time, reads, seeks, and allocations for each loader\n" \
+  "            after the scan, split into hits and misses (FORMAT_ERROR).\n" \
+  "            Streams used by loaders are unbuffered while profiling so each\n" \
+  "            read call is counted, which inflates time for those loaders.\n" \
+  "            Allocations are only counted if built with PROFILE_ALLOCS=1.\n" \
+  "            Requires --output=text.\n" \
+  "  --archives\n" \
+  "            Scan the members of archives and disk images supported by\n" \
+  "            modunpack (Spark, ArcFS, LZX) and Pack-Ice packed files in\n" \
+  "            memory, including nested containers. Members are displayed as\n" \
+  "            'archive/member'.\n" \
+  "  --prefetch=N\n" \
+  "            While a file is scanned, start reading the next N files into the\n" \
+  "            page cache in the background (default 8, 0 to disable).\n" \
+  "  --prefetch-mem=N\n" \
+  "            Limit the total size of files being prefetched to N bytes\n" \
+  "            (default 64 MiB).\n" \
+  "  --query=C:#[-#][,...]\n" \
+  "            Print the pattern, row, and channel (hex) of every pattern event\n" \
+  "            matching the query instead of the usual output. Column types are\n" \
+  "            the same as for -H and values may be ranges ('e:19,p:0xb0-0xbf').\n" \
+  "            Events must match every column type given, and may match any\n" \
+  "            value given for a column type. If --query is used more than\n" \
+  "            once, events matching any query are printed. Supported by the\n" \
+  "            MOD, S3M, XM, and IT loaders.\n\n"
 
-static int total_identified = 0;
-static int total_unidentified = 0;
+static std::atomic<int> total_identified;
+static std::atomic<int> total_unidentified;
+static unsigned num_threads = 1;
+
+enum output_modes
+{
+  OUTPUT_TEXT,
+  OUTPUT_JSONL,
+  OUTPUT_BINARY
+};
+static enum output_modes output_mode = OUTPUT_TEXT;
+static const char *cache_filename = nullptr;
+static modutil::result_cache *cache = nullptr;
+static modutil::walk_filter scan_filter;
+static bool recursive = false;
+static char stdin_delimiter = '\n';
+static bool profile_loaders = false;
+static bool scan_archives = false;
+static size_t prefetch_depth = modutil::prefetch::DEFAULT_DEPTH;
+static int64_t prefetch_max_bytes = modutil::prefetch::DEFAULT_MAX_BYTES;
+static modutil::profile *profiler = nullptr;
 
 
 namespace modutil
 {
-char loaded_mod_magic[4];
+thread_local char loaded_mod_magic[4];
 
 static std::vector<const modutil::loader *> &loaders_vector()
 {
@@ -68,11 +148,129 @@ static void sort_loaders()
   std::sort(loaders.begin(), loaders.end(), sort_function);
 }
 
-modutil::loader::loader(const char *e, const char *t, const char *n): ext(e), tag(t), name(n)
+modutil::loader::loader(const char *e, const char *t, const char *n, unsigned v):
+ ext(e), tag(t), name(n), version(v)
 {
   loaders_vector().push_back(this);
 }
 
+modutil::loader::loader(const char *e, const char *t, const char *n, std::vector<signature> &&s,
+ unsigned v): ext(e), tag(t), name(n), version(v), signatures(std::move(s))
+{
+  loaders_vector().push_back(this);
+}
+
+bool modutil::signature::match(const uint8_t *buf, size_t buf_len) const
+{
+  if(offset > buf_len || length > buf_len - offset)
+    return false;
+
+  buf += offset;
+  if(!mask)
+    return !memcmp(buf, magic, length);
+
+  for(size_t i = 0; i < length; i++)
+    if((buf[i] ^ (uint8_t)magic[i]) & (uint8_t)mask[i])
+      return false;
+
+  return true;
+}
+
+/**
+ * Index of all loader signatures, grouped by offset and then by the first
+ * byte of the signature. Each file only needs to be read once into the probe
+ * window, and then only the signatures in the matching buckets are compared.
+ * Loaders without signatures (or with signatures that don't fit in the
+ * window) are always probed.
+ */
+class signature_index
+{
+  struct entry
+  {
+    const signature *sig;
+    size_t pos;
+  };
+
+  struct offset_table
+  {
+    size_t offset;
+    std::vector<entry> buckets[256];
+  };
+
+  std::vector<offset_table> tables;
+  std::vector<bool> always_probe;
+
+  offset_table &get_table(size_t offset)
+  {
+    for(offset_table &t : tables)
+      if(t.offset == offset)
+        return t;
+
+    tables.emplace_back();
+    tables.back().offset = offset;
+    return tables.back();
+  }
+
+public:
+  static constexpr size_t PROBE_WINDOW = 64;
+
+  /* Loaders should be sorted before this is constructed. */
+  signature_index()
+  {
+    auto &loaders = loaders_vector();
+    always_probe.resize(loaders.size());
+
+    for(size_t i = 0; i < loaders.size(); i++)
+    {
+      const loader *ld = loaders[i];
+      bool indexed = !ld->signatures.empty();
+
+      for(const signature &sig : ld->signatures)
+      {
+        if(!sig.length || sig.offset + sig.length > PROBE_WINDOW ||
+         (sig.mask && (uint8_t)sig.mask[0] != 0xff))
+          indexed = false;
+      }
+
+      if(!indexed)
+      {
+        always_probe[i] = true;
+        continue;
+      }
+
+      for(const signature &sig : ld->signatures)
+      {
+        offset_table &t = get_table(sig.offset);
+        t.buckets[(uint8_t)sig.magic[0]].push_back({ &sig, i });
+      }
+    }
+  }
+
+  /**
+   * Flag every loader that should be probed for the provided probe window.
+   */
+  void candidates(std::vector<bool> &out, const uint8_t *buf, size_t buf_len) const
+  {
+    out = always_probe;
+
+    for(const offset_table &t : tables)
+    {
+      if(t.offset >= buf_len)
+        continue;
+
+      for(const entry &e : t.buckets[buf[t.offset]])
+        if(e.sig->match(buf, buf_len))
+          out[e.pos] = true;
+    }
+  }
+
+  static const signature_index &get()
+  {
+    static const signature_index index;
+    return index;
+  }
+};
+
 static bool is_loader_filtered(const modutil::loader *loader)
 {
   if(Config.num_format_filters)
@@ -88,31 +286,75 @@ static bool is_loader_filtered(const modutil::loader *loader)
   return false;
 }
 
-static void check_module(vio &vf)
+static void check_module(vio &_vf)
 {
   {
+    /* Loaders read through a counting wrapper while profiling. */
+    std::unique_ptr<vio_profile> pvf;
+    if(profiler)
+      pvf = std::make_unique<vio_profile>(_vf);
+    vio &vf = pvf ? *pvf : _vf;
+
     loaded_mod_magic[0] = '\0';
 
     modutil::error err;
     bool has_format = false;
 
-    for(const modutil::loader *loader : loaders_vector())
+    const signature_index &index = signature_index::get();
+    std::vector<bool> candidates;
+    uint8_t probe[signature_index::PROBE_WINDOW];
+    size_t probe_len = vf.read(probe, sizeof(probe));
+    vf.seek(0, SEEK_SET);
+
+    index.candidates(candidates, probe, probe_len);
+
+    auto &loaders = loaders_vector();
+    for(size_t i = 0; i < loaders.size(); i++)
     {
-      if(is_loader_filtered(loader))
+      const modutil::loader *loader = loaders[i];
+      if(!candidates[i] || is_loader_filtered(loader))
         continue;
 
       trace("%-4s %-8s %s", loader->ext, loader->tag, loader->name);
 
       modutil::data state(vf);
-      err = loader->load(state);
+      if(profiler)
+      {
+        vio_profile::counters io_start = pvf->stats;
+        uint64_t alloc_start = modutil::thread_allocations();
+        auto start = std::chrono::steady_clock::now();
+
+        err = loader->load(state);
+
+        auto nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(
+         std::chrono::steady_clock::now() - start).count();
+        vio_profile::counters io = pvf->stats;
+        io.reads -= io_start.reads;
+        io.bytes -= io_start.bytes;
+        io.seeks -= io_start.seeks;
+        profiler->add(i, err != modutil::FORMAT_ERROR, nsec, io,
+         modutil::thread_allocations() - alloc_start);
+      }
+      else
+        err = loader->load(state);
       if(err == modutil::FORMAT_ERROR)
       {
+        query::clear();
         vf.seek(0, SEEK_SET);
         continue;
       }
 
       has_format = true;
       total_identified++;
+      if(format::current_record)
+      {
+        format::record &rec = *format::current_record;
+        rec.ext = loader->ext;
+        rec.tag = loader->tag;
+        rec.name = loader->name;
+        rec.error_code = err;
+        rec.error_str = err ? modutil::strerror(err) : nullptr;
+      }
       if(err)
         format::error("in loader '%s': %s", loader->name, modutil::strerror(err));
 
@@ -153,20 +395,405 @@ static void check_module(vio &vf)
   }
 }
 
-static void check_module(const char *filename)
+/* Limit for nested containers, e.g. a Pack-Ice file inside a Spark archive. */
+static constexpr int MAX_ARCHIVE_DEPTH = 8;
+
+/**
+ * With --archives, open a stream as a container and print its summary.
+ * Returns nullptr if the stream should be scanned as a module instead.
+ */
+static std::unique_ptr<modutil::archive> open_archive(vio &vf, int depth)
 {
+  if(!scan_archives || depth >= MAX_ARCHIVE_DEPTH)
+    return nullptr;
+
+  std::unique_ptr<modutil::archive> arc = modutil::archive::open(vf);
+  if(arc)
+  {
+    format::line("Archive", "%s", arc->type);
+    format::line("Members", "%zu", arc->num_members);
+    format::endline();
+  }
+  return arc;
+}
+
+static void write_record(format::record &rec, std::string &tmp)
+{
+  format::current_record = nullptr;
+  if(output_mode == OUTPUT_JSONL)
+    rec.to_jsonl(tmp);
+  else
+    rec.to_binary(tmp);
+
+  format::output.write(tmp.data(), tmp.size());
+}
+
+static void check_archive(modutil::archive &arc, const std::string &path, int depth);
+
+/**
+ * Unpack an archive member and scan it from memory.
+ */
+static void check_member(modutil::archive &parent, modutil::archive::member &m,
+ const std::string &path, int depth)
+{
+  format::record rec;
+  std::string tmp;
+
+  if(output_mode != OUTPUT_TEXT)
+  {
+    rec.filename = path;
+    format::current_record = &rec;
+  }
+  else
+    format::line("File", "%s", path.c_str());
+
+  /* Unpack warnings belong to this member, so unpack after its header. */
+  parent.unpack(m);
+
+  vio_buffer vf(m.data, m.length);
+  std::unique_ptr<modutil::archive> arc;
+  if(m.data)
+  {
+    arc = open_archive(vf, depth);
+    if(!arc)
+      check_module(vf);
+  }
+  else
+  {
+    format::error("failed to unpack '%s'.", m.name);
+    format::endline();
+  }
+
+  if(format::current_record)
+    write_record(rec, tmp);
+
+  query::print(path.c_str());
+
+  if(arc)
+    check_archive(*arc, path, depth + 1);
+}
+
+/**
+ * Scan every member of a container. This happens after the container's
+ * own output so members are printed in order after it.
+ */
+static void check_archive(modutil::archive &arc, const std::string &path, int depth)
+{
+  modutil::archive::member m;
+  while(arc.next(m))
+    check_member(arc, m, path + '/' + m.name, depth);
+}
+
+/**
+ * Scan a file. If dir is provided, name is relative to it and filename is
+ * only used for display and as the cache key.
+ */
+static void check_module(const char *filename, const scan_dir *dir = nullptr,
+ const char *name = nullptr)
+{
+  format::record rec;
+  std::unique_ptr<vio> vf;
+  std::unique_ptr<modutil::archive> arc;
+  std::string tmp;
+
+  if(output_mode != OUTPUT_TEXT)
+  {
+    bool identified;
+    if(cache && cache->lookup(filename, tmp, identified))
+    {
+      if(identified)
+        total_identified++;
+      else
+        total_unidentified++;
+
+      format::output.write(tmp.data(), tmp.size());
+      return;
+    }
+    rec.filename = filename;
+    format::current_record = &rec;
+  }
+
   try
   {
-    vio_file vf(filename, "rb");
+    /* Archives patch their headers in place, so map copy-on-write. */
+    vf = dir ? vio_open_read(dir->fd, name, scan_archives) :
+     vio_open_read(filename, scan_archives);
 
-    format::line("File", "%s", filename);
-    check_module(vf);
+    if(!format::current_record)
+      format::line("File", "%s", filename);
+
+    arc = open_archive(*vf, 0);
+    if(!arc)
+      check_module(*vf);
   }
   catch(const char *e)
   {
     format::error("failed to open '%s'.", filename);
-    return;
   }
+
+  query::print(filename);
+
+  if(format::current_record)
+  {
+    write_record(rec, tmp);
+
+    /* Archives aren't cached since their members aren't part of the record. */
+    if(cache && vf && !arc)
+      cache->store(filename, *vf, rec.tag, std::move(tmp));
+  }
+
+  if(arc)
+    check_archive(*arc, filename, 1);
+}
+
+/**
+ * Scans files on a pool of worker threads. Each file's output is captured
+ * from the worker's output sink and printed once all files before it have finished,
+ * so the combined output is identical to a serial scan.
+ */
+class scan_queue
+{
+  struct job
+  {
+    std::string filename;
+    std::shared_ptr<scan_dir> dir;
+    std::string name;
+    std::string output;
+    bool done = false;
+  };
+
+  std::vector<std::thread> workers;
+  std::mutex lock;
+  std::condition_variable cond_work;
+  std::condition_variable cond_space;
+  std::deque<job> jobs;
+  size_t first_index = 0; /* Index of jobs.front(). */
+  size_t next_index = 0;  /* Index of the next job to start. */
+  size_t max_jobs;
+  bool finished = false;
+
+  static void capture(job &j)
+  {
+    format::output.set_buffered(true);
+    check_module(j.filename.c_str(), j.dir.get(), j.name.c_str());
+    if(format::output.size())
+      j.output.assign(format::output.data(), format::output.size());
+    format::output.clear();
+  }
+
+  /* Print all completed jobs at the front of the queue. Call with lock held. */
+  void flush_completed()
+  {
+    bool any = false;
+    while(jobs.size() && jobs.front().done)
+    {
+      job &j = jobs.front();
+      format::sink::write_direct(j.output.data(), j.output.size());
+
+      jobs.pop_front();
+      first_index++;
+      any = true;
+    }
+    if(any)
+      cond_space.notify_one();
+  }
+
+  void worker()
+  {
+    std::unique_lock<std::mutex> l(lock);
+    while(true)
+    {
+      cond_work.wait(l, [this]{ return finished || next_index < first_index + jobs.size(); });
+      if(next_index >= first_index + jobs.size())
+        return;
+
+      size_t index = next_index++;
+      job current;
+      job &src = jobs[index - first_index];
+      current.filename = std::move(src.filename);
+      current.dir = std::move(src.dir);
+      current.name = std::move(src.name);
+      l.unlock();
+
+      capture(current);
+
+      l.lock();
+      job &dest = jobs[index - first_index];
+      dest.output = std::move(current.output);
+      dest.dir.reset();
+      dest.done = true;
+      flush_completed();
+    }
+  }
+
+public:
+  scan_queue(unsigned threads): max_jobs(threads * 8)
+  {
+    for(unsigned i = 0; i < threads; i++)
+      workers.emplace_back(&scan_queue::worker, this);
+  }
+
+  ~scan_queue()
+  {
+    finish();
+  }
+
+  void push(const char *filename, const std::shared_ptr<scan_dir> &dir = nullptr,
+   const char *name = nullptr)
+  {
+    std::unique_lock<std::mutex> l(lock);
+    cond_space.wait(l, [this]{ return jobs.size() < max_jobs; });
+
+    jobs.emplace_back();
+    jobs.back().filename = filename;
+    if(dir && name)
+    {
+      jobs.back().dir = dir;
+      jobs.back().name = name;
+    }
+    cond_work.notify_one();
+  }
+
+  void finish()
+  {
+    {
+      std::lock_guard<std::mutex> l(lock);
+      finished = true;
+    }
+    cond_work.notify_all();
+    for(std::thread &t : workers)
+      t.join();
+
+    workers.clear();
+  }
+};
+
+static bool parse_size(const char *value, int64_t &out)
+{
+  char *end;
+  long long tmp = strtoll(value, &end, 10);
+  if(!*value || *end || tmp < 0)
+    return false;
+
+  out = tmp;
+  return true;
+}
+
+static bool moddiag_option(const char *arg, void *priv)
+{
+  if(!strncmp(arg, "--ext=", 6))
+  {
+    const char *pos = arg + 6;
+    while(*pos)
+    {
+      const char *end = strchr(pos, ',');
+      if(!end)
+        end = pos + strlen(pos);
+      if(*pos == '.')
+        pos++;
+      if(end > pos)
+        scan_filter.extensions.emplace_back(pos, end - pos);
+
+      pos = *end ? end + 1 : end;
+    }
+    return scan_filter.extensions.size() > 0;
+  }
+
+  if(!strncmp(arg, "--min-size=", 11))
+    return parse_size(arg + 11, scan_filter.min_size);
+
+  if(!strncmp(arg, "--max-size=", 11))
+    return parse_size(arg + 11, scan_filter.max_size);
+
+  if(!strncmp(arg, "--prefetch=", 11))
+  {
+    int64_t value;
+    if(!parse_size(arg + 11, value))
+      return false;
+
+    prefetch_depth = value;
+    return true;
+  }
+
+  if(!strncmp(arg, "--prefetch-mem=", 15))
+    return parse_size(arg + 15, prefetch_max_bytes);
+
+  if(!strncmp(arg, "--query=", 8))
+    return query::parse(arg + 8);
+
+  if(!strcmp(arg, "--archives"))
+  {
+    scan_archives = true;
+    return true;
+  }
+
+  if(!strcmp(arg, "--profile"))
+  {
+    profile_loaders = true;
+    return true;
+  }
+
+  if(!strcmp(arg, "-r"))
+  {
+    recursive = true;
+    return true;
+  }
+
+  if(!strcmp(arg, "-0"))
+  {
+    stdin_delimiter = '\0';
+    return true;
+  }
+
+  if(!strncmp(arg, "--cache=", 8))
+  {
+    if(!arg[8])
+      return false;
+
+    cache_filename = arg + 8;
+    return true;
+  }
+
+  if(!strncmp(arg, "--output=", 9))
+  {
+    const char *value = arg + 9;
+    if(!strcmp(value, "text"))
+      output_mode = OUTPUT_TEXT;
+    else
+
+    if(!strcmp(value, "jsonl"))
+      output_mode = OUTPUT_JSONL;
+    else
+
+    if(!strcmp(value, "binary"))
+      output_mode = OUTPUT_BINARY;
+    else
+      return false;
+
+    return true;
+  }
+
+  if(arg[1] == 'j')
+  {
+    long value = 0;
+    if(arg[2] == '=')
+    {
+      char *end;
+      value = strtol(arg + 3, &end, 10);
+      if(!arg[3] || *end || value < 0)
+        return false;
+    }
+    else
+
+    if(arg[2])
+      return false;
+
+    num_threads = value;
+    if(!num_threads)
+      num_threads = MAX(std::thread::hardware_concurrency(), 1u);
+    return true;
+  }
+  return false;
 }
 
 } /* namespace modutil */
@@ -191,6 +818,17 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
 static __attribute__((unused))
 #endif
 
+#ifdef BENCH_FRONTEND
+int main(int argc, char *argv[])
+{
+  modutil::sort_loaders();
+  return modutil::bench_main(argc, argv, modutil::loaders_vector(), modutil::check_module);
+}
+
+#define main _main
+static __attribute__((unused))
+#endif
+
 int main(int argc, char *argv[])
 {
   bool read_stdin = false;
@@ -210,31 +848,180 @@ int main(int argc, char *argv[])
     return 0;
   }
 
-  if(!Config.init(&argc, argv))
+  if(!Config.init(&argc, argv, modutil::moddiag_option, nullptr))
     return -1;
 
+  if(modutil::query::enabled)
+  {
+    if(output_mode != OUTPUT_TEXT)
+    {
+      format::error("--query requires --output=text");
+      return -1;
+    }
+    /* Only matches are printed. */
+    Config.quiet = true;
+  }
+
+  if(profile_loaders && output_mode != OUTPUT_TEXT)
+  {
+    format::error("--profile requires --output=text");
+    return -1;
+  }
+
+  /* Records only contain header info. */
+  if(output_mode != OUTPUT_TEXT)
+  {
+    Config.quiet = true;
+    if(!format::sink::has_destination())
+      format::sink::set_destination(stdout);
+  }
+
+  if(Config.quiet)
+  {
+    /* Nothing will be printed, so let the loaders skip all dump-only work
+     * (pattern event storage, tables, descriptions). Features and totals
+     * are still collected. */
+    Config.dump_descriptions = false;
+    Config.dump_samples = false;
+    Config.dump_samples_extra = false;
+    Config.dump_patterns = false;
+    Config.dump_pattern_rows = false;
+  }
+
+  std::unique_ptr<modutil::result_cache> result_cache;
+  if(cache_filename)
+  {
+    if(output_mode == OUTPUT_TEXT)
+    {
+      format::error("--cache requires --output=jsonl or --output=binary");
+      return -1;
+    }
+
+    /* Anything that changes the output for a given file goes here. */
+    std::string config = (output_mode == OUTPUT_JSONL) ? "jsonl" : "binary";
+    if(scan_archives)
+      config.append(";--archives");
+    for(int i = 0; i < Config.num_format_filters; i++)
+      config.append(";").append(Config.format_filter[i]);
+
+    result_cache = std::make_unique<modutil::result_cache>();
+    if(!result_cache->load(cache_filename, config.c_str()))
+    {
+      format::error("failed to load cache '%s'", cache_filename);
+      return -1;
+    }
+
+    /* Unidentified files need to be rescanned if any loader changes. */
+    std::string all_stamps;
+    for(const modutil::loader *loader : modutil::loaders_vector())
+    {
+      char stamp[32];
+      snprintf(stamp, sizeof(stamp), "%u.%u", loader->version, modutil::SHARED_VERSION);
+      result_cache->set_stamp(loader->tag, stamp);
+      all_stamps.append(loader->tag).append("=").append(stamp).append(";");
+    }
+    uint64_t h = modutil::result_cache::hash(
+     reinterpret_cast<const uint8_t *>(all_stamps.data()), all_stamps.size());
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016" PRIx64, h);
+    result_cache->set_stamp("", buf);
+    cache = result_cache.get();
+  }
+
+  std::unique_ptr<modutil::profile> loader_profile;
+  if(profile_loaders)
+  {
+    loader_profile = std::make_unique<modutil::profile>(modutil::loaders_vector().size());
+    profiler = loader_profile.get();
+  }
+
+  std::unique_ptr<modutil::scan_queue> queue;
+  if(num_threads > 1)
+    queue = std::make_unique<modutil::scan_queue>(num_threads);
+
+  /* Output is written once per file instead of once per line. */
+  format::output.set_buffered(true);
+
+  /* Files found by the walker are opened relative to their directory. */
+  auto scan = [&queue](const char *filename,
+   const std::shared_ptr<modutil::scan_dir> &dir, const char *name)
+  {
+    if(queue)
+      queue->push(filename, dir, name);
+    else
+    {
+      modutil::check_module(filename, dir.get(), name);
+      format::output.flush();
+    }
+  };
+
+  /* Files pass through the read-ahead window first (in order). */
+  modutil::prefetch prefetcher(prefetch_depth, prefetch_max_bytes, scan);
+
+  auto scan_found = [&prefetcher](modutil::walk_file &f)
+  {
+    prefetcher.push(f.path.c_str(), f.dir, f.name);
+  };
+
+  auto scan_arg = [&](const char *filename)
+  {
+    if(recursive && modutil::walk_directory(filename, scan_filter, scan_found))
+      return;
+
+    prefetcher.push(filename);
+  };
+
   for(int i = 1; i < argc; i++)
   {
     if(!strcmp(argv[i], "-"))
     {
       if(!read_stdin)
       {
-        char buffer[1024];
-        while(fgets_safe(buffer, stdin))
-          modutil::check_module(buffer);
+        std::string buffer;
+        int c;
+        do
+        {
+          c = fgetc(stdin);
+          if(c == EOF || c == stdin_delimiter)
+          {
+            /* Strip CR for lists written on Windows. */
+            if(stdin_delimiter == '\n' && buffer.size() && buffer.back() == '\r')
+              buffer.pop_back();
+            if(buffer.size())
+              scan_arg(buffer.c_str());
+
+            buffer.clear();
+          }
+          else
+            buffer += c;
+        }
+        while(c != EOF);
 
         read_stdin = true;
       }
       continue;
     }
-    modutil::check_module(argv[i]);
+    scan_arg(argv[i]);
   }
 
+  prefetcher.flush();
+  if(queue)
+    queue->finish();
+
   for(const modutil::loader *loader : modutil::loaders_vector())
     loader->report();
 
   if(total_unidentified)
     format::report("Total unidentified", total_unidentified);
 
+  modutil::query::report();
+
+  if(profiler)
+    profiler->report(modutil::loaders_vector());
+
+  if(cache && !cache->save())
+    format::error("failed to save cache '%s'", cache_filename);
+
+  format::output.flush();
   return (total_identified == 0);
 }
@@ -24,6 +24,7 @@
 #define MODUTIL_HPP
 
 #include <stdio.h>
+#include <vector>
 
 #include "Config.hpp"
 #include "common.hpp"
@@ -33,7 +34,8 @@
 
 namespace modutil
 {
-  extern char loaded_mod_magic[4];
+  /* Per-thread, reset for each file scanned. */
+  extern thread_local char loaded_mod_magic[4];
 
   class data
   {
@@ -43,16 +45,54 @@ namespace modutil
     data(vio &r): reader(r) {}
   };
 
+  /**
+   * Magic bytes that must be present at a fixed offset for a loader to
+   * accept a file. If a mask is provided, only the bits set in the mask are
+   * compared. The first byte of the signature must not be masked out, as it
+   * is used to index the signature.
+   */
+  struct signature
+  {
+    size_t offset;
+    size_t length;
+    const char *magic;
+    const char *mask;
+
+    constexpr signature(size_t o, const char *m, size_t l, const char *k = nullptr):
+     offset(o), length(l), magic(m), mask(k) {}
+
+    template<size_t N>
+    constexpr signature(size_t o, const char (&m)[N], const char *k = nullptr):
+     signature(o, m, N - 1, k) {}
+
+    bool match(const uint8_t *buf, size_t buf_len) const;
+  };
+
+  /**
+   * Versions used to invalidate cached results. A loader's version must be
+   * bumped whenever a change to it can change its output for any file.
+   * SHARED_VERSION must be bumped for output-affecting changes to code used
+   * by several loaders (vio, format::, LZW, Bitstream, etc.).
+   */
+  static constexpr unsigned SHARED_VERSION = 1;
+
   class loader
   {
   public:
     const char *ext;
     const char *tag;
     const char *name;
+    unsigned version;
+    /* If empty, this loader is always probed (heuristic formats).
+     * Otherwise, it is only probed when at least one signature matches. */
+    std::vector<signature> signatures;
+
     virtual modutil::error load(modutil::data state) const = 0;
     virtual void           report() const = 0;
 
-    loader(const char *e, const char *t, const char *n);
+    loader(const char *e, const char *t, const char *n, unsigned v = 1);
+    loader(const char *e, const char *t, const char *n, std::vector<signature> &&s,
+     unsigned v = 1);
   };
 }
 
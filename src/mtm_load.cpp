@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 #include "modutil.hpp"
 
@@ -40,7 +41,7 @@ static constexpr const char *FEATURE_STR[NUM_FEATURES] =
   "E:Tempo",
 };
 
-static int total_mtms = 0;
+static std::atomic<int> total_mtms;
 
 
 static const int MAX_CHANNELS = 32;
@@ -177,7 +178,8 @@ struct MTM_data
 class MTM_loader : public modutil::loader
 {
 public:
-  MTM_loader(): modutil::loader("MTM", "mtm", "MultiTracker") {}
+  MTM_loader(): modutil::loader("MTM", "mtm", "MultiTracker",
+   {{ 0, "MTM" }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
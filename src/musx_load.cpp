@@ -26,8 +26,9 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include <atomic>
 
-static size_t num_musx = 0;
+static std::atomic<size_t> num_musx;
 
 
 enum MUSX_features
@@ -666,7 +667,8 @@ static const IFF<
 class MUSX_loader: modutil::loader
 {
 public:
-  MUSX_loader(): modutil::loader("-", "musx", "!Tracker-compatible/MUSX") {}
+  MUSX_loader(): modutil::loader("-", "musx", "!Tracker-compatible/MUSX",
+   {{ 0, "MUSX" }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
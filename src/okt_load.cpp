@@ -23,11 +23,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 #include "IFF.hpp"
 #include "modutil.hpp"
 
-static int total_okts = 0;
+static std::atomic<int> total_okts;
 
 
 enum OKT_features
@@ -333,7 +334,8 @@ static const IFF<
 class OKT_loader : modutil::loader
 {
 public:
-  OKT_loader(): modutil::loader("OKT", "okta", "Oktalyzer") {}
+  OKT_loader(): modutil::loader("OKT", "okta", "Oktalyzer",
+   {{ 0, "OKTASONG" }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
@@ -0,0 +1,173 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "prefetch.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(POSIX_FADV_WILLNEED)
+#define PREFETCH_SUPPORTED
+
+static int open_file(const char *filename, const modutil::scan_dir *dir,
+ const char *name)
+{
+  if(dir)
+    return openat(dir->fd, name, O_RDONLY | O_CLOEXEC);
+
+  return open(filename, O_RDONLY | O_CLOEXEC);
+}
+#endif
+
+bool modutil::prefetch::supported()
+{
+#ifdef PREFETCH_SUPPORTED
+  return true;
+#else
+  return false;
+#endif
+}
+
+modutil::prefetch::prefetch(size_t _depth, int64_t _max_bytes, scan_fn &&_fn):
+ fn(std::move(_fn)), depth(_depth), max_bytes(_max_bytes)
+{
+  if(depth && supported())
+    io_thread = std::thread(&prefetch::worker, this);
+}
+
+modutil::prefetch::~prefetch()
+{
+  flush();
+  {
+    std::lock_guard<std::mutex> l(lock);
+    finished = true;
+  }
+  cond.notify_all();
+  if(io_thread.joinable())
+    io_thread.join();
+}
+
+void modutil::prefetch::push(const char *filename,
+ const std::shared_ptr<scan_dir> &dir, const char *name)
+{
+  if(!io_thread.joinable())
+  {
+    fn(filename, dir, name);
+    return;
+  }
+
+  std::unique_lock<std::mutex> l(lock);
+  std::shared_ptr<entry> e = std::make_shared<entry>();
+  e->filename = filename;
+  if(dir && name)
+  {
+    e->dir = dir;
+    e->name = name;
+  }
+  entries.push_back(std::move(e));
+  cond.notify_all();
+
+  while(entries.size() > depth)
+    scan_front(l);
+}
+
+void modutil::prefetch::flush()
+{
+  std::unique_lock<std::mutex> l(lock);
+  while(entries.size())
+    scan_front(l);
+}
+
+/* Call with lock held. The lock is released while the file is scanned. */
+void modutil::prefetch::scan_front(std::unique_lock<std::mutex> &l)
+{
+  std::shared_ptr<entry> e = std::move(entries.front());
+  entries.pop_front();
+  first_index++;
+
+  if(e->hinted)
+  {
+    bytes -= e->size;
+    cond.notify_all();
+  }
+
+  l.unlock();
+  fn(e->filename.c_str(), e->dir, e->dir ? e->name.c_str() : nullptr);
+  l.lock();
+}
+
+void modutil::prefetch::worker()
+{
+#ifdef PREFETCH_SUPPORTED
+  std::unique_lock<std::mutex> l(lock);
+  while(true)
+  {
+    /* Entries that were scanned before they could be hinted are skipped. */
+    cond.wait(l, [this]
+    {
+      if(next_index < first_index)
+        next_index = first_index;
+      return finished || next_index < first_index + entries.size();
+    });
+    if(finished)
+      return;
+
+    size_t index = next_index++;
+    std::shared_ptr<entry> e = entries[index - first_index];
+    l.unlock();
+
+    int fd = open_file(e->filename.c_str(), e->dir.get(), e->name.c_str());
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0)
+    {
+      if(fd >= 0)
+        close(fd);
+      l.lock();
+      continue;
+    }
+
+    l.lock();
+    cond.wait(l, [&]
+    {
+      return finished || index < first_index ||
+       bytes == 0 || bytes + st.st_size <= max_bytes;
+    });
+    if(!finished && index >= first_index)
+    {
+      e->size = st.st_size;
+      e->hinted = true;
+      bytes += e->size;
+
+      l.unlock();
+      posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+      l.lock();
+    }
+    close(fd);
+  }
+#endif
+}
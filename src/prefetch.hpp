@@ -0,0 +1,98 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MODUTIL_PREFETCH_HPP
+#define MODUTIL_PREFETCH_HPP
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "dirwalk.hpp"
+
+namespace modutil
+{
+  /**
+   * Read-ahead window for corpus scans. Files are queued here before they
+   * are scanned and are always passed to the scan function in order. The
+   * newest `depth` files are held back, and while older files are being
+   * scanned an I/O thread opens the held files and asks the OS to start
+   * reading them into the page cache (posix_fadvise WILLNEED). Files are
+   * only hinted while the total size of hinted, unscanned files is at most
+   * `max_bytes` (a single larger file is still hinted on its own).
+   */
+  class prefetch
+  {
+  public:
+    using scan_fn = std::function<void(const char *filename,
+     const std::shared_ptr<scan_dir> &dir, const char *name)>;
+
+    /* Defaults for moddiag --prefetch and --prefetch-mem. */
+    static constexpr size_t DEFAULT_DEPTH = 8;
+    static constexpr int64_t DEFAULT_MAX_BYTES = 64 << 20;
+
+    /* Returns false if read-ahead hints aren't supported on this platform. */
+    static bool supported();
+
+    prefetch(size_t _depth, int64_t _max_bytes, scan_fn &&_fn);
+    ~prefetch();
+
+    void push(const char *filename, const std::shared_ptr<scan_dir> &dir = nullptr,
+     const char *name = nullptr);
+
+    /* Scan every queued file. */
+    void flush();
+
+  private:
+    struct entry
+    {
+      std::string filename;
+      std::shared_ptr<scan_dir> dir;
+      std::string name;
+      int64_t size = 0;
+      bool hinted = false;
+    };
+
+    scan_fn fn;
+    size_t depth;
+    int64_t max_bytes;
+    int64_t bytes = 0;        /* Total size of hinted files in the queue. */
+
+    std::thread io_thread;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<std::shared_ptr<entry>> entries;
+    size_t first_index = 0;   /* Index of entries.front(). */
+    size_t next_index = 0;    /* Index of the next entry to hint. */
+    bool finished = false;
+
+    void worker();
+    void scan_front(std::unique_lock<std::mutex> &l);
+  };
+}
+
+#endif /* MODUTIL_PREFETCH_HPP */
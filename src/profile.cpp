@@ -0,0 +1,116 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <new>
+
+#include "format.hpp"
+#include "modutil.hpp"
+#include "profile.hpp"
+
+/* Counting allocations requires replacing the global operator new, so it
+ * is only built with PROFILE_ALLOCS=1. Sanitizers provide their own. */
+#ifdef PROFILE_ALLOCS
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#undef PROFILE_ALLOCS
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer) || \
+ __has_feature(thread_sanitizer) || __has_feature(hwaddress_sanitizer)
+#undef PROFILE_ALLOCS
+#endif
+#endif
+#endif
+
+#ifdef PROFILE_ALLOCS
+static thread_local uint64_t allocations;
+
+uint64_t modutil::thread_allocations() noexcept
+{
+  return allocations;
+}
+
+/* The default operator new[] and nothrow variants call this one, and the
+ * default operator delete calls free(), so this is all that's needed. */
+void *operator new(size_t sz)
+{
+  allocations++;
+  void *ptr = malloc(sz ? sz : 1);
+  if(!ptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+#else
+uint64_t modutil::thread_allocations() noexcept
+{
+  return 0;
+}
+#endif
+
+void modutil::profile::add(size_t loader_index, bool hit, uint64_t nsec,
+ const vio_profile::counters &io, uint64_t allocs) noexcept
+{
+  totals &t = stats[loader_index * 2 + (hit ? 0 : 1)];
+  t.calls += 1;
+  t.nsec += nsec;
+  t.reads += io.reads;
+  t.bytes += io.bytes;
+  t.seeks += io.seeks;
+  t.allocs += allocs;
+}
+
+void modutil::profile::report(const std::vector<const loader *> &loaders) const
+{
+  uint64_t total_nsec = 0;
+  for(size_t i = 0; i < num_loaders * 2; i++)
+    total_nsec += stats[i].nsec;
+
+  format::printf("\nProfile:\n\n");
+  format::printf("%-4s %-6s %-4s : %8s %10s %6s : %10s %12s %8s %10s\n",
+   "Ext", "Tag", "", "Calls", "Time (ms)", "%", "Reads", "Bytes", "Seeks", "Allocs");
+  format::printf("---- ------ ---- : -------- ---------- ------ : "
+   "---------- ------------ -------- ----------\n");
+
+  for(size_t i = 0; i < num_loaders && i < loaders.size(); i++)
+  {
+    for(int miss = 0; miss < 2; miss++)
+    {
+      const totals &t = stats[i * 2 + miss];
+      if(!t.calls)
+        continue;
+
+      double ms = t.nsec / 1000000.0;
+      double pct = total_nsec ? t.nsec * 100.0 / total_nsec : 0.0;
+      char allocs[24] = "-";
+#ifdef PROFILE_ALLOCS
+      snprintf(allocs, sizeof(allocs), "%" PRIu64, t.allocs.load());
+#endif
+      format::printf("%-4.4s %-6.6s %-4s : %8" PRIu64 " %10.3f %6.2f : "
+       "%10" PRIu64 " %12" PRIu64 " %8" PRIu64 " %10s\n",
+       loaders[i]->ext, loaders[i]->tag, miss ? "miss" : "hit",
+       t.calls.load(), ms, pct, t.reads.load(), t.bytes.load(),
+       t.seeks.load(), allocs);
+    }
+  }
+  format::printf("\nTotal loader time: %.3f ms\n", total_nsec / 1000000.0);
+}
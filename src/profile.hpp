@@ -0,0 +1,73 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MODUTIL_PROFILE_HPP
+#define MODUTIL_PROFILE_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "vio.hpp"
+
+namespace modutil
+{
+  class loader;
+
+  /**
+   * Number of times operator new has been called by the calling thread.
+   * Always 0 unless built with PROFILE_ALLOCS=1, and always 0 in sanitizer
+   * builds, which provide their own operator new.
+   */
+  uint64_t thread_allocations() noexcept;
+
+  /**
+   * Per-loader totals for --profile. Loads that return FORMAT_ERROR are
+   * counted as misses, everything else as hits.
+   */
+  class profile
+  {
+    struct totals
+    {
+      std::atomic<uint64_t> calls{0};
+      std::atomic<uint64_t> nsec{0};
+      std::atomic<uint64_t> reads{0};
+      std::atomic<uint64_t> bytes{0};
+      std::atomic<uint64_t> seeks{0};
+      std::atomic<uint64_t> allocs{0};
+    };
+    std::unique_ptr<totals[]> stats;
+    size_t num_loaders;
+
+  public:
+    profile(size_t n): stats(new totals[n * 2]), num_loaders(n) {}
+
+    void add(size_t loader_index, bool hit, uint64_t nsec,
+     const vio_profile::counters &io, uint64_t allocs) noexcept;
+
+    /* Print the totals, one line per loader used. */
+    void report(const std::vector<const loader *> &loaders) const;
+  };
+}
+
+#endif /* MODUTIL_PROFILE_HPP */
@@ -28,11 +28,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 #include <vector>
 
 #include "modutil.hpp"
 
-static int total_ps16 = 0;
+static std::atomic<int> total_ps16;
 
 
 enum PS16_features
@@ -201,7 +202,8 @@ struct PS16_data
 class PS16_loader : modutil::loader
 {
 public:
-  PS16_loader(): modutil::loader("PSM", "ps16", "Protracker Studio 16 / Epic MegaGames MASI") {}
+  PS16_loader(): modutil::loader("PSM", "ps16", "Protracker Studio 16 / Epic MegaGames MASI",
+   {{ 0, MAGIC }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
@@ -28,11 +28,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 #include "IFF.hpp"
 #include "modutil.hpp"
 
-static int total_psm = 0;
+static std::atomic<int> total_psm;
 
 
 enum PSM_features
@@ -205,7 +206,8 @@ static const IFF<
 class PSM_loader : modutil::loader
 {
 public:
-  PSM_loader(): modutil::loader("PSM", "masi", "Protracker Studio Module / Epic MegaGames MASI") {}
+  PSM_loader(): modutil::loader("PSM", "masi", "Protracker Studio Module / Epic MegaGames MASI",
+   {{ 0, "PSM \0\0\0\0FILE", "\xff\xff\xff\xff\0\0\0\0\xff\xff\xff\xff" }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
@@ -0,0 +1,245 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <atomic>
+#include <vector>
+
+#include "format.hpp"
+#include "query.hpp"
+
+namespace modutil
+{
+namespace query
+{
+  bool enabled = false;
+
+  enum column
+  {
+    NOTE,
+    INSTRUMENT,
+    VOLUME,
+    EFFECT,
+    PARAMETER,
+    NUM_COLUMNS
+  };
+
+  struct range
+  {
+    unsigned min;
+    unsigned max;
+  };
+
+  struct query
+  {
+    unsigned mask = 0; /* Highlight flags of the columns in ranges. */
+    std::vector<range> ranges[NUM_COLUMNS];
+
+    bool match(unsigned present, const unsigned (&values)[NUM_COLUMNS]) const
+    {
+      if((present & mask) != mask)
+        return false;
+
+      for(int i = 0; i < NUM_COLUMNS; i++)
+      {
+        if(!(mask & (1 << i)))
+          continue;
+
+        bool found = false;
+        for(const range &r : ranges[i])
+        {
+          if(values[i] >= r.min && values[i] <= r.max)
+          {
+            found = true;
+            break;
+          }
+        }
+        if(!found)
+          return false;
+      }
+      return true;
+    }
+  };
+
+  struct result
+  {
+    uint32_t pattern;
+    uint32_t row;
+    uint32_t channel;
+  };
+
+  static std::vector<query> queries;
+
+  /* Per-thread, reset for each file scanned. */
+  static thread_local std::vector<result> results;
+
+  static std::atomic<size_t> total_files;
+  static std::atomic<size_t> total_events;
+
+  static char next_char(const char **str)
+  {
+    while(isspace(**str))
+      (*str)++;
+
+    return *((*str)++);
+  }
+
+  static bool parse_value(const char **str, unsigned &value)
+  {
+    while(isspace(**str))
+      (*str)++;
+
+    if(!isdigit(**str))
+      return false;
+
+    char *end;
+    unsigned long tmp;
+    if((*str)[0] == '0' && tolower((*str)[1]) == 'x')
+      tmp = strtoul(*str + 2, &end, 16);
+    else
+      tmp = strtoul(*str, &end, 10);
+
+    if(end == *str || tmp > 0xffff)
+      return false;
+
+    value = tmp;
+    *str = end;
+    return true;
+  }
+
+  bool parse(const char *str)
+  {
+    // n=note, s/i=instrument, v=volume, e/x=effect p=param
+    query q;
+    while(true)
+    {
+      int col;
+      char c = next_char(&str);
+      switch(tolower(c))
+      {
+        case 'n':
+          col = NOTE;
+          break;
+        case 's':
+        case 'i':
+          col = INSTRUMENT;
+          break;
+        case 'v':
+          col = VOLUME;
+          break;
+        case 'e':
+        case 'x':
+          col = EFFECT;
+          break;
+        case 'p':
+          col = PARAMETER;
+          break;
+        default:
+          return false;
+      }
+
+      if(next_char(&str) != ':')
+        return false;
+
+      range r;
+      if(!parse_value(&str, r.min))
+        return false;
+
+      r.max = r.min;
+      c = next_char(&str);
+      if(c == '-')
+      {
+        if(!parse_value(&str, r.max) || r.max < r.min)
+          return false;
+
+        c = next_char(&str);
+      }
+
+      q.mask |= 1 << col;
+      q.ranges[col].push_back(r);
+      if(c == '\0')
+        break;
+
+      if(c != ',')
+        return false;
+    }
+
+    queries.push_back(std::move(q));
+    enabled = true;
+    return true;
+  }
+
+  void match(size_t pattern, size_t row, size_t channel, unsigned present,
+   unsigned note, unsigned instrument, unsigned volume, unsigned effect, unsigned param)
+  {
+    static_assert(Highlight::NOTE == (1 << NOTE) &&
+     Highlight::INSTRUMENT == (1 << INSTRUMENT) && Highlight::VOLUME == (1 << VOLUME) &&
+     Highlight::EFFECT == (1 << EFFECT) && Highlight::PARAMETER == (1 << PARAMETER),
+     "query columns should match Highlight flags");
+
+    const unsigned values[NUM_COLUMNS] = { note, instrument, volume, effect, param };
+    if(present & Highlight::EFFECT)
+      present |= Highlight::PARAMETER;
+
+    for(const query &q : queries)
+    {
+      if(q.match(present, values))
+      {
+        results.push_back({ (uint32_t)pattern, (uint32_t)row, (uint32_t)channel });
+        return;
+      }
+    }
+  }
+
+  void clear()
+  {
+    results.clear();
+  }
+
+  void print(const char *filename)
+  {
+    if(!results.size())
+      return;
+
+    /* Positions are in hex, the same as in the pattern dump. */
+    for(const result &r : results)
+    {
+      format::printf("%s: pattern %02" PRIx32 " row %02" PRIx32 " channel %02" PRIx32 "\n",
+       filename, r.pattern, r.row, r.channel);
+    }
+
+    total_files++;
+    total_events += results.size();
+    results.clear();
+  }
+
+  void report()
+  {
+    if(!enabled)
+      return;
+
+    format::printf("\n%-22.22s: %zu\n", "Total matching files", total_files.load());
+    format::printf("%-22.22s: %zu\n", "Total matching events", total_events.load());
+  }
+} /* namespace query */
+} /* namespace modutil */
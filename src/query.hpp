@@ -0,0 +1,80 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MODUTIL_QUERY_HPP
+#define MODUTIL_QUERY_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Config.hpp"
+
+namespace modutil
+{
+  /**
+   * Pattern event queries (moddiag --query). Loaders that support queries
+   * pass every decoded event to query::event() from their pattern decoders,
+   * and events that match any query are recorded for the current file.
+   * Values are the same ones displayed in the pattern dump (and used by -H),
+   * e.g. MOD notes are periods and IT/S3M effects are numbered from A=1.
+   */
+  namespace query
+  {
+    /* Set by parse(). Nothing is recorded while no queries exist. */
+    extern bool enabled;
+
+    /**
+     * Parse a query string in the format 'C:#[-#][,...]' and add it to the
+     * list of queries. Column types are the same as for -H. An event must
+     * match every column type in a query, and may match any value given for
+     * a column type. Values may be decimal or hex (0x prefix).
+     */
+    bool parse(const char *str);
+
+    void match(size_t pattern, size_t row, size_t channel, unsigned present,
+     unsigned note, unsigned instrument, unsigned volume, unsigned effect, unsigned param);
+
+    /**
+     * Check a decoded event. `present` contains the Highlight flags for the
+     * columns that aren't empty; empty columns never match. The parameter
+     * is present if the effect is. Decoders should read `enabled` once
+     * before decoding and only call this if it's set.
+     */
+    static inline void event(size_t pattern, size_t row, size_t channel, unsigned present,
+     unsigned note, unsigned instrument, unsigned volume, unsigned effect, unsigned param)
+    {
+      if(present)
+        match(pattern, row, channel, present, note, instrument, volume, effect, param);
+    }
+
+    /* Discard the matches recorded for the current file. */
+    void clear();
+
+    /* Print and clear the matches recorded for the current file. */
+    void print(const char *filename);
+
+    /* Print the total number of matching files and events. */
+    void report();
+  }
+}
+
+#endif /* MODUTIL_QUERY_HPP */
@@ -0,0 +1,271 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef MODUTIL_RECORD_HPP
+#define MODUTIL_RECORD_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace format
+{
+  /**
+   * Structured result for a single file, collected from the format:: printers
+   * instead of printing them. Used by moddiag's --output=jsonl and
+   * --output=binary modes.
+   */
+  class record
+  {
+  public:
+    std::string filename;
+    const char *ext = nullptr;
+    const char *tag = nullptr;
+    const char *name = nullptr;
+    int error_code = 0;
+    const char *error_str = nullptr;
+
+    std::vector<std::pair<std::string, std::string>> fields;
+    std::vector<const char *> uses;
+    std::vector<std::string> errors;
+    std::vector<std::string> warnings;
+
+    void clear()
+    {
+      filename.clear();
+      ext = tag = name = nullptr;
+      error_code = 0;
+      error_str = nullptr;
+      fields.clear();
+      uses.clear();
+      errors.clear();
+      warnings.clear();
+    }
+
+    /**
+     * Add a header field. Lines with an empty label are continuations of the
+     * previous field, and repeated labels are appended to the first one.
+     */
+    void field(const char *label, std::string &&value)
+    {
+      while(*label == ' ')
+        label++;
+
+      if(!*label)
+      {
+        if(fields.size())
+          fields.back().second.append("\n").append(value);
+        return;
+      }
+
+      for(auto &f : fields)
+      {
+        if(f.first == label)
+        {
+          f.second.append("\n").append(value);
+          return;
+        }
+      }
+      fields.emplace_back(label, std::move(value));
+    }
+
+    /**
+     * One JSON object per line. Bytes outside of printable ASCII are escaped
+     * as \u00XX (i.e. the strings are treated as Latin-1), since module text
+     * is rarely valid UTF-8.
+     */
+    void to_jsonl(std::string &out) const
+    {
+      out += "{\"file\":";
+      json_string(out, filename.c_str());
+      if(name)
+      {
+        out += ",\"ext\":";
+        json_string(out, ext);
+        out += ",\"tag\":";
+        json_string(out, tag);
+        out += ",\"loader\":";
+        json_string(out, name);
+      }
+      else
+        out += ",\"loader\":null";
+
+      char tmp[32];
+      snprintf(tmp, sizeof(tmp), ",\"error\":%d", error_code);
+      out += tmp;
+      if(error_str)
+      {
+        out += ",\"error_str\":";
+        json_string(out, error_str);
+      }
+
+      out += ",\"fields\":{";
+      for(size_t i = 0; i < fields.size(); i++)
+      {
+        if(i)
+          out += ',';
+        json_string(out, fields[i].first.c_str());
+        out += ':';
+        json_string(out, fields[i].second.c_str());
+      }
+      out += "},\"uses\":[";
+      for(size_t i = 0; i < uses.size(); i++)
+      {
+        if(i)
+          out += ',';
+        json_string(out, uses[i]);
+      }
+      out += "],\"errors\":[";
+      for(size_t i = 0; i < errors.size(); i++)
+      {
+        if(i)
+          out += ',';
+        json_string(out, errors[i].c_str());
+      }
+      out += "],\"warnings\":[";
+      for(size_t i = 0; i < warnings.size(); i++)
+      {
+        if(i)
+          out += ',';
+        json_string(out, warnings[i].c_str());
+      }
+      out += "]}\n";
+    }
+
+    /**
+     * Binary record stream. Each record is:
+     *
+     *   u32le  record length (not including this field)
+     *   entries...
+     *
+     * Each entry is a u8 type, a u32le length, and that many bytes of data.
+     * Strings are not terminated. Unknown entry types should be skipped.
+     */
+    enum binary_type
+    {
+      B_FILE      = 1,
+      B_EXT       = 2,
+      B_TAG       = 3,
+      B_LOADER    = 4,
+      B_ERROR     = 5, /* s32le error code. */
+      B_ERROR_STR = 6,
+      B_FIELD     = 7, /* label, NUL, value. */
+      B_USES      = 8, /* One entry per feature. */
+      B_MSG_ERROR = 9,
+      B_MSG_WARN  = 10,
+    };
+
+    void to_binary(std::string &out) const
+    {
+      size_t start = out.size();
+      out.append(4, '\0');
+
+      binary_entry(out, B_FILE, filename.data(), filename.size());
+      if(name)
+      {
+        binary_string(out, B_EXT, ext);
+        binary_string(out, B_TAG, tag);
+        binary_string(out, B_LOADER, name);
+      }
+
+      uint8_t err[4] =
+      {
+        (uint8_t)(error_code >> 0),  (uint8_t)(error_code >> 8),
+        (uint8_t)(error_code >> 16), (uint8_t)(error_code >> 24),
+      };
+      binary_entry(out, B_ERROR, err, sizeof(err));
+      if(error_str)
+        binary_string(out, B_ERROR_STR, error_str);
+
+      for(auto &f : fields)
+      {
+        std::string tmp = f.first;
+        tmp += '\0';
+        tmp += f.second;
+        binary_entry(out, B_FIELD, tmp.data(), tmp.size());
+      }
+      for(const char *u : uses)
+        binary_string(out, B_USES, u);
+      for(auto &e : errors)
+        binary_entry(out, B_MSG_ERROR, e.data(), e.size());
+      for(auto &w : warnings)
+        binary_entry(out, B_MSG_WARN, w.data(), w.size());
+
+      size_t len = out.size() - start - 4;
+      out[start + 0] = len >> 0;
+      out[start + 1] = len >> 8;
+      out[start + 2] = len >> 16;
+      out[start + 3] = len >> 24;
+    }
+
+  private:
+    static void json_string(std::string &out, const char *str)
+    {
+      static const char hex[] = "0123456789abcdef";
+      out += '"';
+      for(; *str; str++)
+      {
+        uint8_t c = *str;
+        if(c == '"' || c == '\\')
+        {
+          out += '\\';
+          out += c;
+        }
+        else
+
+        if(c == '\n')
+          out += "\\n";
+        else
+
+        if(c < 0x20 || c >= 0x7f)
+        {
+          out += "\\u00";
+          out += hex[c >> 4];
+          out += hex[c & 15];
+        }
+        else
+          out += c;
+      }
+      out += '"';
+    }
+
+    static void binary_entry(std::string &out, int type, const void *data, size_t len)
+    {
+      out += (char)type;
+      out += (char)(len & 0xff);
+      out += (char)(len >> 8);
+      out += (char)(len >> 16);
+      out += (char)(len >> 24);
+      out.append(reinterpret_cast<const char *>(data), len);
+    }
+
+    static void binary_string(std::string &out, int type, const char *str)
+    {
+      binary_entry(out, type, str, strlen(str));
+    }
+  };
+}
+
+#endif /* MODUTIL_RECORD_HPP */
@@ -22,10 +22,12 @@
 
 /* Real Tracker 2 RTM Loader. */
 
+#include <atomic>
+
 #include "error.hpp"
 #include "modutil.hpp"
 
-static int total_rtm = 0;
+static std::atomic<int> total_rtm;
 
 
 static constexpr size_t MAX_CHANNELS = 32;
@@ -751,7 +753,8 @@ struct RTM_data
 class RTM_loader : public modutil::loader
 {
 public:
-  RTM_loader(): modutil::loader("RTM", "rtm", "Real Tracker") {}
+  RTM_loader(): modutil::loader("RTM", "rtm", "Real Tracker",
+   {{ 0, "RTMM" }}) {}
 
   modutil::error load(modutil::data state) const override
   {
@@ -993,15 +996,15 @@ public:
                                           (effect == 38) ? 'e' :
                                           (effect == 39) ? 'k' :
                                           (effect == 40) ? 'a' : '?'; }
-        void print() const
+        char *render(char *dest) const
         {
-          if(can_print())
-          {
-            fprintf(stderr, HIGHLIGHT_FX("%c%02x", effect, param),
-              effect_char(), param);
-          }
-          else
-            format::spaces(width());
+          if(!can_print())
+            return format::render::blank(dest, width());
+
+          char tmp[3] = { effect_char() };
+          format::render::hex2(tmp + 1, param);
+          return format::render::field(dest, tmp, 3,
+           format::render::highlight_fx(effect, param));
         }
       };
 
@@ -24,10 +24,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 #include "modutil.hpp"
+#include "query.hpp"
 
-static int total_s3ms = 0;
+static std::atomic<int> total_s3ms;
 
 
 enum S3M_features
@@ -137,6 +139,28 @@ struct S3M_header
   uint8_t panning_table[32];
 };
 
+using S3M_header_layout = layout::record<S3M_header, 96,
+  layout::bytes<&S3M_header::name,               0>,
+  layout::u8   <&S3M_header::eof,               28>,
+  layout::u8   <&S3M_header::type,              29>,
+  layout::u16le<&S3M_header::reserved,          30>,
+  layout::u16le<&S3M_header::num_orders,        32>,
+  layout::u16le<&S3M_header::num_instruments,   34>,
+  layout::u16le<&S3M_header::num_patterns,      36>,
+  layout::u16le<&S3M_header::flags,             38>,
+  layout::u16le<&S3M_header::cwtv,              40>,
+  layout::u16le<&S3M_header::ffi,               42>,
+  layout::bytes<&S3M_header::magic,             44>,
+  layout::u8   <&S3M_header::global_volume,     48>,
+  layout::u8   <&S3M_header::initial_speed,     49>,
+  layout::u8   <&S3M_header::initial_tempo,     50>,
+  layout::u8   <&S3M_header::master_volume,     51>,
+  layout::u8   <&S3M_header::click_removal,     52>,
+  layout::u8   <&S3M_header::has_panning_table, 53>,
+  layout::bytes<&S3M_header::reserved2,         54>,
+  layout::u16le<&S3M_header::special_segment,   62>,
+  layout::bytes<&S3M_header::channel_settings,  64>>;
+
 struct S3M_instrument
 {
   enum
@@ -253,7 +277,6 @@ struct S3M_data
   uint8_t        *orders = nullptr;
   S3M_instrument *instruments = nullptr;
   S3M_pattern    *patterns = nullptr;
-  uint8_t        *buffer = nullptr;
 
   char name[29];
   const char *tracker_string;
@@ -268,7 +291,6 @@ struct S3M_data
     delete[] orders;
     delete[] instruments;
     delete[] patterns;
-    delete[] buffer;
   }
 
   void allocate()
@@ -276,7 +298,6 @@ struct S3M_data
     orders = new uint8_t[header.num_orders]{};
     patterns = new S3M_pattern[header.num_patterns]{};
     instruments = new S3M_instrument[header.num_instruments]{};
-    buffer = new uint8_t[1 << 16];
   }
 };
 
@@ -284,17 +305,18 @@ struct S3M_data
 class S3M_loader : public modutil::loader
 {
 public:
-  S3M_loader(): modutil::loader("S3M", "s3m", "Scream Tracker 3") {}
+  S3M_loader(): modutil::loader("S3M", "s3m", "Scream Tracker 3",
+   {{ 44, S3M_MAGIC }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
-    FILE *fp = state.reader.unwrap(); /* FIXME: */
+    vio_reader<> r(state.reader);
 
     S3M_data m{};
     S3M_header &h = m.header;
-    uint8_t buffer[96];
 
-    if(!fread(buffer, 96, 1, fp))
+    const uint8_t *buffer = r.span(S3M_header_layout::size);
+    if(!buffer)
       return modutil::FORMAT_ERROR;
 
     if(memcmp(buffer + 44, S3M_MAGIC, 4))
@@ -304,35 +326,12 @@ public:
 
     /* Header. */
 
-    memcpy(h.name, buffer, sizeof(h.name));
+    S3M_header_layout::decode(h, buffer);
+
     memcpy(m.name, h.name, sizeof(h.name));
     m.name[sizeof(h.name)] = '\0';
     strip_module_name(m.name, sizeof(m.name));
 
-    h.eof               = buffer[28];
-    h.type              = buffer[29];
-    h.reserved          = mem_u16le(buffer + 30);
-    h.num_orders        = mem_u16le(buffer + 32);
-    h.num_instruments   = mem_u16le(buffer + 34);
-    h.num_patterns      = mem_u16le(buffer + 36);
-    h.flags             = mem_u16le(buffer + 38);
-    h.cwtv              = mem_u16le(buffer + 40);
-    h.ffi               = mem_u16le(buffer + 42);
-
-    memcpy(h.magic, buffer + 44, sizeof(h.magic));
-
-    h.global_volume     = buffer[48];
-    h.initial_speed     = buffer[49];
-    h.initial_tempo     = buffer[50];
-    h.master_volume     = buffer[51];
-    h.click_removal     = buffer[52];
-    h.has_panning_table = buffer[53];
-
-    memcpy(h.reserved2, buffer + 54, sizeof(h.reserved2));
-
-    h.special_segment   = mem_u16le(buffer + 62);
-
-    memcpy(h.channel_settings, buffer + 64, MAX_CHANNELS);
     // Now synchronized with the FILE stream.
 
     if(h.num_instruments > 255)
@@ -348,24 +347,24 @@ public:
     // Standard Scream Tracker 3 S3Ms are saved with this padded to
     // a multiple of 4 (to keep the segment pointers aligned?), but
     // other trackers (IT) seem to ignore that when saving.
-    if(!fread(m.orders, h.num_orders, 1, fp))
+    if(r.read(m.orders, h.num_orders) < h.num_orders)
       return modutil::READ_ERROR;
 
     // Instrument parapointers.
     for(size_t i = 0; i < h.num_instruments; i++)
-      m.instruments[i].instrument_segment = fget_u16le(fp);
+      m.instruments[i].instrument_segment = r.u16le();
 
     // Pattern parapointers.
     for(size_t i = 0; i < h.num_patterns; i++)
-      m.patterns[i].pattern_segment = fget_u16le(fp);
+      m.patterns[i].pattern_segment = r.u16le();
 
     // Panning table.
     if(h.has_panning_table == HAS_PANNING_TABLE)
     {
-      if(!fread(h.panning_table, MAX_CHANNELS, 1, fp))
+      if(r.read(h.panning_table, MAX_CHANNELS) < MAX_CHANNELS)
         return modutil::READ_ERROR;
     }
-    if(feof(fp))
+    if(r.eof())
       return modutil::READ_ERROR;
 
     // Get channel count.
@@ -397,10 +396,11 @@ public:
       if(!ins.instrument_segment)
         continue;
 
-      if(fseek(fp, ins.instrument_segment << 4, SEEK_SET))
+      if(r.seek(ins.instrument_segment << 4, SEEK_SET))
         return modutil::SEEK_ERROR;
 
-      if(!fread(buffer, 80, 1, fp))
+      buffer = r.span(80);
+      if(!buffer)
       {
         format::warning("read error at instrument %zu : segment %u", i, ins.instrument_segment);
         return modutil::READ_ERROR;
@@ -518,28 +518,33 @@ public:
     for(size_t i = 0; i < h.num_patterns; i++)
     {
       S3M_pattern &p = m.patterns[i];
-      p.allocate(MAX_CHANNELS, 64);
+      /* Events are only kept if they will be printed. */
+      if(Config.dump_pattern_rows)
+        p.allocate(MAX_CHANNELS, 64);
 
       if(!p.pattern_segment)
         continue;
 
-      if(fseek(fp, p.pattern_segment << 4, SEEK_SET))
+      if(r.seek(p.pattern_segment << 4, SEEK_SET))
         return modutil::SEEK_ERROR;
 
-      p.packed_size = fget_u16le(fp);
+      p.packed_size = r.u16le();
       if(!p.packed_size)
         continue;
 
-      if(!fread(m.buffer, p.packed_size, 1, fp))
+      /* Decoded in place when the module is in memory. */
+      const uint8_t *data = r.span(p.packed_size);
+      if(!data)
       {
         format::warning("read error at pattern %zu : segment %u", i, p.pattern_segment);
         return modutil::READ_ERROR;
       }
 
-      const uint8_t *pos = m.buffer;
-      const uint8_t *end = m.buffer + p.packed_size;
+      const uint8_t *pos = data;
+      const uint8_t *end = data + p.packed_size;
       size_t row = 0;
       int row_sbx_count = 0;
+      bool check_query = modutil::query::enabled;
       while(pos < end && row < 64)
       {
         uint8_t flg = *(pos++);
@@ -551,7 +556,8 @@ public:
         }
 
         uint8_t chn = flg & 0x1f;
-        S3M_event *ev = &(p.events[row * MAX_CHANNELS + chn]);
+        S3M_event tmp;
+        S3M_event *ev = p.events ? &(p.events[row * MAX_CHANNELS + chn]) : &tmp;
         *ev = S3M_event(flg, pos, end);
 
         if(ev->effect == 19 && (ev->param & 0xf0) == 0xb0) // FIXME
@@ -566,6 +572,14 @@ public:
           format::warning("invalid pattern stream for %zu", i);
           break;
         }
+
+        if(check_query)
+          modutil::query::event(i, row, chn,
+           ((flg & 0x20) && ev->note != 255 ? Highlight::NOTE : 0) |
+           ((flg & 0x20) && ev->instrument ? Highlight::INSTRUMENT : 0) |
+           ((flg & 0x40) ? Highlight::VOLUME : 0) |
+           ((flg & 0x80) && ev->effect ? Highlight::EFFECT : 0),
+           ev->note, ev->instrument, ev->volume, ev->effect, ev->param);
       }
     }
 
@@ -23,10 +23,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 #include "modutil.hpp"
 
-static int total_stms = 0;
+static std::atomic<int> total_stms;
 
 
 enum STM_features
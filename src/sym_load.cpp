@@ -23,12 +23,14 @@
 #include "modutil.hpp"
 #include "Bitstream.hpp"
 #include "LZW.hpp"
+#include "SigmaDelta.hpp"
 
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include <atomic>
 
-static size_t num_syms = 0;
+static std::atomic<size_t> num_syms;
 
 
 enum SYM_features
@@ -333,79 +335,6 @@ struct SYM_data
   }
 };
 
-
-class SigmaDelta
-{
-public:
-  /**
-   * Based on the sigma delta sample decoder from OpenMPT by Saga Musix.
-   */
-  static modutil::error read(uint8_t *dest, size_t dest_len, FILE *fp)
-  {
-    size_t pos = 0;
-    size_t runlength = 0;
-    uint8_t bits = 8;
-
-    if(!dest_len)
-      return modutil::SUCCESS;
-
-    Bitstream bs(fp, dest_len);
-
-    size_t max_runlength = fgetc(fp); // Doesn't count towards alignment for some reason.
-    uint8_t accumulator = bs.read(8);
-    dest[pos++] = accumulator;
-
-    while(pos < dest_len)
-    {
-      int value = bs.read(bits);
-      if(value < 0)
-        return modutil::READ_ERROR;
-
-      // Expand bitwidth.
-      if(value == 0)
-      {
-        if(bits >= 9)
-          break; // ??
-
-        bits++;
-        runlength = 0;
-        continue;
-      }
-
-      if(value & 1)
-        accumulator -= (value >> 1);
-      else
-        accumulator += (value >> 1);
-
-      dest[pos++] = accumulator;
-
-      // High bit set -> reset run length.
-      if(value >> (bits - 1))
-      {
-        runlength = 0;
-      }
-      else
-
-      if(++runlength >= max_runlength)
-      {
-        if(bits > 1)
-          bits--;
-        runlength = 0;
-      }
-    }
-
-    /* Digital Symphony aligns packed stream lengths to 4 bytes. */
-    size_t total = bs.num_read;
-    while(total & 3)
-    {
-      fgetc(fp);
-      total++;
-    }
-
-    return modutil::SUCCESS;
-  }
-};
-
 static SYM_features get_effect_feature(const SYM_event &ev)
 {
   switch(ev.effect)
@@ -463,16 +392,17 @@ static void check_event_features(SYM_data &m, const SYM_event &ev)
 class SYM_loader: public modutil::loader
 {
 public:
-  SYM_loader(): modutil::loader("-", "sym", "Digital Symphony") {}
+  SYM_loader(): modutil::loader("-", "sym", "Digital Symphony",
+   {{ 0, MAGIC }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
-    FILE *fp = state.reader.unwrap(); /* FIXME: */
+    vio_reader<> vf(state.reader);
 
     SYM_data m{};
     SYM_header &h = m.header;
 
-    if(!fread(h.magic, sizeof(h.magic), 1, fp))
+    if(vf.read_buffer(h.magic) < sizeof(h.magic))
       return modutil::FORMAT_ERROR;
 
     if(memcmp(h.magic, MAGIC, sizeof(h.magic)))
@@ -480,11 +410,11 @@ public:
 
     num_syms++;
 
-    h.version      = fgetc(fp);
-    h.num_channels = fgetc(fp);
-    h.num_orders   = fget_u16le(fp);
-    h.num_tracks   = fget_u16le(fp);
-    h.text_length  = fget_u24le(fp);
+    h.version      = vf.u8();
+    h.num_channels = vf.u8();
+    h.num_orders   = vf.u16le();
+    h.num_tracks   = vf.u16le();
+    h.text_length  = vf.u24le();
 
     if(h.num_channels > MAX_CHANNELS)
     {
@@ -495,18 +425,18 @@ public:
     for(size_t i = 0; i < MAX_SAMPLES; i++)
     {
       SYM_instrument &ins = m.instruments[i];
-      ins.name_length = fgetc(fp);
+      ins.name_length = vf.u8();
       if(~ins.name_length & 0x80)
       {
-        ins.length = fget_u24le(fp) << 1;
+        ins.length = vf.u24le() << 1;
         m.num_samples++;
       }
     }
 
-    h.name_length = fgetc(fp);
+    h.name_length = vf.u8();
     if(h.name_length)
     {
-      if(!fread(h.name, h.name_length, 1, fp))
+      if(vf.read(h.name, h.name_length) < h.name_length)
         return modutil::READ_ERROR;
 
       memcpy(m.name, h.name, h.name_length);
@@ -514,7 +444,7 @@ public:
       strip_module_name(m.name, h.name_length + 1);
     }
 
-    if(!fread(h.effects_allowed, sizeof(h.effects_allowed), 1, fp))
+    if(vf.read_buffer(h.effects_allowed) < sizeof(h.effects_allowed))
       return modutil::READ_ERROR;
 
     /* Initialize data structures and temporary buffer. */
@@ -525,8 +455,8 @@ public:
      */
     if(h.num_orders)
     {
-      h.order_packing = fgetc(fp);
-      if(feof(fp) || h.order_packing > 1)
+      h.order_packing = vf.u8();
+      if(vf.eof() || h.order_packing > 1)
       {
         format::error("invalid order packing type %u", h.order_packing);
         return modutil::INVALID;
@@ -534,12 +464,12 @@ public:
 
       if(h.order_packing)
       {
-        if(LZW_read(m.buffer, m.total_sequence_size, m.total_sequence_size, LZW_FLAGS_SYM, fp) != 0)
+        if(LZW_read(m.buffer, m.total_sequence_size, m.total_sequence_size, LZW_FLAGS_SYM, vf) != 0)
           return modutil::BAD_PACKING;
       }
       else
       {
-        if(!fread(m.buffer, m.total_sequence_size, 1, fp))
+        if(vf.read(m.buffer, m.total_sequence_size) < m.total_sequence_size)
           return modutil::READ_ERROR;
       }
 
@@ -565,8 +495,8 @@ public:
       {
         size_t block_size = MIN(m.total_track_size - i, TRACK_BLOCK_SIZE);
 
-        h.track_packing = fgetc(fp);
-        if(feof(fp) || h.track_packing > 1)
+        h.track_packing = vf.u8();
+        if(vf.eof() || h.track_packing > 1)
         {
           format::error("invalid track packing type %u", h.track_packing);
           return modutil::INVALID;
@@ -574,12 +504,12 @@ public:
 
         if(h.track_packing)
         {
-          if(LZW_read(m.buffer + i, block_size, block_size, LZW_FLAGS_SYM, fp) != 0)
+          if(LZW_read(m.buffer + i, block_size, block_size, LZW_FLAGS_SYM, vf) != 0)
             return modutil::BAD_PACKING;
         }
         else
         {
-          if(!fread(m.buffer + i, block_size, 1, fp))
+          if(vf.read(m.buffer + i, block_size) < block_size)
             return modutil::READ_ERROR;
         }
       }
@@ -606,57 +536,58 @@ public:
     {
       SYM_instrument &ins = m.instruments[i];
 
-      if(ins.name_length & 0x3f)
-        if(!fread(ins.name, ins.name_length & 0x3f, 1, fp))
+      size_t name_length = ins.name_length & 0x3f;
+      if(name_length)
+        if(vf.read(ins.name, name_length) < name_length)
           return modutil::READ_ERROR;
 
       if(ins.name_length & 0x80)
         continue;
 
-      ins.loop_start  = fget_u24le(fp) << 1;
-      ins.loop_length = fget_u24le(fp) << 1;
-      ins.volume      = fgetc(fp);
-      ins.finetune    = fgetc(fp);
+      ins.loop_start  = vf.u24le() << 1;
+      ins.loop_length = vf.u24le() << 1;
+      ins.volume      = vf.u8();
+      ins.finetune    = vf.u8();
 
       if(ins.length == 0)
         continue;
 
-      ins.packing = fgetc(fp);
+      ins.packing = vf.u8();
       switch(ins.packing)
       {
         case SYM_instrument::UNCOMPRESSED_VIDC:
           m.uses[FT_SAMPLE_VIDC] = true;
-          if(fseek(fp, ins.length, SEEK_CUR))
+          if(vf.skip(ins.length))
             return modutil::SEEK_ERROR;
           break;
 
         case SYM_instrument::LZW_DELTA_LINEAR:
           m.uses[FT_SAMPLE_LZW] = true;
-          if(LZW_read(m.buffer, ins.length, ins.length, LZW_FLAGS_SYM, fp) != 0)
+          if(LZW_read(m.buffer, ins.length, ins.length, LZW_FLAGS_SYM, vf) != 0)
             return modutil::BAD_PACKING;
           break;
 
         case SYM_instrument::UNCOMPRESSED_LINEAR:
           m.uses[FT_SAMPLE_LINEAR] = true;
-          if(fseek(fp, ins.length, SEEK_CUR))
+          if(vf.skip(ins.length))
             return modutil::SEEK_ERROR;
           break;
 
         case SYM_instrument::UNCOMPRESSED_LINEAR_16:
           m.uses[FT_SAMPLE_LINEAR_16] = true;
-          if(fseek(fp, ins.length << 1, SEEK_CUR))
+          if(vf.skip(ins.length << 1))
             return modutil::SEEK_ERROR;
           break;
 
         case SYM_instrument::SIGMA_DELTA_LINEAR:
           m.uses[FT_SAMPLE_SIGMA_DELTA_LINEAR] = true;
-          if(SigmaDelta::read(m.buffer, ins.length, fp) != modutil::SUCCESS)
+          if(SigmaDelta::read(m.buffer, ins.length, vf) != modutil::SUCCESS)
             return modutil::BAD_PACKING;
           break;
 
         case SYM_instrument::SIGMA_DELTA_VIDC:
           m.uses[FT_SAMPLE_SIGMA_DELTA_VIDC] = true;
-          if(SigmaDelta::read(m.buffer, ins.length, fp) != modutil::SUCCESS)
+          if(SigmaDelta::read(m.buffer, ins.length, vf) != modutil::SUCCESS)
             return modutil::BAD_PACKING;
           break;
 
@@ -671,8 +602,8 @@ public:
      */
     if(h.text_length)
     {
-      h.text_packing = fgetc(fp);
-      if(feof(fp) || h.text_packing > 1)
+      h.text_packing = vf.u8();
+      if(vf.eof() || h.text_packing > 1)
       {
         format::error("invalid text packing %u", h.text_packing);
         return modutil::INVALID;
@@ -680,12 +611,12 @@ public:
 
       if(h.text_packing)
       {
-        if(LZW_read(m.text, h.text_length, h.text_length, LZW_FLAGS_SYM, fp) != 0)
+        if(LZW_read(m.text, h.text_length, h.text_length, LZW_FLAGS_SYM, vf) != 0)
           return modutil::BAD_PACKING;
       }
       else
       {
-        if(!fread(m.text, h.text_length, 1, fp))
+        if(vf.read(m.text, h.text_length) < h.text_length)
           return modutil::READ_ERROR;
       }
       m.text[h.text_length] = '\0';
@@ -758,8 +689,12 @@ public:
         uint16_t param;
         static constexpr int width() { return 6; }
         bool can_print() const { return effect > 0 || param > 0; }
-        void print() const { if(can_print()) fprintf(stderr, " %2x%03x", effect, param); else format::spaces(width()); }
-//        void print() const { if(can_print()) fprintf(stderr, HIGHLIGHT_FX("%2x%03x", effect, param), effect, param); else format::spaces(width()); }
+        char *render(char *dest) const
+        {
+          if(!can_print())
+            return format::render::blank(dest, width());
+          return dest + sprintf(dest, " %2x%03x", effect, param); // TODO highlight.
+        }
       };
 
       for(size_t i = 0; i < h.num_orders; i++)
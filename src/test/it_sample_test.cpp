@@ -0,0 +1,514 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Regression test for the IT 2.14/2.15 compressed sample decoder. Builds IT
+ * files with a separate encoder and checks the CRC-32s moddiag prints in
+ * its Smp.PCM table (-s=2) against reference values for the source PCM.
+ *
+ * Usage: it_sample_test path/to/moddiag
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../dimgutil/crc32.h"
+
+static int num_checks;
+static int num_failed;
+
+#define CHECK(cond, ...) do { \
+  num_checks++; \
+  if(!(cond)) \
+  { \
+    num_failed++; \
+    fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); \
+    fprintf(stderr, "\n"); \
+    return; \
+  } \
+} while(0)
+
+/* xorshift32, so the inputs are the same everywhere. */
+static uint32_t rng_state = 0x1badb002;
+
+static uint32_t rng()
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+struct test_sample
+{
+  const char *name;
+  unsigned bits;
+  bool it215;
+  bool stereo;
+  uint32_t length;
+  /* CRC-32 of the source PCM (signed little endian, left then right),
+   * computed separately with zlib. */
+  uint32_t reference_crc;
+};
+
+static const test_sample samples[] =
+{
+  { "8-bit IT214",         8, false, false, 100000, 0xf1c28ac6 },
+  { "8-bit IT215",         8, true,  false,  40000, 0x28c3454c },
+  { "16-bit IT214",       16, false, false,  50000, 0xa87e956d },
+  { "16-bit IT215",       16, true,  false,  20000, 0x4c12202a },
+  { "8-bit IT214 stereo",  8, false, true,   33000, 0x2c63fbc3 },
+  { "16-bit IT215 stereo",16, true,  true,   30000, 0xd4fe92d6 },
+};
+static constexpr size_t num_samples = sizeof(samples) / sizeof(samples[0]);
+
+/**
+ * Signal with silence, quiet noise, loud noise, and slow waves so that the
+ * encoder visits every bit width.
+ */
+static std::vector<int32_t> make_channel(unsigned bits, uint32_t length)
+{
+  std::vector<int32_t> out(length);
+  int32_t max = (1 << (bits - 1)) - 1;
+  int32_t prev = 0;
+
+  for(uint32_t i = 0; i < length; )
+  {
+    uint32_t run = 1 + rng() % 3000;
+    unsigned mode = rng() % 4;
+    int32_t range = 1 << (rng() % bits);
+
+    for(; run && i < length; run--, i++)
+    {
+      int32_t value;
+      switch(mode)
+      {
+        case 0:  value = prev; break;
+        case 1:  value = prev + (int32_t)(rng() % range) - range / 2; break;
+        case 2:  value = (int32_t)(rng() % (2u << (bits - 1))) - max - 1; break;
+        default: value = prev + ((i & 256) ? range / 64 : -(range / 64)); break;
+      }
+      if(value > max)
+        value = max;
+      if(value < -max - 1)
+        value = -max - 1;
+
+      out[i] = value;
+      prev = value;
+    }
+  }
+  return out;
+}
+
+/* LSB-first bit writer. */
+struct bit_writer
+{
+  std::vector<uint8_t> &out;
+  uint32_t buf = 0;
+  unsigned pos = 0;
+
+  bit_writer(std::vector<uint8_t> &o): out(o) {}
+
+  void write(uint32_t value, unsigned width)
+  {
+    for(unsigned i = 0; i < width; i++)
+    {
+      buf |= ((value >> i) & 1) << pos;
+      if(++pos == 8)
+      {
+        out.push_back(buf);
+        buf = 0;
+        pos = 0;
+      }
+    }
+  }
+
+  void flush()
+  {
+    if(pos)
+      out.push_back(buf);
+    buf = 0;
+    pos = 0;
+  }
+};
+
+/**
+ * Encoder for one IT 2.14/2.15 block, written from the format description
+ * rather than the decoder. Widths below 7 signal a change with the most
+ * negative code followed by the new width; widths 7 to bits use a range of
+ * codes around the sign boundary; width bits+1 uses its top bit.
+ */
+static void encode_block(std::vector<uint8_t> &out, const int32_t *in,
+ size_t count, unsigned bits, bool it215)
+{
+  const unsigned max_width = bits + 1;
+  const unsigned width_bits = (bits == 16) ? 4 : 3;
+  const uint32_t mask = (1u << bits) - 1;
+
+  std::vector<uint8_t> block;
+  bit_writer bw(block);
+  unsigned width = max_width;
+  int32_t prev = 0;
+  int32_t prev_delta = 0;
+
+  auto fits = [&](int32_t v, unsigned w) -> bool
+  {
+    int32_t half = 1 << (w - 1);
+    if(w < 7)
+      return v > -half && v < half;
+    if(w < max_width)
+      return v >= -half + (int32_t)bits / 2 && v < half - (int32_t)bits / 2;
+    return true;
+  };
+
+  auto change_width = [&](unsigned new_width)
+  {
+    if(width < 7)
+    {
+      bw.write(1u << (width - 1), width);
+      bw.write((new_width < width) ? new_width - 1 : new_width - 2, width_bits);
+    }
+    else
+
+    if(width < max_width)
+    {
+      unsigned v = (new_width < width) ? new_width : new_width - 1;
+      uint32_t lo = (1u << (width - 1)) - bits / 2;
+      bw.write(lo + v - 1, width);
+    }
+    else
+      bw.write((1u << bits) | (new_width - 1), width);
+
+    width = new_width;
+  };
+
+  for(size_t i = 0; i < count; i++)
+  {
+    /* Wrap the delta to a signed sample-sized value. */
+    int32_t delta = (in[i] - prev) & mask;
+    int32_t code = delta;
+    if(it215)
+      code = (delta - prev_delta) & mask;
+    prev = in[i];
+    prev_delta = delta;
+
+    if(code & (1 << (bits - 1)))
+      code -= 1 << bits;
+
+    unsigned needed = 1;
+    while(!fits(code, needed))
+      needed++;
+
+    /* Grow when needed, sometimes shrink, sometimes waste a width. */
+    if(needed > width || (needed < width && rng() % 4 == 0))
+    {
+      unsigned target = needed;
+      if(needed < max_width && rng() % 8 == 0)
+        target = needed + 1;
+      if(target != width)
+        change_width(target);
+    }
+    bw.write(code & ((width < max_width) ? (1u << width) - 1 : mask), width);
+  }
+  bw.flush();
+
+  if(block.size() > 0xffff)
+  {
+    fprintf(stderr, "block too large (%zu)\n", block.size());
+    exit(1);
+  }
+  out.push_back(block.size() & 0xff);
+  out.push_back(block.size() >> 8);
+  out.insert(out.end(), block.begin(), block.end());
+}
+
+struct built_sample
+{
+  std::vector<uint8_t> pcm;
+  std::vector<uint8_t> packed;
+};
+
+static built_sample build_sample(const test_sample &ts)
+{
+  built_sample bs;
+  size_t block_len = (ts.bits == 16) ? 0x4000 : 0x8000;
+  unsigned channels = ts.stereo ? 2 : 1;
+
+  for(unsigned ch = 0; ch < channels; ch++)
+  {
+    std::vector<int32_t> in = make_channel(ts.bits, ts.length);
+
+    for(int32_t v : in)
+    {
+      bs.pcm.push_back(v & 0xff);
+      if(ts.bits == 16)
+        bs.pcm.push_back((v >> 8) & 0xff);
+    }
+
+    for(size_t pos = 0; pos < in.size(); pos += block_len)
+    {
+      size_t count = in.size() - pos;
+      if(count > block_len)
+        count = block_len;
+      encode_block(bs.packed, in.data() + pos, count, ts.bits, ts.it215);
+    }
+  }
+  return bs;
+}
+
+/* Little endian IT writer, same layout as modgen. */
+class output
+{
+public:
+  std::vector<uint8_t> buf;
+
+  void u8(unsigned v) { buf.push_back(v); }
+  void u16le(unsigned v) { u8(v & 0xff); u8(v >> 8); }
+  void u32le(uint32_t v) { u16le(v & 0xffff); u16le(v >> 16); }
+  void zero(size_t count) { buf.resize(buf.size() + count, 0); }
+
+  void string(const char *str, size_t count)
+  {
+    size_t len = strlen(str);
+    for(size_t i = 0; i < count; i++)
+      u8(i < len ? str[i] : 0);
+  }
+
+  void patch_u32le(size_t at, uint32_t v)
+  {
+    for(int i = 0; i < 4; i++)
+      buf[at + i] = v >> (i * 8);
+  }
+};
+
+/**
+ * Sample mode IT with one order, no patterns, and the given samples.
+ * A sample with no data is given a data offset past the end of the file.
+ */
+static std::vector<uint8_t> build_it(const std::vector<const test_sample *> &list,
+ const std::vector<built_sample> &data)
+{
+  output out;
+  out.string("IMPM", 4);
+  out.string("it_sample_test", 26);
+  out.u16le(0x1004);
+  out.u16le(1);
+  out.u16le(0);
+  out.u16le(list.size());
+  out.u16le(0);
+  out.u16le(0x0215);
+  out.u16le(0x0215);
+  out.u16le(0x0001 | 0x0008); /* stereo, linear */
+  out.u16le(0);
+  out.u8(128);
+  out.u8(48);
+  out.u8(6);
+  out.u8(125);
+  out.u8(128);
+  out.u8(0);
+  out.u16le(0);
+  out.u32le(0);
+  out.u32le(0);
+  for(int i = 0; i < 64; i++)
+    out.u8(i < 4 ? 32 : 0xa0);
+  for(int i = 0; i < 64; i++)
+    out.u8(64);
+
+  out.u8(255);
+  size_t sample_ptrs = out.buf.size();
+  out.zero(list.size() * 4);
+  out.u16le(0);
+
+  std::vector<size_t> sample_pos;
+  for(size_t i = 0; i < list.size(); i++)
+  {
+    const test_sample &ts = *list[i];
+    out.patch_u32le(sample_ptrs + i * 4, out.buf.size());
+    sample_pos.push_back(out.buf.size());
+
+    out.string("IMPS", 4);
+    out.zero(13);
+    out.u8(64);
+    out.u8(0x01 | 0x08 | (ts.bits == 16 ? 0x02 : 0) | (ts.stereo ? 0x04 : 0));
+    out.u8(64);
+    out.string(ts.name, 26);
+    out.u8(0x01 | (ts.it215 ? 0x04 : 0));
+    out.u8(32);
+    out.u32le(ts.length);
+    out.u32le(0);
+    out.u32le(0);
+    out.u32le(8363);
+    out.u32le(0);
+    out.u32le(0);
+    out.u32le(0);
+    out.zero(4);
+  }
+
+  for(size_t i = 0; i < list.size(); i++)
+  {
+    if(data[i].packed.empty())
+      continue;
+    out.patch_u32le(sample_pos[i] + 72, out.buf.size());
+    out.buf.insert(out.buf.end(), data[i].packed.begin(), data[i].packed.end());
+  }
+  for(size_t i = 0; i < list.size(); i++)
+    if(data[i].packed.empty())
+      out.patch_u32le(sample_pos[i] + 72, out.buf.size() + 0x10000);
+
+  return out.buf;
+}
+
+/**
+ * Write an IT file, run moddiag -s=2 on it, and return the rows of its
+ * Smp.PCM table as "type crc" strings. has_table is false if no Smp.PCM
+ * table was printed at all.
+ */
+static std::vector<std::string> run_moddiag(const char *moddiag,
+ const std::vector<uint8_t> &file, bool &has_table)
+{
+  std::vector<std::string> rows;
+  has_table = false;
+
+  const char *tmpdir = getenv("TMPDIR");
+  std::string path = std::string(tmpdir ? tmpdir : "/tmp") + "/it_sample_test.XXXXXX";
+  int fd = mkstemp(&path[0]);
+  if(fd < 0)
+  {
+    perror("mkstemp");
+    exit(1);
+  }
+  if(write(fd, file.data(), file.size()) != (ssize_t)file.size())
+  {
+    perror("write");
+    exit(1);
+  }
+  close(fd);
+
+  std::string cmd = std::string(moddiag) + " -s=2 -o=- '" + path + "'";
+  FILE *fp = popen(cmd.c_str(), "r");
+  if(!fp)
+  {
+    perror("popen");
+    exit(1);
+  }
+
+  char line[1024];
+  bool in_table = false;
+  while(fgets(line, sizeof(line), fp))
+  {
+    if(strstr(line, "Smp.PCM"))
+    {
+      has_table = true;
+      in_table = true;
+      continue;
+    }
+    if(!in_table)
+      continue;
+
+    char type[16];
+    unsigned crc;
+    if(sscanf(line, " : %*u : %15s %x :", type, &crc) == 2)
+    {
+      char tmp[32];
+      snprintf(tmp, sizeof(tmp), "%s %08x", type, crc);
+      rows.push_back(tmp);
+    }
+    else
+
+    if(!strstr(line, "----"))
+      in_table = false;
+  }
+  pclose(fp);
+  unlink(path.c_str());
+  return rows;
+}
+
+static void test_reference_crcs(const char *moddiag)
+{
+  std::vector<const test_sample *> list;
+  std::vector<built_sample> data;
+
+  for(const test_sample &ts : samples)
+  {
+    list.push_back(&ts);
+    data.push_back(build_sample(ts));
+
+    const built_sample &bs = data.back();
+    uint32_t crc = dimgutil_crc32(0, bs.pcm.data(), bs.pcm.size());
+    CHECK(crc == ts.reference_crc, "%s: source PCM CRC %08" PRIx32 ", expected %08" PRIx32,
+     ts.name, crc, ts.reference_crc);
+  }
+
+  bool has_table;
+  std::vector<std::string> rows = run_moddiag(moddiag, build_it(list, data), has_table);
+  CHECK(has_table, "no Smp.PCM table");
+  CHECK(rows.size() == num_samples, "expected %zu Smp.PCM rows, got %zu", num_samples, rows.size());
+
+  for(size_t i = 0; i < num_samples; i++)
+  {
+    char expected[32];
+    snprintf(expected, sizeof(expected), "%s %08" PRIx32,
+     samples[i].it215 ? "IT215" : "IT214", samples[i].reference_crc);
+    CHECK(rows[i] == expected, "%s: got '%s', expected '%s'",
+     samples[i].name, rows[i].c_str(), expected);
+  }
+}
+
+static void test_no_scanned_samples(const char *moddiag)
+{
+  /* Compressed, but the sample data is past the end of the file. */
+  static const test_sample missing = { "missing", 8, false, false, 1000, 0 };
+  std::vector<const test_sample *> list{ &missing };
+  std::vector<built_sample> data(1);
+
+  bool has_table;
+  std::vector<std::string> rows = run_moddiag(moddiag, build_it(list, data), has_table);
+  CHECK(!has_table, "Smp.PCM table printed with no decoded samples");
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+  {
+    fprintf(stderr, "usage: %s path/to/moddiag\n", argv[0]);
+    return 1;
+  }
+
+  test_reference_crcs(argv[1]);
+  test_no_scanned_samples(argv[1]);
+
+  if(num_failed)
+  {
+    fprintf(stderr, "it_sample_test: %d of %d checks failed\n", num_failed, num_checks);
+    return 1;
+  }
+  printf("it_sample_test: %d checks passed\n", num_checks);
+  return 0;
+}
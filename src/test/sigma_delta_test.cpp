@@ -0,0 +1,328 @@
+/**
+ * Copyright (C) 2025 Lachesis <petrifiedrowan@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ * Round-trip test for the Digital Symphony sigma delta decoder against the
+ * dsymgen encoder, plus truncated and corrupted streams checked against a
+ * simple bit-at-a-time reference decoder.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "../SigmaDelta.hpp"
+#include "../vio.hpp"
+#include "../converters/sigma_delta.hpp"
+
+static int num_checks;
+static int num_failed;
+
+#define CHECK(cond, ...) do { \
+  num_checks++; \
+  if(!(cond)) \
+  { \
+    num_failed++; \
+    fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+    fprintf(stderr, __VA_ARGS__); \
+    fprintf(stderr, "\n"); \
+    return; \
+  } \
+} while(0)
+
+/* xorshift32, so the inputs are the same everywhere. */
+static uint32_t rng_state = 0x2545f491;
+
+static uint32_t rng()
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+/**
+ * Bit-at-a-time decoder following the original loader. Returns the same
+ * values as SigmaDelta::read.
+ */
+static ssize_t reference_read(uint8_t *dest, size_t dest_len,
+ const uint8_t *src, size_t src_len)
+{
+  size_t pos = 0;
+  size_t runlength = 0;
+  unsigned bits = 8;
+
+  if(!dest_len)
+    return 0;
+  if(!src_len)
+    return -1;
+
+  size_t max_runlength = src[0];
+  size_t bit_pos = 0;
+  size_t bit_len = (src_len - 1) * 8;
+  src++;
+
+  auto read = [&](unsigned n) -> int
+  {
+    if(bit_len - bit_pos < n)
+      return -1;
+
+    int value = 0;
+    for(unsigned i = 0; i < n; i++, bit_pos++)
+      value |= ((src[bit_pos >> 3] >> (bit_pos & 7)) & 1) << i;
+    return value;
+  };
+
+  int first = read(8);
+  if(first < 0)
+    return -1;
+
+  uint8_t accumulator = first;
+  dest[pos++] = accumulator;
+
+  while(pos < dest_len)
+  {
+    int value = read(bits);
+    if(value < 0)
+      return -1;
+
+    if(value == 0)
+    {
+      if(bits >= 9)
+        break;
+
+      bits++;
+      runlength = 0;
+      continue;
+    }
+
+    if(value & 1)
+      accumulator -= (value >> 1);
+    else
+      accumulator += (value >> 1);
+
+    dest[pos++] = accumulator;
+
+    if(value >> (bits - 1))
+    {
+      runlength = 0;
+    }
+    else
+
+    if(++runlength >= max_runlength)
+    {
+      if(bits > 1)
+        bits--;
+      runlength = 0;
+    }
+  }
+
+  size_t bytes_used = (bit_pos + 7) >> 3;
+  return 1 + ((bytes_used + 3) & ~(size_t)3);
+}
+
+/**
+ * Sample data with quiet, loud, and noisy stretches so every code width
+ * gets used. The encoder can't represent a delta of -128, so nudge those.
+ */
+static std::vector<uint8_t> make_sample(size_t len)
+{
+  std::vector<uint8_t> out(len);
+  uint8_t prev = rng();
+
+  for(size_t i = 0; i < len; )
+  {
+    size_t run = 1 + rng() % 600;
+    unsigned mode = rng() % 4;
+    unsigned range = 1u << (rng() % 9);
+
+    for(; run && i < len; run--, i++)
+    {
+      uint8_t value;
+      switch(mode)
+      {
+        case 0:  value = prev; break;
+        case 1:  value = prev + (int)(rng() % range) - (int)(range / 2); break;
+        case 2:  value = rng(); break;
+        default: value = prev + ((i & 64) ? 3 : -3); break;
+      }
+      if(i && static_cast<int8_t>(value - prev) == -128)
+        value++;
+
+      out[i] = value;
+      prev = value;
+    }
+  }
+  return out;
+}
+
+static void check_stream(const std::vector<uint8_t> &in,
+ const std::vector<uint8_t> &stream, unsigned max_runlength)
+{
+  std::vector<uint8_t> dest(in.size());
+  std::vector<uint8_t> ref(in.size());
+
+  ssize_t ret = SigmaDelta::read(dest.data(), dest.size(), stream.data(), stream.size());
+  ssize_t ref_ret = reference_read(ref.data(), ref.size(), stream.data(), stream.size());
+
+  /* dsymgen always writes a padding word, even when the last word is full. */
+  size_t len = stream.size();
+  CHECK(ret == (ssize_t)len || ret == (ssize_t)len - 4,
+   "length %zu, runlength %u: returned %zd for a %zu byte stream",
+   in.size(), max_runlength, ret, len);
+  CHECK(ret == ref_ret,
+   "length %zu, runlength %u: returned %zd, reference returned %zd",
+   in.size(), max_runlength, ret, ref_ret);
+  CHECK(dest == in,
+   "length %zu, runlength %u: decoded sample differs", in.size(), max_runlength);
+
+  /* The reader interface should leave the file right after the stream. */
+  std::vector<uint8_t> file(stream);
+  file.push_back(0xA5);
+
+  vio_buffer buf(file.data(), file.size());
+  vio_reader<> vf(buf);
+
+  std::fill(dest.begin(), dest.end(), 0);
+  modutil::error err = SigmaDelta::read(dest.data(), dest.size(), vf);
+  CHECK(err == modutil::SUCCESS,
+   "length %zu, runlength %u: vio read failed", in.size(), max_runlength);
+  CHECK(vf.tell() == ret,
+   "length %zu, runlength %u: vio ended at %" PRId64 ", expected %zd",
+   in.size(), max_runlength, vf.tell(), ret);
+  CHECK(dest == in,
+   "length %zu, runlength %u: vio decoded sample differs", in.size(), max_runlength);
+}
+
+/**
+ * Truncated and corrupted streams must never read past src_len and must
+ * agree with the reference decoder on both the result and the output.
+ */
+static void check_damaged(const std::vector<uint8_t> &stream, size_t dest_len)
+{
+  std::vector<uint8_t> dest(dest_len);
+  std::vector<uint8_t> ref(dest_len);
+
+  ssize_t ret = SigmaDelta::read(dest.data(), dest.size(), stream.data(), stream.size());
+  ssize_t ref_ret = reference_read(ref.data(), ref.size(), stream.data(), stream.size());
+
+  CHECK(ret == ref_ret, "damaged stream (%zu bytes): returned %zd, reference returned %zd",
+   stream.size(), ret, ref_ret);
+  if(ret >= 0)
+    CHECK(dest == ref, "damaged stream (%zu bytes): decoded sample differs", stream.size());
+}
+
+static void test_round_trip()
+{
+  static const size_t lengths[] = { 1, 2, 3, 31, 32, 33, 1000, 4096, 65536, 200001 };
+  static const unsigned runlengths[] = { 0, 1, 2, 3, 8, 31, 64, 255 };
+
+  for(size_t len : lengths)
+  {
+    std::vector<uint8_t> in = make_sample(len);
+
+    for(unsigned rl : runlengths)
+    {
+      std::vector<uint8_t> stream;
+      sigma_delta_compress(stream, in, rl);
+      check_stream(in, stream, rl);
+    }
+
+    /* Every run length dsymgen tries when searching for the smallest. */
+    if(len <= 4096)
+    {
+      for(unsigned rl = 1; rl < 255; rl++)
+      {
+        std::vector<uint8_t> stream;
+        sigma_delta_compress(stream, in, rl);
+        check_stream(in, stream, rl);
+      }
+    }
+  }
+}
+
+static void test_truncated()
+{
+  std::vector<uint8_t> in = make_sample(3000);
+
+  for(unsigned rl : { 1u, 5u, 40u })
+  {
+    std::vector<uint8_t> stream;
+    sigma_delta_compress(stream, in, rl);
+
+    for(size_t cut = 0; cut < stream.size(); cut++)
+    {
+      /* Exact-size copies so ASan catches reads past the end. */
+      std::vector<uint8_t> part(stream.begin(), stream.begin() + cut);
+      check_damaged(part, in.size());
+    }
+  }
+
+  /* Empty output never reads the input. */
+  uint8_t dummy;
+  CHECK(SigmaDelta::read(&dummy, 0, nullptr, 0) == 0, "empty output should return 0");
+}
+
+static void test_bit_flipped()
+{
+  std::vector<uint8_t> in = make_sample(1500);
+  std::vector<uint8_t> stream;
+  sigma_delta_compress(stream, in, 12);
+
+  /* Every single bit flip, including the runlength byte. */
+  for(size_t bit = 0; bit < stream.size() * 8; bit++)
+  {
+    std::vector<uint8_t> tmp(stream);
+    tmp[bit >> 3] ^= 1 << (bit & 7);
+    check_damaged(tmp, in.size());
+  }
+
+  /* Random garbage, including streams full of width changes. */
+  for(int i = 0; i < 2000; i++)
+  {
+    std::vector<uint8_t> tmp(1 + rng() % 256);
+    unsigned density = rng() % 4;
+    for(uint8_t &b : tmp)
+      b = density ? rng() & rng() & (density == 1 ? rng() : 0xff) : 0;
+    tmp[0] = rng();
+
+    check_damaged(tmp, 1 + rng() % 2048);
+  }
+}
+
+int main()
+{
+  test_round_trip();
+  test_truncated();
+  test_bit_flipped();
+
+  if(num_failed)
+  {
+    fprintf(stderr, "sigma_delta_test: %d of %d checks failed\n", num_failed, num_checks);
+    return 1;
+  }
+  printf("sigma_delta_test: %d checks passed\n", num_checks);
+  return 0;
+}
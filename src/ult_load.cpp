@@ -23,10 +23,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 
 #include "modutil.hpp"
 
-static int total_ults = 0;
+static std::atomic<int> total_ults;
 
 
 static constexpr char MAGIC[] = "MAS_UTrack_V00";
@@ -309,7 +310,8 @@ static void check_event(ULT_data &m, const ULT_event &e)
 class ULT_loader : modutil::loader
 {
 public:
-  ULT_loader(): modutil::loader("ULT", "ult", "Ultra Tracker") {}
+  ULT_loader(): modutil::loader("ULT", "ult", "Ultra Tracker",
+   {{ 0, MAGIC }}) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
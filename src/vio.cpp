@@ -22,8 +22,18 @@
 
 #include "vio.hpp"
 
+#include <new>
 #include <sys/stat.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef VIO_HAS_MMAP
+#include <sys/mman.h>
+#endif
+
 static bool is_read(const char *mode)
 {
   switch(mode[0])
@@ -37,6 +47,111 @@ static bool is_read(const char *mode)
   return false;
 }
 
+const uint8_t *vio::span(size_t num) noexcept
+{
+  if(num > span_buffer_size || !span_buffer)
+  {
+    uint8_t *tmp = new (std::nothrow) uint8_t[num ? num : 1];
+    if(!tmp)
+    {
+      err_value = 1;
+      return nullptr;
+    }
+    span_buffer.reset(tmp);
+    span_buffer_size = num;
+  }
+
+  if(read(span_buffer.get(), num) < num)
+    return nullptr;
+
+  return span_buffer.get();
+}
+
+const uint8_t *vio::peek(size_t num) noexcept
+{
+  int64_t pos = tell();
+  if(pos < 0)
+  {
+    err_value = 1;
+    return nullptr;
+  }
+
+  const uint8_t *ret = span(num);
+  if(seek(pos, SEEK_SET) < 0)
+    return nullptr;
+
+  return ret;
+}
+
+/* Shared by the streams stored in memory (vio_buffer, vio_mmap). */
+static const uint8_t *memory_span(const uint8_t *data, size_t &pos, size_t len,
+ size_t num, bool advance, int &eof_value) noexcept
+{
+  if(pos > len || num > len - pos)
+  {
+    if(advance)
+    {
+      if(pos < len)
+        pos = len;
+      eof_value = 1;
+    }
+    return nullptr;
+  }
+
+  const uint8_t *ret = data + pos;
+  if(advance)
+    pos += num;
+  return ret;
+}
+
+/* Returns the new absolute position, or -1 if it is invalid. */
+static int64_t memory_resolve_seek(int64_t offset, int whence, size_t pos, size_t len)
+{
+  switch(whence)
+  {
+    case SEEK_SET:
+      break;
+    case SEEK_CUR:
+      offset += static_cast<int64_t>(pos);
+      break;
+    case SEEK_END:
+      offset += static_cast<int64_t>(len);
+      break;
+    default:
+      return -1;
+  }
+#if SIZE_MAX < INT64_MAX
+  if(offset > SIZE_MAX)
+    return -1;
+#endif
+  return offset;
+}
+
+static char *memory_gets(const uint8_t *data, size_t &pos, size_t len,
+ char *dest, size_t num, int &eof_value) noexcept
+{
+  if(!num)
+    return nullptr;
+
+  if(pos >= len)
+  {
+    eof_value = 1;
+    return nullptr;
+  }
+
+  size_t left = len - pos;
+  size_t max = (num - 1 < left) ? num - 1 : left;
+  const uint8_t *end = reinterpret_cast<const uint8_t *>(memchr(data + pos, '\n', max));
+  size_t n = end ? (end - (data + pos)) + 1 : max;
+  if(!end && n == left)
+    eof_value = 1;
+
+  memcpy(dest, data + pos, n);
+  dest[n] = '\0';
+  pos += n;
+  return dest;
+}
+
 vio_file::vio_file(const char *filename, const char *mode)
 {
   f = fopen(filename, mode);
@@ -51,6 +166,12 @@ vio_file::vio_file(const char *filename, const char *mode)
   }
 }
 
+vio_file::vio_file(FILE *fp): f(fp)
+{
+  setvbuf(f, NULL, _IOFBF, 8192);
+  saved_length = -1;
+}
+
 vio_file::~vio_file() noexcept
 {
   fclose(f);
@@ -157,13 +278,19 @@ vio_buffer::vio_buffer(const void *src, size_t src_len) noexcept
 
 size_t vio_buffer::read(void *dest, size_t num) noexcept
 {
+  if(pos >= len)
+  {
+    eof_value = 1;
+    return 0;
+  }
   if(num > len - pos)
   {
     num = len - pos;
     eof_value = 1;
   }
 
-  memcpy(dest, src_buffer, num);
+  memcpy(dest, src_buffer + pos, num);
+  pos += num;
   return num;
 }
 
@@ -174,51 +301,42 @@ size_t vio_buffer::write(const void *src, size_t num) noexcept
     err_value = 1;
     return 0;
   }
+  if(pos >= len)
+  {
+    eof_value = 1;
+    return 0;
+  }
   if(num > len - pos)
   {
     num = len - pos;
     eof_value = 1;
   }
 
-  memcpy(dest_buffer, src, num);
+  memcpy(dest_buffer + pos, src, num);
+  pos += num;
   return num;
 }
 
 char *vio_buffer::gets(char *dest, size_t num) noexcept
 {
-  // FIXME:
-  err_value = 1;
-  return NULL;
+  return memory_gets(src_buffer, pos, len, dest, num, eof_value);
 }
 
 int vio_buffer::seek(int64_t offset, int whence) noexcept
 {
-  switch(whence)
-  {
-    case SEEK_SET:
-      break;
-    case SEEK_CUR:
-      offset += static_cast<int64_t>(pos);
-      break;
-    case SEEK_END:
-      offset = static_cast<int64_t>(len) - offset;
-      break;
-  }
-#if SIZE_MAX < INT64_MAX
-  if(offset > SIZE_MAX)
-    offset = -1;
-#endif
+  offset = memory_resolve_seek(offset, whence, pos, len);
   if(offset < 0)
   {
-    eof_value = 1;
+    err_value = 1;
     return -1;
   }
-  if(static_cast<size_t>(offset) > len)
-    offset = len;
 
+  /* Like fseek, seeking past the end is allowed; reads will just fail. */
   pos = static_cast<size_t>(offset);
   eof_value = 0;
   err_value = 0;
+
+  memfp.follow(pos);
   return 0;
 }
 
@@ -231,3 +349,361 @@ int64_t vio_buffer::length() noexcept
 {
   return static_cast<int64_t>(len);
 }
+
+const uint8_t *vio_buffer::peek(size_t num) noexcept
+{
+  return memory_span(src_buffer, pos, len, num, false, eof_value);
+}
+
+const uint8_t *vio_buffer::span(size_t num) noexcept
+{
+  return memory_span(src_buffer, pos, len, num, true, eof_value);
+}
+
+
+#ifdef VIO_HAS_MMAP
+vio_mmap::vio_mmap(const char *filename, bool copy_on_write)
+{
+  int fd = open(filename, O_RDONLY);
+  if(fd < 0)
+    throw "failed to open file";
+
+  try
+  {
+    map(fd, copy_on_write);
+  }
+  catch(const char *)
+  {
+    close(fd);
+    throw;
+  }
+  close(fd);
+}
+
+vio_mmap::vio_mmap(int fd, bool copy_on_write)
+{
+  map(fd, copy_on_write);
+}
+
+void vio_mmap::map(int fd, bool copy_on_write)
+{
+  struct stat st;
+  if(fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+   static_cast<uint64_t>(st.st_size) > SIZE_MAX)
+    throw "file can not be mapped";
+
+  int prot = PROT_READ | (copy_on_write ? PROT_WRITE : 0);
+  void *ptr = mmap(nullptr, st.st_size, prot, MAP_PRIVATE, fd, 0);
+  if(ptr == MAP_FAILED)
+    throw "failed to map file";
+
+  data = reinterpret_cast<uint8_t *>(ptr);
+  pos = 0;
+  len = st.st_size;
+}
+
+vio_mmap::~vio_mmap() noexcept
+{
+  munmap(data, len);
+}
+
+size_t vio_mmap::read(void *dest, size_t num) noexcept
+{
+  if(pos >= len)
+  {
+    eof_value = 1;
+    return 0;
+  }
+  if(num > len - pos)
+  {
+    num = len - pos;
+    eof_value = 1;
+  }
+
+  memcpy(dest, data + pos, num);
+  pos += num;
+  return num;
+}
+
+size_t vio_mmap::write(const void *src, size_t num) noexcept
+{
+  err_value = 1;
+  return 0;
+}
+
+char *vio_mmap::gets(char *dest, size_t num) noexcept
+{
+  return memory_gets(data, pos, len, dest, num, eof_value);
+}
+
+int vio_mmap::seek(int64_t offset, int whence) noexcept
+{
+  offset = memory_resolve_seek(offset, whence, pos, len);
+  if(offset < 0)
+  {
+    err_value = 1;
+    return -1;
+  }
+
+  /* Like fseek, seeking past the end is allowed; reads will just fail. */
+  pos = static_cast<size_t>(offset);
+  eof_value = 0;
+  err_value = 0;
+
+  memfp.follow(pos);
+  return 0;
+}
+
+int64_t vio_mmap::tell() noexcept
+{
+  return static_cast<int64_t>(pos);
+}
+
+int64_t vio_mmap::length() noexcept
+{
+  return static_cast<int64_t>(len);
+}
+
+const uint8_t *vio_mmap::peek(size_t num) noexcept
+{
+  return memory_span(data, pos, len, num, false, eof_value);
+}
+
+const uint8_t *vio_mmap::span(size_t num) noexcept
+{
+  return memory_span(data, pos, len, num, true, eof_value);
+}
+#endif /* VIO_HAS_MMAP */
+
+#ifdef VIO_HAS_MEMFP
+struct vio_memfp_cookie
+{
+  static ssize_t read(void *priv, char *dest, size_t num)
+  {
+    vio_memfp *m = reinterpret_cast<vio_memfp *>(priv);
+    if(m->pos >= m->len)
+      return 0;
+
+    if(num > m->len - m->pos)
+      num = m->len - m->pos;
+
+    memcpy(dest, m->data + m->pos, num);
+    m->pos += num;
+    return num;
+  }
+
+  static int seek(void *priv, off64_t *offset, int whence)
+  {
+    vio_memfp *m = reinterpret_cast<vio_memfp *>(priv);
+    int64_t pos = memory_resolve_seek(*offset, whence, m->pos, m->len);
+    if(pos < 0)
+      return -1;
+
+    m->pos = pos;
+    *offset = pos;
+    return 0;
+  }
+};
+
+vio_memfp::~vio_memfp() noexcept
+{
+  if(fp)
+    fclose(fp);
+}
+
+FILE *vio_memfp::open(const uint8_t *d, size_t l, size_t start) noexcept
+{
+  if(!fp)
+  {
+    cookie_io_functions_t fns{};
+    fns.read = vio_memfp_cookie::read;
+    fns.seek = vio_memfp_cookie::seek;
+    data = d;
+    len = l;
+    pos = 0;
+    fp = fopencookie(this, "rb", fns);
+    if(fp)
+      fseeko(fp, start, SEEK_SET);
+  }
+  return fp;
+}
+
+void vio_memfp::follow(size_t offset) noexcept
+{
+  if(fp)
+    fseeko(fp, offset, SEEK_SET);
+}
+#else
+vio_memfp::~vio_memfp() noexcept {}
+
+FILE *vio_memfp::open(const uint8_t *d, size_t l, size_t start) noexcept
+{
+  return nullptr;
+}
+
+void vio_memfp::follow(size_t offset) noexcept {}
+#endif /* VIO_HAS_MEMFP */
+
+vio_profile::~vio_profile() noexcept
+{
+  if(memfp)
+    fclose(memfp);
+}
+
+void vio_profile::sync() noexcept
+{
+  eof_value = inner.eof();
+  err_value |= inner.error();
+}
+
+size_t vio_profile::read(void *dest, size_t num) noexcept
+{
+  size_t ret = inner.read(dest, num);
+  stats.reads++;
+  stats.bytes += ret;
+  sync();
+  return ret;
+}
+
+size_t vio_profile::write(const void *src, size_t num) noexcept
+{
+  size_t ret = inner.write(src, num);
+  sync();
+  return ret;
+}
+
+char *vio_profile::gets(char *dest, size_t num) noexcept
+{
+  char *ret = inner.gets(dest, num);
+  stats.reads++;
+  if(ret)
+    stats.bytes += strlen(ret);
+  sync();
+  return ret;
+}
+
+int vio_profile::seek(int64_t offset, int whence) noexcept
+{
+  int ret = inner.seek(offset, whence);
+  stats.seeks++;
+  sync();
+  /* The stream is unbuffered, so its position is always the position of
+   * inner; only a stale EOF flag needs to be cleared. */
+  if(memfp)
+    clearerr(memfp);
+  return ret;
+}
+
+int64_t vio_profile::tell() noexcept
+{
+  return inner.tell();
+}
+
+int64_t vio_profile::length() noexcept
+{
+  return inner.length();
+}
+
+const uint8_t *vio_profile::peek(size_t num) noexcept
+{
+  const uint8_t *ret = inner.peek(num);
+  stats.reads++;
+  sync();
+  return ret;
+}
+
+const uint8_t *vio_profile::span(size_t num) noexcept
+{
+  const uint8_t *ret = inner.span(num);
+  stats.reads++;
+  if(ret)
+    stats.bytes += num;
+  sync();
+  return ret;
+}
+
+#ifdef VIO_HAS_MMAP
+struct vio_profile_cookie
+{
+  static ssize_t read(void *priv, char *dest, size_t num)
+  {
+    vio_profile *vf = reinterpret_cast<vio_profile *>(priv);
+    size_t ret = vf->inner.read(dest, num);
+    vf->stats.reads++;
+    vf->stats.bytes += ret;
+    return vf->inner.error() ? -1 : (ssize_t)ret;
+  }
+
+  static int seek(void *priv, off64_t *offset, int whence)
+  {
+    vio_profile *vf = reinterpret_cast<vio_profile *>(priv);
+    /* ftell() is implemented as a seek; don't count it. */
+    if(*offset != 0 || whence != SEEK_CUR)
+    {
+      vf->stats.seeks++;
+      if(vf->inner.seek(*offset, whence) < 0)
+        return -1;
+    }
+    *offset = vf->inner.tell();
+    return 0;
+  }
+};
+
+FILE *vio_profile::unwrap() noexcept
+{
+  if(!memfp)
+  {
+    cookie_io_functions_t fns{};
+    fns.read = vio_profile_cookie::read;
+    fns.seek = vio_profile_cookie::seek;
+    memfp = fopencookie(this, "rb", fns);
+    if(memfp)
+      setvbuf(memfp, nullptr, _IONBF, 0);
+  }
+  return memfp;
+}
+#else
+FILE *vio_profile::unwrap() noexcept
+{
+  return inner.unwrap();
+}
+#endif
+
+#ifndef _WIN32
+std::unique_ptr<vio> vio_open_read(int dirfd, const char *filename, bool copy_on_write)
+{
+  int fd = openat(dirfd, filename, O_RDONLY);
+  if(fd < 0)
+    throw "failed to open file";
+
+#ifdef VIO_HAS_MMAP
+  try
+  {
+    std::unique_ptr<vio> vf(new vio_mmap(fd, copy_on_write));
+    close(fd);
+    return vf;
+  }
+  catch(const char *)
+  {
+    /* Not a regular file, empty, or couldn't be mapped; use stdio. */
+  }
+#endif
+
+  FILE *fp = fdopen(fd, "rb");
+  if(!fp)
+  {
+    close(fd);
+    throw "failed to open file";
+  }
+  return std::unique_ptr<vio>(new vio_file(fp));
+}
+#endif
+
+std::unique_ptr<vio> vio_open_read(const char *filename, bool copy_on_write)
+{
+#ifndef _WIN32
+  return vio_open_read(AT_FDCWD, filename, copy_on_write);
+#else
+  return std::unique_ptr<vio>(new vio_file(filename, "rb"));
+#endif
+}
@@ -26,15 +26,54 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <memory>
 #include <type_traits>
 
+#include "common.hpp"
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+#define VIO_HAS_MMAP
+/* fopencookie is available everywhere mmap is used. */
+#define VIO_HAS_MEMFP
+#endif
+
+/**
+ * stdio stream over a memory buffer, for loaders that haven't been ported
+ * to vio yet. It has its own position and buffer; follow() moves it to
+ * match seeks made through vio, e.g. to rewind between loaders. fmemopen
+ * isn't used since it doesn't allow seeking past the end of the buffer.
+ * Without fopencookie, open() always returns nullptr.
+ */
+class vio_memfp
+{
+  const uint8_t *data = nullptr;
+  size_t len = 0;
+  size_t pos = 0;
+  FILE *fp = nullptr;
+
+  friend struct vio_memfp_cookie;
+
+public:
+  ~vio_memfp() noexcept;
+
+  FILE *open(const uint8_t *d, size_t l, size_t start) noexcept;
+  void follow(size_t offset) noexcept;
+};
+
 class vio
 {
 protected:
   int eof_value = 0;
   int err_value = 0;
 
+private:
+  /* Backing storage for peek() and span() on streams not in memory. */
+  std::unique_ptr<uint8_t[]> span_buffer;
+  size_t span_buffer_size = 0;
+
 public:
+  virtual ~vio() = default;
+
   virtual size_t read(void *dest, size_t num) noexcept = 0;
   virtual size_t write(const void *src, size_t num) noexcept = 0;
   virtual char *gets(char *dest, size_t num) noexcept = 0;
@@ -45,6 +84,28 @@ public:
   /* FIXME: remove! */
   virtual FILE *unwrap() noexcept { return nullptr; }
 
+  /**
+   * Get a pointer to the entire contents of the stream if it is already
+   * stored in memory, otherwise nullptr.
+   */
+  virtual uint8_t *contents() noexcept { return nullptr; }
+
+  /**
+   * Get a bounds-checked pointer to the next num bytes of the stream without
+   * advancing the position, or nullptr if fewer than num bytes remain.
+   * Streams stored in memory return a pointer into the stream itself;
+   * otherwise the bytes are read into an internal buffer that remains valid
+   * until the next peek() or span().
+   */
+  virtual const uint8_t *peek(size_t num) noexcept;
+
+  /**
+   * Like peek(), but advances the position past the returned bytes.
+   * If fewer than num bytes remain, the position is moved to the end of the
+   * stream, EOF is set, and nullptr is returned, like a short read().
+   */
+  virtual const uint8_t *span(size_t num) noexcept;
+
   inline int eof() const noexcept
   {
     return eof_value;
@@ -284,6 +345,8 @@ class vio_file : public vio
 
 public:
   vio_file(const char *filename, const char *mode);
+  /* Takes ownership of an already opened read-only stream. */
+  explicit vio_file(FILE *fp);
   ~vio_file() noexcept;
 
   size_t read(void *dest, size_t num) noexcept override;
@@ -303,6 +366,7 @@ class vio_buffer : public vio
   uint8_t *dest_buffer;
   size_t pos;
   size_t len;
+  vio_memfp memfp;
 
 public:
   vio_buffer(void *d, size_t d_len) noexcept;
@@ -315,6 +379,446 @@ public:
   int seek(int64_t offset, int whence) noexcept override;
   int64_t tell() noexcept override;
   int64_t length() noexcept override;
+
+  const uint8_t *peek(size_t num) noexcept override;
+  const uint8_t *span(size_t num) noexcept override;
+
+  /* FIXME: remove! */
+  FILE *unwrap() noexcept override { return memfp.open(src_buffer, len, pos); }
+
+  /* Only available if the buffer is writable. */
+  uint8_t *contents() noexcept override { return dest_buffer; }
+};
+
+#ifdef VIO_HAS_MMAP
+/**
+ * Read-only memory mapped file. Reads, seeks, and length are all served
+ * directly from the mapping. If copy_on_write is set, the mapping may be
+ * written to through contents() without modifying the file.
+ */
+class vio_mmap : public vio
+{
+  uint8_t *data;
+  size_t pos;
+  size_t len;
+  vio_memfp memfp;
+
+  void map(int fd, bool copy_on_write);
+
+public:
+  vio_mmap(const char *filename, bool copy_on_write = false);
+  /* Maps an open file. fd can be closed once this returns. */
+  vio_mmap(int fd, bool copy_on_write = false);
+  ~vio_mmap() noexcept;
+
+  size_t read(void *dest, size_t num) noexcept override;
+  size_t write(const void *src, size_t num) noexcept override;
+  char *gets(char *dest, size_t num) noexcept override;
+  int seek(int64_t offset, int whence) noexcept override;
+  int64_t tell() noexcept override;
+  int64_t length() noexcept override;
+
+  const uint8_t *peek(size_t num) noexcept override;
+  const uint8_t *span(size_t num) noexcept override;
+
+  /* FIXME: remove! */
+  FILE *unwrap() noexcept override { return memfp.open(data, len, pos); }
+
+  uint8_t *contents() noexcept override { return data; }
+};
+#endif
+
+/**
+ * Passes every call through to another vio and counts reads and seeks.
+ * On platforms with vio_mmap, unwrap() returns an unbuffered stream over the
+ * counted calls, so each fread/fgetc from an unported loader is counted too.
+ * Otherwise only calls made through vio are counted.
+ */
+class vio_profile : public vio
+{
+  vio &inner;
+  FILE *memfp;
+
+  void sync() noexcept;
+  friend struct vio_profile_cookie;
+
+public:
+  struct counters
+  {
+    uint64_t reads = 0;
+    uint64_t bytes = 0;
+    uint64_t seeks = 0;
+  };
+  counters stats;
+
+  vio_profile(vio &v) noexcept: inner(v), memfp(nullptr) {}
+  ~vio_profile() noexcept;
+
+  size_t read(void *dest, size_t num) noexcept override;
+  size_t write(const void *src, size_t num) noexcept override;
+  char *gets(char *dest, size_t num) noexcept override;
+  int seek(int64_t offset, int whence) noexcept override;
+  int64_t tell() noexcept override;
+  int64_t length() noexcept override;
+
+  const uint8_t *peek(size_t num) noexcept override;
+  const uint8_t *span(size_t num) noexcept override;
+
+  /* FIXME: remove! */
+  FILE *unwrap() noexcept override;
+
+  /* Never expose the inner stream's memory, so every access by vio_reader
+   * and span-based loaders goes through the counted functions above. */
+  uint8_t *contents() noexcept override { return nullptr; }
 };
 
+/**
+ * Non-virtual buffered reader for loaders. Streams stored in memory are
+ * read in place; other streams are read through an inline buffer that is
+ * refilled from the vio, so the integer accessors below are plain loads
+ * from memory except when the buffer runs out.
+ *
+ * EOF and error are sticky: a read past the end sets eof() and the value
+ * returned is the same as the equivalent fget_* function in common.hpp
+ * would return, so loaders can check once after reading a structure.
+ * Like fseek, seek() clears eof(). The vio is moved to the position of the
+ * reader when the reader is destroyed.
+ */
+template<class Backend = vio>
+class vio_reader
+{
+  static constexpr size_t BUFFER_SIZE = 4096;
+
+  Backend &vf;
+  const uint8_t *window;
+  const uint8_t *cur;
+  const uint8_t *end;
+  int64_t window_offset;
+  int64_t overshoot;
+  int64_t len;
+  bool in_memory;
+  bool eof_value = false;
+  bool err_value = false;
+  uint8_t buffer[BUFFER_SIZE];
+
+  /* Try to make at least num bytes available. */
+  bool refill(size_t num) noexcept
+  {
+    if(!in_memory && num <= BUFFER_SIZE)
+    {
+      size_t left = (end > cur) ? end - cur : 0;
+      if(left && cur != buffer)
+        memmove(buffer, cur, left);
+
+      window_offset += cur - window;
+      window = buffer;
+      cur = buffer;
+
+      size_t n = vf.read(buffer + left, BUFFER_SIZE - left);
+      end = buffer + left + n;
+      if(vf.error())
+        err_value = true;
+    }
+    if(static_cast<size_t>(end - cur) >= num)
+      return true;
+
+    eof_value = true;
+    return false;
+  }
+
+  /* Short reads: fill missing bytes with 0xFF like fget_* (which OR EOF
+   * into the value). Big endian values end up entirely 0xFF. */
+  template<size_t N>
+  const uint8_t *slow(uint8_t (&tmp)[N], bool big_endian) noexcept
+  {
+    if(refill(N))
+    {
+      const uint8_t *ret = cur;
+      cur += N;
+      return ret;
+    }
+    size_t left = end - cur;
+    memset(tmp, 0xff, N);
+    if(!big_endian)
+      memcpy(tmp, cur, left);
+    cur = end;
+    return tmp;
+  }
+
+#define VIO_READER_FN(type, name, N, is_be, mem) \
+  inline type name() noexcept \
+  { \
+    if(static_cast<size_t>(end - cur) >= N) \
+    { \
+      type v = mem(cur); \
+      cur += N; \
+      return v; \
+    } \
+    uint8_t tmp[N]; \
+    return mem(slow(tmp, is_be)); \
+  }
+
+public:
+  vio_reader(Backend &v) noexcept: vf(v)
+  {
+    const uint8_t *data = vf.contents();
+    int64_t pos = vf.tell();
+    len = vf.length();
+    if(pos < 0)
+      pos = 0;
+
+    overshoot = 0;
+    if(data && len >= 0)
+    {
+      in_memory = true;
+      window = data;
+      end = data + len;
+      cur = data;
+      window_offset = 0;
+      seek(pos, SEEK_SET);
+    }
+    else
+    {
+      in_memory = false;
+      window = cur = end = buffer;
+      window_offset = pos;
+    }
+  }
+
+  ~vio_reader() noexcept
+  {
+    vf.seek(tell(), SEEK_SET);
+  }
+
+  vio_reader(const vio_reader &) = delete;
+  vio_reader &operator=(const vio_reader &) = delete;
+
+  inline bool eof() const noexcept
+  {
+    return eof_value;
+  }
+
+  inline bool error() const noexcept
+  {
+    return err_value;
+  }
+
+  /* Neither EOF nor an error has occurred. */
+  inline bool ok() const noexcept
+  {
+    return !eof_value && !err_value;
+  }
+
+  inline int64_t tell() const noexcept
+  {
+    return window_offset + (cur - window) + overshoot;
+  }
+
+  inline int64_t length() const noexcept
+  {
+    return len;
+  }
+
+  int seek(int64_t offset, int whence) noexcept
+  {
+    switch(whence)
+    {
+      case SEEK_SET:
+        break;
+      case SEEK_CUR:
+        offset += tell();
+        break;
+      case SEEK_END:
+        if(len < 0)
+          return -1;
+        offset += len;
+        break;
+      default:
+        return -1;
+    }
+    if(offset < 0)
+      return -1;
+
+    eof_value = false;
+    overshoot = 0;
+    if(offset >= window_offset && offset <= window_offset + (end - window))
+    {
+      cur = window + (offset - window_offset);
+      return 0;
+    }
+
+    if(in_memory)
+    {
+      /* Like fseek, seeking past the end is allowed; reads will fail. */
+      cur = end;
+      overshoot = offset - len;
+      return 0;
+    }
+
+    window = cur = end = buffer;
+    window_offset = offset;
+    if(vf.seek(offset, SEEK_SET) < 0)
+    {
+      err_value = vf.error() != 0;
+      return -1;
+    }
+    return 0;
+  }
+
+  inline int skip(int64_t count) noexcept
+  {
+    return seek(count, SEEK_CUR);
+  }
+
+  size_t read(void *_dest, size_t num) noexcept
+  {
+    uint8_t *dest = reinterpret_cast<uint8_t *>(_dest);
+    size_t left = end - cur;
+    if(num <= left)
+    {
+      memcpy(dest, cur, num);
+      cur += num;
+      return num;
+    }
+
+    memcpy(dest, cur, left);
+    cur += left;
+    if(in_memory)
+    {
+      eof_value = true;
+      return left;
+    }
+
+    /* Large reads go directly to the vio. */
+    size_t total = left;
+    if(num - total >= BUFFER_SIZE)
+    {
+      window_offset += cur - window;
+      window = cur = end = buffer;
+
+      size_t n = vf.read(dest + total, num - total);
+      window_offset += n;
+      total += n;
+      if(vf.error())
+        err_value = true;
+      if(total < num)
+        eof_value = true;
+      return total;
+    }
+
+    if(!refill(num - total))
+    {
+      size_t n = end - cur;
+      memcpy(dest + total, cur, n);
+      cur += n;
+      return total + n;
+    }
+    memcpy(dest + total, cur, num - total);
+    cur += num - total;
+    return num;
+  }
+
+  template<typename T, size_t N,
+    typename E = typename std::enable_if<sizeof(T) == 1>::type>
+  size_t read_buffer(T (&dest)[N]) noexcept
+  {
+    return read(dest, N);
+  }
+
+  /**
+   * Get a pointer to the next num bytes and advance past them, or nullptr
+   * (and EOF) if fewer than num bytes remain. The pointer is into the
+   * stream itself when it is stored in memory, otherwise it is into the
+   * vio's span buffer and is valid until the next span.
+   */
+  const uint8_t *span(size_t num) noexcept
+  {
+    if(static_cast<size_t>(end - cur) >= num || (num <= BUFFER_SIZE && refill(num)))
+    {
+      const uint8_t *ret = cur;
+      cur += num;
+      return ret;
+    }
+    if(in_memory || eof_value)
+    {
+      cur = end;
+      eof_value = true;
+      return nullptr;
+    }
+
+    /* Too large for the buffer; defer to the vio. */
+    int64_t pos = tell();
+    window = cur = end = buffer;
+    window_offset = pos;
+    const uint8_t *ret = nullptr;
+    if(vf.seek(pos, SEEK_SET) == 0)
+      ret = vf.span(num);
+
+    window_offset = vf.tell();
+    if(!ret)
+      eof_value = true;
+    if(vf.error())
+      err_value = true;
+    return ret;
+  }
+
+  /**
+   * Get a pointer to the bytes at the current position that can be read
+   * without reading from the vio, refilling the buffer first if it's empty.
+   * This doesn't advance the position; use skip() to move past the bytes
+   * used. Returns the number of bytes available (0 at the end of the stream).
+   */
+  size_t buffered(const uint8_t *&data) noexcept
+  {
+    if(cur >= end && !refill(1))
+      return 0;
+
+    data = cur;
+    return end - cur;
+  }
+
+  /* Like fgetc: the next byte, or -1 at the end of the stream. */
+  inline int byte() noexcept
+  {
+    if(cur < end || refill(1))
+      return *(cur++);
+    return -1;
+  }
+
+  inline uint8_t u8() noexcept
+  {
+    return byte();
+  }
+
+  inline int8_t s8() noexcept
+  {
+    return byte();
+  }
+
+  VIO_READER_FN(uint16_t, u16le, 2, false, mem_u16le)
+  VIO_READER_FN(uint16_t, u16be, 2, true,  mem_u16be)
+  VIO_READER_FN(int16_t,  s16le, 2, false, mem_s16le)
+  VIO_READER_FN(int16_t,  s16be, 2, true,  mem_s16be)
+  VIO_READER_FN(uint32_t, u24le, 3, false, mem_u24le)
+  VIO_READER_FN(uint32_t, u24be, 3, true,  mem_u24be)
+  VIO_READER_FN(uint32_t, u32le, 4, false, mem_u32le)
+  VIO_READER_FN(uint32_t, u32be, 4, true,  mem_u32be)
+#undef VIO_READER_FN
+};
+
+/**
+ * Open a file for reading. Regular files are memory mapped when possible;
+ * pipes, devices, and empty files fall back to vio_file.
+ * Throws on failure, like the vio constructors.
+ */
+std::unique_ptr<vio> vio_open_read(const char *filename, bool copy_on_write = false);
+
+#ifndef _WIN32
+/**
+ * Like vio_open_read, but filename is relative to the directory dirfd
+ * (or AT_FDCWD) and the file is only opened once.
+ */
+std::unique_ptr<vio> vio_open_read(int dirfd, const char *filename, bool copy_on_write = false);
+#endif
+
 #endif /* MODDIAG_VIO_HPP */
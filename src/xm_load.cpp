@@ -24,12 +24,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 #include <memory>
 #include <vector>
 
 #include "modutil.hpp"
+#include "query.hpp"
 
-static int num_xms;
+static std::atomic<int> num_xms;
 
 
 enum XM_features
@@ -219,37 +221,55 @@ struct XM_event
   uint8_t param = 0;
 
   XM_event() {}
-  XM_event(uint8_t *&stream, uint8_t *end) noexcept
+  XM_event(const uint8_t *data, size_t &pos, size_t size) noexcept
   {
-    /* Pattern buffer has extra end data allocated to allow skipping checks here. */
-    uint8_t flags = *(stream++);
+    /* Events are at most 6 bytes. Decode the last few from a zero-padded
+     * copy so the rest of the pattern can be decoded in place. */
+    if(size - pos >= 6)
+    {
+      pos += decode(data + pos);
+    }
+    else
+    {
+      uint8_t tmp[6]{};
+      memcpy(tmp, data + pos, size - pos);
+      pos += decode(tmp);
+    }
+  }
+
+private:
+  size_t decode(const uint8_t *stream) noexcept
+  {
+    uint8_t flags = stream[0];
 
     if(flags & PACKED)
     {
+      size_t i = 1;
       if(flags & NOTE)
-        note = *(stream++);
+        note = stream[i++];
 
       if(flags & INSTRUMENT)
-        instrument = *(stream++);
+        instrument = stream[i++];
 
       if(flags & VOLUME)
-        volume = *(stream++);
+        volume = stream[i++];
 
       if(flags & EFFECT)
-        effect = *(stream++);
+        effect = stream[i++];
 
       if(flags & PARAM)
-        param = *(stream++);
+        param = stream[i++];
+
+      return i;
     }
     else
     {
       note       = flags;
-      instrument = stream[0];
-      volume     = stream[1];
-      effect     = stream[2];
-      param      = stream[3];
-
-      stream += 4;
+      instrument = stream[1];
+      volume     = stream[2];
+      effect     = stream[3];
+      param      = stream[4];
+      return 5;
     }
   }
 };
@@ -342,21 +362,12 @@ struct XM_data
   std::vector<XM_instrument> instruments;
   XM_modplug_ext             mpt;
 
-#define PATTERN_BUFFER_SIZE (65536 + 6) /* Extra to allow removing bounds checks. */
-  std::unique_ptr<uint8_t[]> buffer;
-
   char name[21];
   char tracker[21];
   size_t num_samples;
   int64_t sample_total_length;
   bool uses[NUM_FEATURES];
 
-  void allocate_buffer()
-  {
-    if(!buffer)
-      buffer = std::make_unique<uint8_t[]>(PATTERN_BUFFER_SIZE);
-  }
-
   void allocate_instruments()
   {
     instruments.resize(header.num_instruments);
@@ -523,10 +534,8 @@ static void check_event(XM_data &m, const XM_event &ev)
   }
 }
 
-static modutil::error load_patterns(XM_data &m, vio &vf)
+static modutil::error load_patterns(XM_data &m, vio_reader<> &vf)
 {
-  m.allocate_buffer();
-
   for(size_t i = 0; i < m.header.num_patterns; i++)
   {
     XM_pattern &p = m.patterns[i];
@@ -558,17 +567,21 @@ static modutil::error load_patterns(XM_data &m, vio &vf)
     if(!p.packed_size)
       continue;
 
-    if(vf.read(m.buffer.get(), p.packed_size) < p.packed_size)
+    /* Decoded in place when the module is in memory. */
+    const uint8_t *data = vf.span(p.packed_size);
+    if(!data)
     {
       format::warning("read error at pattern %zu", i);
       return modutil::READ_ERROR;
     }
-    memset(m.buffer.get() + p.packed_size, 0, 6);
 
-    uint8_t *current = m.buffer.get();
-    uint8_t *end = current + p.packed_size;
+    /* Events are only kept if they will be printed. */
+    size_t pos = 0;
+    bool keep = Config.dump_pattern_rows;
+    bool check_query = modutil::query::enabled;
     std::vector<XM_event> &events = p.events;
-    events.reserve(m.header.num_channels * p.num_rows);
+    if(keep)
+      events.reserve(m.header.num_channels * p.num_rows);
 
     for(size_t j = 0; j < p.num_rows; j++)
     {
@@ -576,22 +589,32 @@ static modutil::error load_patterns(XM_data &m, vio &vf)
       {
         /* Some modules have patterns that end early on an event boundary.
          * Not clear what tracker(s) do this or why. */
-        if(current == end)
+        if(pos == p.packed_size)
         {
           m.uses[FT_PATTERN_EARLY_END] = true;
           goto break_current_pattern;
         }
 
-        events.emplace_back(current, end);
-        if(current > end)
+        XM_event ev(data, pos, p.packed_size);
+        if(keep)
+          events.push_back(ev);
+        if(pos > p.packed_size)
         {
           format::warning("invalid pattern packing for %zu", i);
-          format::warning("attempted to read %zd past end; ch %zu of %u, row %zu of %u",
-            current - end, k, m.header.num_channels, j, p.num_rows
+          format::warning("attempted to read %zu past end; ch %zu of %u, row %zu of %u",
+            pos - p.packed_size, k, m.header.num_channels, j, p.num_rows
           );
           goto break_current_pattern;
         }
-        check_event(m, events.back());
+        check_event(m, ev);
+
+        if(check_query)
+          modutil::query::event(i, j, k,
+           (ev.note ? Highlight::NOTE : 0) |
+           (ev.instrument ? Highlight::INSTRUMENT : 0) |
+           (ev.volume ? Highlight::VOLUME : 0) |
+           ((ev.effect || ev.param) ? Highlight::EFFECT : 0),
+           ev.note, ev.instrument, ev.volume, ev.effect, ev.param);
       }
     }
 break_current_pattern:
@@ -600,7 +623,7 @@ break_current_pattern:
   return modutil::SUCCESS;
 }
 
-static modutil::error load_instruments(XM_data &m, vio &vf)
+static modutil::error load_instruments(XM_data &m, vio_reader<> &vf)
 {
   uint8_t buffer[XM_INS_HEADER_FULL_SIZE];
 
@@ -770,7 +793,7 @@ static modutil::error load_instruments(XM_data &m, vio &vf)
   return modutil::SUCCESS;
 }
 
-static modutil::error load_modplug_ext(XM_data &m, vio &vf)
+static modutil::error load_modplug_ext(XM_data &m, vio_reader<> &vf)
 {
   XM_modplug_ext &mpt = m.mpt;
   uint8_t buf[8];
@@ -839,11 +862,12 @@ exit:
 class XM_loader : public modutil::loader
 {
 public:
-  XM_loader(): modutil::loader("XM", "xm", "Extended Module") {}
+  XM_loader(): modutil::loader("XM", "xm", "Extended Module",
+   {{ 0, "Extended Module: " }}, 2) {}
 
   virtual modutil::error load(modutil::data state) const override
   {
-    vio &vf = state.reader;
+    vio_reader<> vf(state.reader);
 
     XM_data m{};
     XM_header &h = m.header;
@@ -28,11 +28,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <atomic>
 #include <vector>
 
 #include "modutil.hpp"
 
-static int total_xmf = 0;
+static std::atomic<int> total_xmf;
 
 
 enum XMF_features